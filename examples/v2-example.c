@@ -20,6 +20,19 @@
 #include <unistd.h>
 #include <aws_dynamo/aws_dynamo.h>
 
+static struct aws_dynamo_attribute bss_attributes[] = {
+	{
+		.type = AWS_DYNAMO_STRING,
+		.name = "bssid",
+		.name_len = 5,
+	},
+	{
+		.type = AWS_DYNAMO_MAP,
+		.name = "info",
+		.name_len = 4,
+	},
+};
+
 static void example_v2_query(struct aws_handle *aws)
 {
 	const char *request = "\
@@ -27,19 +40,31 @@ static void example_v2_query(struct aws_handle *aws)
     \"IndexName\": \"bssid_index\",\
     \"ExpressionAttributeValues\": { \":bssid\":{\"S\":\"001122334455\"}},\
     \"KeyConditionExpression\": \"bssid = :bssid\",\
+    \"ReturnConsumedCapacity\": \"INDEXES\",\
     \"TableName\": \"tdssp_bss\"\
 }\
 ";
-	const char *response;
-	int response_len;
+	struct aws_dynamo_v2_response *r;
+	int i;
 
-	if (aws_dynamo_layer1_request(aws, AWS_DYNAMO_V2_QUERY, request) == -1) {
+	r = aws_dynamo_v2_query(aws, request, bss_attributes,
+		sizeof(bss_attributes) / sizeof(bss_attributes[0]));
+	if (r == NULL) {
 		fprintf(stderr, "failure performnig query");
-	} else {
-		response = aws_dynamo_layer1_get_response(aws, &response_len);
+		return;
+	}
+
+	for (i = 0; i < r->num_items; i++) {
+		struct aws_dynamo_attribute *info = &(r->items[i].attributes[1]);
 
-		printf("%s", response);
+		printf("%s: %d info attributes\n", r->items[i].attributes[0].value.string,
+			info->value.map.num_attributes);
 	}
+	if (r->consumed_capacity != NULL) {
+		printf("consumed %f capacity units\n", r->consumed_capacity->total.capacity_units);
+	}
+
+	aws_dynamo_v2_free_response(r);
 }
 
 int main(int argc, char *argv[])
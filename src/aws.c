@@ -24,6 +24,7 @@
 #include "aws_kinesis.h"
 #include "aws_iam.h"
 #include "aws_sigv4.h"
+#include "aws_dynamo_limiter.h"
 #include "aws.h"
 
 #include <openssl/engine.h>
@@ -37,10 +38,13 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdint.h>
 
 #define AWS_DYNAMO_DEFAULT_MAX_RETRIES	10
 #define AWS_DYNAMO_DEFAULT_HTTPS			1
 
+static void aws_free_thread_state(void *arg);
+
 struct aws_handle *aws_init(const char *aws_id, const char *aws_key) {
 	struct aws_handle *aws = NULL;
 
@@ -55,10 +59,21 @@ struct aws_handle *aws_init(const char *aws_id, const char *aws_key) {
 		goto error;
 	}
 
-	aws->http = http_init();
+	if (pthread_key_create(&aws->thread_key, aws_free_thread_state) != 0) {
+		Errx("aws_init: Failed to create thread key.");
+		free(aws);
+		return NULL;
+	}
+	pthread_mutex_init(&aws->lock, NULL);
+	pthread_mutex_init(&aws->iam_lock, NULL);
+	pthread_mutex_init(&aws->retry_lock, NULL);
+	aws->retry_budget = AWS_RETRY_BUDGET;
+	pthread_cond_init(&aws->refresher_cond, NULL);
+
+	aws->http_pool = http_pool_init();
 
-	if (aws->http == NULL) {
-		Errx("aws_init: Failed to initialize http handle.");
+	if (aws->http_pool == NULL) {
+		Errx("aws_init: Failed to initialize http pool.");
 		goto error;
 	}
 
@@ -69,12 +84,23 @@ struct aws_handle *aws_init(const char *aws_id, const char *aws_key) {
 	}
 
 	if (aws_id == NULL || aws_key == NULL) {
+		const char *endpoint;
+
+		endpoint = getenv("AWS_EC2_METADATA_SERVICE_ENDPOINT");
+		if (endpoint != NULL && aws_set_iam_endpoint(aws, endpoint) == -1) {
+			goto error;
+		}
+
 		/* Get token from EC2 Role. */
 		aws->token = aws_iam_load_default_token(aws);
 		if (aws->token == NULL) {
 			Errx("aws_init: Failed to get aws token.");
 			goto error;
 		}
+
+		/* Without the refresher the token is renewed by whichever
+		   request finds it about to expire. */
+		aws_iam_start_refresher(aws);
 	} else {
 		aws->aws_id = strdup(aws_id);
 
@@ -106,24 +132,141 @@ error:
 	return NULL;
 }
 
+/**
+ * aws_release_thread_state - release the resources of a thread state
+ * @ts: thread state, already unlinked from its handle
+ */
+static void aws_release_thread_state(struct aws_thread_state *ts) {
+	http_multi_deinit(ts->http_multi);
+	http_pool_release(ts->aws->http_pool, ts->http);
+	free(ts->signing_keys);
+	aws_dynamo_builder_free(ts->builder);
+	free(ts);
+}
+
+/**
+ * aws_free_thread_state - thread exit destructor for thread states
+ * @arg: the exiting thread's state
+ */
+static void aws_free_thread_state(void *arg) {
+	struct aws_thread_state *ts = arg;
+	struct aws_handle *aws = ts->aws;
+	struct aws_thread_state **p;
+
+	pthread_mutex_lock(&aws->lock);
+	for (p = &aws->threads; *p != NULL; p = &(*p)->next) {
+		if (*p == ts) {
+			*p = ts->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&aws->lock);
+
+	aws_release_thread_state(ts);
+}
+
+struct aws_thread_state *aws_get_thread_state(struct aws_handle *aws) {
+	struct aws_thread_state *ts;
+
+	ts = pthread_getspecific(aws->thread_key);
+	if (ts != NULL) {
+		return ts;
+	}
+
+	ts = calloc(1, sizeof(*ts));
+	if (ts == NULL) {
+		Warnx("aws_get_thread_state: Failed to allocate thread state.");
+		return NULL;
+	}
+	ts->aws = aws;
+	ts->dynamo_errno = AWS_DYNAMO_CODE_NONE;
+	/* Any odd seed that differs between threads will do. */
+	ts->rand_state = ((unsigned long long)time(NULL) << 32 ^
+		(unsigned long long)(uintptr_t)ts) | 1;
+
+	ts->http = http_pool_acquire(aws->http_pool);
+	if (ts->http == NULL) {
+		Warnx("aws_get_thread_state: Failed to acquire http handle.");
+		free(ts);
+		return NULL;
+	}
+
+	if (pthread_setspecific(aws->thread_key, ts) != 0) {
+		Warnx("aws_get_thread_state: Failed to set thread state.");
+		aws_release_thread_state(ts);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&aws->lock);
+	ts->next = aws->threads;
+	aws->threads = ts;
+	pthread_mutex_unlock(&aws->lock);
+
+	return ts;
+}
+
+void *aws_get_http(struct aws_handle *aws) {
+	struct aws_thread_state *ts;
+
+	ts = aws_get_thread_state(aws);
+	if (ts == NULL) {
+		return NULL;
+	}
+	return ts->http;
+}
 
 void aws_deinit(struct aws_handle *aws) {
 
 	if (aws != NULL) {
+		struct aws_thread_state *ts;
+
+		aws_iam_stop_refresher(aws);
 
-		if (aws->http != NULL) {
-			http_deinit(aws->http);
+		/* Deleting the key does not run the destructors, release the
+		   state of every thread here. */
+		pthread_key_delete(aws->thread_key);
+		while ((ts = aws->threads) != NULL) {
+			aws->threads = ts->next;
+			aws_release_thread_state(ts);
+		}
+		http_pool_deinit(aws->http_pool);
+		if (aws->iam_http != NULL) {
+			http_deinit(aws->iam_http);
 		}
+		pthread_cond_destroy(&aws->refresher_cond);
+		pthread_mutex_destroy(&aws->iam_lock);
+		pthread_mutex_destroy(&aws->retry_lock);
+		pthread_mutex_destroy(&aws->lock);
+
 		free(aws->aws_id);
 		free(aws->aws_key);
 		free(aws->dynamo_host);
 		free(aws->dynamo_region);
+		free(aws->iam_endpoint);
+		aws_dynamo_limiter_deinit(aws->dynamo_limiter);
 		aws_free_session_token(aws->token);
 
 		free(aws);
 	}
 }
 
+int aws_set_iam_endpoint(struct aws_handle *aws, const char *endpoint) {
+	char *copy;
+
+	copy = strdup(endpoint);
+	if (copy == NULL) {
+		Warnx("aws_set_iam_endpoint: Failed to copy endpoint.");
+		return -1;
+	}
+
+	pthread_mutex_lock(&aws->iam_lock);
+	free(aws->iam_endpoint);
+	aws->iam_endpoint = copy;
+	pthread_mutex_unlock(&aws->iam_lock);
+
+	return 0;
+}
+
 char *aws_base64_encode(char *in, int in_len, size_t *out_len) {
     BIO *bio = NULL, *b64 = NULL;
     char *out = NULL;
@@ -210,59 +353,82 @@ void aws_free_session_token(struct aws_session_token *token)
 }
 
 
-static char *aws_dynamo_get_canonicalized_headers(struct http_headers *headers) {
-    int i;
-	int canonical_headers_len = 0;
-	char *canonical_headers;
-	char *ptr;
-
-	/* Assume all header .name fields are lowercase. */
-    
-	/* Assume no duplicate headers (that is, all header names are
-		distinct.) */
-
-	/* Assume headers are already sorted alphabetically by header name. */
+/**
+ * aws_update_request_time - format the time of a request
+ * @ts: thread state of the calling thread
+ * @now: request time
+ * Returns: 0 on success, -1 on failure
+ *
+ * The formatted time is kept in @ts so that it is only redone when the
+ * second changes.
+ */
+static int aws_update_request_time(struct aws_thread_state *ts, time_t now) {
+	struct tm tm;
 
-	for (i = 0; i < headers->count; i++) {
-		canonical_headers_len += strlen(headers->entries[i].name);
-		canonical_headers_len += strlen(headers->entries[i].value);
-		canonical_headers_len += 2; /* ':' and '\n' */
+	if (ts->request_time == now && ts->iso8601_basic_date[0] != '\0') {
+		return 0;
 	}
-	canonical_headers_len++; /* \0 terminator */
 
-	ptr = canonical_headers = calloc(sizeof(char), canonical_headers_len);
-
-	if (ptr == NULL) {
-		Err("aws_dynamo_get_canonicalized_headers: Failed to allocate.");
-		return NULL;
+	if (gmtime_r(&now, &tm) == NULL) {
+		Warnx("aws_post: Failed to get time structure.");
+		return -1;
 	}
 
-	for (i = 0; i < headers->count; i++) {
-		int n;
-		int remaining;
-
-		remaining = canonical_headers_len - (ptr - canonical_headers);
-
-		n = snprintf(ptr, remaining, "%s:%s\n", headers->entries[i].name,
-			headers->entries[i].value);
-
-		if (n == -1 || n >= remaining) {
-			Warnx("aws_dynamo_get_canonicalized_headers: string buffer not large enough.");
-			free(canonical_headers);
-			return NULL;
-		}
-		ptr += n;
+	if (strftime(ts->iso8601_basic_date, sizeof(ts->iso8601_basic_date),
+		     "%Y%m%dT%H%M%SZ", &tm) != AWS_ISO8601_BASIC_DATE_LEN) {
+		Warnx("aws_post: Failed to format time.");
+		ts->iso8601_basic_date[0] = '\0';
+		return -1;
 	}
 
-	return canonical_headers;
+	/* The date is the leading YYYYMMDD of the basic format time. */
+	memcpy(ts->yyyy_mm_dd, ts->iso8601_basic_date, sizeof(ts->yyyy_mm_dd) - 1);
+	ts->yyyy_mm_dd[sizeof(ts->yyyy_mm_dd) - 1] = '\0';
+	ts->request_time = now;
+
+	return 0;
 }
 
-int aws_post(struct aws_handle *aws, const char *aws_service, const char *target, const char *body) {
-	char iso8601_basic_date[128];
+/**
+ * struct aws_request - a signed request ready to be handed to the http layer
+ * @iso8601_basic_date: value of the date header, YYYYMMDD'T'HHMMSS'Z'
+ * @token_header: value of the session token header
+ * @host_header: value of the host header
+ * @authorization: value of the authorization header
+ * @hdrs: storage for the request headers
+ * @headers: the headers to send with the request
+ * @url: request URL
+ *
+ * Everything needed to send the request is held here so that preparing
+ * a request allocates nothing.
+ */
+struct aws_request {
+	char iso8601_basic_date[AWS_ISO8601_BASIC_DATE_LEN + 1];
 	char token_header[4096];
 	char host_header[256];
 	char authorization[256];
-	struct http_header hdrs[] = {
+	struct http_header hdrs[6];
+	struct http_headers headers;
+	char url[320];
+};
+
+/**
+ * aws_prepare_post - build and sign a request to an AWS service
+ * @aws: aws handle
+ * @aws_service: service name, "dynamodb" or "kinesis"
+ * @target: value of the target header
+ * @body: request body
+ * @req: request to fill in
+ * Returns: 0 on success, -1 on failure
+ */
+static int aws_prepare_post(struct aws_handle *aws, const char *aws_service,
+	const char *target, const char *body, struct aws_request *req) {
+	struct http_header *hdrs = req->hdrs;
+	char *iso8601_basic_date = req->iso8601_basic_date;
+	char *token_header = req->token_header;
+	char *host_header = req->host_header;
+	char *authorization = req->authorization;
+	const struct http_header default_hdrs[] = {
 		/* Note: The .name fields must all lowercase and the headers included
 			in the signature must be sorted here.  This simplifies the signature
 			calculation. */
@@ -276,28 +442,33 @@ int aws_post(struct aws_handle *aws, const char *aws_service, const char *target
 	};
     const int content_type_offset = 4;
 	int total_num_headers;
-	struct http_headers headers = {
-		.count = 3,
-		/* AWS_DYNAMO_AUTHORIZATION and HTTP_CONTENT_TYPE_HEADER are
-		   not included for now since they are not used in the
-		   signature calculation. */
-		.entries = hdrs,
-	};
+	struct http_headers *headers = &req->headers;
 	const char *signed_headers = HTTP_HOST_HEADER ";" AWS_DYNAMO_DATE_HEADER ";" AWS_DYNAMO_TARGET_HEADER;
-	struct tm tm;
 	time_t now;
-	char *canonical_headers = NULL;
-	char *hashed_canonical_request = NULL;
-	char *string_to_sign = NULL;
-	char *signature = NULL;
+	char hashed_canonical_request[AWS_SIGV4_HEX_LEN + 1];
+	char signature[AWS_SIGV4_HEX_LEN + 1];
+	const char *payload_hash;
+	const unsigned char *signing_key;
+	struct aws_thread_state *ts;
 	int n;
-	char *url = NULL;
+	int rv;
 	const char *scheme;
 	const char *host;
 	const char *region;
-	const char *aws_secret_access_key;
-	const char *aws_access_key_id;
-	char yyyy_mm_dd[16];
+	char aws_secret_access_key[128];
+	char aws_access_key_id[128];
+
+	ts = aws_get_thread_state(aws);
+	if (ts == NULL) {
+		return -1;
+	}
+
+	memcpy(hdrs, default_hdrs, sizeof(default_hdrs));
+	/* AWS_DYNAMO_AUTHORIZATION and HTTP_CONTENT_TYPE_HEADER are
+	   not included for now since they are not used in the
+	   signature calculation. */
+	headers->count = 3;
+	headers->entries = hdrs;
 
     /* FIXME - choose host based on service enum, no strcmp. */
 	if (strcmp(aws_service, "dynamodb") == 0) {
@@ -330,9 +501,9 @@ int aws_post(struct aws_handle *aws, const char *aws_service, const char *target
         goto failure;
     }
 
-	n = snprintf(host_header, sizeof(host_header), "%s", host);
+	n = snprintf(host_header, sizeof(req->host_header), "%s", host);
 
-	if (n == -1 || n >= sizeof(host_header)) {
+	if (n == -1 || n >= sizeof(req->host_header)) {
 		Warnx("aws_post: host header truncated");
 		goto failure;
 	}
@@ -343,7 +514,14 @@ int aws_post(struct aws_handle *aws, const char *aws_service, const char *target
 	}
 
 	if (aws->aws_id == NULL && aws->aws_key == NULL) {
-		if (aws->token->expiration - now <= AWS_SESSION_REFRESH_TIME) {
+		/* The token may be replaced by another thread, take copies of the
+		   credentials while holding the lock. */
+		pthread_mutex_lock(&aws->lock);
+		/* The refresher renews the token well before it expires,
+		   only fall back to renewing it here when that has failed. */
+		if (aws->token->expiration <= now ||
+		    (!aws->refresher_running &&
+		     aws->token->expiration - now <= AWS_SESSION_REFRESH_TIME)) {
 			struct aws_session_token *new_token;
 
 			new_token = aws_iam_load_default_token(aws);
@@ -358,90 +536,96 @@ int aws_post(struct aws_handle *aws, const char *aws_service, const char *target
 			}
 		}
 
-		n = snprintf(token_header, sizeof(token_header), "%s", aws->token->session_token);
+		n = snprintf(token_header, sizeof(req->token_header), "%s", aws->token->session_token);
 
-		if (n == -1 || n >= sizeof(token_header)) {
+		if (n == -1 || n >= sizeof(req->token_header)) {
+			pthread_mutex_unlock(&aws->lock);
 			Warnx("aws_dynamo_post: token header truncated: %d", n);
 			goto failure;
 		}
 
-		/* Include all headers, including the token header. */
-		total_num_headers = sizeof(hdrs) / sizeof(hdrs[0]);
+		n = snprintf(aws_secret_access_key, sizeof(aws_secret_access_key), "%s",
+			aws->token->secret_access_key);
+		if (n == -1 || n >= sizeof(aws_secret_access_key) ||
+		    snprintf(aws_access_key_id, sizeof(aws_access_key_id), "%s",
+			aws->token->access_key_id) >= sizeof(aws_access_key_id)) {
+			pthread_mutex_unlock(&aws->lock);
+			Warnx("aws_post: credentials truncated");
+			goto failure;
+		}
+		pthread_mutex_unlock(&aws->lock);
 
-		aws_secret_access_key = aws->token->secret_access_key;
-		aws_access_key_id = aws->token->access_key_id;
+		/* Include all headers, including the token header. */
+		total_num_headers = sizeof(default_hdrs) / sizeof(default_hdrs[0]);
 	} else {
 		/* The -1 is to omit the token header, there is not token in this case. */
-		total_num_headers = sizeof(hdrs) / sizeof(hdrs[0]) - 1;
-
-		aws_secret_access_key = aws->aws_key;
-		aws_access_key_id = aws->aws_id;
-	}
-
-	if (gmtime_r(&now, &tm) == NULL) {
-		Warnx("aws_post: Failed to get time structure.");
-		return -1;
-	}
-
-	if (strftime(iso8601_basic_date, sizeof(iso8601_basic_date),
-		     "%Y%m%dT%H%M%SZ", &tm) == 0) {
-		Warnx("aws_post: Failed to format time.");
-		return -1;
+		total_num_headers = sizeof(default_hdrs) / sizeof(default_hdrs[0]) - 1;
+
+		n = snprintf(aws_secret_access_key, sizeof(aws_secret_access_key), "%s",
+			aws->aws_key);
+		if (n == -1 || n >= sizeof(aws_secret_access_key) ||
+		    snprintf(aws_access_key_id, sizeof(aws_access_key_id), "%s",
+			aws->aws_id) >= sizeof(aws_access_key_id)) {
+			Warnx("aws_post: credentials truncated");
+			goto failure;
+		}
 	}
 
-	if (strftime(yyyy_mm_dd, sizeof(yyyy_mm_dd), "%Y%m%d", &tm) == 0) {
-		Warnx("aws_post: Failed to format date.");
-		return -1;
+	if (aws_update_request_time(ts, now) == -1) {
+		goto failure;
 	}
-
-	canonical_headers = aws_dynamo_get_canonicalized_headers(&headers);
-
-	if (canonical_headers == NULL) {
-		Warnx("aws_post: Failed to get canonical_headers.");
-		return -1;
+	memcpy(iso8601_basic_date, ts->iso8601_basic_date,
+		sizeof(req->iso8601_basic_date));
+
+	/* A body written by this thread's builder was hashed as it was
+	   written. */
+	payload_hash = aws_dynamo_builder_payload_hash(ts->builder, body);
+	if (payload_hash != NULL) {
+		rv = aws_sigv4_hash_canonical_request_hashed("POST", "/", "",
+			headers, signed_headers, payload_hash, hashed_canonical_request);
+	} else {
+		rv = aws_sigv4_hash_canonical_request("POST", "/", "", headers,
+			signed_headers, body, strlen(body), hashed_canonical_request);
 	}
-
-	hashed_canonical_request = aws_sigv4_create_hashed_canonical_request("POST", "/", "",
-		canonical_headers, signed_headers, body);
-
-	if (hashed_canonical_request == NULL) {
+	if (rv == -1) {
 		Warnx("aws_post: Failed to get canonical request.");
 		goto failure;
 	}
 
-	string_to_sign = aws_sigv4_create_string_to_sign(
-		iso8601_basic_date, yyyy_mm_dd,
-		region,
-		aws_service, 
-		hashed_canonical_request);
-	if (string_to_sign == NULL) {
-		Warnx("aws_post: Failed to get string to sign.");
-		goto failure;
+	/* The signing key only changes daily, reuse this thread's copy. */
+	if (ts->signing_keys == NULL) {
+		ts->signing_keys = calloc(1, sizeof(*(ts->signing_keys)));
+		if (ts->signing_keys == NULL) {
+			Warnx("aws_post: Failed to allocate signing key cache.");
+			goto failure;
+		}
 	}
 
-	signature = aws_sigv4_create_signature(aws_secret_access_key,
-		yyyy_mm_dd, 
-		region,
-		aws_service,
-		string_to_sign);
+	signing_key = aws_sigv4_get_signing_key(ts->signing_keys,
+		aws_secret_access_key, ts->yyyy_mm_dd, region, aws_service);
+	if (signing_key == NULL) {
+		Warnx("aws_post: Failed to get signing key.");
+		goto failure;
+	}
 
-	if (signature == NULL) {
+	if (aws_sigv4_sign(signing_key, iso8601_basic_date, ts->yyyy_mm_dd,
+		region, aws_service, hashed_canonical_request, signature) == -1) {
 		Warnx("aws_post: Failed to get signature.");
 		goto failure;
 	}
 
-	n = snprintf(authorization, sizeof(authorization),
+	n = snprintf(authorization, sizeof(req->authorization),
                  /* FIXME - hard coded region */
                  "AWS4-HMAC-SHA256 Credential=%s/%s/%s/%s/aws4_request,SignedHeaders=%s,Signature=%s", 
-                 aws_access_key_id, yyyy_mm_dd, region, aws_service, signed_headers, signature);
+                 aws_access_key_id, ts->yyyy_mm_dd, region, aws_service, signed_headers, signature);
 
-	if (n == -1 || n >= sizeof(authorization)) {
+	if (n == -1 || n >= sizeof(req->authorization)) {
 		Warnx("aws_post: authorization truncated");
 		goto failure;
 	}
 
 	/* Include all headers now that the signature calculation is complete. */
-	headers.count = total_num_headers;
+	headers->count = total_num_headers;
 
 #ifdef DEBUG_AWS_DYNAMO
 	Debug("aws_post: '%s'", body);
@@ -449,48 +633,481 @@ int aws_post(struct aws_handle *aws, const char *aws_service, const char *target
 
         /* FIXME: make the kinesis service port configurable?  Or not? */
 	if (aws->dynamo_port > 0) {
-		if (asprintf(&url, "%s://%s:%d/", scheme, host, aws->dynamo_port) == -1) {
-			Warnx("aws_post: failed to create url");
-			goto failure;
-
-		}
+		n = snprintf(req->url, sizeof(req->url), "%s://%s:%d/", scheme,
+			host, aws->dynamo_port);
 	} else {
-		if (asprintf(&url, "%s://%s/", scheme, host) == -1) {
-			Warnx("aws_post: failed to create url");
-			goto failure;
-		}
+		n = snprintf(req->url, sizeof(req->url), "%s://%s/", scheme, host);
+	}
+	if (n == -1 || n >= sizeof(req->url)) {
+		Warnx("aws_post: failed to create url");
+		goto failure;
+	}
+
+	return 0;
+failure:
+	return -1;
+}
+
+int aws_post(struct aws_handle *aws, const char *aws_service, const char *target, const char *body) {
+	struct aws_thread_state *ts;
+	struct aws_request req;
+	long remaining;
+	int rv = -1;
+	int ret;
+
+	ts = aws_get_thread_state(aws);
+	if (ts == NULL) {
+		Warnx("aws_post: No http handle.");
+		return -1;
+	}
+
+	aws_deadline_begin(aws);
+
+	if (aws_deadline_check(aws, &remaining) == -1) {
+		goto out;
 	}
 
-	if (http_post(aws->http, url, body, &headers) != HTTP_OK) {
+	if (aws_prepare_post(aws, aws_service, target, body, &req) == -1) {
+		goto out;
+	}
+
+	http_set_timeout(ts->http, remaining,
+		ts->cancel ? &ts->cancel->cancelled : NULL);
+	ret = http_post(ts->http, req.url, body, &req.headers);
+	/* Neither a cancelled transfer nor one aborted by the receiver of
+	   its body would fare any better a second time. */
+	if (ret != HTTP_OK && ret != HTTP_CANCELLED && ret != HTTP_ABORTED) {
 		Warnx("aws_post: HTTP post failed, will retry.");
-		usleep(100000);
-		if (http_post(aws->http, url, body, &headers) != HTTP_OK) {
+		if (aws_sleep(aws, 100000) == -1 ||
+		    aws_deadline_check(aws, &remaining) == -1) {
+			goto out;
+		}
+		http_set_timeout(ts->http, remaining,
+			ts->cancel ? &ts->cancel->cancelled : NULL);
+		ret = http_post(ts->http, req.url, body, &req.headers);
+		if (ret != HTTP_OK) {
 			Warnx("aws_post: Retry failed.");
-			goto failure;
 		}
 	}
+	if (ret != HTTP_OK) {
+		/* Record a timeout or cancellation as the error. */
+		aws_deadline_check(aws, &remaining);
+		goto out;
+	}
 
 #ifdef DEBUG_AWS_DYNAMO
 	{
 		int response_len;
-		Debug("aws_post response: '%s'", http_get_data(aws->http, &response_len));
+		Debug("aws_post response: '%s'", http_get_data(ts->http, &response_len));
+	}
+#endif
+
+	rv = 0;
+
+out:
+	aws_deadline_end(aws);
+	return rv;
+}
+
+/**
+ * struct aws_async_request - state of a request submitted with aws_post_async()
+ * @aws: aws handle the request was submitted on
+ * @aws_service: service name
+ * @target: value of the target header
+ * @body: request body
+ * @retried: nonzero once the request has been sent a second time
+ * @cb: completion callback
+ * @arg: argument for @cb
+ */
+struct aws_async_request {
+	struct aws_handle *aws;
+	char *aws_service;
+	char *target;
+	char *body;
+	int retried;
+	aws_async_callback cb;
+	void *arg;
+};
+
+static void aws_async_request_free(struct aws_async_request *ar) {
+	free(ar->aws_service);
+	free(ar->target);
+	free(ar->body);
+	free(ar);
+}
+
+static int aws_post_async_send(struct aws_async_request *ar);
+
+/* Timer callback sending a request again after a transport failure. */
+static void aws_post_async_retry(void *arg) {
+	struct aws_async_request *ar = arg;
+
+	if (aws_post_async_send(ar) == -1) {
+		Warnx("aws_post_async: Retry failed.");
+		ar->cb(ar->aws, NULL, -1, ar->arg);
+		aws_async_request_free(ar);
+	}
+}
+
+static void aws_post_async_complete(void *http, int result, void *arg) {
+	struct aws_async_request *ar = arg;
+
+#ifdef DEBUG_AWS_DYNAMO
+	if (result == HTTP_OK) {
+		int response_len;
+		Debug("aws_post_async response: '%s'", http_get_data(http, &response_len));
 	}
 #endif
 
-	free(canonical_headers);
-	free(hashed_canonical_request);
-	free(string_to_sign);
-	free(signature);
-	free(url);
+	/* As aws_post(), a transfer that failed is tried once more unless it
+	   was cancelled or aborted by the receiver of its body. */
+	if (result != HTTP_OK && result != HTTP_CANCELLED &&
+	    result != HTTP_ABORTED && !ar->retried) {
+		Warnx("aws_post_async: HTTP post failed, will retry.");
+		ar->retried = 1;
+		if (aws_async_schedule(ar->aws, 100, aws_post_async_retry, ar) == 0) {
+			return;
+		}
+	}
+
+	ar->cb(ar->aws, http, result == HTTP_OK ? 0 : -1, ar->arg);
+	aws_async_request_free(ar);
+}
+
+/**
+ * aws_get_http_multi - get the calling thread's multi handle
+ * @aws: aws handle
+ * Returns: multi handle, NULL on failure
+ */
+static void *aws_get_http_multi(struct aws_handle *aws) {
+	struct aws_thread_state *ts;
+
+	ts = aws_get_thread_state(aws);
+	if (ts == NULL) {
+		return NULL;
+	}
+
+	if (ts->http_multi == NULL) {
+		ts->http_multi = http_multi_init(aws->http_pool);
+		if (ts->http_multi == NULL) {
+			Warnx("aws_get_http_multi: Failed to initialize http multi handle.");
+		}
+	}
+	return ts->http_multi;
+}
+
+/* Sign a request and hand it to the calling thread's multi handle. */
+static int aws_post_async_send(struct aws_async_request *ar) {
+	struct aws_request req;
+	void *http_multi;
+
+	http_multi = aws_get_http_multi(ar->aws);
+	if (http_multi == NULL) {
+		return -1;
+	}
+
+	if (aws_prepare_post(ar->aws, ar->aws_service, ar->target, ar->body, &req) == -1) {
+		return -1;
+	}
+
+	if (http_multi_post(http_multi, req.url, ar->body, &req.headers,
+			aws_post_async_complete, ar) != HTTP_OK) {
+		Warnx("aws_post_async: Failed to start HTTP post.");
+		return -1;
+	}
 
 	return 0;
-failure:
-	free(canonical_headers);
-	free(hashed_canonical_request);
-	free(string_to_sign);
-	free(signature);
-	free(url);
+}
 
-	return -1;
+int aws_post_async(struct aws_handle *aws, const char *aws_service, const char *target,
+	const char *body, aws_async_callback cb, void *arg) {
+	struct aws_async_request *ar;
+
+	ar = calloc(1, sizeof(*ar));
+	if (ar == NULL) {
+		Warnx("aws_post_async: Failed to allocate request.");
+		return -1;
+	}
+	ar->aws = aws;
+	ar->cb = cb;
+	ar->arg = arg;
+
+	ar->aws_service = strdup(aws_service);
+	ar->target = strdup(target);
+	ar->body = strdup(body);
+	if (ar->aws_service == NULL || ar->target == NULL || ar->body == NULL) {
+		Warnx("aws_post_async: Failed to allocate request.");
+		aws_async_request_free(ar);
+		return -1;
+	}
+
+	if (aws_post_async_send(ar) == -1) {
+		aws_async_request_free(ar);
+		return -1;
+	}
+
+	return 0;
+}
+
+int aws_async_perform(struct aws_handle *aws, int timeout_ms) {
+	void *http_multi;
+
+	http_multi = aws_get_http_multi(aws);
+	if (http_multi == NULL) {
+		return -1;
+	}
+	return http_multi_perform(http_multi, timeout_ms);
+}
+
+int aws_async_pending(struct aws_handle *aws) {
+	void *http_multi;
+
+	http_multi = aws_get_http_multi(aws);
+	if (http_multi == NULL) {
+		return 0;
+	}
+	return http_multi_pending(http_multi);
+}
+
+int aws_async_schedule(struct aws_handle *aws, int delay_ms,
+	void (*cb)(void *arg), void *arg) {
+	void *http_multi;
+
+	http_multi = aws_get_http_multi(aws);
+	if (http_multi == NULL) {
+		return -1;
+	}
+	if (http_multi_schedule(http_multi, delay_ms, cb, arg) != HTTP_OK) {
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * aws_random - next number from the calling thread's generator
+ * @ts: thread state
+ * Returns: 64 random bits
+ *
+ * xorshift64*, plenty for spreading retries and free of the shared state
+ * of rand().
+ */
+static unsigned long long aws_random(struct aws_thread_state *ts) {
+	unsigned long long x = ts->rand_state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	ts->rand_state = x;
+	return x * 2685821657736338717ULL;
+}
+
+long aws_backoff(struct aws_handle *aws, int attempt) {
+	struct aws_thread_state *ts;
+	long ceiling = AWS_BACKOFF_CAP;
+
+	if (attempt < 30 && ((long)AWS_BACKOFF_BASE << attempt) < ceiling) {
+		ceiling = (long)AWS_BACKOFF_BASE << attempt;
+	}
+
+	ts = aws_get_thread_state(aws);
+	if (ts == NULL) {
+		return ceiling;
+	}
+	return (long)(aws_random(ts) % (unsigned long long)(ceiling + 1));
+}
+
+int aws_retry_acquire(struct aws_handle *aws) {
+	int rv = -1;
+
+	pthread_mutex_lock(&aws->retry_lock);
+	if (aws->retry_budget >= AWS_RETRY_COST) {
+		aws->retry_budget -= AWS_RETRY_COST;
+		rv = 0;
+	}
+	pthread_mutex_unlock(&aws->retry_lock);
+
+	return rv;
+}
+
+void aws_retry_release(struct aws_handle *aws) {
+	pthread_mutex_lock(&aws->retry_lock);
+	if (aws->retry_budget < AWS_RETRY_BUDGET) {
+		aws->retry_budget++;
+	}
+	pthread_mutex_unlock(&aws->retry_lock);
+}
+
+/**
+ * aws_now_ms - read the clock deadlines are measured on
+ * Returns: CLOCK_MONOTONIC time in milliseconds
+ */
+static long long aws_now_ms(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+struct aws_cancel *aws_cancel_init(void) {
+	struct aws_cancel *cancel;
+	pthread_condattr_t attr;
+
+	cancel = calloc(1, sizeof(*cancel));
+	if (cancel == NULL) {
+		Warnx("aws_cancel_init: Failed to allocate cancellation handle.");
+		return NULL;
+	}
+
+	pthread_mutex_init(&cancel->lock, NULL);
+	/* Waits are bounded by deadlines on the monotonic clock. */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&cancel->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	return cancel;
+}
+
+void aws_cancel_deinit(struct aws_cancel *cancel) {
+	if (cancel == NULL) {
+		return;
+	}
+	pthread_cond_destroy(&cancel->cond);
+	pthread_mutex_destroy(&cancel->lock);
+	free(cancel);
+}
+
+void aws_cancel_signal(struct aws_cancel *cancel) {
+	pthread_mutex_lock(&cancel->lock);
+	cancel->cancelled = 1;
+	pthread_cond_broadcast(&cancel->cond);
+	pthread_mutex_unlock(&cancel->lock);
+}
+
+void aws_cancel_reset(struct aws_cancel *cancel) {
+	pthread_mutex_lock(&cancel->lock);
+	cancel->cancelled = 0;
+	pthread_mutex_unlock(&cancel->lock);
+}
+
+int aws_set_timeout(struct aws_handle *aws, int timeout_ms, struct aws_cancel *cancel) {
+	struct aws_thread_state *ts;
+
+	ts = aws_get_thread_state(aws);
+	if (ts == NULL) {
+		return -1;
+	}
+	ts->timeout_ms = timeout_ms > 0 ? timeout_ms : 0;
+	ts->cancel = cancel;
+	return 0;
 }
 
+void aws_deadline_begin(struct aws_handle *aws) {
+	struct aws_thread_state *ts;
+
+	ts = aws_get_thread_state(aws);
+	if (ts == NULL) {
+		return;
+	}
+	if (ts->deadline_depth++ == 0 && ts->timeout_ms > 0) {
+		ts->deadline = aws_now_ms() + ts->timeout_ms;
+	}
+}
+
+void aws_deadline_end(struct aws_handle *aws) {
+	struct aws_thread_state *ts;
+
+	ts = aws_get_thread_state(aws);
+	if (ts == NULL) {
+		return;
+	}
+	if (ts->deadline_depth > 0 && --ts->deadline_depth == 0) {
+		ts->deadline = 0;
+	}
+}
+
+/**
+ * aws_deadline_fail - record why the current call was stopped
+ * @ts: thread state
+ * @code: AWS_DYNAMO_CODE_DEADLINE_EXCEEDED or AWS_DYNAMO_CODE_CANCELLED
+ */
+static void aws_deadline_fail(struct aws_thread_state *ts, int code) {
+	ts->dynamo_errno = code;
+	snprintf(ts->dynamo_message, sizeof(ts->dynamo_message), "%s",
+		code == AWS_DYNAMO_CODE_CANCELLED ?
+			"Request cancelled" : "Request deadline exceeded");
+}
+
+int aws_deadline_check(struct aws_handle *aws, long *remaining_ms) {
+	struct aws_thread_state *ts;
+
+	*remaining_ms = 0;
+
+	ts = aws_get_thread_state(aws);
+	if (ts == NULL) {
+		return -1;
+	}
+
+	if (ts->cancel != NULL && ts->cancel->cancelled) {
+		aws_deadline_fail(ts, AWS_DYNAMO_CODE_CANCELLED);
+		return -1;
+	}
+
+	if (ts->deadline != 0) {
+		long long left = ts->deadline - aws_now_ms();
+
+		if (left <= 0) {
+			aws_deadline_fail(ts, AWS_DYNAMO_CODE_DEADLINE_EXCEEDED);
+			return -1;
+		}
+		*remaining_ms = (long)left;
+	}
+
+	return 0;
+}
+
+int aws_sleep(struct aws_handle *aws, long usec) {
+	struct aws_thread_state *ts;
+	struct aws_cancel *cancel;
+	long long wake;
+	struct timespec ts_wake;
+	int rv = 0;
+
+	ts = aws_get_thread_state(aws);
+	if (ts == NULL) {
+		return -1;
+	}
+
+	wake = aws_now_ms() + usec / 1000;
+	if (ts->deadline != 0 && wake >= ts->deadline) {
+		/* The call would be out of time before it could go on. */
+		aws_deadline_fail(ts, AWS_DYNAMO_CODE_DEADLINE_EXCEEDED);
+		return -1;
+	}
+
+	cancel = ts->cancel;
+	if (cancel == NULL) {
+		ts_wake.tv_sec = usec / 1000000;
+		ts_wake.tv_nsec = (usec % 1000000) * 1000;
+		while (nanosleep(&ts_wake, &ts_wake) == -1 && errno == EINTR)
+			;
+		return 0;
+	}
+
+	ts_wake.tv_sec = wake / 1000;
+	ts_wake.tv_nsec = (wake % 1000) * 1000000;
+
+	pthread_mutex_lock(&cancel->lock);
+	while (!cancel->cancelled &&
+	       pthread_cond_timedwait(&cancel->cond, &cancel->lock, &ts_wake) != ETIMEDOUT)
+		;
+	if (cancel->cancelled) {
+		rv = -1;
+	}
+	pthread_mutex_unlock(&cancel->lock);
+
+	if (rv == -1) {
+		aws_deadline_fail(ts, AWS_DYNAMO_CODE_CANCELLED);
+	}
+	return rv;
+}
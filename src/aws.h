@@ -22,12 +22,29 @@
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #ifdef  __cplusplus
 extern "C" {
 #endif
 
 #define AWS_SESSION_REFRESH_TIME (60 * 5) /* seconds */
+#define AWS_SESSION_RETRY_TIME 10 /* seconds */
+
+/* Retries wait a random time of up to AWS_BACKOFF_BASE << attempt,
+   capped at AWS_BACKOFF_CAP. */
+#define AWS_BACKOFF_BASE 50000 /* microseconds */
+#define AWS_BACKOFF_CAP 10000000 /* microseconds */
+
+/* Each retry spends AWS_RETRY_COST tokens of a handle's retry budget and
+   each success returns one, up to AWS_RETRY_BUDGET.  Once most requests
+   fail the budget runs dry and retries stop adding to the load. */
+#define AWS_RETRY_BUDGET 1000
+#define AWS_RETRY_COST 10
+
+/* Instance metadata service, overridden by the
+   AWS_EC2_METADATA_SERVICE_ENDPOINT environment variable. */
+#define AWS_IAM_DEFAULT_ENDPOINT "http://169.254.169.254"
 
 #define AWS_KINESIS_SEQUENCE_SIZE 64
 
@@ -38,26 +55,120 @@ struct aws_session_token {
 	char *access_key_id;
 };
 
-struct aws_handle {
-	void *http;
-	struct aws_session_token *token;
-	char *aws_id;
-	char *aws_key;
+struct aws_handle;
+struct aws_dynamo_limiter;
 
+/**
+ * struct aws_cancel - cancellation handle, see aws_cancel_init()
+ * @lock: protects @cancelled and serves @cond
+ * @cond: wakes threads waiting to retry when @cancelled is set
+ * @cancelled: non-zero once aws_cancel_signal() has been called
+ */
+struct aws_cancel {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	volatile int cancelled;
+};
+
+/**
+ * struct aws_thread_state - state of an aws_handle private to one thread
+ * @aws: the handle this state belongs to
+ * @http: HTTP handle acquired from the handle's pool
+ * @http_multi: multi handle for asynchronous requests, created on first use
+ * @dynamo_message: message of the last error seen by this thread
+ * @dynamo_errno: code of the last error seen by this thread
+ * @signing_keys: SigV4 signing keys derived by this thread, allocated on
+ *		  first use
+ * @request_time: time of this thread's last signed request
+ * @iso8601_basic_date: @request_time as YYYYMMDD'T'HHMMSS'Z'
+ * @yyyy_mm_dd: date of @request_time
+ * @rand_state: state of this thread's random number generator
+ * @timeout_ms: time limit of each call, 0 for none, see aws_set_timeout()
+ * @cancel: cancellation handle of the calls, or NULL
+ * @deadline: CLOCK_MONOTONIC time in milliseconds by which the current call
+ *	      must end, 0 if there is none
+ * @deadline_depth: nesting of calls sharing @deadline
+ * @builder: request builder of this thread, see aws_dynamo_builder_get()
+ * @next: next state in the handle's list of thread states
+ */
+struct aws_sigv4_key_cache;
+struct aws_dynamo_builder;
+
+/* Length of a time in the ISO 8601 basic format, YYYYMMDD'T'HHMMSS'Z'. */
+#define AWS_ISO8601_BASIC_DATE_LEN	16
+
+struct aws_thread_state {
+	struct aws_handle *aws;
+	void *http;
+	void *http_multi;
     /*FIXME: Rename dynamo away*/
 	/* Last DynamoDB error info. */
 	char dynamo_message[512];
 	int dynamo_errno;
+	struct aws_sigv4_key_cache *signing_keys;
+	time_t request_time;
+	char iso8601_basic_date[AWS_ISO8601_BASIC_DATE_LEN + 1];
+	char yyyy_mm_dd[9];
+	unsigned long long rand_state;
+	int timeout_ms;
+	struct aws_cancel *cancel;
+	long long deadline;
+	int deadline_depth;
+	struct aws_dynamo_builder *builder;
+	struct aws_thread_state *next;
+};
+
+/* An aws_handle may be shared by any number of threads once it has been
+   configured.  Each thread makes its requests on its own HTTP handle, taken
+   from a pool whose handles share DNS lookups, TLS sessions and
+   connections, and sees its own error state. */
+struct aws_handle {
+	void *http_pool;
+	pthread_key_t thread_key;
+	/* Protects token and threads. */
+	pthread_mutex_t lock;
+	struct aws_thread_state *threads;
+	struct aws_session_token *token;
+	char *aws_id;
+	char *aws_key;
+
 	int dynamo_max_retries;
 	int dynamo_https;
 	int dynamo_port;
 	char *dynamo_host;
 	char *dynamo_region;
+	int dynamo_parse_flags;
+	/* Shared by all requests on the handle, protected by retry_lock. */
+	pthread_mutex_t retry_lock;
+	int retry_budget;
 
+	/* Paces requests per table, NULL when rate limiting is off. */
+	struct aws_dynamo_limiter *dynamo_limiter;
+
+	/* Role credentials are renewed by a background thread with a
+	   transport of its own, iam_http, used under iam_lock. */
+	char *iam_endpoint;
+	void *iam_http;
+	pthread_mutex_t iam_lock;
+	pthread_t refresher;
+	/* Wakes the refresher to stop, waited on with lock held. */
+	pthread_cond_t refresher_cond;
+	int refresher_running;
+	int refresher_stop;
 };
 
 struct aws_handle *aws_init(const char *aws_id, const char *aws_key);
 
+/**
+ * aws_deinit - free a handle and the state of every thread that used it
+ * @aws: aws handle, may be NULL
+ *
+ * Asynchronous requests and timers still pending are dropped without
+ * their callbacks being called, and what the requests hold is not freed.
+ * Each thread that started any must call aws_async_perform() until
+ * aws_async_pending() returns 0 before this is called, and before the
+ * thread exits.
+ */
 void aws_deinit(struct aws_handle *aws);
 
 char *aws_base64_encode(char *in, int in_len, size_t *out_len);
@@ -68,8 +179,203 @@ void aws_free_session_token(struct aws_session_token *token);
 
 int aws_get_security_credentials(struct aws_handle *aws, char **id, char **key);
 
+/**
+ * aws_set_iam_endpoint - set the instance metadata service to get role
+ *	credentials from
+ * @aws: aws handle
+ * @endpoint: scheme, host and optional port, e.g. "http://169.254.169.254"
+ * Returns: 0 on success, -1 on failure to allocate a copy of @endpoint
+ *
+ * Applies to the refreshes after this call.  The credentials loaded by
+ * aws_init() come from the endpoint in the
+ * AWS_EC2_METADATA_SERVICE_ENDPOINT environment variable, if set.
+ */
+int aws_set_iam_endpoint(struct aws_handle *aws, const char *endpoint);
+
+/**
+ * aws_get_thread_state - get the calling thread's state of a handle
+ * @aws: aws handle
+ * Returns: the thread state, created on first use, NULL on failure
+ */
+struct aws_thread_state *aws_get_thread_state(struct aws_handle *aws);
+
+/**
+ * aws_get_http - get the calling thread's HTTP handle
+ * @aws: aws handle
+ * Returns: HTTP handle, NULL on failure
+ */
+void *aws_get_http(struct aws_handle *aws);
+
 int aws_post(struct aws_handle *aws, const char *aws_service, const char *target, const char *body);
 
+/**
+ * aws_async_callback - called when a request started with aws_post_async()
+ *			completes
+ * @aws: aws handle the request was submitted on
+ * @http: HTTP handle holding the response, only valid until the callback
+ *	  returns, may be NULL if @result is -1
+ * @result: 0 if a response was received, -1 if the transfer failed
+ * @arg: argument given to aws_post_async()
+ */
+typedef void (*aws_async_callback)(struct aws_handle *aws, void *http, int result, void *arg);
+
+/**
+ * aws_post_async - start a request to an AWS service without waiting for it
+ * @aws: aws handle
+ * @aws_service: service name, "dynamodb" or "kinesis"
+ * @target: value of the target header
+ * @body: request body, copied before this returns
+ * @cb: function called from aws_async_perform() when the request completes
+ * @arg: argument passed to @cb
+ * Returns: 0 if the request was started, -1 on failure
+ *
+ * As with aws_post(), a transfer that fails is sent once more after 100 ms
+ * unless it was cancelled or aborted by the receiver of its body.  The
+ * retry waits on the timer wheel of aws_async_perform().
+ */
+int aws_post_async(struct aws_handle *aws, const char *aws_service, const char *target,
+	const char *body, aws_async_callback cb, void *arg);
+
+/**
+ * aws_async_perform - make progress on the asynchronous requests of a handle
+ * @aws: aws handle
+ * @timeout_ms: maximum time to wait for network activity, 0 to not wait
+ * Returns: number of requests still in flight, -1 on failure
+ *
+ * Only requests started by the calling thread are driven.  Completion
+ * callbacks are called from within this function.
+ */
+int aws_async_perform(struct aws_handle *aws, int timeout_ms);
+
+/**
+ * aws_async_pending - number of asynchronous requests in flight
+ * @aws: aws handle
+ * Returns: number of requests started and not yet completed
+ *
+ * This must be down to 0 before the thread exits or the handle is freed,
+ * see aws_deinit().
+ */
+int aws_async_pending(struct aws_handle *aws);
+
+/**
+ * aws_async_schedule - call a function from aws_async_perform() after a
+ *	delay
+ * @aws: aws handle
+ * @delay_ms: delay in milliseconds
+ * @cb: function to call
+ * @arg: argument passed to @cb
+ * Returns: 0 on success, -1 on failure
+ *
+ * The calling thread's aws_async_perform() calls @cb; until then it counts
+ * as pending.
+ */
+int aws_async_schedule(struct aws_handle *aws, int delay_ms,
+	void (*cb)(void *arg), void *arg);
+
+/**
+ * aws_backoff - pick the time to wait before retrying a request
+ * @aws: aws handle
+ * @attempt: number of attempts already retried, 0 for the first retry
+ * Returns: delay in microseconds, uniformly distributed between 0 and
+ *	    AWS_BACKOFF_BASE << @attempt, at most AWS_BACKOFF_CAP
+ *
+ * Spreading retries over the whole interval ("full jitter") keeps clients
+ * that were throttled together from retrying together.  Each thread draws
+ * from a random number generator of its own.
+ */
+long aws_backoff(struct aws_handle *aws, int attempt);
+
+/**
+ * aws_retry_acquire - take a retry out of the handle's retry budget
+ * @aws: aws handle
+ * Returns: 0 if the request may be retried, -1 if the budget is spent
+ */
+int aws_retry_acquire(struct aws_handle *aws);
+
+/**
+ * aws_retry_release - credit the retry budget for a successful request
+ * @aws: aws handle
+ */
+void aws_retry_release(struct aws_handle *aws);
+
+/**
+ * aws_cancel_init - create a cancellation handle
+ * Returns: cancellation handle, NULL on failure
+ *
+ * A handle given to aws_set_timeout() lets any thread stop the calls of
+ * the thread that set it.
+ */
+struct aws_cancel *aws_cancel_init(void);
+
+/**
+ * aws_cancel_deinit - destroy a cancellation handle
+ * @cancel: cancellation handle, no longer set on any thread
+ */
+void aws_cancel_deinit(struct aws_cancel *cancel);
+
+/**
+ * aws_cancel_signal - stop the calls that use a cancellation handle
+ * @cancel: cancellation handle
+ *
+ * Calls waiting to retry return at once, transfers are aborted within about
+ * a second.  The calls fail with AWS_DYNAMO_CODE_CANCELLED, as do later
+ * calls until aws_cancel_reset().  May be called from any thread.
+ */
+void aws_cancel_signal(struct aws_cancel *cancel);
+
+/**
+ * aws_cancel_reset - make a cancellation handle usable again
+ * @cancel: cancellation handle
+ */
+void aws_cancel_reset(struct aws_cancel *cancel);
+
+/**
+ * aws_set_timeout - limit the calls the calling thread makes on a handle
+ * @aws: aws handle
+ * @timeout_ms: time each following call may take, signing, connecting,
+ *		transfers, rate limiting and retries included; 0 for no limit
+ * @cancel: cancellation handle, NULL for none
+ * Returns: 0 on success, -1 on failure
+ *
+ * A call that runs out of time fails with AWS_DYNAMO_CODE_DEADLINE_EXCEEDED
+ * as its aws_dynamo_get_errno().  A retry is given up as soon as its wait
+ * would end past the deadline.  Asynchronous requests are not limited.
+ */
+int aws_set_timeout(struct aws_handle *aws, int timeout_ms, struct aws_cancel *cancel);
+
+/**
+ * aws_deadline_begin - start the time limit of a call
+ * @aws: aws handle
+ *
+ * Nested calls share the deadline of the outermost one.  Each call must be
+ * matched by aws_deadline_end().
+ */
+void aws_deadline_begin(struct aws_handle *aws);
+
+/**
+ * aws_deadline_end - end the time limit of a call
+ * @aws: aws handle
+ */
+void aws_deadline_end(struct aws_handle *aws);
+
+/**
+ * aws_deadline_check - check whether the current call may go on
+ * @aws: aws handle
+ * @remaining_ms: time left to the call (out), 0 if it is not limited
+ * Returns: 0 if the call may go on, -1 if it was cancelled or is out of
+ *	    time, with the calling thread's error state set accordingly
+ */
+int aws_deadline_check(struct aws_handle *aws, long *remaining_ms);
+
+/**
+ * aws_sleep - wait within the current call
+ * @aws: aws handle
+ * @usec: time to wait in microseconds
+ * Returns: 0 after waiting, -1 with the error state set if the call was
+ *	    cancelled or the wait would end past its deadline
+ */
+int aws_sleep(struct aws_handle *aws, long usec);
+
 #ifdef  __cplusplus
 }
 #endif
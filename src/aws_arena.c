@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "aws_dynamo_utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "aws_arena.h"
+
+#define AWS_ARENA_ROUND(n)	(((n) + AWS_ARENA_ALIGN - 1) & ~((size_t)AWS_ARENA_ALIGN - 1))
+
+/**
+ * struct aws_arena_block - a block of memory allocations are carved from
+ * @next: next block of the arena
+ * @size: number of bytes following the header
+ * @used: number of those bytes handed out
+ */
+struct aws_arena_block {
+	struct aws_arena_block *next;
+	size_t size;
+	size_t used;
+};
+
+#define AWS_ARENA_HEADER	AWS_ARENA_ROUND(sizeof(struct aws_arena_block))
+
+/**
+ * struct aws_arena_cleanup - a function to call when an arena is freed
+ * @next: next cleanup of the arena
+ * @fn: function
+ * @arg: argument for @fn
+ */
+struct aws_arena_cleanup {
+	struct aws_arena_cleanup *next;
+	void (*fn)(void *arg);
+	void *arg;
+};
+
+/**
+ * struct aws_arena - a bump allocator
+ * @blocks: blocks of the arena, allocations are made from the first one
+ * @next_size: size of the next block
+ * @last: most recent allocation from the first block, it may grow in place
+ * @cleanups: functions registered with aws_arena_defer(), newest first
+ */
+struct aws_arena {
+	struct aws_arena_block *blocks;
+	size_t next_size;
+	void *last;
+	struct aws_arena_cleanup *cleanups;
+};
+
+static char *aws_arena_data(struct aws_arena_block *b)
+{
+	return (char *)b + AWS_ARENA_HEADER;
+}
+
+static struct aws_arena_block *aws_arena_new_block(size_t size)
+{
+	struct aws_arena_block *b;
+
+	b = malloc(AWS_ARENA_HEADER + size);
+	if (b == NULL) {
+		Warnx("aws_arena_new_block: Failed to allocate %zu bytes.", size);
+		return NULL;
+	}
+	b->next = NULL;
+	b->size = size;
+	b->used = 0;
+
+	return b;
+}
+
+struct aws_arena *aws_arena_init(size_t size_hint)
+{
+	struct aws_arena_block *b;
+	struct aws_arena *arena;
+	size_t size;
+
+	size = size_hint ? size_hint : AWS_ARENA_DEFAULT_BLOCK;
+	if (size < AWS_ARENA_MIN_BLOCK) {
+		size = AWS_ARENA_MIN_BLOCK;
+	} else if (size > AWS_ARENA_MAX_BLOCK) {
+		size = AWS_ARENA_MAX_BLOCK;
+	}
+	size = AWS_ARENA_ROUND(size);
+
+	b = aws_arena_new_block(AWS_ARENA_ROUND(sizeof(*arena)) + size);
+	if (b == NULL) {
+		return NULL;
+	}
+
+	arena = (struct aws_arena *)aws_arena_data(b);
+	b->used = AWS_ARENA_ROUND(sizeof(*arena));
+	arena->blocks = b;
+	arena->next_size = size * 2 < AWS_ARENA_MAX_BLOCK ?
+		size * 2 : AWS_ARENA_MAX_BLOCK;
+	arena->last = NULL;
+	arena->cleanups = NULL;
+
+	return arena;
+}
+
+void aws_arena_deinit(struct aws_arena *arena)
+{
+	struct aws_arena_cleanup *c;
+	struct aws_arena_block *b;
+	struct aws_arena_block *next;
+
+	if (arena == NULL) {
+		return;
+	}
+
+	/* The cleanups live in the blocks, run them all first. */
+	for (c = arena->cleanups; c != NULL; c = c->next) {
+		c->fn(c->arg);
+	}
+
+	/* The arena itself goes with its first block. */
+	for (b = arena->blocks; b != NULL; b = next) {
+		next = b->next;
+		free(b);
+	}
+}
+
+void *aws_arena_alloc(struct aws_arena *arena, size_t size)
+{
+	struct aws_arena_block *b;
+	void *p;
+
+	if (arena == NULL) {
+		return malloc(size);
+	}
+
+	size = AWS_ARENA_ROUND(size);
+
+	b = arena->blocks;
+	if (b->size - b->used < size) {
+		if (size > arena->next_size / 4) {
+			/* Too big to share a block, don't waste what is left
+			   of the current one. */
+			b = aws_arena_new_block(size);
+			if (b == NULL) {
+				return NULL;
+			}
+			b->used = size;
+			b->next = arena->blocks->next;
+			arena->blocks->next = b;
+			return aws_arena_data(b);
+		}
+
+		b = aws_arena_new_block(arena->next_size);
+		if (b == NULL) {
+			return NULL;
+		}
+		b->next = arena->blocks;
+		arena->blocks = b;
+		if (arena->next_size < AWS_ARENA_MAX_BLOCK) {
+			arena->next_size *= 2;
+		}
+	}
+
+	p = aws_arena_data(b) + b->used;
+	b->used += size;
+	arena->last = p;
+
+	return p;
+}
+
+void *aws_arena_calloc(struct aws_arena *arena, size_t n, size_t size)
+{
+	void *p;
+
+	if (arena == NULL) {
+		return calloc(n, size);
+	}
+
+	if (size != 0 && n > (size_t)-1 / size) {
+		return NULL;
+	}
+
+	p = aws_arena_alloc(arena, n * size);
+	if (p != NULL) {
+		memset(p, 0, n * size);
+	}
+
+	return p;
+}
+
+void *aws_arena_realloc(struct aws_arena *arena, void *ptr, size_t old_size,
+	size_t size)
+{
+	struct aws_arena_block *b;
+	void *p;
+
+	if (arena == NULL) {
+		return realloc(ptr, size);
+	}
+
+	if (ptr == NULL) {
+		return aws_arena_alloc(arena, size);
+	}
+
+	if (ptr == arena->last) {
+		size_t offset;
+
+		b = arena->blocks;
+		offset = (char *)ptr - aws_arena_data(b);
+		if (AWS_ARENA_ROUND(size) <= b->size - offset) {
+			b->used = offset + AWS_ARENA_ROUND(size);
+			return ptr;
+		}
+	}
+
+	if (size <= old_size) {
+		return ptr;
+	}
+
+	p = aws_arena_alloc(arena, size);
+	if (p == NULL) {
+		return NULL;
+	}
+	memcpy(p, ptr, old_size);
+
+	return p;
+}
+
+char *aws_arena_strndup(struct aws_arena *arena, const char *s, size_t len)
+{
+	char *p;
+
+	if (arena == NULL) {
+		return strndup(s, len);
+	}
+
+	p = aws_arena_alloc(arena, len + 1);
+	if (p == NULL) {
+		return NULL;
+	}
+	memcpy(p, s, len);
+	p[len] = '\0';
+
+	return p;
+}
+
+void aws_arena_free(struct aws_arena *arena, void *ptr)
+{
+	if (arena == NULL) {
+		free(ptr);
+	}
+}
+
+void aws_arena_adopt(struct aws_arena *arena, struct aws_arena *other)
+{
+	struct aws_arena_block *b;
+
+	struct aws_arena_cleanup **c;
+
+	/* Keep allocating from the first block of @arena. */
+	for (b = arena->blocks; b->next != NULL; b = b->next)
+		;
+	b->next = other->blocks;
+
+	for (c = &(arena->cleanups); *c != NULL; c = &((*c)->next))
+		;
+	*c = other->cleanups;
+}
+
+int aws_arena_defer(struct aws_arena *arena, void (*fn)(void *arg), void *arg)
+{
+	struct aws_arena_cleanup *c;
+
+	if (arena == NULL) {
+		Warnx("aws_arena_defer: no arena.");
+		return -1;
+	}
+
+	c = aws_arena_alloc(arena, sizeof(*c));
+	if (c == NULL) {
+		return -1;
+	}
+	c->fn = fn;
+	c->arg = arg;
+	c->next = arena->cleanups;
+	arena->cleanups = c;
+
+	return 0;
+}
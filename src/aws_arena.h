@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AWS_ARENA_H_
+#define _AWS_ARENA_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Blocks start at AWS_ARENA_MIN_BLOCK bytes, or the size hint given to
+   aws_arena_init(), and each new block is twice the size of the last one
+   up to AWS_ARENA_MAX_BLOCK.  Larger allocations get a block of their
+   own. */
+#define AWS_ARENA_MIN_BLOCK	4096
+#define AWS_ARENA_DEFAULT_BLOCK	65536
+#define AWS_ARENA_MAX_BLOCK	1048576
+
+/* Every allocation is aligned for the strictest type it may hold, an
+   aws_dynamo_double_t. */
+#define AWS_ARENA_ALIGN		16
+
+struct aws_arena;
+
+/**
+ * aws_arena_init - create an arena
+ * @size_hint: expected total size of the allocations, 0 if unknown
+ * Returns: arena, NULL on failure
+ *
+ * Memory is handed out from a few large blocks and only given back, all at
+ * once, by aws_arena_deinit().  The arena lives in its own first block.
+ */
+struct aws_arena *aws_arena_init(size_t size_hint);
+
+/**
+ * aws_arena_deinit - free an arena and everything allocated from it
+ * @arena: arena, may be NULL
+ */
+void aws_arena_deinit(struct aws_arena *arena);
+
+/*
+ * The functions below take a NULL arena to mean the C library heap, so that
+ * parsers can build their results either way with the same code.
+ */
+
+/**
+ * aws_arena_alloc - allocate uninitialised memory
+ * @arena: arena, NULL for malloc()
+ * @size: number of bytes
+ * Returns: memory, NULL on failure
+ */
+void *aws_arena_alloc(struct aws_arena *arena, size_t size);
+
+/**
+ * aws_arena_calloc - allocate zeroed memory for an array
+ * @arena: arena, NULL for calloc()
+ * @n: number of elements
+ * @size: size of an element
+ * Returns: memory, NULL on failure
+ */
+void *aws_arena_calloc(struct aws_arena *arena, size_t n, size_t size);
+
+/**
+ * aws_arena_realloc - resize an allocation
+ * @arena: arena, NULL for realloc()
+ * @ptr: allocation to resize, may be NULL
+ * @old_size: current size of @ptr
+ * @size: new size
+ * Returns: resized allocation, NULL on failure with @ptr left intact
+ *
+ * The last allocation of an arena grows in place while its block has room,
+ * others are copied.
+ */
+void *aws_arena_realloc(struct aws_arena *arena, void *ptr, size_t old_size,
+	size_t size);
+
+/**
+ * aws_arena_strndup - copy a string of known length
+ * @arena: arena, NULL for strndup()
+ * @s: string
+ * @len: length of @s
+ * Returns: nul terminated copy, NULL on failure
+ */
+char *aws_arena_strndup(struct aws_arena *arena, const char *s, size_t len);
+
+/**
+ * aws_arena_free - release an allocation
+ * @arena: arena, NULL for free()
+ * @ptr: allocation
+ *
+ * Does nothing for an arena, its memory is released by aws_arena_deinit().
+ */
+void aws_arena_free(struct aws_arena *arena, void *ptr);
+
+/**
+ * aws_arena_adopt - move the memory of one arena into another
+ * @arena: arena that takes over the blocks
+ * @other: arena to empty, invalid after this call
+ *
+ * Lets results parsed into separate arenas be combined and freed together.
+ */
+void aws_arena_adopt(struct aws_arena *arena, struct aws_arena *other);
+
+/**
+ * aws_arena_defer - have a function called when an arena is freed
+ * @arena: arena, must not be NULL
+ * @fn: function to call from aws_arena_deinit()
+ * @arg: argument for @fn
+ * Returns: 0 on success, -1 on failure
+ *
+ * Ties the lifetime of memory the arena does not own, such as a response
+ * body its strings point into, to that of the arena.  Functions are called
+ * newest first, before any of the arena's memory is released, and move
+ * with aws_arena_adopt().
+ */
+int aws_arena_defer(struct aws_arena *arena, void (*fn)(void *arg), void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _AWS_ARENA_H_ */
@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 
 #include <yajl/yajl_parse.h>
 
@@ -34,12 +35,25 @@
 #include "aws_sigv4.h"
 #include "aws_dynamo.h"
 #include "aws_dynamo_query.h"
+#include "aws_dynamo_stream.h"
+#include "aws_dynamo_limiter.h"
+#include "aws_arena.h"
+#include "aws_dynamo_number.h"
+
+/* Initial capacity of the string array of a string set. */
+#define AWS_DYNAMO_STRING_SET_MIN	4
 
 const char *aws_dynamo_attribute_types[] = {
 	AWS_DYNAMO_JSON_TYPE_STRING,
 	AWS_DYNAMO_JSON_TYPE_STRING_SET,
 	AWS_DYNAMO_JSON_TYPE_NUMBER,
 	AWS_DYNAMO_JSON_TYPE_NUMBER_SET,
+	AWS_DYNAMO_JSON_TYPE_BINARY,
+	AWS_DYNAMO_JSON_TYPE_BINARY_SET,
+	AWS_DYNAMO_JSON_TYPE_BOOLEAN,
+	AWS_DYNAMO_JSON_TYPE_NULL,
+	AWS_DYNAMO_JSON_TYPE_LIST,
+	AWS_DYNAMO_JSON_TYPE_MAP,
 };
 
 static int aws_dynamo_post(struct aws_handle *aws, const char *target, const char *body) {
@@ -305,7 +319,15 @@ static int aws_dynamo_parse_error_response(const unsigned char *response, int re
 	return rv;
 }
 
-int aws_dynamo_request(struct aws_handle *aws, const char *target, const char *body) {
+/**
+ * aws_dynamo_request_retry - make a request, retrying it while that helps
+ * @aws: library handle
+ * @target: DynamoDB target
+ * @body: request body
+ * Returns: 0 on success, -1 on failure
+ */
+static int aws_dynamo_request_retry(struct aws_handle *aws, const char *target, const char *body) {
+	struct aws_thread_state *ts;
 	int http_response_code;
 	int dynamodb_response_code = AWS_DYNAMO_CODE_UNKNOWN;
 	int rv = -1;
@@ -314,14 +336,35 @@ int aws_dynamo_request(struct aws_handle *aws, const char *target, const char *b
 
 	do {
 
+		if (aws->dynamo_limiter != NULL) {
+			long wait;
+
+			if (aws_dynamo_limiter_acquire(aws->dynamo_limiter, body, &wait) == -1) {
+				Warnx("aws_dynamo_request: Rate limiter failed.");
+				free(message);
+				return -1;
+			}
+			if (wait > 0 && aws_sleep(aws, wait) == -1) {
+				Warnx("aws_dynamo_request: Stopped waiting for the rate limiter: %s %s", target, body);
+				aws_dynamo_limiter_release(aws->dynamo_limiter, body);
+				free(message);
+				return -1;
+			}
+		}
+
 		if (aws_dynamo_post(aws, target, body) == -1) {
 			Warnx("aws_dynamo_request: Post failed.");
+			free(message);
 			return -1;
 		}
 	
-		http_response_code = http_get_response_code(aws->http);
+		http_response_code = http_get_response_code(aws_get_http(aws));
 
 		if (http_response_code == 200) {
+			if (aws->dynamo_limiter != NULL) {
+				aws_dynamo_limiter_update(aws->dynamo_limiter, body, 0);
+			}
+			aws_retry_release(aws);
 			rv = 0;
 			break;
 		} else if (http_response_code ==  413) {
@@ -331,9 +374,9 @@ int aws_dynamo_request(struct aws_handle *aws, const char *target, const char *b
 			const char *response;
 			int response_len;
 			int retry;
-			useconds_t backoff;
+			long backoff;
 
-			response = http_get_data(aws->http, &response_len);
+			response = http_get_data(aws_get_http(aws), &response_len);
 
 			if (response == NULL) {
 				Warnx("aws_dynamo_request: Failed to get error response.");
@@ -341,6 +384,11 @@ int aws_dynamo_request(struct aws_handle *aws, const char *target, const char *b
 			}
 
 			retry = aws_dynamo_parse_error_response(response, response_len, &message, &dynamodb_response_code);
+			if (aws->dynamo_limiter != NULL &&
+			    (dynamodb_response_code == AWS_DYNAMO_CODE_PROVISIONED_THROUGHPUT_EXCEEDED_EXCEPTION ||
+			     dynamodb_response_code == AWS_DYNAMO_CODE_THROTTLING_EXCEPTION)) {
+				aws_dynamo_limiter_update(aws->dynamo_limiter, body, 1);
+			}
 			if (retry == 0) {
 				/* Don't retry. */
 				Warnx("aws_dynamo_request: Aborting request. http code = %d, target='%s' body='%s' response='%s'",
@@ -352,10 +400,24 @@ int aws_dynamo_request(struct aws_handle *aws, const char *target, const char *b
 				break;
 			}
 
-			backoff = (1 << attempt) * (rand() % 50000 + 25000);
-			Warnx("aws_dynamo_request: '%s' will retry after %d ms wait, attempt %d: %s %s",
+			if (attempt + 1 >= aws->dynamo_max_retries) {
+				attempt++;
+				break;
+			}
+			if (aws_retry_acquire(aws) == -1) {
+				Warnx("aws_dynamo_request: retry budget exhausted, giving up: %s %s", target, body);
+				break;
+			}
+
+			backoff = aws_backoff(aws, attempt);
+			Warnx("aws_dynamo_request: '%s' will retry after %ld ms wait, attempt %d: %s %s",
 				message ? message : "unknown error", backoff / 1000, attempt, target, body);
-			usleep(backoff);
+			free(message);
+			message = NULL;
+			if (aws_sleep(aws, backoff) == -1) {
+				Warnx("aws_dynamo_request: Giving up before the retry: %s %s", target, body);
+				return -1;
+			}
 			attempt++;
 		}
 
@@ -365,148 +427,96 @@ int aws_dynamo_request(struct aws_handle *aws, const char *target, const char *b
 			Warnx("aws_dynamo_request: max retry limit hit, giving up: %s %s", target, body);
 	}
 
+	/* The error state is per thread so that threads sharing the handle
+	   each see the result of their own last request. */
+	ts = aws_get_thread_state(aws);
+	if (ts == NULL) {
+		free(message);
+		return -1;
+	}
+
 	if (message != NULL) {
-		snprintf(aws->dynamo_message, sizeof(aws->dynamo_message), "%s",
+		snprintf(ts->dynamo_message, sizeof(ts->dynamo_message), "%s",
 			message);
 		free(message);
-		aws->dynamo_errno = dynamodb_response_code;
+		ts->dynamo_errno = dynamodb_response_code;
 	} else {
-		aws->dynamo_message[0] = '\0';
-		aws->dynamo_errno = AWS_DYNAMO_CODE_NONE;
+		ts->dynamo_message[0] = '\0';
+		ts->dynamo_errno = AWS_DYNAMO_CODE_NONE;
 	}
 
 	return rv;
 }
 
+int aws_dynamo_request(struct aws_handle *aws, const char *target, const char *body) {
+	int rv;
+
+	/* One deadline covers the request and all of its retries. */
+	aws_deadline_begin(aws);
+	rv = aws_dynamo_request_retry(aws, target, body);
+	aws_deadline_end(aws);
+
+	return rv;
+}
+
 char *aws_dynamo_get_message(struct aws_handle *aws) {
-	return aws->dynamo_message;
+	struct aws_thread_state *ts;
+	static char no_message[] = "";
+
+	ts = aws_get_thread_state(aws);
+	if (ts == NULL) {
+		return no_message;
+	}
+	return ts->dynamo_message;
 }
 
 int aws_dynamo_get_errno(struct aws_handle *aws) {
-	return aws->dynamo_errno;
+	struct aws_thread_state *ts;
+
+	ts = aws_get_thread_state(aws);
+	if (ts == NULL) {
+		return AWS_DYNAMO_CODE_UNKNOWN;
+	}
+	return ts->dynamo_errno;
 }
 
 int aws_dynamo_json_get_double(const char *val, size_t len, double *d)
 {
-	char buf[32];
-
-	if (len + 1 > sizeof(buf)) {
-		Warnx("aws_dynamo_json_get_double: double string too long.");
+	if (aws_dynamo_number_parse_double(val, len, d) == -1) {
+		Warnx("aws_dynamo_json_get_double: double conversion failed.");
 		return -1;
-	} else {
-		char *endptr;
-		double temp;
-
-		snprintf(buf, len + 1, "%s", val);
-
-		errno = 0;
-		temp = strtod(buf, &endptr);
-
-		if (errno != 0) {
-			Warnx("aws_dynamo_json_get_double: double conversion failed.");
-			return -1;
-		}
-
-		if (*endptr == '\0') {
-			*d = temp;
-		} else {
-			Warnx("aws_dynamo_json_get_double: double conversion incomplete.");
-			return -1;
-		}
 	}
 	return 0;
 }
 
 static int aws_dynamo_json_get_aws_dynamo_double_t(const char *val, size_t len, aws_dynamo_double_t *d)
 {
-	char buf[256];
-
-	if (len + 1 > sizeof(buf)) {
-		Warnx("aws_dynamo_json_get_aws_dynamo_double_t: double string too long.");
+	if (aws_dynamo_number_parse_long_double(val, len, d) == -1) {
+		Warnx("aws_dynamo_json_get_aws_dynamo_double_t: double conversion failed.");
 		return -1;
-	} else {
-		char *endptr;
-		aws_dynamo_double_t temp;
-
-		snprintf(buf, len + 1, "%s", val);
-
-		errno = 0;
-		temp = strtold(buf, &endptr);
-
-		if (errno != 0) {
-			Warnx("aws_dynamo_json_get_aws_dynamo_double_t: double conversion failed.");
-			return -1;
-		}
-
-		if (*endptr == '\0') {
-			*d = temp;
-		} else {
-			Warnx("aws_dynamo_json_get_aws_dynamo_double_t: double conversion incomplete.");
-			return -1;
-		}
 	}
 	return 0;
 }
 
 int aws_dynamo_json_get_long_long_int(const unsigned char *val, size_t len, long long int *i)
 {
-	char buf[64];
-
-	if (len + 1 > sizeof(buf)) {
-		Warnx("aws_dynamo_json_get_long_long_int: int string too long.");
+	if (aws_dynamo_number_parse_integer((const char *)val, len, i) == -1) {
+		Warnx("aws_dynamo_json_get_long_long_int: int conversion failed.");
 		return -1;
-	} else {
-		char *endptr;
-		long long int temp;
-
-		snprintf(buf, len + 1, "%s", val);
-
-		errno = 0;
-		temp = strtoll(buf, &endptr, 0);
-
-		if (errno != 0) {
-			Warnx("aws_dynamo_json_get_long_long_int: int conversion failed.");
-			return -1;
-		}
-
-		if (*endptr == '\0') {
-			*i = temp;
-		} else {
-			Warnx("aws_dynamo_json_get_long_long_int: int conversion incomplete.");
-			return -1;
-		}
 	}
 	return 0;
 }
 
 int aws_dynamo_json_get_int(const unsigned char *val, size_t len, int *i)
 {
-	char buf[32];
+	long long temp;
 
-	if (len + 1 > sizeof(buf)) {
-		Warnx("aws_dynamo_json_get_int: int string too long.");
+	if (aws_dynamo_number_parse_integer((const char *)val, len, &temp) == -1 ||
+		temp < INT_MIN || temp > INT_MAX) {
+		Warnx("aws_dynamo_json_get_int: int conversion failed.");
 		return -1;
-	} else {
-		char *endptr;
-		int temp;
-
-		snprintf(buf, len + 1, "%s", val);
-
-		errno = 0;
-		temp = strtol(buf, &endptr, 0);
-
-		if (errno != 0) {
-			Warnx("aws_dynamo_json_get_int: int conversion failed.");
-			return -1;
-		}
-
-		if (*endptr == '\0') {
-			*i = temp;
-		} else {
-			Warnx("aws_dynamo_json_get_int: int conversion incomplete.");
-			return -1;
-		}
 	}
+	*i = (int)temp;
 	return 0;
 }
 
@@ -604,6 +614,47 @@ void aws_dynamo_dump_attributes(struct aws_dynamo_attribute *attributes,
 				Warnx("aws_dynamo_dump_attributes - Number sets not implemented.");
 				break;
 			}
+			case AWS_DYNAMO_BINARY: {
+				if (attribute->value.binary.data != NULL) {
+					Debug("Attribute %d, Binary, %s, %zu bytes", j, attribute->name,
+						attribute->value.binary.len);
+				} else {
+					Debug("Attribute %d, %s is NULL", j, attribute->name);
+				}
+				break;
+			}
+			case AWS_DYNAMO_BINARY_SET: {
+				int i;
+
+				Debug("Attribute %d, Binary set, %s", j, attribute->name);
+				for (i = 0; i < attribute->value.binary_set.num_binaries; i++) {
+					Debug("%d - %zu bytes", i, attribute->value.binary_set.binaries[i].len);
+				}
+				break;
+			}
+			case AWS_DYNAMO_BOOLEAN: {
+				Debug("Attribute %d, Boolean, %s=%s", j, attribute->name,
+					attribute->value.boolean ? "true" : "false");
+				break;
+			}
+			case AWS_DYNAMO_NULL: {
+				Debug("Attribute %d, Null, %s", j, attribute->name);
+				break;
+			}
+			case AWS_DYNAMO_LIST: {
+				Debug("Attribute %d, List, %s, %d values", j, attribute->name,
+					attribute->value.list.num_values);
+				aws_dynamo_dump_attributes(attribute->value.list.values,
+					attribute->value.list.num_values);
+				break;
+			}
+			case AWS_DYNAMO_MAP: {
+				Debug("Attribute %d, Map, %s, %d members", j, attribute->name,
+					attribute->value.map.num_attributes);
+				aws_dynamo_dump_attributes(attribute->value.map.attributes,
+					attribute->value.map.num_attributes);
+				break;
+			}
 			default: {
 				Warnx("aws_dynamo_dump_attributes - Unknown type %d",
 					attribute->type);
@@ -615,6 +666,12 @@ void aws_dynamo_dump_attributes(struct aws_dynamo_attribute *attributes,
 }
 
 void aws_dynamo_free_attributes(struct aws_dynamo_attribute *attributes,
+	int num_attributes) {
+	aws_dynamo_free_attribute_values(attributes, num_attributes);
+	free(attributes);
+}
+
+void aws_dynamo_free_attribute_values(struct aws_dynamo_attribute *attributes,
 	int num_attributes) {
 	int j;
 
@@ -660,6 +717,16 @@ void aws_dynamo_free_attributes(struct aws_dynamo_attribute *attributes,
 				Warnx("aws_dynamo_free_attributes - Number sets not implemented.");
 				break;
 			}
+			case AWS_DYNAMO_BINARY:
+			case AWS_DYNAMO_BINARY_SET:
+			case AWS_DYNAMO_BOOLEAN:
+			case AWS_DYNAMO_NULL:
+			case AWS_DYNAMO_LIST:
+			case AWS_DYNAMO_MAP: {
+				/* Only parsed into the arena of a response, which is
+				   freed as a whole. */
+				break;
+			}
 			default: {
 				Warnx("aws_dynamo_free_attributes - Unknown type %d",
 					attribute->type);
@@ -667,7 +734,6 @@ void aws_dynamo_free_attributes(struct aws_dynamo_attribute *attributes,
 			}
 		}
 	}
-	free(attributes);
 }
 
 void aws_dynamo_free_item(struct aws_dynamo_item *item) {
@@ -678,7 +744,144 @@ void aws_dynamo_free_item(struct aws_dynamo_item *item) {
 	free(item);
 }
 
+int aws_dynamo_alloc_item_matrix(struct aws_arena *arena, int count,
+	const struct aws_dynamo_attribute *attributes, int num_attributes,
+	struct aws_dynamo_item **items, struct aws_dynamo_attribute **matrix)
+{
+	struct aws_dynamo_attribute *a = NULL;
+	struct aws_dynamo_item *i;
+	int item;
+
+	if (count < 0 || num_attributes < 0) {
+		Warnx("aws_dynamo_alloc_item_matrix: bad dimensions.");
+		return -1;
+	}
+
+	i = aws_arena_calloc(arena, count, sizeof(*i));
+	if (i == NULL) {
+		Warnx("aws_dynamo_alloc_item_matrix: item alloc failed.");
+		return -1;
+	}
+
+	if (count > 0 && num_attributes > 0) {
+		a = aws_arena_alloc(arena, sizeof(*a) * (size_t)count * num_attributes);
+		if (a == NULL) {
+			Warnx("aws_dynamo_alloc_item_matrix: attribute alloc failed.");
+			aws_arena_free(arena, i);
+			return -1;
+		}
+	}
+
+	for (item = 0; item < count; item++) {
+		/* Set expected types for attributes. */
+		i[item].attributes = a + (size_t)item * num_attributes;
+		i[item].num_attributes = num_attributes;
+		memcpy(i[item].attributes, attributes, sizeof(*a) * num_attributes);
+	}
+
+	*items = i;
+	*matrix = a;
+	return 0;
+}
+
+void aws_dynamo_free_item_matrix(struct aws_dynamo_attribute *matrix, int count,
+	int num_attributes)
+{
+	if (matrix == NULL) {
+		return;
+	}
+	aws_dynamo_free_attribute_values(matrix, count * num_attributes);
+	free(matrix);
+}
+
+int aws_dynamo_number_set_integer(struct aws_arena *arena,
+	struct aws_dynamo_number *number, aws_dynamo_integer_t i)
+{
+	aws_dynamo_integer_t *p;
+
+	p = aws_arena_alloc(arena, sizeof(*p));
+	if (p == NULL) {
+		Warnx("aws_dynamo_number_set_integer: alloc failed");
+		return -1;
+	}
+	*p = i;
+
+	number->type = AWS_DYNAMO_NUMBER_INTEGER;
+	number->value.integer_val = p;
+	return 0;
+}
+
+int aws_dynamo_number_set_double(struct aws_arena *arena,
+	struct aws_dynamo_number *number, aws_dynamo_double_t d)
+{
+	aws_dynamo_double_t *p;
+
+	p = aws_arena_alloc(arena, sizeof(*p));
+	if (p == NULL) {
+		Warnx("aws_dynamo_number_set_double: alloc failed");
+		return -1;
+	}
+	*p = d;
+
+	number->type = AWS_DYNAMO_NUMBER_DOUBLE;
+	number->value.double_val = p;
+	return 0;
+}
+
+aws_dynamo_integer_t aws_dynamo_number_get_integer(const struct aws_dynamo_number *number)
+{
+	switch (number->type) {
+		case AWS_DYNAMO_NUMBER_INTEGER:
+			return number->value.integer_val != NULL ? *(number->value.integer_val) : 0;
+		case AWS_DYNAMO_NUMBER_DOUBLE:
+			return number->value.double_val != NULL ?
+				(aws_dynamo_integer_t)*(number->value.double_val) : 0;
+		default:
+			return 0;
+	}
+}
+
+aws_dynamo_double_t aws_dynamo_number_get_double(const struct aws_dynamo_number *number)
+{
+	switch (number->type) {
+		case AWS_DYNAMO_NUMBER_INTEGER:
+			return number->value.integer_val != NULL ? *(number->value.integer_val) : 0;
+		case AWS_DYNAMO_NUMBER_DOUBLE:
+			return number->value.double_val != NULL ? *(number->value.double_val) : 0;
+		default:
+			return 0;
+	}
+}
+
 int aws_dynamo_parse_attribute_value(struct aws_dynamo_attribute *attribute, const unsigned char *val,  size_t len)
+{
+	return aws_dynamo_parse_attribute_value_arena(NULL, attribute, val, len);
+}
+
+int aws_dynamo_parse_attribute_value_arena(struct aws_arena *arena,
+	struct aws_dynamo_attribute *attribute, const unsigned char *val,  size_t len)
+{
+	return aws_dynamo_parse_attribute_value_borrow(arena, NULL, attribute, val, len);
+}
+
+char *aws_dynamo_strndup_borrow(struct aws_arena *arena,
+	const struct http_body *body, const unsigned char *val, size_t len)
+{
+	/* A string the tokenizer had to unescape is not in the body.  One
+		that is is followed by its closing quote, which can go. */
+	if (body != NULL && val >= body->data && val + len < body->data + body->len) {
+		char *s = (char *)val;
+
+		s[len] = '\0';
+		return s;
+	}
+
+	return aws_arena_strndup(arena, (const char *)val, len);
+}
+
+int aws_dynamo_parse_attribute_value_borrow(struct aws_arena *arena,
+	const struct http_body *body, struct aws_dynamo_attribute *attribute,
+	const unsigned char *val, size_t len)
 {
 	switch (attribute->type) {
 		case AWS_DYNAMO_NUMBER: {
@@ -696,13 +899,9 @@ int aws_dynamo_parse_attribute_value(struct aws_dynamo_attribute *attribute, con
 						return 0;
 					}
 
-					attribute->value.number.value.integer_val = calloc(sizeof(aws_dynamo_integer_t), 1);
-					if (attribute->value.number.value.integer_val == NULL) {
-						Warnx("aws_dynamo_parse_attribute_value: number alloc failed");
+					if (aws_dynamo_number_set_integer(arena, &(attribute->value.number), lli) == -1) {
 						return 0;
 					}
-	
-					*(attribute->value.number.value.integer_val) = lli;
 					break;
 				}
 				case AWS_DYNAMO_NUMBER_DOUBLE: {
@@ -718,13 +917,9 @@ int aws_dynamo_parse_attribute_value(struct aws_dynamo_attribute *attribute, con
 						return 0;
 					}
 
-					attribute->value.number.value.double_val = calloc(sizeof(aws_dynamo_double_t), 1);
-					if (attribute->value.number.value.double_val == NULL) {
-						Warnx("aws_dynamo_parse_attribute_value: number alloc failed");
+					if (aws_dynamo_number_set_double(arena, &(attribute->value.number), addt) == -1) {
 						return 0;
 					}
-
-					*(attribute->value.number.value.double_val) = addt;
 					break;
 				}
 				default: {
@@ -736,23 +931,38 @@ int aws_dynamo_parse_attribute_value(struct aws_dynamo_attribute *attribute, con
 			break;
 		}
 		case AWS_DYNAMO_STRING: {
-			attribute->value.string = strndup(val, len);
+			attribute->value.string = aws_dynamo_strndup_borrow(arena, body, val, len);
 			break;
 		}
 		case AWS_DYNAMO_STRING_SET: {
+			struct aws_dynamo_string_set *set = &(attribute->value.string_set);
 			char **strings;
 
-			strings = realloc(attribute->value.string_set.strings,
-				sizeof(*strings) * (attribute->value.string_set.num_strings + 1));
+			/* The array doubles in size whenever the number of strings
+				reaches a power of two. */
+			if (set->num_strings == 0 ||
+				(set->num_strings >= AWS_DYNAMO_STRING_SET_MIN &&
+				 (set->num_strings & (set->num_strings - 1)) == 0)) {
+				int size = set->num_strings < AWS_DYNAMO_STRING_SET_MIN ?
+					AWS_DYNAMO_STRING_SET_MIN : set->num_strings * 2;
 
-			if (strings == NULL) {
-				Warnx("aws_dynamo_parse_attribute_value: string set realloc failed.");
-				return 0;
+				strings = aws_arena_realloc(arena, set->strings,
+					sizeof(*strings) * set->num_strings,
+					sizeof(*strings) * size);
+
+				if (strings == NULL) {
+					Warnx("aws_dynamo_parse_attribute_value: string set realloc failed.");
+					return 0;
+				}
+				set->strings = strings;
 			}
 
-			attribute->value.string_set.strings = strings;
-			attribute->value.string_set.strings[attribute->value.string_set.num_strings] = strndup(val, len);
-			attribute->value.string_set.num_strings++;
+			set->strings[set->num_strings] = aws_dynamo_strndup_borrow(arena, body, val, len);
+			if (set->strings[set->num_strings] == NULL) {
+				Warnx("aws_dynamo_parse_attribute_value: string alloc failed.");
+				return 0;
+			}
+			set->num_strings++;
 
 			break;
 		}
@@ -812,24 +1022,20 @@ struct aws_dynamo_item *aws_dynamo_copy_item(struct aws_dynamo_item *item) {
 					case AWS_DYNAMO_NUMBER_INTEGER: {
 						copy->attributes[j].value.number.type = AWS_DYNAMO_NUMBER_INTEGER;
 						if (attribute->value.number.value.integer_val != NULL) {
-							copy->attributes[j].value.number.value.integer_val = calloc(sizeof(aws_dynamo_integer_t), 1);
-							if (copy->attributes[j].value.number.value.integer_val == NULL) {
-								Warnx("aws_dynamo_copy_item: calloc() for int val failed.");
+							if (aws_dynamo_number_set_integer(NULL, &(copy->attributes[j].value.number),
+								*(attribute->value.number.value.integer_val)) == -1) {
 								goto error;
-							} 
-							*(copy->attributes[j].value.number.value.integer_val) = *(attribute->value.number.value.integer_val);
+							}
 						}
 						break;
 					}
 					case AWS_DYNAMO_NUMBER_DOUBLE: {
 						copy->attributes[j].value.number.type = AWS_DYNAMO_NUMBER_DOUBLE;
 						if (attribute->value.number.value.double_val != NULL) {
-							copy->attributes[j].value.number.value.double_val = calloc(sizeof(aws_dynamo_double_t), 1);
-							if (copy->attributes[j].value.number.value.double_val == NULL) {
-								Warnx("aws_dynamo_copy_item: calloc() for double val failed.");
+							if (aws_dynamo_number_set_double(NULL, &(copy->attributes[j].value.number),
+								*(attribute->value.number.value.double_val)) == -1) {
 								goto error;
 							}
-							*(copy->attributes[j].value.number.value.double_val) = *(attribute->value.number.value.double_val);
 						}
 						break;
 					}
@@ -856,10 +1062,16 @@ struct aws_dynamo_item *aws_dynamo_copy_item(struct aws_dynamo_item *item) {
 						strings[i] = strdup(attribute->value.string_set.strings[i]);
 						if (strings[i] == NULL) {
 							Warnx("aws_dynamo_copy_item: calloc() for string failed.");
+							while (--i >= 0) {
+								free(strings[i]);
+							}
 							free(strings);
 							goto error;
 						}
 					}
+					copy->attributes[j].value.string_set.strings = strings;
+					copy->attributes[j].value.string_set.num_strings =
+						attribute->value.string_set.num_strings;
 				}
 
 				break;
@@ -895,7 +1107,18 @@ void aws_dynamo_set_https(struct aws_handle *aws, int https) {
 }
 
 void aws_dynamo_set_https_certificate_file(struct aws_handle *aws, const char *filename) {
-	http_set_https_certificate_file(aws->http, filename);
+	struct aws_thread_state *ts;
+
+	http_pool_set_https_certificate_file(aws->http_pool, filename);
+
+	/* Also update the handles the calling thread already holds. */
+	ts = aws_get_thread_state(aws);
+	if (ts != NULL) {
+		http_set_https_certificate_file(ts->http, filename);
+		if (ts->http_multi != NULL) {
+			http_multi_set_https_certificate_file(ts->http_multi, filename);
+		}
+	}
 }
 
 int aws_dynamo_set_endpoint(struct aws_handle *aws, const char *host, const char *region) {
@@ -922,6 +1145,143 @@ void aws_dynamo_set_port(struct aws_handle *aws, int port) {
 	aws->dynamo_port = port;
 }
 
+void aws_dynamo_set_parse_flags(struct aws_handle *aws, int flags) {
+	aws->dynamo_parse_flags = flags;
+}
+
+int aws_dynamo_set_rate_limit(struct aws_handle *aws, double initial_rate,
+	double max_rate) {
+	struct aws_dynamo_limiter *limiter = NULL;
+
+	if (initial_rate > 0) {
+		limiter = aws_dynamo_limiter_init(initial_rate, max_rate);
+		if (limiter == NULL) {
+			return -1;
+		}
+	}
+
+	aws_dynamo_limiter_deinit(aws->dynamo_limiter);
+	aws->dynamo_limiter = limiter;
+	return 0;
+}
+
+struct aws_dynamo_stream_ctx {
+	const yajl_callbacks *callbacks;
+	int (*reset)(void *ctx);
+	void *ctx;
+	yajl_handle hand;
+};
+
+static int aws_dynamo_stream_begin(void *arg) {
+	struct aws_dynamo_stream_ctx *s = arg;
+
+	/* A retried request starts the parse over. */
+	if (s->hand != NULL) {
+		yajl_free(s->hand);
+		s->hand = NULL;
+	}
+
+	if (s->reset(s->ctx) == -1) {
+		Warnx("aws_dynamo_stream_begin: reset failed.");
+		return -1;
+	}
+
+#if YAJL_MAJOR == 2
+	s->hand = yajl_alloc(s->callbacks, NULL, s->ctx);
+#else
+	s->hand = yajl_alloc(s->callbacks, NULL, NULL, s->ctx);
+#endif
+	if (s->hand == NULL) {
+		Warnx("aws_dynamo_stream_begin: yajl_alloc failed.");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int aws_dynamo_stream_data(void *arg, const unsigned char *data, size_t len) {
+	struct aws_dynamo_stream_ctx *s = arg;
+	yajl_status stat;
+
+	stat = yajl_parse(s->hand, data, len);
+#if YAJL_MAJOR == 2
+	if (stat != yajl_status_ok) {
+#else
+	if (stat != yajl_status_ok && stat != yajl_status_insufficient_data) {
+#endif
+		unsigned char *str = yajl_get_error(s->hand, 1, data, len);
+		Warnx("aws_dynamo_stream_data: json parse failed, '%s'", (const char *) str);
+		yajl_free_error(s->hand, str);
+		return -1;
+	}
+
+	return 0;
+}
+
+int aws_dynamo_request_stream(struct aws_handle *aws, const char *target,
+	const char *body, const yajl_callbacks *callbacks,
+	int (*reset)(void *ctx), void *ctx) {
+	struct aws_dynamo_stream_ctx s = {
+		.callbacks = callbacks,
+		.reset = reset,
+		.ctx = ctx,
+	};
+	struct http_stream stream = {
+		.begin = aws_dynamo_stream_begin,
+		.data = aws_dynamo_stream_data,
+		.arg = &s,
+	};
+	void *http;
+	yajl_status stat;
+	int rv = -1;
+
+	http = aws_get_http(aws);
+	if (http == NULL) {
+		return -1;
+	}
+
+	http_set_stream(http, &stream);
+	if (aws_dynamo_request(aws, target, body) == -1) {
+		goto failure;
+	}
+
+	if (!http_get_streamed(http)) {
+		const unsigned char *response;
+		int response_len;
+
+		/* The body was empty, the parser has not seen any of it yet. */
+		response = http_get_data(http, &response_len);
+		if (response == NULL) {
+			Warnx("aws_dynamo_request_stream: Failed to get response.");
+			goto failure;
+		}
+		if (aws_dynamo_stream_begin(&s) == -1 ||
+			aws_dynamo_stream_data(&s, response, response_len) == -1) {
+			goto failure;
+		}
+	}
+
+#if YAJL_MAJOR == 2
+	stat = yajl_complete_parse(s.hand);
+#else
+	stat = yajl_parse_complete(s.hand);
+#endif
+	if (stat != yajl_status_ok) {
+		Warnx("aws_dynamo_request_stream: json parse failed, incomplete response.");
+		goto failure;
+	}
+
+	rv = 0;
+
+failure:
+	http_set_stream(http, NULL);
+	http_release_data(http);
+	if (s.hand != NULL) {
+		yajl_free(s.hand);
+	}
+	return rv;
+}
+
 int aws_dynamo_layer1_request(struct aws_handle *aws, const char *target, const char *body) {
 	int rv;
 
@@ -930,5 +1290,209 @@ int aws_dynamo_layer1_request(struct aws_handle *aws, const char *target, const
 }
 
 const char *aws_dynamo_layer1_get_response(struct aws_handle *aws, int *response_len) {
-	return http_get_data(aws->http, response_len);
+	return http_get_data(aws_get_http(aws), response_len);
+}
+
+/**
+ * struct aws_dynamo_async_ctx - state of a request started with
+ *	aws_dynamo_request_async()
+ * @aws: library handle
+ * @cb: completion callback
+ * @arg: argument for @cb
+ * @attempt: number of retries so far
+ * @target: copy of the DynamoDB operation, for retries
+ * @body: copy of the request body, for retries
+ */
+struct aws_dynamo_async_ctx {
+	struct aws_handle *aws;
+	aws_dynamo_async_callback cb;
+	void *arg;
+	int attempt;
+	char *target;
+	char *body;
+};
+
+static void aws_dynamo_async_complete(struct aws_handle *aws, void *http, int result, void *arg);
+
+static void aws_dynamo_async_free(struct aws_dynamo_async_ctx *ctx) {
+	free(ctx->target);
+	free(ctx->body);
+	free(ctx);
+}
+
+/* Complete a request that could not be sent. */
+static void aws_dynamo_async_fail(struct aws_dynamo_async_ctx *ctx) {
+	struct aws_dynamo_async_response r = {
+		.rv = -1,
+		.dynamo_errno = AWS_DYNAMO_CODE_UNKNOWN,
+		.message = "",
+	};
+
+	ctx->cb(ctx->aws, &r, ctx->arg);
+	aws_dynamo_async_free(ctx);
+}
+
+/* Give back the limiter slot of a request that was never sent. */
+static void aws_dynamo_async_release(struct aws_dynamo_async_ctx *ctx) {
+	if (ctx->aws->dynamo_limiter != NULL) {
+		aws_dynamo_limiter_release(ctx->aws->dynamo_limiter, ctx->body);
+	}
+}
+
+/* Timer callback sending a request whose wait for the rate limiter is
+   over. */
+static void aws_dynamo_async_send(void *arg) {
+	struct aws_dynamo_async_ctx *ctx = arg;
+
+	if (aws_post_async(ctx->aws, "dynamodb", ctx->target, ctx->body,
+			aws_dynamo_async_complete, ctx) == -1) {
+		Warnx("aws_dynamo_async_send: Post failed.");
+		aws_dynamo_async_release(ctx);
+		aws_dynamo_async_fail(ctx);
+	}
+}
+
+/**
+ * aws_dynamo_async_start - send a request once the rate limiter allows it
+ * @ctx: the request
+ * Returns: 0 if the request was sent or is waiting to be, -1 on failure
+ *
+ * Like aws_dynamo_request() every attempt takes a slot from the limiter,
+ * but the wait is spent on the engine's timer wheel instead of asleep.
+ */
+static int aws_dynamo_async_start(struct aws_dynamo_async_ctx *ctx) {
+	struct aws_handle *aws = ctx->aws;
+
+	if (aws->dynamo_limiter != NULL) {
+		long wait;
+
+		if (aws_dynamo_limiter_acquire(aws->dynamo_limiter, ctx->body, &wait) == -1) {
+			Warnx("aws_dynamo_async_start: Rate limiter failed.");
+			return -1;
+		}
+		if (wait > 0) {
+			if (aws_async_schedule(aws, (wait + 999) / 1000,
+					aws_dynamo_async_send, ctx) == -1) {
+				Warnx("aws_dynamo_async_start: Failed to schedule request.");
+				aws_dynamo_async_release(ctx);
+				return -1;
+			}
+			return 0;
+		}
+	}
+
+	if (aws_post_async(aws, "dynamodb", ctx->target, ctx->body,
+			aws_dynamo_async_complete, ctx) == -1) {
+		Warnx("aws_dynamo_async_start: Post failed.");
+		aws_dynamo_async_release(ctx);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Timer callback re-issuing a request whose backoff is over. */
+static void aws_dynamo_async_retry(void *arg) {
+	struct aws_dynamo_async_ctx *ctx = arg;
+
+	if (aws_dynamo_async_start(ctx) == -1) {
+		aws_dynamo_async_fail(ctx);
+	}
+}
+
+static void aws_dynamo_async_complete(struct aws_handle *aws, void *http, int result, void *arg) {
+	struct aws_dynamo_async_ctx *ctx = arg;
+	struct aws_dynamo_async_response r = {
+		.rv = -1,
+		.dynamo_errno = AWS_DYNAMO_CODE_UNKNOWN,
+		.message = "",
+	};
+	char *message = NULL;
+
+	if (result == 0) {
+		r.http_code = http_get_response_code(http);
+		r.response = http_get_data(http, &r.response_len);
+
+		if (r.http_code == 200) {
+			r.rv = 0;
+			r.dynamo_errno = AWS_DYNAMO_CODE_NONE;
+			if (aws->dynamo_limiter != NULL) {
+				aws_dynamo_limiter_update(aws->dynamo_limiter, ctx->body, 0);
+			}
+			aws_retry_release(aws);
+		} else if (r.http_code == 413) {
+			Warnx("aws_dynamo_async_complete: Request Entity Too Large. Maximum item size of 1MB exceeded.");
+		} else if (r.http_code == 400 || r.http_code == 500) {
+			int retry;
+
+			retry = aws_dynamo_parse_error_response(r.response, r.response_len,
+					&message, &r.dynamo_errno);
+			if (retry < 0) {
+				Warnx("aws_dynamo_async_complete: Error evaluating error body. response='%s'",
+					r.response);
+			}
+			if (aws->dynamo_limiter != NULL &&
+			    (r.dynamo_errno == AWS_DYNAMO_CODE_PROVISIONED_THROUGHPUT_EXCEEDED_EXCEPTION ||
+			     r.dynamo_errno == AWS_DYNAMO_CODE_THROTTLING_EXCEPTION)) {
+				aws_dynamo_limiter_update(aws->dynamo_limiter, ctx->body, 1);
+			}
+
+			/* Retries wait on the engine's timer wheel, the thread
+			   goes on driving other requests meanwhile. */
+			if (retry == 1 && ctx->attempt + 1 < aws->dynamo_max_retries &&
+			    aws_retry_acquire(aws) == 0) {
+				long backoff = aws_backoff(aws, ctx->attempt);
+
+				Warnx("aws_dynamo_async_complete: '%s' will retry after %ld ms wait, attempt %d: %s %s",
+					message ? message : "unknown error", backoff / 1000,
+					ctx->attempt, ctx->target, ctx->body);
+				ctx->attempt++;
+				if (aws_async_schedule(aws, backoff / 1000,
+						aws_dynamo_async_retry, ctx) == 0) {
+					free(message);
+					return;
+				}
+				Warnx("aws_dynamo_async_complete: Failed to schedule retry.");
+			}
+			if (message != NULL) {
+				r.message = message;
+			}
+		}
+	} else {
+		Warnx("aws_dynamo_async_complete: Post failed.");
+	}
+
+	ctx->cb(aws, &r, ctx->arg);
+
+	free(message);
+	aws_dynamo_async_free(ctx);
+}
+
+int aws_dynamo_request_async(struct aws_handle *aws, const char *target,
+	const char *body, aws_dynamo_async_callback cb, void *arg) {
+	struct aws_dynamo_async_ctx *ctx;
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (ctx == NULL) {
+		Warnx("aws_dynamo_request_async: Failed to allocate context.");
+		return -1;
+	}
+	ctx->aws = aws;
+	ctx->cb = cb;
+	ctx->arg = arg;
+	ctx->target = strdup(target);
+	ctx->body = strdup(body);
+	if (ctx->target == NULL || ctx->body == NULL) {
+		Warnx("aws_dynamo_request_async: Failed to copy request.");
+		aws_dynamo_async_free(ctx);
+		return -1;
+	}
+
+	if (aws_dynamo_async_start(ctx) == -1) {
+		Warnx("aws_dynamo_request_async: Post failed.");
+		aws_dynamo_async_free(ctx);
+		return -1;
+	}
+
+	return 0;
 }
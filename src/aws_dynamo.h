@@ -98,6 +98,9 @@ enum {
 	AWS_DYNAMO_CODE_INTERNAL_FAILURE,
 	AWS_DYNAMO_CODE_INTERNAL_SERVER_ERROR,
 	AWS_DYNAMO_CODE_SERVICE_UNAVAILABLE_EXCEPTION,
+	/* Not sent by DynamoDB, see aws_set_timeout(). */
+	AWS_DYNAMO_CODE_DEADLINE_EXCEEDED,
+	AWS_DYNAMO_CODE_CANCELLED,
 };
 
 #define AWS_DYNAMO_JSON_RESPONSES			"Responses"
@@ -124,6 +127,14 @@ enum {
 #define AWS_DYNAMO_JSON_TYPE_NULL			"NULL"
 #define AWS_DYNAMO_JSON_TYPE_BINARY_SET			"BS"
 
+/* Keys of DynamoDB_20120810 responses. */
+#define AWS_DYNAMO_JSON_V2_CONSUMED_CAPACITY	"ConsumedCapacity"
+#define AWS_DYNAMO_JSON_V2_CAPACITY_UNITS		"CapacityUnits"
+#define AWS_DYNAMO_JSON_V2_READ_CAPACITY_UNITS	"ReadCapacityUnits"
+#define AWS_DYNAMO_JSON_V2_WRITE_CAPACITY_UNITS	"WriteCapacityUnits"
+#define AWS_DYNAMO_JSON_V2_GLOBAL_SECONDARY_INDEXES	"GlobalSecondaryIndexes"
+#define AWS_DYNAMO_JSON_V2_LOCAL_SECONDARY_INDEXES	"LocalSecondaryIndexes"
+
 #define AWS_DYNAMO_JSON_TABLE_DESCRIPTION "TableDescription"
 #define AWS_DYNAMO_JSON_TABLE "Table"
 #define AWS_DYNAMO_JSON_TABLE_NAMES "TableNames"
@@ -170,6 +181,15 @@ enum aws_dynamo_attribute_type {
 	AWS_DYNAMO_STRING_SET = 1,
 	AWS_DYNAMO_NUMBER = 2,
 	AWS_DYNAMO_NUMBER_SET = 3,
+
+	/* The DynamoDB_20120810 types, only found in items parsed from v2
+		responses, see aws_dynamo_v2.h. */
+	AWS_DYNAMO_BINARY = 4,
+	AWS_DYNAMO_BINARY_SET = 5,
+	AWS_DYNAMO_BOOLEAN = 6,
+	AWS_DYNAMO_NULL = 7,
+	AWS_DYNAMO_LIST = 8,
+	AWS_DYNAMO_MAP = 9,
 };
 
 enum aws_dynamo_number_type {
@@ -198,6 +218,33 @@ struct aws_dynamo_number_set {
 	struct aws_dynamo_number *numbers;
 };
 
+/* Binary values are base64 decoded. */
+struct aws_dynamo_binary {
+	size_t len;
+	unsigned char *data;
+};
+
+struct aws_dynamo_binary_set {
+	int num_binaries;
+	struct aws_dynamo_binary *binaries;
+};
+
+struct aws_dynamo_attribute;
+
+/* The values of a list have no names, their types are those in the
+	response. */
+struct aws_dynamo_list {
+	int num_values;
+	struct aws_dynamo_attribute *values;
+};
+
+/* The members of a map are named by their keys, in the order of the
+	response. */
+struct aws_dynamo_map {
+	int num_attributes;
+	struct aws_dynamo_attribute *attributes;
+};
+
 /* XXX: A long long int isn't big enough in general but it
    is big enough for our intended use. */
 typedef signed long long int aws_dynamo_integer_t;
@@ -212,6 +259,11 @@ struct aws_dynamo_number {
 		is used to represent these numbers as best we can. */
 
 	enum aws_dynamo_number_type type;
+
+	/* 'value' points at the number, NULL while it is unset.  Numbers
+		parsed or copied by this library own their storage: it comes
+		from the response's arena when it has one, otherwise from
+		malloc() and is released by aws_dynamo_free_attributes(). */
 	union {
 		aws_dynamo_integer_t *integer_val;
 
@@ -220,6 +272,42 @@ struct aws_dynamo_number {
 	} value;
 };
 
+struct aws_arena;
+
+/**
+ * aws_dynamo_number_set_integer - store an integer in a number
+ * @arena: arena to allocate the value from, NULL for malloc()
+ * @number: number, its type is set to AWS_DYNAMO_NUMBER_INTEGER
+ * @i: value
+ * Returns: 0 on success, -1 on failure with @number unchanged
+ */
+int aws_dynamo_number_set_integer(struct aws_arena *arena,
+	struct aws_dynamo_number *number, aws_dynamo_integer_t i);
+
+/**
+ * aws_dynamo_number_set_double - store a double in a number
+ * @arena: arena to allocate the value from, NULL for malloc()
+ * @number: number, its type is set to AWS_DYNAMO_NUMBER_DOUBLE
+ * @d: value
+ * Returns: 0 on success, -1 on failure with @number unchanged
+ */
+int aws_dynamo_number_set_double(struct aws_arena *arena,
+	struct aws_dynamo_number *number, aws_dynamo_double_t d);
+
+/**
+ * aws_dynamo_number_get_integer - read a number as an integer
+ * @number: number
+ * Returns: the value, a double truncated, 0 if @number is unset
+ */
+aws_dynamo_integer_t aws_dynamo_number_get_integer(const struct aws_dynamo_number *number);
+
+/**
+ * aws_dynamo_number_get_double - read a number as a double
+ * @number: number
+ * Returns: the value, 0 if @number is unset
+ */
+aws_dynamo_double_t aws_dynamo_number_get_double(const struct aws_dynamo_number *number);
+
 struct aws_dynamo_attribute {
 
 	/* The name of the attribute. */
@@ -229,16 +317,22 @@ struct aws_dynamo_attribute {
 		to quickly determine an attribute name match. */
 	int name_len;
 
-	/* The DynamoDB type: Number, Number Set, String, String Set. */
+	/* The DynamoDB type: Number, Number Set, String, String Set, or one
+		of the v2 types. */
 	enum aws_dynamo_attribute_type type;
 
 	/* The value for the attribute. 'type' above determines
-		which entry in the union is used. */
+		which entry in the union is used.  Null has no value. */
 	union {
 		char *string;
 		struct aws_dynamo_number number;
 		struct aws_dynamo_string_set string_set;
 		struct aws_dynamo_number_set number_set;
+		struct aws_dynamo_binary binary;
+		struct aws_dynamo_binary_set binary_set;
+		int boolean;
+		struct aws_dynamo_list list;
+		struct aws_dynamo_map map;
 	} value;
 
 };
@@ -264,11 +358,43 @@ int aws_dynamo_request(struct aws_handle *aws, const char *target, const char *b
 void aws_dynamo_free_attributes(struct aws_dynamo_attribute *attributes,
 	int num_attributes);
 
+/* As aws_dynamo_free_attributes(), leaving the array itself alone. */
+void aws_dynamo_free_attribute_values(struct aws_dynamo_attribute *attributes,
+	int num_attributes);
+
 void aws_dynamo_dump_attributes(struct aws_dynamo_attribute *attributes,
 	int num_attributes);
 
 int aws_dynamo_parse_attribute_value(struct aws_dynamo_attribute *attribute, const unsigned char *val,  size_t len);
 
+/* As aws_dynamo_parse_attribute_value(), allocating the value from 'arena'
+   unless it is NULL. */
+int aws_dynamo_parse_attribute_value_arena(struct aws_arena *arena,
+	struct aws_dynamo_attribute *attribute, const unsigned char *val,  size_t len);
+
+struct http_body;
+
+/* As aws_dynamo_parse_attribute_value_arena(), strings that lie in 'body'
+   are terminated in place and borrowed rather than copied. */
+int aws_dynamo_parse_attribute_value_borrow(struct aws_arena *arena,
+	const struct http_body *body, struct aws_dynamo_attribute *attribute,
+	const unsigned char *val, size_t len);
+
+/* Copy a string into 'arena', or borrow it if it lies in 'body'. */
+char *aws_dynamo_strndup_borrow(struct aws_arena *arena,
+	const struct http_body *body, const unsigned char *val, size_t len);
+
+/* Allocate 'count' items that share one 'count' x 'num_attributes' block of
+   attributes, each row a copy of the template 'attributes'.  Returns 0 on
+   success, -1 on failure. */
+int aws_dynamo_alloc_item_matrix(struct aws_arena *arena, int count,
+	const struct aws_dynamo_attribute *attributes, int num_attributes,
+	struct aws_dynamo_item **items, struct aws_dynamo_attribute **matrix);
+
+/* Free the values and the block of a heap allocated item matrix. */
+void aws_dynamo_free_item_matrix(struct aws_dynamo_attribute *matrix, int count,
+	int num_attributes);
+
 /* Begin public interface. */
 
 void aws_dynamo_set_max_retries(struct aws_handle *aws, int dynamo_max_retries);
@@ -304,7 +430,94 @@ int aws_dynamo_set_endpoint(struct aws_handle *aws, const char *host, const char
  */
 void aws_dynamo_set_port(struct aws_handle *aws, int port);
 
+/* Parse Query, Scan and BatchGetItem responses as they are received rather
+   than after the whole body has been buffered. */
+#define AWS_DYNAMO_PARSE_STREAM		0x1
+/* Allocate everything in a Query, Scan or BatchGetItem response from a few
+   large blocks owned by the response, freed all at once with it. */
+#define AWS_DYNAMO_PARSE_ARENA		0x2
+/* Keep the body of a Query, Scan or BatchGetItem response alive with it and
+   point strings into the body rather than copying them.  Implies
+   AWS_DYNAMO_PARSE_ARENA, ignored with AWS_DYNAMO_PARSE_STREAM. */
+#define AWS_DYNAMO_PARSE_BORROW		0x4
+/* Skip keys a parser does not know, and attributes missing from the
+   template, instead of failing the response. */
+#define AWS_DYNAMO_PARSE_SKIP_UNKNOWN	0x8
+
+/**
+ * aws_dynamo_set_parse_flags() - Select how responses are parsed.
+ * @aws:	Library handle.
+ * @flags:	AWS_DYNAMO_PARSE_* flags, 0 for the defaults
+ *
+ * With AWS_DYNAMO_PARSE_STREAM set a large response never has to be held
+ * in memory in its JSON form, and parsing overlaps with the transfer.
+ *
+ * With AWS_DYNAMO_PARSE_ARENA set the items, attributes and strings of a
+ * response are bump allocated and freeing the response costs one free()
+ * per block instead of one per value.  The response must then be treated
+ * as a whole: its parts cannot be freed or resized on their own, use
+ * aws_dynamo_copy_item() to keep an item beyond the response.
+ *
+ * AWS_DYNAMO_PARSE_BORROW goes further for readers that look at a few
+ * values of each item: the response holds a reference to its HTTP body and
+ * string values, string set members and last evaluated keys are nul
+ * terminated in place in the body instead of being copied out of it.  Only
+ * strings with JSON escapes in them are copied.  The same rules as for an
+ * arena apply.
+ *
+ * With AWS_DYNAMO_PARSE_SKIP_UNKNOWN set the parsers of responses with
+ * items pass over what they were not asked for: keys of the response new
+ * to this library, tables not asked for and item attributes not in the
+ * template.  Their values are scanned past without being decoded, so wide
+ * items can be read through a small template without an AttributesToGet
+ * in every request.  The aws_dynamo_parse_*_response() functions, which
+ * have no handle, stay strict.
+ */
+void aws_dynamo_set_parse_flags(struct aws_handle *aws, int flags);
+
+/**
+ * aws_dynamo_set_rate_limit() - Pace requests to stay under the
+ *	provisioned throughput.
+ * @aws:	Library handle.
+ * @initial_rate:	requests per second allowed per table to start with,
+ *		0 to turn rate limiting off
+ * @max_rate:	highest rate to grow to, 0 for no limit
+ *
+ * Requests are paced per table by a token bucket shared by all threads
+ * using the handle.  The rate of a table is halved when DynamoDB throttles
+ * a request to it and grows slowly while requests succeed, so that
+ * clients settle near the provisioned rate.  Off by default.  Must be
+ * set before the handle is shared between threads.
+ *
+ * Requests started with aws_dynamo_request_async() are paced by the same
+ * buckets and feed the rate back in the same way.  Submitting one does not
+ * block: a request that has to wait is sent from a timer by
+ * aws_async_perform() once its turn comes.
+ *
+ * Return: 0 on success, -1 on failure to allocate the limiter.
+ */
+int aws_dynamo_set_rate_limit(struct aws_handle *aws, double initial_rate,
+	double max_rate);
+
+/**
+ * aws_dynamo_get_message() - Get the message of the last DynamoDB error.
+ * @aws:	Library handle.
+ *
+ * The error state is kept per thread, this returns the message for the last
+ * request made by the calling thread.
+ *
+ * Returns: the error message, an empty string if there was no error.
+ */
 char *aws_dynamo_get_message(struct aws_handle *aws);
+
+/**
+ * aws_dynamo_get_errno() - Get the code of the last DynamoDB error.
+ * @aws:	Library handle.
+ *
+ * Like aws_dynamo_get_message() this is per thread.
+ *
+ * Returns: AWS_DYNAMO_CODE_* code of the calling thread's last request.
+ */
 int aws_dynamo_get_errno(struct aws_handle *aws);
 
 struct aws_dynamo_item *aws_dynamo_copy_item(struct aws_dynamo_item *item);
@@ -313,22 +526,81 @@ void aws_dynamo_free_item(struct aws_dynamo_item *item);
 
 #include "aws_dynamo_batch_get_item.h"
 #include "aws_dynamo_batch_write_item.h"
+#include "aws_dynamo_builder.h"
+#include "aws_dynamo_columns.h"
 #include "aws_dynamo_create_table.h"
 #include "aws_dynamo_delete_item.h"
 #include "aws_dynamo_delete_table.h"
 #include "aws_dynamo_describe_table.h"
+#include "aws_dynamo_foreach.h"
 #include "aws_dynamo_get_item.h"
+#include "aws_dynamo_lazy.h"
 #include "aws_dynamo_list_tables.h"
+#include "aws_dynamo_pages.h"
+#include "aws_dynamo_prepared.h"
 #include "aws_dynamo_put_item.h"
 #include "aws_dynamo_query.h"
 #include "aws_dynamo_scan.h"
 #include "aws_dynamo_update_item.h"
 #include "aws_dynamo_update_table.h"
+#include "aws_dynamo_v2.h"
 
 int aws_dynamo_layer1_request(struct aws_handle *aws, const char *target, const char *body);
 
 const char *aws_dynamo_layer1_get_response(struct aws_handle *aws, int *response_len);
 
+/**
+ * struct aws_dynamo_async_response - result of an asynchronous request
+ * @rv: 0 on success, -1 on failure
+ * @http_code: HTTP response code, 0 if no response was received
+ * @dynamo_errno: AWS_DYNAMO_CODE_* error code
+ * @message: DynamoDB error message, empty if there is none
+ * @response: response body, only valid until the callback returns
+ * @response_len: length of @response
+ */
+struct aws_dynamo_async_response {
+	int rv;
+	int http_code;
+	int dynamo_errno;
+	const char *message;
+	const char *response;
+	int response_len;
+};
+
+/**
+ * aws_dynamo_async_callback - called when an asynchronous request completes
+ * @aws: Library handle.
+ * @response: result of the request.
+ * @arg: argument given to aws_dynamo_request_async().
+ *
+ * A successful response body can be parsed with the matching
+ * aws_dynamo_parse_*_response() function, e.g.
+ * aws_dynamo_parse_get_item_response().
+ */
+typedef void (*aws_dynamo_async_callback)(struct aws_handle *aws,
+	const struct aws_dynamo_async_response *response, void *arg);
+
+/**
+ * aws_dynamo_request_async() - Start a DynamoDB request without waiting.
+ * @aws:	Library handle.
+ * @target:	DynamoDB target, e.g. AWS_DYNAMO_GET_ITEM.
+ * @body:	JSON request body, copied before this returns.
+ * @cb:		function called when the request completes.
+ * @arg:	argument passed to @cb.
+ *
+ * Any number of requests can be in flight on one handle, they share the
+ * handle's keep-alive connections.  Requests make progress, and @cb is
+ * called, only from within aws_async_perform(), so a typical caller
+ * submits a batch of requests and then calls aws_async_perform() until it
+ * returns 0.  It must do so before it exits or calls aws_deinit(), requests
+ * still pending then are dropped without calling @cb and leak their copy
+ * of @body.
+ *
+ * Returns: 0 if the request was started, -1 on failure.
+ */
+int aws_dynamo_request_async(struct aws_handle *aws, const char *target,
+	const char *body, aws_dynamo_async_callback cb, void *arg);
+
 #ifdef  __cplusplus
 }
 #endif
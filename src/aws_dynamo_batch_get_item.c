@@ -27,12 +27,19 @@
 #include "http.h"
 #include "aws_dynamo.h"
 #include "aws_dynamo_batch_get_item.h"
+#include "aws_dynamo_stream.h"
+#include "aws_arena.h"
+#include "aws_dynamo_template.h"
+#include "aws_dynamo_tokenizer.h"
 
 // TODO: Add support for "UnprocessedKeys".  The parse succeeds now when the
 // keys are empty but anything inside the unprocessed keys will trigger an
 // error.  We should have some way of storing the unprocessed keys so that
 // they can be used in a subsequant request.
 
+/* Initial capacity of the item array of a table. */
+#define BATCH_GET_ITEM_MIN_ITEMS	8
+
 enum {
 	PARSER_STATE_NONE,
 	PARSER_STATE_ROOT_MAP,
@@ -66,6 +73,19 @@ struct batch_get_item_ctx {
 	struct aws_dynamo_batch_get_item_response_table *tables;
 	int num_tables;
 
+	/* The attribute templates of the tables compiled for lookups. */
+	struct aws_dynamo_template *templates;
+
+	/* AWS_DYNAMO_PARSE_* flags and the expected size of the response. */
+	int flags;
+	size_t size_hint;
+
+	/* Body strings are borrowed from with AWS_DYNAMO_PARSE_BORROW. */
+	struct http_body *body;
+
+	/* Unknown keys skipped with AWS_DYNAMO_PARSE_SKIP_UNKNOWN. */
+	struct aws_dynamo_skip skip;
+
 	int parser_state;
 };
 
@@ -81,6 +101,10 @@ static int batch_get_item_number(void *ctx, const char *val, unsigned int len)
 	      _ctx->parser_state);
 #endif				/* DEBUG_PARSER */
 
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_SCALAR)) {
+		return 1;
+	}
+
 	table = &(_ctx->r->tables[_ctx->table_index]);
 
 	switch (_ctx->parser_state) {
@@ -121,13 +145,18 @@ static int batch_get_item_string(void *ctx, const unsigned char *val,
 	      _ctx->parser_state);
 #endif				/* DEBUG_PARSER */
 
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_SCALAR)) {
+		return 1;
+	}
+
 	table = &(_ctx->r->tables[_ctx->table_index]);
 	item = &(table->items[_ctx->item_index]);
 	attribute = &(item->attributes[_ctx->attribute_index]);
 
 	switch (_ctx->parser_state) {
 	case PARSER_STATE_ATTRIBUTE_VALUE:{
-			if (aws_dynamo_parse_attribute_value(attribute, val, len) != 1) {
+			if (aws_dynamo_parse_attribute_value_borrow(_ctx->r->arena, _ctx->body,
+				attribute, val, len) != 1) {
 				Warnx("get_item_string - attribute parse failed, table %d (%s) item %d, attribute %d",
 					_ctx->table_index, table->name, _ctx->item_index, _ctx->attribute_index);
 				return 0;
@@ -156,6 +185,10 @@ static int batch_get_item_start_map(void *ctx)
 	Debug("batch_get_item_start_map, enter state %d", _ctx->parser_state);
 #endif				/* DEBUG_PARSER */
 
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_START)) {
+		return 1;
+	}
+
 	switch (_ctx->parser_state) {
 	case PARSER_STATE_NONE:{
 			_ctx->parser_state = PARSER_STATE_ROOT_MAP;
@@ -177,21 +210,28 @@ static int batch_get_item_start_map(void *ctx)
 
 			table = &(_ctx->r->tables[_ctx->table_index]);
 
-			items = calloc(_ctx->item_index + 2, sizeof(*items));
-
-			if (items == NULL) {
-				Warnx("batch_get_item_start_map - item alloc failed");
-				return 0;
+			/* The item array doubles in size whenever the number of
+			   items reaches a power of two. */
+			if (table->num_items == 0 ||
+			    (table->num_items >= BATCH_GET_ITEM_MIN_ITEMS &&
+			     (table->num_items & (table->num_items - 1)) == 0)) {
+				int size = table->num_items < BATCH_GET_ITEM_MIN_ITEMS ?
+					BATCH_GET_ITEM_MIN_ITEMS : table->num_items * 2;
+
+				items = aws_arena_realloc(_ctx->r->arena, table->items,
+					sizeof(*items) * table->num_items,
+					sizeof(*items) * size);
+				if (items == NULL) {
+					Warnx("batch_get_item_start_map - item alloc failed");
+					return 0;
+				}
+				table->items = items;
 			}
 
-			memcpy(items, table->items,
-			       sizeof(*items) * (_ctx->item_index + 1));
-
-			attributes =
-			    malloc(sizeof(*attributes) * table->num_attributes);
+			attributes = aws_arena_alloc(_ctx->r->arena,
+			    sizeof(*attributes) * table->num_attributes);
 			if (attributes == NULL) {
 				Warnx("batch_get_item_start_map - attributes alloc failed");
-				free(items);
 				return 0;
 			}
 			_ctx->item_index++;
@@ -199,8 +239,6 @@ static int batch_get_item_start_map(void *ctx)
 			/* Set expected types for attributes. */
 			memcpy(attributes, table->attributes,
 			       sizeof(*attributes) * table->num_attributes);
-			free(table->items);
-			table->items = items;
 			table->num_items++;
 			table->items[_ctx->item_index].attributes = attributes;
 			table->items[_ctx->item_index].num_attributes =
@@ -243,12 +281,18 @@ static int batch_get_item_map_key(void *ctx, const unsigned char *val,
 	      _ctx->parser_state);
 #endif				/* DEBUG_PARSER */
 
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_KEY)) {
+		return 1;
+	}
+
 	switch (_ctx->parser_state) {
 	case PARSER_STATE_ROOT_MAP:{
 			if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_RESPONSES, val, len)) {
 				_ctx->parser_state = PARSER_STATE_RESPONSES_KEY;
 			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_UNPROCESSED_KEYS, val, len)) {
 				_ctx->parser_state = PARSER_STATE_UNPROCESSED_KEY;
+			} else if (_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+				return aws_dynamo_skip_start(&(_ctx->skip));
 			} else {
 				char key[len + 1];
 				snprintf(key, len + 1, "%s", val);
@@ -276,6 +320,10 @@ static int batch_get_item_map_key(void *ctx, const unsigned char *val,
 			}
 			if (table == _ctx->num_tables) {
 				char table[len + 1];
+
+				if (_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+					return aws_dynamo_skip_start(&(_ctx->skip));
+				}
 				snprintf(table, len + 1, "%s", val);
 
 				Warnx("batch_get_item_map_key: Unknown table '%s'.", table);
@@ -293,6 +341,8 @@ static int batch_get_item_map_key(void *ctx, const unsigned char *val,
 			} else
 			    if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_CONSUMED_CAPACITY, val, len)) {
 				_ctx->parser_state = PARSER_STATE_CAPACITY_KEY;
+			} else if (_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+				return aws_dynamo_skip_start(&(_ctx->skip));
 			} else {
 				char key[len + 1];
 				snprintf(key, len + 1, "%s", val);
@@ -304,25 +354,14 @@ static int batch_get_item_map_key(void *ctx, const unsigned char *val,
 		}
 	case PARSER_STATE_ITEM_MAP:{
 			/* Set the attribute index based on the name. */
-			int attribute;
-			struct aws_dynamo_batch_get_item_response_table *table;
-
-			table = &(_ctx->tables[_ctx->table_index]);
-
-			for (attribute = 0; attribute < table->num_attributes;
-			     attribute++) {
-				struct aws_dynamo_attribute *a =
-				    &(table->attributes[attribute]);
+			_ctx->attribute_index = aws_dynamo_template_lookup(
+				&(_ctx->templates[_ctx->table_index]), val, len);
+			if (_ctx->attribute_index == -1) {
+				char attr[len + 1];
 
-				if (len == a->name_len
-				    && strncmp(val, a->name, len) == 0) {
-					_ctx->attribute_index = attribute;
-					break;
+				if (_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+					return aws_dynamo_skip_start(&(_ctx->skip));
 				}
-			}
-
-			if (attribute == table->num_attributes) {
-				char attr[len + 1];
 				snprintf(attr, len + 1, "%s", val);
 
 				Warnx("batch_get_item_map_key: Unknown attribute '%s'.", attr);
@@ -333,22 +372,15 @@ static int batch_get_item_map_key(void *ctx, const unsigned char *val,
 		}
 	case PARSER_STATE_ATTRIBUTE_MAP:{
 			/* verify the attribute is of the expected type. */
-			struct aws_dynamo_batch_get_item_response_table *table;
-			struct aws_dynamo_attribute *a;
-			const char *expected_type;
-
-			table = &(_ctx->tables[_ctx->table_index]);
-
-			a = &(table->attributes[_ctx->attribute_index]);
-			expected_type = aws_dynamo_attribute_types[a->type];
-
-			if (len != strlen(expected_type)
-			    || strncmp(val, expected_type, len) != 0) {
+			if (!aws_dynamo_template_check_type(&(_ctx->templates[_ctx->table_index]),
+				_ctx->attribute_index, val, len)) {
+				struct aws_dynamo_attribute *a;
 				char type[len + 1];
 				snprintf(type, len + 1, "%s", val);
 
+				a = &(_ctx->tables[_ctx->table_index].attributes[_ctx->attribute_index]);
 				Warnx("batch_get_item_map_key: Unexpected type for attribute %s.  Got %s, expected %s.",
-					a->name, type, expected_type);
+					a->name, type, aws_dynamo_attribute_types[a->type]);
 				return 0;
 			}
 			_ctx->parser_state = PARSER_STATE_ATTRIBUTE_VALUE;
@@ -374,6 +406,10 @@ static int batch_get_item_end_map(void *ctx)
 	Debug("batch_get_item_end_map enter %d", _ctx->parser_state);
 #endif				/* DEBUG_PARSER */
 
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_END)) {
+		return 1;
+	}
+
 	switch (_ctx->parser_state) {
 	case PARSER_STATE_ATTRIBUTE_VALUE:{
 			_ctx->parser_state = PARSER_STATE_ITEM_MAP;
@@ -420,6 +456,10 @@ static int batch_get_item_start_array(void *ctx)
 	Debug("batch_get_item_start_array enter %d", _ctx->parser_state);
 #endif				/* DEBUG_PARSER */
 
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_START)) {
+		return 1;
+	}
+
 	switch (_ctx->parser_state) {
 	case PARSER_STATE_ITEMS_KEY:{
 			_ctx->parser_state = PARSER_STATE_ITEMS_ARRAY;
@@ -450,6 +490,10 @@ static int batch_get_item_end_array(void *ctx)
 	Debug("batch_get_item_end_array enter %d", _ctx->parser_state);
 #endif				/* DEBUG_PARSER */
 
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_END)) {
+		return 1;
+	}
+
 	switch (_ctx->parser_state) {
 	case PARSER_STATE_ITEMS_ARRAY:{
 			_ctx->parser_state = PARSER_STATE_TABLE_MAP;
@@ -483,56 +527,195 @@ static yajl_callbacks batch_get_item_callbacks = {
 	.yajl_end_array = batch_get_item_end_array,
 };
 
-struct aws_dynamo_batch_get_item_response * aws_dynamo_parse_batch_get_item_response(const unsigned char *response, int response_len, struct aws_dynamo_batch_get_item_response_table
-*tables, int num_tables)
+/* Compile the attribute template of each table. */
+static int batch_get_item_compile(struct batch_get_item_ctx *_ctx)
+{
+	int table;
+
+	_ctx->templates = calloc(_ctx->num_tables, sizeof(*(_ctx->templates)));
+	if (_ctx->templates == NULL) {
+		Warnx("batch_get_item_compile: template alloc failed.");
+		return -1;
+	}
+
+	for (table = 0; table < _ctx->num_tables; table++) {
+		aws_dynamo_template_init(&(_ctx->templates[table]),
+			_ctx->tables[table].attributes, _ctx->tables[table].num_attributes);
+	}
+
+	return 0;
+}
+
+static void batch_get_item_release(struct batch_get_item_ctx *_ctx)
+{
+	int table;
+
+	if (_ctx->templates == NULL) {
+		return;
+	}
+
+	for (table = 0; table < _ctx->num_tables; table++) {
+		aws_dynamo_template_deinit(&(_ctx->templates[table]));
+	}
+	free(_ctx->templates);
+	_ctx->templates = NULL;
+}
+
+/* Start a new response, dropping any from an earlier parse. */
+static int batch_get_item_reset(void *ctx)
+{
+	struct batch_get_item_ctx *_ctx = (struct batch_get_item_ctx *)ctx;
+
+	struct aws_arena *arena = NULL;
+
+	aws_dynamo_free_batch_get_item_response(_ctx->r);
+	_ctx->r = NULL;
+	_ctx->table_index = 0;
+	_ctx->item_index = 0;
+	_ctx->attribute_index = 0;
+	_ctx->parser_state = PARSER_STATE_NONE;
+	memset(&(_ctx->skip), 0, sizeof(_ctx->skip));
+
+	if (_ctx->flags & (AWS_DYNAMO_PARSE_ARENA | AWS_DYNAMO_PARSE_BORROW)) {
+		/* The response itself comes from its arena. */
+		arena = aws_arena_init(_ctx->size_hint);
+		if (arena == NULL) {
+			Warnx("batch_get_item_reset: arena alloc failed.");
+			return -1;
+		}
+		if (_ctx->body != NULL) {
+			if (aws_arena_defer(arena, http_body_put, _ctx->body) == -1) {
+				Warnx("batch_get_item_reset: body defer failed.");
+				aws_arena_deinit(arena);
+				return -1;
+			}
+			http_body_get(_ctx->body);
+		}
+	}
+
+	_ctx->r = aws_arena_calloc(arena, 1, sizeof(*(_ctx->r)));
+	if (_ctx->r == NULL) {
+		Warnx("batch_get_item_reset: response alloc failed.");
+		aws_arena_deinit(arena);
+		return -1;
+	}
+	_ctx->r->arena = arena;
+
+	_ctx->r->tables = aws_arena_calloc(arena, _ctx->num_tables, sizeof(*(_ctx->tables)));
+	if (_ctx->r->tables == NULL) {
+		Warnx("batch_get_item_reset: table alloc failed.");
+		aws_arena_free(arena, _ctx->r);
+		aws_arena_deinit(arena);
+		_ctx->r = NULL;
+		return -1;
+	}
+
+	_ctx->r->num_tables = _ctx->num_tables;
+	memcpy(_ctx->r->tables, _ctx->tables, sizeof(*(_ctx->tables)) * _ctx->num_tables);
+
+	return 0;
+}
+
+/**
+ * aws_dynamo_batch_get_item_parse - parse a complete batch get item response
+ * @response: response body
+ * @response_len: length of @response
+ * @tables: expected tables and their attribute templates
+ * @num_tables: number of tables in @tables
+ * @flags: AWS_DYNAMO_PARSE_* flags
+ * @body: body holding @response to borrow strings from, NULL to copy them
+ * Returns: response, NULL on failure
+ */
+static struct aws_dynamo_batch_get_item_response *aws_dynamo_batch_get_item_parse(const unsigned char *response,
+	int response_len, struct aws_dynamo_batch_get_item_response_table *tables, int num_tables, int flags,
+	struct http_body *body)
 {
-	yajl_handle hand;
-	yajl_status stat;
 	struct batch_get_item_ctx _ctx = {
 		.num_tables = num_tables,
 		.tables = tables,
+		.flags = flags,
+		.size_hint = response_len,
+		.body = body,
 	};
 
-	_ctx.r = calloc(sizeof(*(_ctx.r)), 1);
-	if (_ctx.r == NULL) {
-		Warnx("aws_dynamo_parse_batch_get_item_response: response alloc failed.");
+	if (batch_get_item_compile(&_ctx) == -1) {
 		return NULL;
 	}
 
-	_ctx.r->tables = calloc(sizeof(*tables), num_tables);
-	if (_ctx.r->tables == NULL) {
-		Warnx("aws_dynamo_parse_batch_get_item_response: table alloc failed.");
-		free(_ctx.r);
+	if (batch_get_item_reset(&_ctx) == -1) {
+		Warnx("aws_dynamo_parse_batch_get_item_response: alloc failed.");
+		batch_get_item_release(&_ctx);
 		return NULL;
 	}
 
-	_ctx.r->num_tables = num_tables;
-	memcpy(_ctx.r->tables, tables, sizeof(*tables) * num_tables);
+	if (aws_dynamo_tokenize(&batch_get_item_callbacks, &_ctx, (const unsigned char *)response,
+		response_len) == -1) {
+		Warnx("aws_dynamo_parse_batch_get_item_response: json parse failed.");
+		batch_get_item_release(&_ctx);
+		aws_dynamo_free_batch_get_item_response(_ctx.r);
+		return NULL;
+	}
 
-#if YAJL_MAJOR == 2
-	hand = yajl_alloc(&batch_get_item_callbacks, NULL, &_ctx);
-	yajl_parse(hand, response, response_len);
-	stat = yajl_complete_parse(hand);
-#else
-	hand = yajl_alloc(&batch_get_item_callbacks, NULL, NULL, &_ctx);
-	yajl_parse(hand, response, response_len);
-	stat = yajl_parse_complete(hand);
-#endif
+	batch_get_item_release(&_ctx);
+	return _ctx.r;
+}
+
+struct aws_dynamo_batch_get_item_response * aws_dynamo_parse_batch_get_item_response(const unsigned char *response, int response_len, struct aws_dynamo_batch_get_item_response_table
+*tables, int num_tables)
+{
+	return aws_dynamo_batch_get_item_parse(response, response_len, tables,
+		num_tables, 0, NULL);
+}
 
-	if (stat != yajl_status_ok) {
-		unsigned char *str =
-		    yajl_get_error(hand, 1, response, response_len);
-		Warnx("aws_dynamo_parse_batch_get_item_response: json parse failed, '%s'", (const char *)str);
-		yajl_free_error(hand, str);
-		yajl_free(hand);
+static struct aws_dynamo_batch_get_item_response *aws_dynamo_batch_get_item_stream(struct aws_handle *aws,
+	const char *request, struct aws_dynamo_batch_get_item_response_table *tables, int num_tables)
+{
+	struct batch_get_item_ctx _ctx = {
+		.num_tables = num_tables,
+		.tables = tables,
+		.flags = aws->dynamo_parse_flags,
+	};
+
+	if (batch_get_item_compile(&_ctx) == -1) {
+		return NULL;
+	}
+
+	if (aws_dynamo_request_stream(aws, AWS_DYNAMO_BATCH_GET_ITEM, request,
+		&batch_get_item_callbacks, batch_get_item_reset, &_ctx) == -1) {
+		Warnx("aws_dynamo_batch_get_item: Failed to get or parse response.");
+		batch_get_item_release(&_ctx);
 		aws_dynamo_free_batch_get_item_response(_ctx.r);
 		return NULL;
 	}
 
-	yajl_free(hand);
+	batch_get_item_release(&_ctx);
 	return _ctx.r;
 }
 
+/* Parse the response of a request made with AWS_DYNAMO_PARSE_BORROW, the
+   response takes a reference to the body. */
+static struct aws_dynamo_batch_get_item_response *aws_dynamo_batch_get_item_borrow(struct aws_handle *aws,
+	struct aws_dynamo_batch_get_item_response_table *tables, int num_tables)
+{
+	struct http_body *body;
+	struct aws_dynamo_batch_get_item_response *r;
+
+	body = http_take_body(aws_get_http(aws));
+	if (body == NULL) {
+		Warnx("aws_dynamo_batch_get_item: Failed to get response.");
+		return NULL;
+	}
+
+	r = aws_dynamo_batch_get_item_parse(body->data, body->len, tables,
+		num_tables, aws->dynamo_parse_flags, body);
+	if (r == NULL) {
+		Warnx("aws_dynamo_batch_get_item: Failed to parse response.");
+	}
+
+	http_body_put(body);
+	return r;
+}
+
 struct aws_dynamo_batch_get_item_response *aws_dynamo_batch_get_item(struct aws_handle *aws, const char *request, struct aws_dynamo_batch_get_item_response_table *tables, int
 								     num_tables)
 {
@@ -540,23 +723,34 @@ struct aws_dynamo_batch_get_item_response *aws_dynamo_batch_get_item(struct aws_
 	int response_len;
 	struct aws_dynamo_batch_get_item_response *r;
 
+	if (aws->dynamo_parse_flags & AWS_DYNAMO_PARSE_STREAM) {
+		return aws_dynamo_batch_get_item_stream(aws, request, tables, num_tables);
+	}
+
 	if (aws_dynamo_request(aws, AWS_DYNAMO_BATCH_GET_ITEM, request) == -1) {
 		return NULL;
 	}
 
-	response = http_get_data(aws->http, &response_len);
+	if (aws->dynamo_parse_flags & AWS_DYNAMO_PARSE_BORROW) {
+		return aws_dynamo_batch_get_item_borrow(aws, tables, num_tables);
+	}
+
+	response = http_get_data(aws_get_http(aws), &response_len);
 
 	if (response == NULL) {
 		Warnx("aws_dynamo_batch_get_item: Failed to get response.");
 		return NULL;
 	}
 
-	if ((r = aws_dynamo_parse_batch_get_item_response(response, response_len,
-						      tables, num_tables)) == NULL) {
+	if ((r = aws_dynamo_batch_get_item_parse(response, response_len,
+						      tables, num_tables, aws->dynamo_parse_flags, NULL)) == NULL) {
 		Warnx("aws_dynamo_batch_get_item: Failed to parse response: '%s'", response);
+		http_release_data(aws_get_http(aws));
 		return NULL;
 	}
 
+	http_release_data(aws_get_http(aws));
+
 	return r;
 }
 
@@ -600,6 +794,12 @@ void aws_dynamo_free_batch_get_item_response(struct aws_dynamo_batch_get_item_re
 		return;
 	}
 
+	if (r->arena != NULL) {
+		/* Everything, r included, is in the arena. */
+		aws_arena_deinit(r->arena);
+		return;
+	}
+
 	for (j = 0; j < r->num_tables; j++) {
 		table = &(r->tables[j]);
 
@@ -48,6 +48,10 @@ struct aws_dynamo_batch_get_item_response {
 	int num_tables;
 	struct aws_dynamo_batch_get_item_response_table *tables;
 	char *unprocessed_keys;
+
+	/* Holds all of the above when parsed with AWS_DYNAMO_PARSE_ARENA or
+		AWS_DYNAMO_PARSE_BORROW, NULL otherwise. */
+	struct aws_arena *arena;
 };
 
 struct aws_dynamo_batch_get_item_response *aws_dynamo_parse_batch_get_item_response(const unsigned char *response, int response_len, struct aws_dynamo_batch_get_item_response_table *tables, int num_tables);
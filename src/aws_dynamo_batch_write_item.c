@@ -216,7 +216,7 @@ struct aws_dynamo_batch_write_item_response
 		return NULL;
 	}
 
-	response = http_get_data(aws->http, &response_len);
+	response = http_get_data(aws_get_http(aws), &response_len);
 
 	if (response == NULL) {
 		Warnx("aws_dynamo_batch_write_item: Failed to get response.");
@@ -225,9 +225,12 @@ struct aws_dynamo_batch_write_item_response
 
 	if ((r = aws_dynamo_parse_batch_write_item_response(response, response_len)) == NULL) {
 		Warnx("aws_dynamo_batch_write_item: Failed to parse response: '%s'", response);
+		http_release_data(aws_get_http(aws));
 		return NULL;
 	}
 
+	http_release_data(aws_get_http(aws));
+
 	return r;
 }
 
@@ -0,0 +1,1024 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "aws_dynamo_utils.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <openssl/sha.h>
+
+#include "aws_dynamo.h"
+#include "aws_dynamo_builder.h"
+#include "aws_dynamo_splice.h"
+#include "aws_sigv4.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define BUILDER_INITIAL_SIZE	1024
+
+/* A buffer grown past this by one large request is not kept for the
+   next. */
+#define BUILDER_KEEP_SIZE	(1024 * 1024)
+
+/* The body is hashed a SHA-256 block at a time as blocks are completed. */
+#define HASH_BLOCK_SIZE		64
+
+/**
+ * struct aws_dynamo_builder - request being written
+ * @buf: the request, nul terminated once finished
+ * @len: length of the request so far
+ * @size: size of @buf
+ * @hashed: bytes of @buf fed to @sha
+ * @sha: hash of the first @hashed bytes
+ * @depth: number of objects and arrays open, the request object included
+ * @arrays: bit n set if the object or array at depth n + 1 is an array
+ * @comma: the object or array open last has a member already
+ * @failed: a call failed since the builder was reset
+ * @finished: the request is complete, see aws_dynamo_builder_finish()
+ * @hash: hex encoded SHA-256 of the finished request
+ */
+struct aws_dynamo_builder {
+	char *buf;
+	size_t len;
+	size_t size;
+	size_t hashed;
+	SHA256_CTX sha;
+	int depth;
+	uint32_t arrays;
+	int comma;
+	int failed;
+	int finished;
+	char hash[AWS_SIGV4_HEX_LEN + 1];
+};
+
+/* Make room for @n more bytes and the nul. */
+static int builder_reserve(struct aws_dynamo_builder *b, size_t n)
+{
+	size_t size;
+	char *buf;
+
+	if (b->len + n < b->size) {
+		return 0;
+	}
+
+	size = b->size > 0 ? b->size : BUILDER_INITIAL_SIZE;
+	while (size <= b->len + n) {
+		size *= 2;
+	}
+
+	buf = realloc(b->buf, size);
+	if (buf == NULL) {
+		Warnx("builder_reserve: alloc failed.");
+		b->failed = 1;
+		return -1;
+	}
+	b->buf = buf;
+	b->size = size;
+
+	return 0;
+}
+
+static int builder_append(struct aws_dynamo_builder *b, const char *s, size_t n)
+{
+	if (builder_reserve(b, n) == -1) {
+		return -1;
+	}
+	memcpy(b->buf + b->len, s, n);
+	b->len += n;
+
+	return 0;
+}
+
+#define builder_append_str(b, s) builder_append(b, s, sizeof(s) - 1)
+
+#define NEEDS_ESCAPE(c) ((c) == '"' || (c) == '\\' || (c) < 0x20)
+
+/* Length of the start of @s that needs no escaping. */
+#ifdef __SSE2__
+static size_t escape_span(const unsigned char *s, size_t len)
+{
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i ctrl = _mm_set1_epi8(0x1f);
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		__m128i m;
+		int mask;
+
+		/* v <= 0x1f, unsigned */
+		m = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+			_mm_cmpeq_epi8(_mm_min_epu8(v, ctrl), v));
+		mask = _mm_movemask_epi8(m);
+		if (mask != 0) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+
+	for (; i < len && !NEEDS_ESCAPE(s[i]); i++) {
+	}
+
+	return i;
+}
+#else
+#define ONES	0x0101010101010101ULL
+#define HIGHS	0x8080808080808080ULL
+/* Any byte of x below n, for n <= 0x80. */
+#define HAS_LESS(x, n)	(((x) - ONES * (n)) & ~(x) & HIGHS)
+
+static size_t escape_span(const unsigned char *s, size_t len)
+{
+	size_t i;
+
+	/* Eight bytes at a time while none of them needs escaping. */
+	for (i = 0; i + 8 <= len; i += 8) {
+		uint64_t v;
+
+		memcpy(&v, s + i, sizeof(v));
+		if (HAS_LESS(v, 0x20) || HAS_LESS(v ^ (ONES * '"'), 1) ||
+		    HAS_LESS(v ^ (ONES * '\\'), 1)) {
+			break;
+		}
+	}
+
+	for (; i < len && !NEEDS_ESCAPE(s[i]); i++) {
+	}
+
+	return i;
+}
+#endif
+
+/* Append @s as a JSON string. */
+static int builder_escape(struct aws_dynamo_builder *b, const char *s, size_t len)
+{
+	static const char hex[] = "0123456789abcdef";
+	unsigned char c;
+	char *p;
+	size_t n;
+
+	if (builder_reserve(b, len + 2) == -1) {
+		return -1;
+	}
+	b->buf[b->len++] = '"';
+
+	for (;;) {
+		n = escape_span((const unsigned char *)s, len);
+		/* The run, an escape of up to six bytes and the closing quote. */
+		if (builder_reserve(b, n + 7) == -1) {
+			return -1;
+		}
+		memcpy(b->buf + b->len, s, n);
+		b->len += n;
+		s += n;
+		len -= n;
+		if (len == 0) {
+			break;
+		}
+
+		c = *s++;
+		len--;
+		p = b->buf + b->len;
+		p[0] = '\\';
+		switch (c) {
+			case '"':
+			case '\\': {
+				p[1] = c;
+				b->len += 2;
+				break;
+			}
+			case '\n': {
+				p[1] = 'n';
+				b->len += 2;
+				break;
+			}
+			case '\r': {
+				p[1] = 'r';
+				b->len += 2;
+				break;
+			}
+			case '\t': {
+				p[1] = 't';
+				b->len += 2;
+				break;
+			}
+			default: {
+				p[1] = 'u';
+				p[2] = '0';
+				p[3] = '0';
+				p[4] = hex[c >> 4];
+				p[5] = hex[c & 0xf];
+				b->len += 6;
+				break;
+			}
+		}
+	}
+
+	b->buf[b->len++] = '"';
+
+	return 0;
+}
+
+static int builder_escape_str(struct aws_dynamo_builder *b, const char *s)
+{
+	if (s == NULL) {
+		Warnx("builder_escape_str: NULL string.");
+		b->failed = 1;
+		return -1;
+	}
+
+	return builder_escape(b, s, strlen(s));
+}
+
+/* Hash the blocks completed by the last call. */
+static int builder_done(struct aws_dynamo_builder *b)
+{
+	size_t n;
+
+	n = (b->len - b->hashed) & ~(size_t)(HASH_BLOCK_SIZE - 1);
+	if (n > 0) {
+		SHA256_Update(&(b->sha), b->buf + b->hashed, n);
+		b->hashed += n;
+	}
+
+	return b->failed ? -1 : 0;
+}
+
+/* Start a member of the object or array open last. */
+static int builder_member(struct aws_dynamo_builder *b, const char *name)
+{
+	int in_array;
+
+	if (b->failed) {
+		return -1;
+	}
+
+	if (b->finished) {
+		Warnx("builder_member: the request is finished.");
+		b->failed = 1;
+		return -1;
+	}
+
+	in_array = (b->arrays >> (b->depth - 1)) & 1;
+	if (in_array && name != NULL) {
+		Warnx("builder_member: array element named %s.", name);
+		b->failed = 1;
+		return -1;
+	} else if (!in_array && name == NULL) {
+		Warnx("builder_member: object member without a name.");
+		b->failed = 1;
+		return -1;
+	}
+
+	if (b->comma && builder_append_str(b, ",") == -1) {
+		return -1;
+	}
+	b->comma = 1;
+
+	if (name != NULL) {
+		if (builder_escape_str(b, name) == -1 ||
+		    builder_append_str(b, ":") == -1) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int builder_open(struct aws_dynamo_builder *b, const char *name, int array)
+{
+	if (builder_member(b, name) == -1) {
+		return -1;
+	}
+
+	if (b->depth == AWS_DYNAMO_BUILDER_MAX_DEPTH) {
+		Warnx("builder_open: too deep.");
+		b->failed = 1;
+		return -1;
+	}
+
+	if (builder_append(b, array ? "[" : "{", 1) == -1) {
+		return -1;
+	}
+	if (array) {
+		b->arrays |= (uint32_t)1 << b->depth;
+	} else {
+		b->arrays &= ~((uint32_t)1 << b->depth);
+	}
+	b->depth++;
+	b->comma = 0;
+
+	return builder_done(b);
+}
+
+static int builder_close(struct aws_dynamo_builder *b, int array)
+{
+	if (b->failed) {
+		return -1;
+	}
+
+	/* The request object is closed by aws_dynamo_builder_finish(). */
+	if (b->finished || b->depth <= 1 ||
+	    (int)((b->arrays >> (b->depth - 1)) & 1) != array) {
+		Warnx("builder_close: no %s open.", array ? "array" : "object");
+		b->failed = 1;
+		return -1;
+	}
+
+	if (builder_append(b, array ? "]" : "}", 1) == -1) {
+		return -1;
+	}
+	b->depth--;
+	b->comma = 1;
+
+	return builder_done(b);
+}
+
+/* Append @i without the overhead of printf. */
+static int builder_integer(struct aws_dynamo_builder *b, long long i)
+{
+	char digits[24];
+	char *p = digits + sizeof(digits);
+	unsigned long long u;
+
+	u = i < 0 ? -(unsigned long long)i : (unsigned long long)i;
+	do {
+		*--p = '0' + u % 10;
+		u /= 10;
+	} while (u > 0);
+	if (i < 0) {
+		*--p = '-';
+	}
+
+	return builder_append(b, p, digits + sizeof(digits) - p);
+}
+
+/* Append @d with as few digits as read back to the same value. */
+static int builder_double(struct aws_dynamo_builder *b, long double d)
+{
+	char digits[64];
+	int n;
+
+	if (!isfinite(d)) {
+		Warnx("builder_double: %Lf is not a DynamoDB number.", d);
+		b->failed = 1;
+		return -1;
+	}
+
+	n = snprintf(digits, sizeof(digits), "%.15Lg", d);
+	if (n > 0 && n < sizeof(digits) && strtold(digits, NULL) != d) {
+		n = snprintf(digits, sizeof(digits), "%.21Lg", d);
+	}
+	if (n <= 0 || n >= sizeof(digits)) {
+		Warnx("builder_double: failed to format %Lg.", d);
+		b->failed = 1;
+		return -1;
+	}
+
+	return builder_append(b, digits, n);
+}
+
+/* Append @number as a JSON string. */
+static int builder_number(struct aws_dynamo_builder *b,
+	const struct aws_dynamo_number *number)
+{
+	int rv;
+
+	if (builder_append_str(b, "\"") == -1) {
+		return -1;
+	}
+
+	switch (number->type) {
+		case AWS_DYNAMO_NUMBER_INTEGER: {
+			if (number->value.integer_val == NULL) {
+				Warnx("builder_number: number has no value.");
+				b->failed = 1;
+				return -1;
+			}
+			rv = builder_integer(b, *(number->value.integer_val));
+			break;
+		}
+		case AWS_DYNAMO_NUMBER_DOUBLE: {
+			if (number->value.double_val == NULL) {
+				Warnx("builder_number: number has no value.");
+				b->failed = 1;
+				return -1;
+			}
+			rv = builder_double(b, *(number->value.double_val));
+			break;
+		}
+		default: {
+			Warnx("builder_number: unknown number type %d.", number->type);
+			b->failed = 1;
+			return -1;
+		}
+	}
+
+	if (rv == -1) {
+		return -1;
+	}
+
+	return builder_append_str(b, "\"");
+}
+
+/* Append @binary base64 encoded, as a JSON string. */
+static int builder_binary(struct aws_dynamo_builder *b,
+	const struct aws_dynamo_binary *binary)
+{
+	static const char base64[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	const unsigned char *in = binary->data;
+	size_t len = binary->len;
+	char *p;
+
+	if (in == NULL && len > 0) {
+		Warnx("builder_binary: binary has no value.");
+		b->failed = 1;
+		return -1;
+	}
+
+	if (builder_reserve(b, (len + 2) / 3 * 4 + 2) == -1) {
+		return -1;
+	}
+
+	p = b->buf + b->len;
+	*p++ = '"';
+	for (; len >= 3; in += 3, len -= 3) {
+		*p++ = base64[in[0] >> 2];
+		*p++ = base64[(in[0] & 0x03) << 4 | in[1] >> 4];
+		*p++ = base64[(in[1] & 0x0f) << 2 | in[2] >> 6];
+		*p++ = base64[in[2] & 0x3f];
+	}
+	if (len > 0) {
+		*p++ = base64[in[0] >> 2];
+		if (len == 1) {
+			*p++ = base64[(in[0] & 0x03) << 4];
+			*p++ = '=';
+		} else {
+			*p++ = base64[(in[0] & 0x03) << 4 | in[1] >> 4];
+			*p++ = base64[(in[1] & 0x0f) << 2];
+		}
+		*p++ = '=';
+	}
+	*p++ = '"';
+	b->len = p - b->buf;
+
+	return 0;
+}
+
+/* Append the value of @attribute, such as {"S":"abc"}.  Lists and maps
+   nest at most @depth deep. */
+static int builder_attribute_value(struct aws_dynamo_builder *b,
+	const struct aws_dynamo_attribute *attribute, int depth)
+{
+	int i;
+
+	if (attribute->type < AWS_DYNAMO_STRING || attribute->type > AWS_DYNAMO_MAP) {
+		Warnx("builder_attribute_value: unknown type %d.", attribute->type);
+		b->failed = 1;
+		return -1;
+	}
+
+	if (depth == 0) {
+		Warnx("builder_attribute_value: too deep.");
+		b->failed = 1;
+		return -1;
+	}
+
+	if (builder_append_str(b, "{\"") == -1 ||
+	    builder_append(b, aws_dynamo_attribute_types[attribute->type],
+		strlen(aws_dynamo_attribute_types[attribute->type])) == -1 ||
+	    builder_append_str(b, "\":") == -1) {
+		return -1;
+	}
+
+	switch (attribute->type) {
+		case AWS_DYNAMO_STRING: {
+			if (builder_escape_str(b, attribute->value.string) == -1) {
+				return -1;
+			}
+			break;
+		}
+		case AWS_DYNAMO_NUMBER: {
+			if (builder_number(b, &(attribute->value.number)) == -1) {
+				return -1;
+			}
+			break;
+		}
+		case AWS_DYNAMO_STRING_SET: {
+			const struct aws_dynamo_string_set *set = &(attribute->value.string_set);
+
+			if (builder_append_str(b, "[") == -1) {
+				return -1;
+			}
+			for (i = 0; i < set->num_strings; i++) {
+				if ((i > 0 && builder_append_str(b, ",") == -1) ||
+				    builder_escape_str(b, set->strings[i]) == -1) {
+					return -1;
+				}
+			}
+			if (builder_append_str(b, "]") == -1) {
+				return -1;
+			}
+			break;
+		}
+		case AWS_DYNAMO_NUMBER_SET: {
+			const struct aws_dynamo_number_set *set = &(attribute->value.number_set);
+
+			if (builder_append_str(b, "[") == -1) {
+				return -1;
+			}
+			for (i = 0; i < set->n; i++) {
+				if ((i > 0 && builder_append_str(b, ",") == -1) ||
+				    builder_number(b, &(set->numbers[i])) == -1) {
+					return -1;
+				}
+			}
+			if (builder_append_str(b, "]") == -1) {
+				return -1;
+			}
+			break;
+		}
+		case AWS_DYNAMO_BINARY: {
+			if (builder_binary(b, &(attribute->value.binary)) == -1) {
+				return -1;
+			}
+			break;
+		}
+		case AWS_DYNAMO_BINARY_SET: {
+			const struct aws_dynamo_binary_set *set = &(attribute->value.binary_set);
+
+			if (builder_append_str(b, "[") == -1) {
+				return -1;
+			}
+			for (i = 0; i < set->num_binaries; i++) {
+				if ((i > 0 && builder_append_str(b, ",") == -1) ||
+				    builder_binary(b, &(set->binaries[i])) == -1) {
+					return -1;
+				}
+			}
+			if (builder_append_str(b, "]") == -1) {
+				return -1;
+			}
+			break;
+		}
+		case AWS_DYNAMO_BOOLEAN: {
+			if ((attribute->value.boolean && builder_append_str(b, "true") == -1) ||
+			    (!attribute->value.boolean && builder_append_str(b, "false") == -1)) {
+				return -1;
+			}
+			break;
+		}
+		case AWS_DYNAMO_NULL: {
+			if (builder_append_str(b, "true") == -1) {
+				return -1;
+			}
+			break;
+		}
+		case AWS_DYNAMO_LIST: {
+			const struct aws_dynamo_list *list = &(attribute->value.list);
+
+			if (builder_append_str(b, "[") == -1) {
+				return -1;
+			}
+			for (i = 0; i < list->num_values; i++) {
+				if ((i > 0 && builder_append_str(b, ",") == -1) ||
+				    builder_attribute_value(b, &(list->values[i]), depth - 1) == -1) {
+					return -1;
+				}
+			}
+			if (builder_append_str(b, "]") == -1) {
+				return -1;
+			}
+			break;
+		}
+		case AWS_DYNAMO_MAP: {
+			const struct aws_dynamo_map *map = &(attribute->value.map);
+
+			if (builder_append_str(b, "{") == -1) {
+				return -1;
+			}
+			for (i = 0; i < map->num_attributes; i++) {
+				if ((i > 0 && builder_append_str(b, ",") == -1) ||
+				    builder_escape_str(b, map->attributes[i].name) == -1 ||
+				    builder_append_str(b, ":") == -1 ||
+				    builder_attribute_value(b, &(map->attributes[i]), depth - 1) == -1) {
+					return -1;
+				}
+			}
+			if (builder_append_str(b, "}") == -1) {
+				return -1;
+			}
+			break;
+		}
+	}
+
+	return builder_append_str(b, "}");
+}
+
+struct aws_dynamo_builder *aws_dynamo_builder_new(void)
+{
+	struct aws_dynamo_builder *b;
+
+	b = calloc(1, sizeof(*b));
+	if (b == NULL) {
+		Warnx("aws_dynamo_builder_new: alloc failed.");
+		return NULL;
+	}
+
+	aws_dynamo_builder_reset(b);
+	if (b->failed) {
+		aws_dynamo_builder_free(b);
+		return NULL;
+	}
+
+	return b;
+}
+
+void aws_dynamo_builder_free(struct aws_dynamo_builder *b)
+{
+	if (b == NULL) {
+		return;
+	}
+
+	free(b->buf);
+	free(b);
+}
+
+struct aws_dynamo_builder *aws_dynamo_builder_get(struct aws_handle *aws)
+{
+	struct aws_thread_state *ts;
+
+	ts = aws_get_thread_state(aws);
+	if (ts == NULL) {
+		return NULL;
+	}
+
+	if (ts->builder == NULL) {
+		ts->builder = aws_dynamo_builder_new();
+	} else {
+		aws_dynamo_builder_reset(ts->builder);
+	}
+
+	return ts->builder;
+}
+
+void aws_dynamo_builder_reset(struct aws_dynamo_builder *b)
+{
+	if (b->size > BUILDER_KEEP_SIZE) {
+		free(b->buf);
+		b->buf = NULL;
+		b->size = 0;
+	}
+
+	b->len = 0;
+	b->hashed = 0;
+	SHA256_Init(&(b->sha));
+	b->depth = 1;
+	b->arrays = 0;
+	b->comma = 0;
+	b->failed = 0;
+	b->finished = 0;
+	b->hash[0] = '\0';
+
+	builder_append_str(b, "{");
+}
+
+int aws_dynamo_builder_object_start(struct aws_dynamo_builder *b, const char *name)
+{
+	return builder_open(b, name, 0);
+}
+
+int aws_dynamo_builder_object_end(struct aws_dynamo_builder *b)
+{
+	return builder_close(b, 0);
+}
+
+int aws_dynamo_builder_array_start(struct aws_dynamo_builder *b, const char *name)
+{
+	return builder_open(b, name, 1);
+}
+
+int aws_dynamo_builder_array_end(struct aws_dynamo_builder *b)
+{
+	return builder_close(b, 1);
+}
+
+int aws_dynamo_builder_string(struct aws_dynamo_builder *b, const char *name,
+	const char *value)
+{
+	if (builder_member(b, name) == -1 || builder_escape_str(b, value) == -1) {
+		return -1;
+	}
+
+	return builder_done(b);
+}
+
+int aws_dynamo_builder_integer(struct aws_dynamo_builder *b, const char *name,
+	long long value)
+{
+	if (builder_member(b, name) == -1 || builder_integer(b, value) == -1) {
+		return -1;
+	}
+
+	return builder_done(b);
+}
+
+int aws_dynamo_builder_boolean(struct aws_dynamo_builder *b, const char *name,
+	int value)
+{
+	if (builder_member(b, name) == -1) {
+		return -1;
+	}
+
+	if (value) {
+		builder_append_str(b, "true");
+	} else {
+		builder_append_str(b, "false");
+	}
+
+	return builder_done(b);
+}
+
+int aws_dynamo_builder_raw(struct aws_dynamo_builder *b, const char *name,
+	const char *json)
+{
+	if (builder_member(b, name) == -1 ||
+	    builder_append(b, json, strlen(json)) == -1) {
+		return -1;
+	}
+
+	return builder_done(b);
+}
+
+int aws_dynamo_builder_table(struct aws_dynamo_builder *b, const char *table)
+{
+	return aws_dynamo_builder_string(b, AWS_DYNAMO_JSON_TABLE_NAME, table);
+}
+
+int aws_dynamo_builder_value(struct aws_dynamo_builder *b, const char *name,
+	const struct aws_dynamo_attribute *attribute)
+{
+	if (builder_member(b, name) == -1 ||
+	    builder_attribute_value(b, attribute, AWS_DYNAMO_BUILDER_MAX_DEPTH) == -1) {
+		return -1;
+	}
+
+	return builder_done(b);
+}
+
+int aws_dynamo_builder_attributes(struct aws_dynamo_builder *b, const char *name,
+	const struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	int i;
+
+	if (builder_member(b, name) == -1 || builder_append_str(b, "{") == -1) {
+		return -1;
+	}
+
+	for (i = 0; i < num_attributes; i++) {
+		if ((i > 0 && builder_append_str(b, ",") == -1) ||
+		    builder_escape_str(b, attributes[i].name) == -1 ||
+		    builder_append_str(b, ":") == -1 ||
+		    builder_attribute_value(b, &(attributes[i]),
+			AWS_DYNAMO_BUILDER_MAX_DEPTH) == -1) {
+			return -1;
+		}
+		builder_done(b);
+	}
+
+	builder_append_str(b, "}");
+
+	return builder_done(b);
+}
+
+int aws_dynamo_builder_key(struct aws_dynamo_builder *b, const char *name,
+	const struct aws_dynamo_attribute *hash_key,
+	const struct aws_dynamo_attribute *range_key)
+{
+	if (builder_member(b, name) == -1 ||
+	    builder_append_str(b, "{\"" AWS_DYNAMO_JSON_HASH_KEY_ELEMENT "\":") == -1 ||
+	    builder_attribute_value(b, hash_key, 1) == -1) {
+		return -1;
+	}
+
+	if (range_key != NULL &&
+	    (builder_append_str(b, ",\"" AWS_DYNAMO_JSON_RANGE_KEY_ELEMENT "\":") == -1 ||
+	     builder_attribute_value(b, range_key, 1) == -1)) {
+		return -1;
+	}
+
+	builder_append_str(b, "}");
+
+	return builder_done(b);
+}
+
+int aws_dynamo_builder_attributes_to_get(struct aws_dynamo_builder *b,
+	const struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	int i;
+
+	if (builder_member(b, AWS_DYNAMO_JSON_ATTRIBUTES_TO_GET) == -1 ||
+	    builder_append_str(b, "[") == -1) {
+		return -1;
+	}
+
+	for (i = 0; i < num_attributes; i++) {
+		if ((i > 0 && builder_append_str(b, ",") == -1) ||
+		    builder_escape_str(b, attributes[i].name) == -1) {
+			return -1;
+		}
+	}
+
+	builder_append_str(b, "]");
+
+	return builder_done(b);
+}
+
+int aws_dynamo_builder_condition(struct aws_dynamo_builder *b, const char *name,
+	const char *op, const struct aws_dynamo_attribute *values, int num_values)
+{
+	int i;
+
+	if (builder_member(b, name) == -1 || builder_append_str(b, "{") == -1) {
+		return -1;
+	}
+
+	if (num_values > 0) {
+		if (builder_append_str(b, "\"" AWS_DYNAMO_JSON_ATTRIBUTE_VALUE_LIST "\":[") == -1) {
+			return -1;
+		}
+		for (i = 0; i < num_values; i++) {
+			if ((i > 0 && builder_append_str(b, ",") == -1) ||
+			    builder_attribute_value(b, &(values[i]),
+				AWS_DYNAMO_BUILDER_MAX_DEPTH) == -1) {
+				return -1;
+			}
+		}
+		if (builder_append_str(b, "],") == -1) {
+			return -1;
+		}
+	}
+
+	if (builder_append_str(b, "\"" AWS_DYNAMO_JSON_COMPARISON_OPERATOR "\":") == -1 ||
+	    builder_escape_str(b, op) == -1) {
+		return -1;
+	}
+
+	builder_append_str(b, "}");
+
+	return builder_done(b);
+}
+
+int aws_dynamo_builder_attribute_updates(struct aws_dynamo_builder *b,
+	const struct aws_dynamo_attribute *attributes, int num_attributes,
+	const char *action)
+{
+	int i;
+
+	if (builder_member(b, AWS_DYNAMO_JSON_ATTRIBUTE_UPDATES) == -1 ||
+	    builder_append_str(b, "{") == -1) {
+		return -1;
+	}
+
+	for (i = 0; i < num_attributes; i++) {
+		if ((i > 0 && builder_append_str(b, ",") == -1) ||
+		    builder_escape_str(b, attributes[i].name) == -1 ||
+		    builder_append_str(b, ":{\"" AWS_DYNAMO_JSON_VALUE "\":") == -1 ||
+		    builder_attribute_value(b, &(attributes[i]),
+			AWS_DYNAMO_BUILDER_MAX_DEPTH) == -1 ||
+		    builder_append_str(b, ",\"" AWS_DYNAMO_JSON_ACTION "\":") == -1 ||
+		    builder_escape_str(b, action) == -1 ||
+		    builder_append_str(b, "}") == -1) {
+			return -1;
+		}
+		builder_done(b);
+	}
+
+	builder_append_str(b, "}");
+
+	return builder_done(b);
+}
+
+void aws_dynamo_builder_prefix_init(struct aws_dynamo_builder_prefix *prefix,
+	const char *json, size_t len)
+{
+	prefix->json = json;
+	prefix->len = len;
+	SHA256_Init(&(prefix->sha));
+	SHA256_Update(&(prefix->sha), json, len);
+}
+
+int aws_dynamo_builder_start(struct aws_dynamo_builder *b,
+	const struct aws_dynamo_builder_prefix *prefix)
+{
+	aws_dynamo_builder_reset(b);
+	b->len = 0;
+	if (builder_append(b, prefix->json, prefix->len) == -1) {
+		return -1;
+	}
+	b->sha = prefix->sha;
+	b->hashed = prefix->len;
+
+	return 0;
+}
+
+int aws_dynamo_builder_splice(struct aws_dynamo_builder *b, const char *json,
+	size_t len)
+{
+	if (b->failed || b->finished) {
+		b->failed = 1;
+		return -1;
+	}
+
+	if (builder_append(b, json, len) == -1) {
+		return -1;
+	}
+
+	return builder_done(b);
+}
+
+int aws_dynamo_builder_splice_value(struct aws_dynamo_builder *b,
+	const struct aws_dynamo_attribute *attribute)
+{
+	if (b->failed || b->finished) {
+		b->failed = 1;
+		return -1;
+	}
+
+	if (builder_attribute_value(b, attribute, AWS_DYNAMO_BUILDER_MAX_DEPTH) == -1) {
+		return -1;
+	}
+
+	return builder_done(b);
+}
+
+const char *aws_dynamo_builder_finish(struct aws_dynamo_builder *b, size_t *len)
+{
+	unsigned char hash[SHA256_DIGEST_LENGTH];
+
+	if (b->failed) {
+		return NULL;
+	}
+
+	if (!b->finished) {
+		if (b->depth != 1) {
+			Warnx("aws_dynamo_builder_finish: %d objects or arrays left open.",
+				b->depth - 1);
+			b->failed = 1;
+			return NULL;
+		}
+
+		if (builder_append_str(b, "}") == -1) {
+			return NULL;
+		}
+		b->buf[b->len] = '\0';
+		b->depth = 0;
+
+		SHA256_Update(&(b->sha), b->buf + b->hashed, b->len - b->hashed);
+		b->hashed = b->len;
+		SHA256_Final(hash, &(b->sha));
+		aws_sigv4_hex_encode(hash, sizeof(hash), b->hash);
+		b->finished = 1;
+	}
+
+	if (len != NULL) {
+		*len = b->len;
+	}
+
+	return b->buf;
+}
+
+const char *aws_dynamo_builder_payload_hash(const struct aws_dynamo_builder *b,
+	const char *body)
+{
+	if (b == NULL || !b->finished || body != b->buf) {
+		return NULL;
+	}
+
+	return b->hash;
+}
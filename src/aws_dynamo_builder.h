@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AWS_DYNAMO_BUILDER_H_
+#define _AWS_DYNAMO_BUILDER_H_
+
+#include <stddef.h>
+
+#include "aws_dynamo.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A builder writes the JSON body of a request from typed values, escaping
+ * every string, into a buffer that is kept and reused from one request to
+ * the next.  The body is hashed for its SigV4 signature as it is written,
+ * so a request built in the calling thread's builder, see
+ * aws_dynamo_builder_get(), is not read again to be signed.
+ *
+ * Each call adds one member to the object or array opened last.  Members
+ * of objects are named, elements of arrays are not and are given a NULL
+ * name.  The first failing call is remembered and makes
+ * aws_dynamo_builder_finish() fail, so the calls need not be checked one
+ * by one:
+ *
+ *	b = aws_dynamo_builder_get(aws);
+ *	aws_dynamo_builder_table(b, "users");
+ *	aws_dynamo_builder_key(b, AWS_DYNAMO_JSON_KEY, &hash_key, NULL);
+ *	aws_dynamo_builder_attributes_to_get(b, attributes, num_attributes);
+ *	request = aws_dynamo_builder_finish(b, NULL);
+ *	if (request != NULL) {
+ *		r = aws_dynamo_get_item(aws, request, attributes, num_attributes);
+ *	}
+ */
+
+#define AWS_DYNAMO_JSON_KEY			"Key"
+#define AWS_DYNAMO_JSON_EXCLUSIVE_START_KEY	"ExclusiveStartKey"
+#define AWS_DYNAMO_JSON_ATTRIBUTES_TO_GET	"AttributesToGet"
+#define AWS_DYNAMO_JSON_ATTRIBUTE_UPDATES	"AttributeUpdates"
+#define AWS_DYNAMO_JSON_HASH_KEY_VALUE		"HashKeyValue"
+#define AWS_DYNAMO_JSON_RANGE_KEY_CONDITION	"RangeKeyCondition"
+#define AWS_DYNAMO_JSON_KEY_CONDITIONS		"KeyConditions"
+#define AWS_DYNAMO_JSON_ATTRIBUTE_VALUE_LIST	"AttributeValueList"
+#define AWS_DYNAMO_JSON_COMPARISON_OPERATOR	"ComparisonOperator"
+#define AWS_DYNAMO_JSON_VALUE			"Value"
+#define AWS_DYNAMO_JSON_ACTION			"Action"
+
+/* Objects and arrays nest at most this deep, the request object included. */
+#define AWS_DYNAMO_BUILDER_MAX_DEPTH	32
+
+struct aws_dynamo_builder;
+
+/**
+ * aws_dynamo_builder_new - allocate a builder
+ * Returns: a builder holding an empty request object, NULL on failure
+ */
+struct aws_dynamo_builder *aws_dynamo_builder_new(void);
+
+/**
+ * aws_dynamo_builder_free - free a builder
+ * @b: builder from aws_dynamo_builder_new(), may be NULL
+ */
+void aws_dynamo_builder_free(struct aws_dynamo_builder *b);
+
+/**
+ * aws_dynamo_builder_get - get the calling thread's builder
+ * @aws: library handle
+ * Returns: the builder, emptied, NULL on failure
+ *
+ * The builder belongs to the handle and is freed with it.  Getting it again
+ * empties it, so the body it last finished must have been sent first.
+ */
+struct aws_dynamo_builder *aws_dynamo_builder_get(struct aws_handle *aws);
+
+/**
+ * aws_dynamo_builder_reset - start a new request
+ * @b: builder
+ *
+ * The buffer is kept for the new request unless it grew unusually large.
+ */
+void aws_dynamo_builder_reset(struct aws_dynamo_builder *b);
+
+/**
+ * aws_dynamo_builder_object_start - open an object
+ * @b: builder
+ * @name: member name, NULL in an array
+ * Returns: 0 on success, -1 on failure
+ */
+int aws_dynamo_builder_object_start(struct aws_dynamo_builder *b, const char *name);
+
+/**
+ * aws_dynamo_builder_object_end - close the object opened last
+ * @b: builder
+ * Returns: 0 on success, -1 on failure
+ */
+int aws_dynamo_builder_object_end(struct aws_dynamo_builder *b);
+
+/**
+ * aws_dynamo_builder_array_start - open an array
+ * @b: builder
+ * @name: member name, NULL in an array
+ * Returns: 0 on success, -1 on failure
+ */
+int aws_dynamo_builder_array_start(struct aws_dynamo_builder *b, const char *name);
+
+/**
+ * aws_dynamo_builder_array_end - close the array opened last
+ * @b: builder
+ * Returns: 0 on success, -1 on failure
+ */
+int aws_dynamo_builder_array_end(struct aws_dynamo_builder *b);
+
+/**
+ * aws_dynamo_builder_string - add a string
+ * @b: builder
+ * @name: member name, NULL in an array
+ * @value: nul terminated string, escaped as it is written
+ * Returns: 0 on success, -1 on failure
+ */
+int aws_dynamo_builder_string(struct aws_dynamo_builder *b, const char *name,
+	const char *value);
+
+/**
+ * aws_dynamo_builder_integer - add a JSON number, such as a Limit
+ * @b: builder
+ * @name: member name, NULL in an array
+ * @value: value
+ * Returns: 0 on success, -1 on failure
+ */
+int aws_dynamo_builder_integer(struct aws_dynamo_builder *b, const char *name,
+	long long value);
+
+/**
+ * aws_dynamo_builder_boolean - add true or false, such as ConsistentRead
+ * @b: builder
+ * @name: member name, NULL in an array
+ * @value: nonzero for true
+ * Returns: 0 on success, -1 on failure
+ */
+int aws_dynamo_builder_boolean(struct aws_dynamo_builder *b, const char *name,
+	int value);
+
+/**
+ * aws_dynamo_builder_raw - add JSON written by the caller
+ * @b: builder
+ * @name: member name, NULL in an array
+ * @json: a complete JSON value, copied as it is
+ * Returns: 0 on success, -1 on failure
+ */
+int aws_dynamo_builder_raw(struct aws_dynamo_builder *b, const char *name,
+	const char *json);
+
+/**
+ * aws_dynamo_builder_table - add the TableName of the request
+ * @b: builder
+ * @table: table name
+ * Returns: 0 on success, -1 on failure
+ */
+int aws_dynamo_builder_table(struct aws_dynamo_builder *b, const char *table);
+
+/**
+ * aws_dynamo_builder_value - add an attribute value
+ * @b: builder
+ * @name: member name, NULL in an array
+ * @attribute: attribute whose value is added, such as {"S":"abc"}, its own
+ *	       name is not used
+ * Returns: 0 on success, -1 on failure
+ *
+ * Values of all types can be written, those only DynamoDB_20120810 knows
+ * included.  Binary values are base64 encoded.
+ */
+int aws_dynamo_builder_value(struct aws_dynamo_builder *b, const char *name,
+	const struct aws_dynamo_attribute *attribute);
+
+/**
+ * aws_dynamo_builder_attributes - add an object of named attribute values
+ * @b: builder
+ * @name: member name, such as AWS_DYNAMO_JSON_ITEM for a PutItem or
+ *	  AWS_DYNAMO_JSON_KEY for a DynamoDB_20120810 key
+ * @attributes: attributes, named by their own names
+ * @num_attributes: number of attributes in @attributes
+ * Returns: 0 on success, -1 on failure
+ */
+int aws_dynamo_builder_attributes(struct aws_dynamo_builder *b, const char *name,
+	const struct aws_dynamo_attribute *attributes, int num_attributes);
+
+/**
+ * aws_dynamo_builder_key - add a key of the DynamoDB_20111205 API
+ * @b: builder
+ * @name: AWS_DYNAMO_JSON_KEY or AWS_DYNAMO_JSON_EXCLUSIVE_START_KEY
+ * @hash_key: value of the HashKeyElement
+ * @range_key: value of the RangeKeyElement, NULL for a table without one
+ * Returns: 0 on success, -1 on failure
+ */
+int aws_dynamo_builder_key(struct aws_dynamo_builder *b, const char *name,
+	const struct aws_dynamo_attribute *hash_key,
+	const struct aws_dynamo_attribute *range_key);
+
+/**
+ * aws_dynamo_builder_attributes_to_get - add the AttributesToGet of a
+ *	template
+ * @b: builder
+ * @attributes: attribute template, only the names are used
+ * @num_attributes: number of attributes in @attributes
+ * Returns: 0 on success, -1 on failure
+ */
+int aws_dynamo_builder_attributes_to_get(struct aws_dynamo_builder *b,
+	const struct aws_dynamo_attribute *attributes, int num_attributes);
+
+/**
+ * aws_dynamo_builder_condition - add a condition on an attribute
+ * @b: builder
+ * @name: AWS_DYNAMO_JSON_RANGE_KEY_CONDITION for a DynamoDB_20111205 Query,
+ *	  or the attribute name within an object opened with
+ *	  AWS_DYNAMO_JSON_KEY_CONDITIONS or a ScanFilter
+ * @op: ComparisonOperator, such as "EQ" or "BETWEEN"
+ * @values: the AttributeValueList
+ * @num_values: number of values in @values, 0 for operators without any
+ * Returns: 0 on success, -1 on failure
+ */
+int aws_dynamo_builder_condition(struct aws_dynamo_builder *b, const char *name,
+	const char *op, const struct aws_dynamo_attribute *values, int num_values);
+
+/**
+ * aws_dynamo_builder_attribute_updates - add the AttributeUpdates of an
+ *	UpdateItem
+ * @b: builder
+ * @attributes: new values, named by their own names
+ * @num_attributes: number of attributes in @attributes
+ * @action: "PUT", "ADD" or "DELETE", applied to all of @attributes
+ * Returns: 0 on success, -1 on failure
+ */
+int aws_dynamo_builder_attribute_updates(struct aws_dynamo_builder *b,
+	const struct aws_dynamo_attribute *attributes, int num_attributes,
+	const char *action);
+
+/**
+ * aws_dynamo_builder_finish - close the request
+ * @b: builder
+ * @len: length of the request (out), may be NULL
+ * Returns: the nul terminated request, owned by @b, NULL if any call since
+ *	    the builder was emptied failed or left an object or array open
+ *
+ * Nothing can be added to a finished request until the builder is reset.
+ */
+const char *aws_dynamo_builder_finish(struct aws_dynamo_builder *b, size_t *len);
+
+/**
+ * aws_dynamo_builder_payload_hash - get the hash computed while writing
+ * @b: builder, may be NULL
+ * @body: a request body
+ * Returns: the hex encoded SHA-256 of @body if it is the request @b
+ *	    finished, NULL otherwise
+ */
+const char *aws_dynamo_builder_payload_hash(const struct aws_dynamo_builder *b,
+	const char *body);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* _AWS_DYNAMO_BUILDER_H_ */
@@ -0,0 +1,1154 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "aws_dynamo_utils.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <yajl/yajl_parse.h>
+
+#include "http.h"
+#include "aws_dynamo.h"
+#include "aws_dynamo_columns.h"
+#include "aws_dynamo_stream.h"
+#include "aws_arena.h"
+#include "aws_dynamo_number.h"
+#include "aws_dynamo_template.h"
+#include "aws_dynamo_tokenizer.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+	(defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define AGGREGATE_X86
+#include <immintrin.h>
+#endif
+
+/* First size of the string blob of a column. */
+#define COLUMN_BLOB_MIN		1024
+
+enum {
+	PARSER_STATE_NONE,
+	PARSER_STATE_ROOT_MAP,
+	PARSER_STATE_CAPACITY_KEY,
+	PARSER_STATE_COUNT_KEY,
+	PARSER_STATE_ITEMS_KEY,
+	PARSER_STATE_ITEMS_ARRAY,
+	PARSER_STATE_ITEM_MAP,
+	PARSER_STATE_SCANNED_COUNT_KEY,
+	PARSER_STATE_ATTRIBUTE_KEY,
+	PARSER_STATE_ATTRIBUTE_MAP,
+	PARSER_STATE_ATTRIBUTE_VALUE,
+	PARSER_STATE_LAST_EVALUATED_KEY,
+	PARSER_STATE_LAST_EVALUATED_MAP,
+	PARSER_STATE_LAST_EVALUATED_HASH_KEY_KEY,
+	PARSER_STATE_LAST_EVALUATED_HASH_KEY_MAP,
+	PARSER_STATE_LAST_EVALUATED_RANGE_KEY_KEY,
+	PARSER_STATE_LAST_EVALUATED_RANGE_KEY_MAP,
+};
+
+static const char *parser_state_strings[] = {
+	"none",
+	"root map",
+	"capacity key",
+	"count key",
+	"items key",
+	"items array",
+	"item map",
+	"scanned count key",
+	"attribute key",
+	"attribute map",
+	"attribute value",
+	"last evaluated",
+	"last evaluated map",
+	"last evaluated hash key key",
+	"last evaluated hash key map",
+	"last evaluated range key key",
+	"last evaluated range key map",
+};
+
+static const char *parser_state_string(int state) {
+	if (state < 0 || state >= sizeof(parser_state_strings) / sizeof(parser_state_strings[0])) {
+		return "invalid state";
+	} else {
+		return parser_state_strings[state];
+	}
+}
+
+struct columns_ctx {
+
+	/* Indicies into the response structure. */
+	int item_index;
+	int attribute_index;
+	struct aws_dynamo_columns *c;
+
+	/* These define the columns. */
+	struct aws_dynamo_attribute *attributes; /* attribute template */
+	int num_attributes; /* number of attributes for each item. */
+	struct aws_dynamo_template template; /* the template compiled for lookups */
+
+	/* Whether Count has been seen and the columns sized. */
+	int have_count;
+
+	/* AWS_DYNAMO_PARSE_* flags and the expected size of the response. */
+	int flags;
+	size_t size_hint;
+
+	/* Unknown keys skipped with AWS_DYNAMO_PARSE_SKIP_UNKNOWN. */
+	struct aws_dynamo_skip skip;
+
+	int parser_state;
+};
+
+/* Size the columns for the number of items in the response. */
+static int columns_alloc(struct columns_ctx *_ctx)
+{
+	struct aws_dynamo_columns *c = _ctx->c;
+	size_t count = c->count > 0 ? c->count : 1;
+	int i;
+
+	for (i = 0; i < c->num_columns; i++) {
+		struct aws_dynamo_column *column = &(c->columns[i]);
+
+		column->valid = aws_arena_calloc(c->arena, (count + 63) / 64,
+			sizeof(*(column->valid)));
+		if (column->valid == NULL) {
+			return -1;
+		}
+
+		if (column->type == AWS_DYNAMO_STRING) {
+			column->offsets = aws_arena_calloc(c->arena, count + 1,
+				sizeof(*(column->offsets)));
+			if (column->offsets == NULL) {
+				return -1;
+			}
+		} else if (column->number_type == AWS_DYNAMO_NUMBER_INTEGER) {
+			column->integers = aws_arena_calloc(c->arena, count,
+				sizeof(*(column->integers)));
+			if (column->integers == NULL) {
+				return -1;
+			}
+		} else {
+			column->doubles = aws_arena_calloc(c->arena, count,
+				sizeof(*(column->doubles)));
+			if (column->doubles == NULL) {
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* Append the string of item @item to a column. */
+static int column_set_string(struct aws_arena *arena, struct aws_dynamo_column *column,
+	int item, const unsigned char *val, size_t len)
+{
+	size_t used = column->offsets[column->filled];
+	int i;
+
+	if (used + len > UINT32_MAX) {
+		Warnx("column_set_string: column too large.");
+		return -1;
+	}
+
+	if (used + len > column->blob_size) {
+		size_t size = column->blob_size ? column->blob_size : COLUMN_BLOB_MIN;
+		char *blob;
+
+		while (size < used + len) {
+			size *= 2;
+		}
+		blob = aws_arena_realloc(arena, column->blob, column->blob_size, size);
+		if (blob == NULL) {
+			Warnx("column_set_string: blob alloc failed.");
+			return -1;
+		}
+		column->blob = blob;
+		column->blob_size = size;
+	}
+
+	/* Items without the attribute get empty strings. */
+	for (i = column->filled + 1; i <= item; i++) {
+		column->offsets[i] = used;
+	}
+	memcpy(column->blob + used, val, len);
+	column->offsets[item + 1] = used + len;
+	column->filled = item + 1;
+
+	return 0;
+}
+
+/* Set the value of item @item in a column. */
+static int column_set(struct aws_arena *arena, struct aws_dynamo_column *column,
+	int item, const unsigned char *val, size_t len)
+{
+	uint64_t bit = (uint64_t)1 << (item % 64);
+
+	if (column->valid[item / 64] & bit) {
+		Warnx("column_set: duplicate attribute.");
+		return -1;
+	}
+
+	if (column->type == AWS_DYNAMO_STRING) {
+		if (column_set_string(arena, column, item, val, len) == -1) {
+			return -1;
+		}
+	} else if (column->number_type == AWS_DYNAMO_NUMBER_INTEGER) {
+		if (aws_dynamo_number_parse_integer((const char *)val, len,
+			&(column->integers[item])) == -1) {
+			Warnx("column_set: failed to parse number");
+			return -1;
+		}
+	} else {
+		if (aws_dynamo_number_parse_double((const char *)val, len,
+			&(column->doubles[item])) == -1) {
+			Warnx("column_set: failed to parse number");
+			return -1;
+		}
+	}
+
+	column->valid[item / 64] |= bit;
+	return 0;
+}
+
+static int columns_number(void *ctx, const char *val, unsigned int len)
+{
+	struct columns_ctx *_ctx = (struct columns_ctx *) ctx;
+
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_SCALAR)) {
+		return 1;
+	}
+
+	switch (_ctx->parser_state) {
+		case PARSER_STATE_COUNT_KEY: {
+			if (_ctx->have_count) {
+				Warnx("columns_number: duplicate count.");
+				return 0;
+			}
+			if (aws_dynamo_json_get_int(val, len, &(_ctx->c->count)) == -1 ||
+				_ctx->c->count < 0) {
+				Warnx("columns_number: failed to get count int.");
+				return 0;
+			}
+			if (columns_alloc(_ctx) == -1) {
+				Warnx("columns_number: column alloc failed.");
+				return 0;
+			}
+			_ctx->have_count = 1;
+			/* We haven't started any items yet. */
+			_ctx->item_index = -1;
+			_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			break;
+		}
+		case PARSER_STATE_SCANNED_COUNT_KEY: {
+			if (aws_dynamo_json_get_int(val, len, &(_ctx->c->scanned_count)) == -1) {
+				Warnx("columns_number: failed to scanned count int.");
+				return 0;
+			}
+			_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			break;
+		}
+		case PARSER_STATE_CAPACITY_KEY: {
+			if (aws_dynamo_json_get_double(val, len, &(_ctx->c->consumed_capacity_units)) == -1) {
+				Warnx("columns_number: failed to get capacity int.");
+				return 0;
+			}
+			_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			break;
+		}
+		default: {
+			Warnx("columns_number - unexpected state '%s'", parser_state_string(_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int columns_string(void *ctx, const unsigned char *val, unsigned int len)
+{
+	struct columns_ctx *_ctx = (struct columns_ctx *) ctx;
+
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_SCALAR)) {
+		return 1;
+	}
+
+	switch (_ctx->parser_state) {
+		case PARSER_STATE_ATTRIBUTE_VALUE: {
+			if (!_ctx->have_count || _ctx->item_index == -1) {
+				Warnx("columns_string - item_index is not set, have we not gotten Count yet?");
+				return 0;
+			}
+
+			if (column_set(_ctx->c->arena, &(_ctx->c->columns[_ctx->attribute_index]),
+				_ctx->item_index, val, len) == -1) {
+				Warnx("columns_string - attribute parse failed, item %d, attribute %d",
+					_ctx->item_index, _ctx->attribute_index);
+				return 0;
+			}
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_HASH_KEY_MAP: {
+			_ctx->c->hash_key->value = aws_arena_strndup(_ctx->c->arena, (const char *)val, len);
+			if (_ctx->c->hash_key->value == NULL) {
+				Warnx("columns_string: failed to allocated last evaluated hash key value");
+				return 0;
+			}
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_RANGE_KEY_MAP: {
+			_ctx->c->range_key->value = aws_arena_strndup(_ctx->c->arena, (const char *)val, len);
+			if (_ctx->c->range_key->value == NULL) {
+				Warnx("columns_string: failed to allocated last evaluated range key value");
+				return 0;
+			}
+			break;
+		}
+		default: {
+			Warnx("columns_string - unexpected state '%s'", parser_state_string(_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int columns_start_map(void *ctx)
+{
+	struct columns_ctx *_ctx = (struct columns_ctx *) ctx;
+
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_START)) {
+		return 1;
+	}
+
+	switch (_ctx->parser_state) {
+		case PARSER_STATE_NONE: {
+			_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			break;
+		}
+		case PARSER_STATE_ITEMS_ARRAY: {
+			if (!_ctx->have_count || _ctx->item_index >= _ctx->c->count - 1) {
+				Warnx("columns_start_map: unexpected item count");
+				return 0;
+			}
+			_ctx->item_index++;
+			_ctx->parser_state = PARSER_STATE_ITEM_MAP;
+			break;
+		}
+		case PARSER_STATE_ATTRIBUTE_KEY: {
+			_ctx->parser_state = PARSER_STATE_ATTRIBUTE_MAP;
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_KEY: {
+			_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_MAP;
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_HASH_KEY_KEY: {
+			_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_HASH_KEY_MAP;
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_RANGE_KEY_KEY: {
+			_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_RANGE_KEY_MAP;
+			break;
+		}
+		default: {
+			Warnx("columns_start_map - unexpected state '%s'", parser_state_string(_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* Start a last evaluated key of type @val. */
+static struct aws_dynamo_key *columns_new_key(struct aws_arena *arena,
+	const unsigned char *val, unsigned int len)
+{
+	struct aws_dynamo_key *key;
+
+	key = aws_arena_calloc(arena, 1, sizeof(*key));
+	if (key == NULL) {
+		return NULL;
+	}
+
+	key->type = aws_arena_strndup(arena, (const char *)val, len);
+	if (key->type == NULL) {
+		return NULL;
+	}
+
+	return key;
+}
+
+static int columns_map_key(void *ctx, const unsigned char *val, unsigned int len)
+{
+	struct columns_ctx *_ctx = (struct columns_ctx *) ctx;
+
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_KEY)) {
+		return 1;
+	}
+
+	switch (_ctx->parser_state) {
+		case PARSER_STATE_ROOT_MAP: {
+			if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_CONSUMED_CAPACITY, val, len)) {
+				_ctx->parser_state = PARSER_STATE_CAPACITY_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_COUNT, val, len)) {
+				_ctx->parser_state = PARSER_STATE_COUNT_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_SCANNED_COUNT, val, len)) {
+				_ctx->parser_state = PARSER_STATE_SCANNED_COUNT_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_ITEMS, val, len)) {
+				_ctx->parser_state = PARSER_STATE_ITEMS_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_LAST_EVALUATED_KEY, val, len)) {
+				_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_KEY;
+			} else if (_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+				return aws_dynamo_skip_start(&(_ctx->skip));
+			} else {
+				Warnx("columns_map_key: Unknown key.");
+				return 0;
+			}
+			break;
+		}
+		case PARSER_STATE_ITEM_MAP: {
+			_ctx->attribute_index = aws_dynamo_template_lookup(&(_ctx->template), (const char *)val, len);
+			if (_ctx->attribute_index == -1) {
+				if (_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+					return aws_dynamo_skip_start(&(_ctx->skip));
+				}
+				Warnx("columns_map_key: Unknown attribute.");
+				return 0;
+			}
+			_ctx->parser_state = PARSER_STATE_ATTRIBUTE_KEY;
+			break;
+		}
+		case PARSER_STATE_ATTRIBUTE_MAP: {
+			if (!aws_dynamo_template_check_type(&(_ctx->template), _ctx->attribute_index,
+				(const char *)val, len)) {
+				Warnx("columns_map_key: Unexpected attribute type.");
+				return 0;
+			}
+			_ctx->parser_state = PARSER_STATE_ATTRIBUTE_VALUE;
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_MAP: {
+			if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_HASH_KEY_ELEMENT, val, len)) {
+				_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_HASH_KEY_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_RANGE_KEY_ELEMENT, val, len)) {
+				_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_RANGE_KEY_KEY;
+			} else {
+				Warnx("columns_map_key: Unknown last eval key.");
+				return 0;
+			}
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_HASH_KEY_MAP: {
+			if (_ctx->c->hash_key != NULL) {
+				Warnx("columns_map_key: duplicate last evaluated hash key?");
+				return 0;
+			}
+			_ctx->c->hash_key = columns_new_key(_ctx->c->arena, val, len);
+			if (_ctx->c->hash_key == NULL) {
+				Warnx("columns_map_key: failed to allocated last evaluated hash key");
+				return 0;
+			}
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_RANGE_KEY_MAP: {
+			if (_ctx->c->range_key != NULL) {
+				Warnx("columns_map_key: duplicate last evaluated range key?");
+				return 0;
+			}
+			_ctx->c->range_key = columns_new_key(_ctx->c->arena, val, len);
+			if (_ctx->c->range_key == NULL) {
+				Warnx("columns_map_key: failed to allocated last evaluated range key");
+				return 0;
+			}
+			break;
+		}
+		default: {
+			Warnx("columns_map_key - unexpected state '%s'", parser_state_string(_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int columns_end_map(void *ctx)
+{
+	struct columns_ctx *_ctx = (struct columns_ctx *) ctx;
+
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_END)) {
+		return 1;
+	}
+
+	switch (_ctx->parser_state) {
+		case PARSER_STATE_ATTRIBUTE_VALUE: {
+			_ctx->parser_state = PARSER_STATE_ITEM_MAP;
+			break;
+		}
+		case PARSER_STATE_ITEM_MAP: {
+			_ctx->parser_state = PARSER_STATE_ITEMS_ARRAY;
+			break;
+		}
+		case PARSER_STATE_ROOT_MAP: {
+			_ctx->parser_state = PARSER_STATE_NONE;
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_HASH_KEY_MAP:
+		case PARSER_STATE_LAST_EVALUATED_RANGE_KEY_MAP: {
+			_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_MAP;
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_MAP: {
+			_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			break;
+		}
+		default: {
+			Warnx("columns_end_map - unexpected state '%s'", parser_state_string(_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int columns_start_array(void *ctx)
+{
+	struct columns_ctx *_ctx = (struct columns_ctx *) ctx;
+
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_START)) {
+		return 1;
+	}
+
+	if (_ctx->parser_state != PARSER_STATE_ITEMS_KEY) {
+		Warnx("columns_start_array - unexpected state '%s'", parser_state_string(_ctx->parser_state));
+		return 0;
+	}
+	_ctx->parser_state = PARSER_STATE_ITEMS_ARRAY;
+
+	return 1;
+}
+
+static int columns_end_array(void *ctx)
+{
+	struct columns_ctx *_ctx = (struct columns_ctx *) ctx;
+
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_END)) {
+		return 1;
+	}
+
+	if (_ctx->parser_state != PARSER_STATE_ITEMS_ARRAY) {
+		Warnx("columns_end_array - unexpected state '%s'", parser_state_string(_ctx->parser_state));
+		return 0;
+	}
+	_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+
+	return 1;
+}
+
+static yajl_callbacks columns_callbacks = {
+	.yajl_number = columns_number,
+	.yajl_string = columns_string,
+	.yajl_start_map = columns_start_map,
+	.yajl_map_key = columns_map_key,
+	.yajl_end_map = columns_end_map,
+	.yajl_start_array = columns_start_array,
+	.yajl_end_array = columns_end_array,
+};
+
+/* Start new columns, dropping any from an earlier parse. */
+static int columns_reset(void *ctx)
+{
+	struct columns_ctx *_ctx = (struct columns_ctx *) ctx;
+	struct aws_arena *arena;
+	int i;
+
+	aws_dynamo_free_columns(_ctx->c);
+	_ctx->c = NULL;
+	_ctx->item_index = 0;
+	_ctx->attribute_index = 0;
+	_ctx->have_count = 0;
+	_ctx->parser_state = PARSER_STATE_NONE;
+	memset(&(_ctx->skip), 0, sizeof(_ctx->skip));
+
+	arena = aws_arena_init(_ctx->size_hint);
+	if (arena == NULL) {
+		Warnx("columns_reset: arena alloc failed.");
+		return -1;
+	}
+
+	_ctx->c = aws_arena_calloc(arena, 1, sizeof(*(_ctx->c)));
+	if (_ctx->c == NULL) {
+		Warnx("columns_reset: alloc failed.");
+		aws_arena_deinit(arena);
+		return -1;
+	}
+	_ctx->c->arena = arena;
+
+	_ctx->c->columns = aws_arena_calloc(arena, _ctx->num_attributes, sizeof(*(_ctx->c->columns)));
+	if (_ctx->num_attributes > 0 && _ctx->c->columns == NULL) {
+		Warnx("columns_reset: column alloc failed.");
+		aws_arena_deinit(arena);
+		_ctx->c = NULL;
+		return -1;
+	}
+	_ctx->c->num_columns = _ctx->num_attributes;
+
+	for (i = 0; i < _ctx->num_attributes; i++) {
+		struct aws_dynamo_attribute *a = &(_ctx->attributes[i]);
+		struct aws_dynamo_column *column = &(_ctx->c->columns[i]);
+
+		column->name = a->name;
+		column->name_len = a->name_len;
+		column->type = a->type;
+		column->number_type = a->value.number.type;
+	}
+
+	return 0;
+}
+
+/* Give items after the last one with a string an empty one. */
+static void columns_finish(struct aws_dynamo_columns *c)
+{
+	int i;
+
+	for (i = 0; i < c->num_columns; i++) {
+		struct aws_dynamo_column *column = &(c->columns[i]);
+		int item;
+
+		if (column->type != AWS_DYNAMO_STRING || column->offsets == NULL) {
+			continue;
+		}
+		for (item = column->filled + 1; item <= c->count; item++) {
+			column->offsets[item] = column->offsets[column->filled];
+		}
+		column->filled = c->count;
+	}
+}
+
+/* Only numbers and strings make columns. */
+static int columns_check_template(struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	int i;
+
+	for (i = 0; i < num_attributes; i++) {
+		struct aws_dynamo_attribute *a = &(attributes[i]);
+
+		if (a->type == AWS_DYNAMO_STRING) {
+			continue;
+		}
+		if (a->type == AWS_DYNAMO_NUMBER &&
+			(a->value.number.type == AWS_DYNAMO_NUMBER_INTEGER ||
+			 a->value.number.type == AWS_DYNAMO_NUMBER_DOUBLE)) {
+			continue;
+		}
+		Warnx("aws_dynamo_columns: attribute %d is not a number or a string.", i);
+		return -1;
+	}
+
+	return 0;
+}
+
+static struct aws_dynamo_columns *columns_parse(const char *response,
+	int response_len, struct aws_dynamo_attribute *attributes, int num_attributes,
+	int flags)
+{
+	struct columns_ctx _ctx = {
+		.num_attributes = num_attributes,
+		.attributes = attributes,
+		.flags = flags,
+		.size_hint = response_len,
+	};
+
+	if (columns_check_template(attributes, num_attributes) == -1) {
+		return NULL;
+	}
+
+	aws_dynamo_template_init(&(_ctx.template), attributes, num_attributes);
+
+	if (columns_reset(&_ctx) == -1) {
+		Warnx("aws_dynamo_parse_columns: alloc failed.");
+		aws_dynamo_template_deinit(&(_ctx.template));
+		return NULL;
+	}
+
+	if (aws_dynamo_tokenize(&columns_callbacks, &_ctx, (const unsigned char *)response,
+		response_len) == -1) {
+		Warnx("aws_dynamo_parse_columns: json parse failed.");
+		aws_dynamo_template_deinit(&(_ctx.template));
+		aws_dynamo_free_columns(_ctx.c);
+		return NULL;
+	}
+
+	aws_dynamo_template_deinit(&(_ctx.template));
+	columns_finish(_ctx.c);
+	return _ctx.c;
+}
+
+struct aws_dynamo_columns *aws_dynamo_parse_columns(const char *response,
+	int response_len, struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	return columns_parse(response, response_len, attributes, num_attributes, 0);
+}
+
+static struct aws_dynamo_columns *aws_dynamo_columns_stream(struct aws_handle *aws,
+	const char *target, const char *request,
+	struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	struct columns_ctx _ctx = {
+		.num_attributes = num_attributes,
+		.attributes = attributes,
+		.flags = aws->dynamo_parse_flags,
+	};
+
+	aws_dynamo_template_init(&(_ctx.template), attributes, num_attributes);
+
+	if (aws_dynamo_request_stream(aws, target, request,
+		&columns_callbacks, columns_reset, &_ctx) == -1) {
+		Warnx("aws_dynamo_columns: Failed to get or parse response.");
+		aws_dynamo_template_deinit(&(_ctx.template));
+		aws_dynamo_free_columns(_ctx.c);
+		return NULL;
+	}
+
+	aws_dynamo_template_deinit(&(_ctx.template));
+	columns_finish(_ctx.c);
+	return _ctx.c;
+}
+
+static struct aws_dynamo_columns *aws_dynamo_columns_request(struct aws_handle *aws,
+	const char *target, const char *request,
+	struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	const char *response;
+	int response_len;
+	struct aws_dynamo_columns *c;
+
+	if (columns_check_template(attributes, num_attributes) == -1) {
+		return NULL;
+	}
+
+	if (aws->dynamo_parse_flags & AWS_DYNAMO_PARSE_STREAM) {
+		return aws_dynamo_columns_stream(aws, target, request, attributes, num_attributes);
+	}
+
+	if (aws_dynamo_request(aws, target, request) == -1) {
+		return NULL;
+	}
+
+	response = http_get_data(aws_get_http(aws), &response_len);
+
+	if (response == NULL) {
+		Warnx("aws_dynamo_columns: Failed to get response.");
+		return NULL;
+	}
+
+	if ((c = columns_parse(response, response_len, attributes,
+		num_attributes, aws->dynamo_parse_flags)) == NULL) {
+		Warnx("aws_dynamo_columns: Failed to parse response: '%s'", response);
+		http_release_data(aws_get_http(aws));
+		return NULL;
+	}
+
+	http_release_data(aws_get_http(aws));
+
+	return c;
+}
+
+struct aws_dynamo_columns *aws_dynamo_scan_columns(struct aws_handle *aws,
+	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	return aws_dynamo_columns_request(aws, AWS_DYNAMO_SCAN, request,
+		attributes, num_attributes);
+}
+
+struct aws_dynamo_columns *aws_dynamo_query_columns(struct aws_handle *aws,
+	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	return aws_dynamo_columns_request(aws, AWS_DYNAMO_QUERY, request,
+		attributes, num_attributes);
+}
+
+void aws_dynamo_free_columns(struct aws_dynamo_columns *c)
+{
+	if (c == NULL) {
+		return;
+	}
+
+	/* Everything, c included, is in the arena. */
+	aws_arena_deinit(c->arena);
+}
+
+/*
+ * Aggregates.  The kernels work on dense runs of values, the bitmap of a
+ * column decides which runs are dense.  Sums need no bitmap at all since
+ * items without a value hold 0.
+ */
+
+struct aggregate_kernels {
+	long long (*sum_integers)(const long long *v, size_t n);
+	void (*min_max_integers)(const long long *v, size_t n, long long *min, long long *max);
+	double (*sum_doubles)(const double *v, size_t n);
+	void (*min_max_doubles)(const double *v, size_t n, double *min, double *max);
+};
+
+static long long sum_integers_scalar(const long long *v, size_t n)
+{
+	uint64_t sum = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		sum += (uint64_t)v[i];
+	}
+
+	return (long long)sum;
+}
+
+static void min_max_integers_scalar(const long long *v, size_t n, long long *min, long long *max)
+{
+	long long lo = v[0];
+	long long hi = v[0];
+	size_t i;
+
+	for (i = 1; i < n; i++) {
+		lo = v[i] < lo ? v[i] : lo;
+		hi = v[i] > hi ? v[i] : hi;
+	}
+
+	*min = lo;
+	*max = hi;
+}
+
+static double sum_doubles_scalar(const double *v, size_t n)
+{
+	double sum = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		sum += v[i];
+	}
+
+	return sum;
+}
+
+static void min_max_doubles_scalar(const double *v, size_t n, double *min, double *max)
+{
+	double lo = v[0];
+	double hi = v[0];
+	size_t i;
+
+	for (i = 1; i < n; i++) {
+		lo = v[i] < lo ? v[i] : lo;
+		hi = v[i] > hi ? v[i] : hi;
+	}
+
+	*min = lo;
+	*max = hi;
+}
+
+static const struct aggregate_kernels scalar_kernels = {
+	.sum_integers = sum_integers_scalar,
+	.min_max_integers = min_max_integers_scalar,
+	.sum_doubles = sum_doubles_scalar,
+	.min_max_doubles = min_max_doubles_scalar,
+};
+
+#ifdef AGGREGATE_X86
+
+__attribute__((target("avx2")))
+static long long sum_integers_avx2(const long long *v, size_t n)
+{
+	__m256i acc0 = _mm256_setzero_si256();
+	__m256i acc1 = _mm256_setzero_si256();
+	uint64_t lanes[4];
+	uint64_t sum;
+	size_t i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		acc0 = _mm256_add_epi64(acc0, _mm256_loadu_si256((const __m256i *)(v + i)));
+		acc1 = _mm256_add_epi64(acc1, _mm256_loadu_si256((const __m256i *)(v + i + 4)));
+	}
+	_mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(acc0, acc1));
+	sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+	for (; i < n; i++) {
+		sum += (uint64_t)v[i];
+	}
+
+	return (long long)sum;
+}
+
+__attribute__((target("avx2")))
+static void min_max_integers_avx2(const long long *v, size_t n, long long *min, long long *max)
+{
+	__m256i lo;
+	__m256i hi;
+	long long lanes[4];
+	long long l;
+	long long h;
+	size_t i;
+	int j;
+
+	if (n < 4) {
+		min_max_integers_scalar(v, n, min, max);
+		return;
+	}
+
+	lo = hi = _mm256_loadu_si256((const __m256i *)v);
+	for (i = 4; i + 4 <= n; i += 4) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(v + i));
+
+		lo = _mm256_blendv_epi8(lo, x, _mm256_cmpgt_epi64(lo, x));
+		hi = _mm256_blendv_epi8(hi, x, _mm256_cmpgt_epi64(x, hi));
+	}
+
+	_mm256_storeu_si256((__m256i *)lanes, lo);
+	l = lanes[0];
+	for (j = 1; j < 4; j++) {
+		l = lanes[j] < l ? lanes[j] : l;
+	}
+	_mm256_storeu_si256((__m256i *)lanes, hi);
+	h = lanes[0];
+	for (j = 1; j < 4; j++) {
+		h = lanes[j] > h ? lanes[j] : h;
+	}
+
+	for (; i < n; i++) {
+		l = v[i] < l ? v[i] : l;
+		h = v[i] > h ? v[i] : h;
+	}
+
+	*min = l;
+	*max = h;
+}
+
+__attribute__((target("avx2")))
+static double sum_doubles_avx2(const double *v, size_t n)
+{
+	__m256d acc0 = _mm256_setzero_pd();
+	__m256d acc1 = _mm256_setzero_pd();
+	double lanes[4];
+	double sum;
+	size_t i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(v + i));
+		acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(v + i + 4));
+	}
+	_mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+	sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+
+	for (; i < n; i++) {
+		sum += v[i];
+	}
+
+	return sum;
+}
+
+__attribute__((target("avx2")))
+static void min_max_doubles_avx2(const double *v, size_t n, double *min, double *max)
+{
+	__m256d lo;
+	__m256d hi;
+	double lanes[4];
+	double l;
+	double h;
+	size_t i;
+	int j;
+
+	if (n < 4) {
+		min_max_doubles_scalar(v, n, min, max);
+		return;
+	}
+
+	lo = hi = _mm256_loadu_pd(v);
+	for (i = 4; i + 4 <= n; i += 4) {
+		__m256d x = _mm256_loadu_pd(v + i);
+
+		lo = _mm256_min_pd(lo, x);
+		hi = _mm256_max_pd(hi, x);
+	}
+
+	_mm256_storeu_pd(lanes, lo);
+	l = lanes[0];
+	for (j = 1; j < 4; j++) {
+		l = lanes[j] < l ? lanes[j] : l;
+	}
+	_mm256_storeu_pd(lanes, hi);
+	h = lanes[0];
+	for (j = 1; j < 4; j++) {
+		h = lanes[j] > h ? lanes[j] : h;
+	}
+
+	for (; i < n; i++) {
+		l = v[i] < l ? v[i] : l;
+		h = v[i] > h ? v[i] : h;
+	}
+
+	*min = l;
+	*max = h;
+}
+
+static const struct aggregate_kernels avx2_kernels = {
+	.sum_integers = sum_integers_avx2,
+	.min_max_integers = min_max_integers_avx2,
+	.sum_doubles = sum_doubles_avx2,
+	.min_max_doubles = min_max_doubles_avx2,
+};
+
+#endif /* AGGREGATE_X86 */
+
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+static const struct aggregate_kernels *kernels = &scalar_kernels;
+
+static void kernels_select_auto(void)
+{
+#ifdef AGGREGATE_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		kernels = &avx2_kernels;
+	}
+#endif
+}
+
+int aws_dynamo_aggregate_select(enum aws_dynamo_aggregate_impl impl)
+{
+	pthread_once(&kernels_once, kernels_select_auto);
+
+	switch (impl) {
+		case AWS_DYNAMO_AGGREGATE_AUTO: {
+			kernels = &scalar_kernels;
+			kernels_select_auto();
+			return 0;
+		}
+		case AWS_DYNAMO_AGGREGATE_SCALAR: {
+			kernels = &scalar_kernels;
+			return 0;
+		}
+#ifdef AGGREGATE_X86
+		case AWS_DYNAMO_AGGREGATE_AVX2: {
+			if (!__builtin_cpu_supports("avx2")) {
+				return -1;
+			}
+			kernels = &avx2_kernels;
+			return 0;
+		}
+#endif
+		default: {
+			return -1;
+		}
+	}
+}
+
+int aws_dynamo_columns_aggregate(const struct aws_dynamo_columns *c, int column,
+	struct aws_dynamo_aggregate *a)
+{
+	const struct aws_dynamo_column *col;
+	size_t words;
+	size_t w;
+	int first = 1;
+
+	memset(a, 0, sizeof(*a));
+
+	if (column < 0 || column >= c->num_columns ||
+		c->columns[column].type != AWS_DYNAMO_NUMBER) {
+		Warnx("aws_dynamo_columns_aggregate: not a number column.");
+		return -1;
+	}
+	col = &(c->columns[column]);
+
+	if (col->valid == NULL || c->count == 0) {
+		return 0;
+	}
+
+	pthread_once(&kernels_once, kernels_select_auto);
+
+	words = ((size_t)c->count + 63) / 64;
+	for (w = 0; w < words; w++) {
+		a->count += __builtin_popcountll(col->valid[w]);
+	}
+
+	if (col->number_type == AWS_DYNAMO_NUMBER_INTEGER) {
+		a->integer_sum = kernels->sum_integers(col->integers, c->count);
+
+		for (w = 0; w < words; w++) {
+			uint64_t bits = col->valid[w];
+			const long long *v = col->integers + w * 64;
+			long long lo;
+			long long hi;
+
+			if (bits == UINT64_MAX) {
+				kernels->min_max_integers(v, 64, &lo, &hi);
+			} else if (bits != 0) {
+				lo = hi = v[__builtin_ctzll(bits)];
+				for (; bits != 0; bits &= bits - 1) {
+					long long x = v[__builtin_ctzll(bits)];
+
+					lo = x < lo ? x : lo;
+					hi = x > hi ? x : hi;
+				}
+			} else {
+				continue;
+			}
+
+			if (first || lo < a->integer_min) {
+				a->integer_min = lo;
+			}
+			if (first || hi > a->integer_max) {
+				a->integer_max = hi;
+			}
+			first = 0;
+		}
+	} else {
+		a->sum = kernels->sum_doubles(col->doubles, c->count);
+
+		for (w = 0; w < words; w++) {
+			uint64_t bits = col->valid[w];
+			const double *v = col->doubles + w * 64;
+			double lo;
+			double hi;
+
+			if (bits == UINT64_MAX) {
+				kernels->min_max_doubles(v, 64, &lo, &hi);
+			} else if (bits != 0) {
+				lo = hi = v[__builtin_ctzll(bits)];
+				for (; bits != 0; bits &= bits - 1) {
+					double x = v[__builtin_ctzll(bits)];
+
+					lo = x < lo ? x : lo;
+					hi = x > hi ? x : hi;
+				}
+			} else {
+				continue;
+			}
+
+			if (first || lo < a->min) {
+				a->min = lo;
+			}
+			if (first || hi > a->max) {
+				a->max = hi;
+			}
+			first = 0;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AWS_DYNAMO_COLUMNS_H_
+#define _AWS_DYNAMO_COLUMNS_H_
+
+#include <stdint.h>
+
+#include "aws_dynamo.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A Query or Scan response can be parsed into columns instead of items:
+ * one array per attribute of the template, so that a value of every item
+ * can be visited without going through the items and attribute unions.
+ * Numbers and strings are supported, string and number sets are not.
+ */
+
+/**
+ * struct aws_dynamo_column - the values of one attribute of every item
+ * @name: attribute name, from the template
+ * @name_len: length of @name
+ * @type: AWS_DYNAMO_NUMBER or AWS_DYNAMO_STRING
+ * @number_type: for numbers, which of @integers and @doubles holds them
+ * @valid: bit i % 64 of word i / 64 is set if item i has the attribute
+ * @integers: value of each item, 0 where it has none
+ * @doubles: value of each item, 0 where it has none
+ * @offsets: the string of item i is the @offsets[i + 1] - @offsets[i]
+ *	     bytes at @blob + @offsets[i], empty where it has none
+ * @blob: the strings of all items, back to back and not nul terminated
+ */
+struct aws_dynamo_column {
+	const char *name;
+	int name_len;
+	enum aws_dynamo_attribute_type type;
+	enum aws_dynamo_number_type number_type;
+
+	uint64_t *valid;
+
+	long long *integers;
+	double *doubles;
+
+	uint32_t *offsets;
+	char *blob;
+
+	/* Used while parsing. */
+	size_t blob_size;
+	int filled;
+};
+
+#define AWS_DYNAMO_COLUMN_VALID(column, item) \
+	(((column)->valid[(item) / 64] >> ((item) % 64)) & 1)
+
+struct aws_dynamo_columns {
+	double consumed_capacity_units;
+	int count;
+	int scanned_count;
+
+	int num_columns;
+	struct aws_dynamo_column *columns;
+
+	/* Last evaluated keys. */
+	struct aws_dynamo_key *hash_key;
+	struct aws_dynamo_key *range_key;
+
+	/* Holds all of the above. */
+	struct aws_arena *arena;
+};
+
+/**
+ * struct aws_dynamo_aggregate - summary of a number column
+ * @count: number of items with a value
+ * @sum: for integer columns, wrapping on overflow
+ * @min: smallest value, 0 if @count is 0
+ * @max: largest value, 0 if @count is 0
+ *
+ * The integer_ fields are set for AWS_DYNAMO_NUMBER_INTEGER columns, the
+ * others for AWS_DYNAMO_NUMBER_DOUBLE ones.  The order the doubles are
+ * added in is unspecified.
+ */
+struct aws_dynamo_aggregate {
+	int count;
+	long long integer_sum;
+	long long integer_min;
+	long long integer_max;
+	double sum;
+	double min;
+	double max;
+};
+
+/* Ways of computing aggregates. */
+enum aws_dynamo_aggregate_impl {
+	AWS_DYNAMO_AGGREGATE_AUTO = 0,	/* the fastest the CPU supports */
+	AWS_DYNAMO_AGGREGATE_SCALAR,
+	AWS_DYNAMO_AGGREGATE_AVX2,
+};
+
+struct aws_dynamo_columns *aws_dynamo_parse_columns(const char *response,
+	int response_len, struct aws_dynamo_attribute *attributes, int num_attributes);
+
+/**
+ * aws_dynamo_scan_columns - make a Scan request, returning columns
+ * @aws: library handle
+ * @request: Scan request body
+ * @attributes: attribute template, one column is made for each
+ * @num_attributes: number of attributes in @attributes
+ * Returns: columns, NULL on failure
+ *
+ * AWS_DYNAMO_PARSE_STREAM is honoured, the other parse flags do not apply:
+ * the columns are always allocated from an arena.
+ */
+struct aws_dynamo_columns *aws_dynamo_scan_columns(struct aws_handle *aws,
+	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes);
+
+/**
+ * aws_dynamo_query_columns - make a Query request, returning columns
+ * @aws: library handle
+ * @request: Query request body
+ * @attributes: attribute template, one column is made for each
+ * @num_attributes: number of attributes in @attributes
+ * Returns: columns, NULL on failure
+ */
+struct aws_dynamo_columns *aws_dynamo_query_columns(struct aws_handle *aws,
+	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes);
+
+void aws_dynamo_free_columns(struct aws_dynamo_columns *c);
+
+/**
+ * aws_dynamo_columns_aggregate - summarise a number column
+ * @c: columns
+ * @column: index of the column in @c
+ * @a: result
+ * Returns: 0 on success, -1 if @column is not a number column
+ *
+ * Dense stretches of the column are handled with SIMD instructions where
+ * the CPU has them.
+ */
+int aws_dynamo_columns_aggregate(const struct aws_dynamo_columns *c, int column,
+	struct aws_dynamo_aggregate *a);
+
+/**
+ * aws_dynamo_aggregate_select - choose how aggregates are computed
+ * @impl: AWS_DYNAMO_AGGREGATE_* implementation
+ * Returns: 0 on success, -1 if the CPU or compiler does not support @impl
+ *
+ * For tests and benchmarks, as aws_dynamo_tokenizer_select().
+ */
+int aws_dynamo_aggregate_select(enum aws_dynamo_aggregate_impl impl);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* _AWS_DYNAMO_COLUMNS_H_ */
@@ -27,6 +27,7 @@
 #include "http.h"
 #include "aws_dynamo.h"
 #include "aws_dynamo_delete_item.h"
+#include "aws_dynamo_template.h"
 
 enum {
 	PARSER_STATE_NONE = 0,
@@ -69,6 +70,7 @@ struct ctx {
 	/* These define the expected attributes. */
 	struct aws_dynamo_attribute *attributes; /* attribute template */
 	int num_attributes; /* number of attributes. */
+	struct aws_dynamo_template template; /* the template compiled for lookups */
 
 	int parser_state;
 };
@@ -224,18 +226,8 @@ static int handle_map_key(void *ctx, const unsigned char *val,
 		}
 		case PARSER_STATE_ATTRIBUTES_MAP: {
 			/* Set the attribute index based on the name. */
-			int attribute;
-
-			for (attribute = 0; attribute < _ctx->num_attributes; attribute++) {
-				struct aws_dynamo_attribute *a = &(_ctx->attributes[attribute]);
-
-				if (len == a->name_len && strncmp(val, a->name, len) == 0) {
-					_ctx->attribute_index = attribute;
-					break;
-				}
-			}
-
-			if (attribute == _ctx->num_attributes) {
+			_ctx->attribute_index = aws_dynamo_template_lookup(&(_ctx->template), val, len);
+			if (_ctx->attribute_index == -1) {
 				Warnx("handle_map_key: Unknown attribute.");
 				return 0;
 			}
@@ -243,10 +235,7 @@ static int handle_map_key(void *ctx, const unsigned char *val,
 			break;
 		}
 		case PARSER_STATE_ATTRIBUTE_MAP: {
-			struct aws_dynamo_attribute *a = &(_ctx->attributes[_ctx->attribute_index]);
-			const char *expected_type = aws_dynamo_attribute_types[a->type];
-
-			if (len != strlen(expected_type) || strncmp(val, expected_type, len) != 0) {
+			if (!aws_dynamo_template_check_type(&(_ctx->template), _ctx->attribute_index, val, len)) {
 				Warnx("handle_map_key: Unexpected attribute type.");
 				return 0;
 			}
@@ -376,6 +365,8 @@ struct aws_dynamo_delete_item_response *aws_dynamo_parse_delete_item_response(co
 		return NULL;
 	}
 
+	aws_dynamo_template_init(&(_ctx.template), attributes, num_attributes);
+
 #if YAJL_MAJOR == 2
 	hand = yajl_alloc(&handle_callbacks, NULL, &_ctx);
 	yajl_parse(hand, response, response_len);
@@ -391,11 +382,13 @@ struct aws_dynamo_delete_item_response *aws_dynamo_parse_delete_item_response(co
 		Warnx("aws_dynamo_parse_delete_item_response: json parse failed, '%s'", (const char *) str);  
 		yajl_free_error(hand, str);  
 		yajl_free(hand);
+		aws_dynamo_template_deinit(&(_ctx.template));
 		aws_dynamo_free_delete_item_response(_ctx.r);
 		return NULL;
 	}
 
 	yajl_free(hand);
+	aws_dynamo_template_deinit(&(_ctx.template));
 	return _ctx.r;
 }
 
@@ -410,7 +403,7 @@ struct aws_dynamo_delete_item_response *aws_dynamo_delete_item(struct aws_handle
 		return NULL;
 	}
 
-	response = http_get_data(aws->http, &response_len);
+	response = http_get_data(aws_get_http(aws), &response_len);
 
 	if (response == NULL) {
 		Warnx("aws_dynamo_delete_item: Failed to get response.");
@@ -420,9 +413,12 @@ struct aws_dynamo_delete_item_response *aws_dynamo_delete_item(struct aws_handle
 	if ((r = aws_dynamo_parse_delete_item_response(response, response_len,
 		attributes, num_attributes)) == NULL) {
 		Warnx("aws_dynamo_delete_item: Failed to parse response: '%s'", response);
+		http_release_data(aws_get_http(aws));
 		return NULL; 
 	}
 
+	http_release_data(aws_get_http(aws));
+
 	return r;
 }
 
@@ -521,7 +521,7 @@ struct aws_dynamo_delete_table_response *aws_dynamo_delete_table(struct
 		return NULL;
 	}
 
-	response = http_get_data(aws->http, &response_len);
+	response = http_get_data(aws_get_http(aws), &response_len);
 
 	if (response == NULL) {
 		Warnx("aws_dynamo_delete_table: Failed to get response.");
@@ -530,9 +530,12 @@ struct aws_dynamo_delete_table_response *aws_dynamo_delete_table(struct
 
 	if ((r = aws_dynamo_parse_delete_table_response(response, response_len)) == NULL) {
 		Warnx("aws_dynamo_delete_table: Failed to parse response: '%s'", response);
+		http_release_data(aws_get_http(aws));
 		return NULL;
 	}
 
+	http_release_data(aws_get_http(aws));
+
 	return r;
 }
 
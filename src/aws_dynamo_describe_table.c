@@ -550,7 +550,7 @@ struct aws_dynamo_describe_table_response *aws_dynamo_describe_table(struct
 		return NULL;
 	}
 
-	response = http_get_data(aws->http, &response_len);
+	response = http_get_data(aws_get_http(aws), &response_len);
 
 	if (response == NULL) {
 		Warnx("aws_dynamo_describe_table: Failed to get response.");
@@ -559,9 +559,12 @@ struct aws_dynamo_describe_table_response *aws_dynamo_describe_table(struct
 
 	if ((r = aws_dynamo_parse_describe_table_response(response, response_len)) == NULL) {
 		Warnx("aws_dynamo_describe_table: Failed to parse response: '%s'", response);
+		http_release_data(aws_get_http(aws));
 		return NULL;
 	}
 
+	http_release_data(aws_get_http(aws));
+
 	return r;
 }
 
@@ -0,0 +1,680 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "aws_dynamo_utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <yajl/yajl_parse.h>
+
+#include "aws_dynamo.h"
+#include "aws_dynamo_foreach.h"
+#include "aws_dynamo_stream.h"
+#include "aws_dynamo_template.h"
+#include "aws_dynamo_tokenizer.h"
+
+enum {
+	PARSER_STATE_NONE,
+	PARSER_STATE_ROOT_MAP,
+	PARSER_STATE_CAPACITY_KEY,
+	PARSER_STATE_COUNT_KEY,
+	PARSER_STATE_SCANNED_COUNT_KEY,
+	PARSER_STATE_ITEMS_KEY,
+	PARSER_STATE_ITEMS_ARRAY,
+	PARSER_STATE_ITEM_MAP,
+	PARSER_STATE_ATTRIBUTE_KEY,
+	PARSER_STATE_ATTRIBUTE_MAP,
+	PARSER_STATE_ATTRIBUTE_VALUE,
+	PARSER_STATE_LAST_EVALUATED_KEY,
+	PARSER_STATE_LAST_EVALUATED_MAP,
+	PARSER_STATE_LAST_EVALUATED_HASH_KEY_KEY,
+	PARSER_STATE_LAST_EVALUATED_HASH_KEY_MAP,
+	PARSER_STATE_LAST_EVALUATED_RANGE_KEY_KEY,
+	PARSER_STATE_LAST_EVALUATED_RANGE_KEY_MAP,
+};
+
+static const char *parser_state_strings[] = {
+	"none",
+	"root map",
+	"capacity key",
+	"count key",
+	"scanned count key",
+	"items key",
+	"items array",
+	"item map",
+	"attribute key",
+	"attribute map",
+	"attribute value",
+	"last evaluated",
+	"last evaluated map",
+	"last evaluated hash key key",
+	"last evaluated hash key map",
+	"last evaluated range key key",
+	"last evaluated range key map",
+};
+
+static const char *parser_state_string(int state) {
+	if (state < 0 || state >= sizeof(parser_state_strings) / sizeof(parser_state_strings[0])) {
+		return "invalid state";
+	} else {
+		return parser_state_strings[state];
+	}
+}
+
+struct foreach_ctx {
+	/* These define the expected attributes for each item. */
+	struct aws_dynamo_attribute *attributes; /* attribute template */
+	int num_attributes; /* number of attributes for each item. */
+	struct aws_dynamo_template template; /* the template compiled for lookups */
+
+	/* The scratch item every item is decoded into. */
+	struct aws_dynamo_item item;
+	int attribute_index;
+
+	aws_dynamo_foreach_callback cb;
+	void *arg;
+
+	/* Set when the callback asks to stop. */
+	int stopped;
+
+	/* Number of items of the page passed to the callback. */
+	int delivered;
+
+	/* Last evaluated key of the page, type NULL if there is none. */
+	struct aws_dynamo_key hash_key;
+	struct aws_dynamo_key range_key;
+
+	/* AWS_DYNAMO_PARSE_* flags, unknown keys are skipped with
+	   AWS_DYNAMO_PARSE_SKIP_UNKNOWN. */
+	int flags;
+	struct aws_dynamo_skip skip;
+
+	int parser_state;
+};
+
+static void foreach_free_key(struct aws_dynamo_key *key)
+{
+	free(key->type);
+	free(key->value);
+	key->type = NULL;
+	key->value = NULL;
+}
+
+/* Empty the scratch item, ready for the next one. */
+static void foreach_clear_item(struct foreach_ctx *f_ctx)
+{
+	aws_dynamo_free_attribute_values(f_ctx->item.attributes, f_ctx->num_attributes);
+	memcpy(f_ctx->item.attributes, f_ctx->attributes,
+		sizeof(*(f_ctx->attributes)) * f_ctx->num_attributes);
+}
+
+static struct aws_dynamo_key *foreach_key(struct foreach_ctx *f_ctx)
+{
+	if (f_ctx->parser_state == PARSER_STATE_LAST_EVALUATED_HASH_KEY_MAP) {
+		return &(f_ctx->hash_key);
+	}
+	return &(f_ctx->range_key);
+}
+
+static int foreach_number(void *ctx, const char *val, unsigned int len)
+{
+	struct foreach_ctx *f_ctx = (struct foreach_ctx *) ctx;
+	double d;
+	int i;
+
+	if (aws_dynamo_skip_event(&(f_ctx->skip), AWS_DYNAMO_SKIP_SCALAR)) {
+		return 1;
+	}
+
+	switch (f_ctx->parser_state) {
+		case PARSER_STATE_COUNT_KEY:
+		case PARSER_STATE_SCANNED_COUNT_KEY: {
+			/* Items are counted as they are passed on. */
+			if (aws_dynamo_json_get_int((const unsigned char *)val, len, &i) == -1) {
+				Warnx("foreach_number: failed to get count int.");
+				return 0;
+			}
+			f_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			break;
+		}
+		case PARSER_STATE_CAPACITY_KEY: {
+			if (aws_dynamo_json_get_double(val, len, &d) == -1) {
+				Warnx("foreach_number: failed to get capacity.");
+				return 0;
+			}
+			f_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			break;
+		}
+		default: {
+			Warnx("foreach_number - unexpected state '%s'",
+				parser_state_string(f_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int foreach_string(void *ctx, const unsigned char *val, unsigned int len)
+{
+	struct foreach_ctx *f_ctx = (struct foreach_ctx *) ctx;
+
+	if (aws_dynamo_skip_event(&(f_ctx->skip), AWS_DYNAMO_SKIP_SCALAR)) {
+		return 1;
+	}
+
+	switch (f_ctx->parser_state) {
+		case PARSER_STATE_ATTRIBUTE_VALUE: {
+			if (aws_dynamo_parse_attribute_value(
+				&(f_ctx->item.attributes[f_ctx->attribute_index]), val, len) != 1) {
+				Warnx("foreach_string - attribute parse failed, attribute %d",
+					f_ctx->attribute_index);
+				return 0;
+			}
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_HASH_KEY_MAP:
+		case PARSER_STATE_LAST_EVALUATED_RANGE_KEY_MAP: {
+			struct aws_dynamo_key *key = foreach_key(f_ctx);
+
+			if (key->value != NULL) {
+				Warnx("foreach_string: duplicate last evaluated key value?");
+				return 0;
+			}
+			key->value = strndup((const char *)val, len);
+			if (key->value == NULL) {
+				Warnx("foreach_string: failed to allocate last evaluated key value");
+				return 0;
+			}
+			break;
+		}
+		default: {
+			Warnx("foreach_string - unexpected state '%s'",
+				parser_state_string(f_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int foreach_start_map(void *ctx)
+{
+	struct foreach_ctx *f_ctx = (struct foreach_ctx *) ctx;
+
+	if (aws_dynamo_skip_event(&(f_ctx->skip), AWS_DYNAMO_SKIP_START)) {
+		return 1;
+	}
+
+	switch (f_ctx->parser_state) {
+		case PARSER_STATE_NONE: {
+			f_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			break;
+		}
+		case PARSER_STATE_ITEMS_ARRAY: {
+			f_ctx->parser_state = PARSER_STATE_ITEM_MAP;
+			break;
+		}
+		case PARSER_STATE_ATTRIBUTE_KEY: {
+			f_ctx->parser_state = PARSER_STATE_ATTRIBUTE_MAP;
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_KEY: {
+			f_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_MAP;
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_HASH_KEY_KEY: {
+			f_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_HASH_KEY_MAP;
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_RANGE_KEY_KEY: {
+			f_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_RANGE_KEY_MAP;
+			break;
+		}
+		default: {
+			Warnx("foreach_start_map - unexpected state '%s'",
+				parser_state_string(f_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int foreach_map_key(void *ctx, const unsigned char *val, unsigned int len)
+{
+	struct foreach_ctx *f_ctx = (struct foreach_ctx *) ctx;
+
+	if (aws_dynamo_skip_event(&(f_ctx->skip), AWS_DYNAMO_SKIP_KEY)) {
+		return 1;
+	}
+
+	switch (f_ctx->parser_state) {
+		case PARSER_STATE_ROOT_MAP: {
+			if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_CONSUMED_CAPACITY, val, len)) {
+				f_ctx->parser_state = PARSER_STATE_CAPACITY_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_COUNT, val, len)) {
+				f_ctx->parser_state = PARSER_STATE_COUNT_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_SCANNED_COUNT, val, len)) {
+				f_ctx->parser_state = PARSER_STATE_SCANNED_COUNT_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_ITEMS, val, len)) {
+				f_ctx->parser_state = PARSER_STATE_ITEMS_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_LAST_EVALUATED_KEY, val, len)) {
+				f_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_KEY;
+			} else if (f_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+				return aws_dynamo_skip_start(&(f_ctx->skip));
+			} else {
+				Warnx("foreach_map_key: Unknown key.");
+				return 0;
+			}
+			break;
+		}
+		case PARSER_STATE_ITEM_MAP: {
+			f_ctx->attribute_index = aws_dynamo_template_lookup(&(f_ctx->template), val, len);
+			if (f_ctx->attribute_index == -1) {
+				if (f_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+					return aws_dynamo_skip_start(&(f_ctx->skip));
+				}
+				Warnx("foreach_map_key: Unknown attribute.");
+				return 0;
+			}
+			f_ctx->parser_state = PARSER_STATE_ATTRIBUTE_KEY;
+			break;
+		}
+		case PARSER_STATE_ATTRIBUTE_MAP: {
+			if (!aws_dynamo_template_check_type(&(f_ctx->template), f_ctx->attribute_index, val, len)) {
+				Warnx("foreach_map_key: Unexpected attribute type.");
+				return 0;
+			}
+			f_ctx->parser_state = PARSER_STATE_ATTRIBUTE_VALUE;
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_MAP: {
+			if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_HASH_KEY_ELEMENT, val, len)) {
+				f_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_HASH_KEY_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_RANGE_KEY_ELEMENT, val, len)) {
+				f_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_RANGE_KEY_KEY;
+			} else {
+				Warnx("foreach_map_key: Unknown last eval key.");
+				return 0;
+			}
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_HASH_KEY_MAP:
+		case PARSER_STATE_LAST_EVALUATED_RANGE_KEY_MAP: {
+			struct aws_dynamo_key *key = foreach_key(f_ctx);
+
+			if (key->type != NULL) {
+				Warnx("foreach_map_key: duplicate last evaluated key?");
+				return 0;
+			}
+			key->type = strndup((const char *)val, len);
+			if (key->type == NULL) {
+				Warnx("foreach_map_key: failed to allocate last evaluated key type");
+				return 0;
+			}
+			break;
+		}
+		default: {
+			Warnx("foreach_map_key - unexpected state '%s'",
+				parser_state_string(f_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int foreach_end_map(void *ctx)
+{
+	struct foreach_ctx *f_ctx = (struct foreach_ctx *) ctx;
+
+	if (aws_dynamo_skip_event(&(f_ctx->skip), AWS_DYNAMO_SKIP_END)) {
+		return 1;
+	}
+
+	switch (f_ctx->parser_state) {
+		case PARSER_STATE_ATTRIBUTE_VALUE: {
+			f_ctx->parser_state = PARSER_STATE_ITEM_MAP;
+			break;
+		}
+		case PARSER_STATE_ITEM_MAP: {
+			int stop;
+
+			/* The item is complete, hand it over and reuse it. */
+			stop = f_ctx->cb(&(f_ctx->item), f_ctx->arg);
+			f_ctx->delivered++;
+			foreach_clear_item(f_ctx);
+			if (stop) {
+				/* Failing the parse aborts the rest of the transfer. */
+				f_ctx->stopped = 1;
+				return 0;
+			}
+			f_ctx->parser_state = PARSER_STATE_ITEMS_ARRAY;
+			break;
+		}
+		case PARSER_STATE_ROOT_MAP: {
+			f_ctx->parser_state = PARSER_STATE_NONE;
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_HASH_KEY_MAP:
+		case PARSER_STATE_LAST_EVALUATED_RANGE_KEY_MAP: {
+			struct aws_dynamo_key *key = foreach_key(f_ctx);
+
+			if (key->type == NULL || key->value == NULL) {
+				Warnx("foreach_end_map: incomplete last evaluated key");
+				return 0;
+			}
+			f_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_MAP;
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_MAP: {
+			f_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			break;
+		}
+		default: {
+			Warnx("foreach_end_map - unexpected state '%s'",
+				parser_state_string(f_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int foreach_start_array(void *ctx)
+{
+	struct foreach_ctx *f_ctx = (struct foreach_ctx *) ctx;
+
+	if (aws_dynamo_skip_event(&(f_ctx->skip), AWS_DYNAMO_SKIP_START)) {
+		return 1;
+	}
+
+	switch (f_ctx->parser_state) {
+		case PARSER_STATE_ITEMS_KEY: {
+			f_ctx->parser_state = PARSER_STATE_ITEMS_ARRAY;
+			break;
+		}
+		case PARSER_STATE_ATTRIBUTE_VALUE: {
+			/* A String Set or a Number Set, no need for a state change. */
+			break;
+		}
+		default: {
+			Warnx("foreach_start_array - unexpected state '%s'",
+				parser_state_string(f_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int foreach_end_array(void *ctx)
+{
+	struct foreach_ctx *f_ctx = (struct foreach_ctx *) ctx;
+
+	if (aws_dynamo_skip_event(&(f_ctx->skip), AWS_DYNAMO_SKIP_END)) {
+		return 1;
+	}
+
+	switch (f_ctx->parser_state) {
+		case PARSER_STATE_ITEMS_ARRAY: {
+			f_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			break;
+		}
+		case PARSER_STATE_ATTRIBUTE_VALUE: {
+			/* A String Set or a Number Set, no need for a state change. */
+			break;
+		}
+		default: {
+			Warnx("foreach_end_array - unexpected state '%s'",
+				parser_state_string(f_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static yajl_callbacks foreach_callbacks = {
+	.yajl_number = foreach_number,
+	.yajl_string = foreach_string,
+	.yajl_start_map = foreach_start_map,
+	.yajl_map_key = foreach_map_key,
+	.yajl_end_map = foreach_end_map,
+	.yajl_start_array = foreach_start_array,
+	.yajl_end_array = foreach_end_array,
+};
+
+/* Start a new page.  The items of a page are passed on as they are parsed,
+   so a retry after a transfer that broke off part way through the page
+   would pass them again; the page fails instead. */
+static int foreach_reset(void *ctx)
+{
+	struct foreach_ctx *f_ctx = (struct foreach_ctx *) ctx;
+
+	if (f_ctx->stopped || f_ctx->delivered > 0) {
+		Warnx("foreach_reset: %d items of the page already passed on, not starting it over.",
+			f_ctx->delivered);
+		return -1;
+	}
+
+	foreach_clear_item(f_ctx);
+	foreach_free_key(&(f_ctx->hash_key));
+	foreach_free_key(&(f_ctx->range_key));
+	f_ctx->attribute_index = 0;
+	f_ctx->parser_state = PARSER_STATE_NONE;
+	memset(&(f_ctx->skip), 0, sizeof(f_ctx->skip));
+
+	return 0;
+}
+
+/* Length of @s with JSON escapes added. */
+static size_t foreach_escaped_len(const char *s)
+{
+	size_t len = 0;
+
+	for (; *s != '\0'; s++) {
+		if (*s == '"' || *s == '\\') {
+			len += 2;
+		} else if ((unsigned char)*s < 0x20) {
+			len += 6;
+		} else {
+			len++;
+		}
+	}
+
+	return len;
+}
+
+static char *foreach_escape(char *p, const char *s)
+{
+	for (; *s != '\0'; s++) {
+		if (*s == '"' || *s == '\\') {
+			*p++ = '\\';
+			*p++ = *s;
+		} else if ((unsigned char)*s < 0x20) {
+			p += sprintf(p, "\\u%04x", (unsigned char)*s);
+		} else {
+			*p++ = *s;
+		}
+	}
+
+	return p;
+}
+
+/* Append "name":{"type":"value"} to @p. */
+static char *foreach_key_element(char *p, const char *name, const struct aws_dynamo_key *key)
+{
+	p += sprintf(p, "\"%s\":{\"", name);
+	p = foreach_escape(p, key->type);
+	p += sprintf(p, "\":\"");
+	p = foreach_escape(p, key->value);
+	p += sprintf(p, "\"}");
+
+	return p;
+}
+
+/**
+ * foreach_next_request - make the request for the page after the last one
+ * @request: the request of the first page
+ * @f_ctx: parse of the last page, with its last evaluated key
+ * Returns: allocated request, NULL on failure
+ *
+ * The request is @request with an ExclusiveStartKey added before its
+ * closing brace.
+ */
+static char *foreach_next_request(const char *request, const struct foreach_ctx *f_ctx)
+{
+	const char *end;
+	const char *p;
+	char *next;
+	char *n;
+	size_t len;
+	int empty;
+
+	if (strstr(request, "\"" AWS_DYNAMO_JSON_EXCLUSIVE_START_KEY "\"") != NULL) {
+		Warnx("foreach_next_request: the request already has an ExclusiveStartKey.");
+		return NULL;
+	}
+
+	end = strrchr(request, '}');
+	if (end == NULL) {
+		Warnx("foreach_next_request: the request is not a JSON object.");
+		return NULL;
+	}
+
+	/* No comma is needed after an empty object. */
+	for (p = end - 1; p >= request && strchr(" \t\r\n", *p) != NULL; p--) {
+	}
+	empty = p < request || *p == '{';
+
+	len = (end - request) + sizeof(",\"" AWS_DYNAMO_JSON_EXCLUSIVE_START_KEY "\":{}}");
+	len += sizeof("\"" AWS_DYNAMO_JSON_HASH_KEY_ELEMENT "\":{\"\":\"\"}") +
+		foreach_escaped_len(f_ctx->hash_key.type) +
+		foreach_escaped_len(f_ctx->hash_key.value);
+	if (f_ctx->range_key.type != NULL) {
+		len += sizeof(",\"" AWS_DYNAMO_JSON_RANGE_KEY_ELEMENT "\":{\"\":\"\"}") +
+			foreach_escaped_len(f_ctx->range_key.type) +
+			foreach_escaped_len(f_ctx->range_key.value);
+	}
+
+	next = malloc(len);
+	if (next == NULL) {
+		Warnx("foreach_next_request: alloc failed.");
+		return NULL;
+	}
+
+	memcpy(next, request, end - request);
+	n = next + (end - request);
+	n += sprintf(n, "%s\"" AWS_DYNAMO_JSON_EXCLUSIVE_START_KEY "\":{", empty ? "" : ",");
+	n = foreach_key_element(n, AWS_DYNAMO_JSON_HASH_KEY_ELEMENT, &(f_ctx->hash_key));
+	if (f_ctx->range_key.type != NULL) {
+		*n++ = ',';
+		n = foreach_key_element(n, AWS_DYNAMO_JSON_RANGE_KEY_ELEMENT, &(f_ctx->range_key));
+	}
+	strcpy(n, "}}");
+
+	return next;
+}
+
+static int aws_dynamo_foreach(struct aws_handle *aws, const char *target,
+	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes,
+	aws_dynamo_foreach_callback cb, void *arg)
+{
+	struct foreach_ctx f_ctx = {
+		.attributes = attributes,
+		.num_attributes = num_attributes,
+		.item.num_attributes = num_attributes,
+		.cb = cb,
+		.arg = arg,
+		.flags = aws->dynamo_parse_flags,
+	};
+	char *next = NULL;
+	int rv = -1;
+
+	f_ctx.item.attributes = calloc(num_attributes > 0 ? num_attributes : 1,
+		sizeof(*(f_ctx.item.attributes)));
+	if (f_ctx.item.attributes == NULL) {
+		Warnx("aws_dynamo_foreach: alloc failed.");
+		return -1;
+	}
+	memcpy(f_ctx.item.attributes, attributes, sizeof(*attributes) * num_attributes);
+
+	aws_dynamo_template_init(&(f_ctx.template), attributes, num_attributes);
+
+	for (;;) {
+		char *page_request;
+
+		f_ctx.delivered = 0;
+		if (aws_dynamo_request_stream(aws, target, next != NULL ? next : request,
+			&foreach_callbacks, foreach_reset, &f_ctx) == -1) {
+			if (f_ctx.stopped) {
+				rv = 1;
+			} else {
+				Warnx("aws_dynamo_foreach: Failed to get or parse response.");
+			}
+			break;
+		}
+
+		if (f_ctx.hash_key.type == NULL) {
+			if (f_ctx.range_key.type != NULL) {
+				Warnx("aws_dynamo_foreach: last evaluated range key without a hash key.");
+				break;
+			}
+			rv = 0;
+			break;
+		}
+
+		page_request = foreach_next_request(request, &f_ctx);
+		if (page_request == NULL) {
+			break;
+		}
+		free(next);
+		next = page_request;
+	}
+
+	free(next);
+	foreach_free_key(&(f_ctx.hash_key));
+	foreach_free_key(&(f_ctx.range_key));
+	aws_dynamo_free_attribute_values(f_ctx.item.attributes, num_attributes);
+	free(f_ctx.item.attributes);
+	aws_dynamo_template_deinit(&(f_ctx.template));
+
+	return rv;
+}
+
+int aws_dynamo_query_foreach(struct aws_handle *aws, const char *request,
+	struct aws_dynamo_attribute *attributes, int num_attributes,
+	aws_dynamo_foreach_callback cb, void *arg)
+{
+	return aws_dynamo_foreach(aws, AWS_DYNAMO_QUERY, request, attributes,
+		num_attributes, cb, arg);
+}
+
+int aws_dynamo_scan_foreach(struct aws_handle *aws, const char *request,
+	struct aws_dynamo_attribute *attributes, int num_attributes,
+	aws_dynamo_foreach_callback cb, void *arg)
+{
+	return aws_dynamo_foreach(aws, AWS_DYNAMO_SCAN, request, attributes,
+		num_attributes, cb, arg);
+}
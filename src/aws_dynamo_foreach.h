@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AWS_DYNAMO_FOREACH_H_
+#define _AWS_DYNAMO_FOREACH_H_
+
+#include "aws_dynamo.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A Query or Scan can be read an item at a time instead of as a response
+ * holding all of its items.  Each item is decoded into the same scratch
+ * item as soon as the parser reaches its end, while the rest of the
+ * response is still arriving, and handed to a callback.  The next page is
+ * requested with the LastEvaluatedKey of each page until there are no more,
+ * so the memory used does not grow with the size of the result.
+ */
+
+/**
+ * aws_dynamo_foreach_callback - receive one item of a Query or Scan
+ * @item: the item, its attributes in the order of the template; the values
+ *	  are freed when the callback returns, copy any that are kept
+ * @arg: argument given to aws_dynamo_query_foreach() or
+ *	 aws_dynamo_scan_foreach()
+ * Returns: 0 to go on to the next item, anything else to stop
+ */
+typedef int (*aws_dynamo_foreach_callback)(struct aws_dynamo_item *item, void *arg);
+
+/**
+ * aws_dynamo_query_foreach - run a Query, passing each item to a callback
+ * @aws: library handle
+ * @request: Query request, a JSON object without an ExclusiveStartKey if the
+ *	     result can take more than one page
+ * @attributes: attribute template of the items
+ * @num_attributes: number of attributes in @attributes
+ * @cb: called with each item in the order of the result
+ * @arg: argument passed to @cb
+ * Returns: 0 once every item has been passed to @cb, 1 if @cb stopped the
+ *	    Query, -1 on failure
+ *
+ * Items already passed to @cb stay passed when a later page fails.  An item
+ * is never passed twice: a page whose transfer breaks off after some of its
+ * items were passed on fails instead of being requested again.
+ */
+int aws_dynamo_query_foreach(struct aws_handle *aws, const char *request,
+	struct aws_dynamo_attribute *attributes, int num_attributes,
+	aws_dynamo_foreach_callback cb, void *arg);
+
+/**
+ * aws_dynamo_scan_foreach - run a Scan, passing each item to a callback
+ * @aws: library handle
+ * @request: Scan request, a JSON object without an ExclusiveStartKey if the
+ *	     result can take more than one page
+ * @attributes: attribute template of the items
+ * @num_attributes: number of attributes in @attributes
+ * @cb: called with each item in the order of the result
+ * @arg: argument passed to @cb
+ * Returns: 0 once every item has been passed to @cb, 1 if @cb stopped the
+ *	    Scan, -1 on failure
+ *
+ * Items already passed to @cb stay passed when a later page fails.  An item
+ * is never passed twice: a page whose transfer breaks off after some of its
+ * items were passed on fails instead of being requested again.
+ */
+int aws_dynamo_scan_foreach(struct aws_handle *aws, const char *request,
+	struct aws_dynamo_attribute *attributes, int num_attributes,
+	aws_dynamo_foreach_callback cb, void *arg);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* _AWS_DYNAMO_FOREACH_H_ */
@@ -27,6 +27,8 @@
 #include "http.h"
 #include "aws_dynamo.h"
 #include "aws_dynamo_get_item.h"
+#include "aws_dynamo_template.h"
+#include "aws_dynamo_tokenizer.h"
 
 #define GET_ITEM_PARSER_STATE_NONE					0
 #define GET_ITEM_PARSER_STATE_ROOT					1
@@ -45,6 +47,10 @@ struct get_item_ctx {
 	/* These define the expected attributes. */
 	struct aws_dynamo_attribute *attributes; /* attribute template */
 	int num_attributes; /* number of attributes. */
+	const struct aws_dynamo_template *template; /* the template compiled for lookups */
+
+	/* AWS_DYNAMO_PARSE_* flags. */
+	int flags;
 
 	int parser_state;
 };
@@ -183,6 +189,10 @@ static int get_item_map_key(void *ctx, const unsigned char *val,
 					sizeof(*(_ctx->attributes)) * _ctx->num_attributes);
 				_ctx->r->item.num_attributes = _ctx->num_attributes;
 
+			} else if (_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+				/* Only ever tokenized, so the tokenizer skips the
+				   whole value. */
+				return AWS_DYNAMO_TOKENIZE_SKIP;
 			} else {
 				Warnx("get_item_map_key: Unknown key.");
 				return 0;
@@ -191,18 +201,11 @@ static int get_item_map_key(void *ctx, const unsigned char *val,
 		}
 		case GET_ITEM_PARSER_STATE_ATTRIBUTES: {
 			/* Set the attribute index based on the name. */
-			int attribute;
-
-			for (attribute = 0; attribute < _ctx->num_attributes; attribute++) {
-				struct aws_dynamo_attribute *a = &(_ctx->attributes[attribute]);
-
-				if (len == a->name_len && strncmp(val, a->name, len) == 0) {
-					_ctx->attribute_index = attribute;
-					break;
+			_ctx->attribute_index = aws_dynamo_template_lookup(_ctx->template, val, len);
+			if (_ctx->attribute_index == -1) {
+				if (_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+					return AWS_DYNAMO_TOKENIZE_SKIP;
 				}
-			}
-
-			if (attribute == _ctx->num_attributes) {
 				Warnx("get_item_map_key: Unknown attribute.");
 				return 0;
 			}
@@ -210,10 +213,7 @@ static int get_item_map_key(void *ctx, const unsigned char *val,
 			break;
 		}
 		case GET_ITEM_PARSER_STATE_ATTRIBUTE_VALUE: {
-			struct aws_dynamo_attribute *a = &(_ctx->attributes[_ctx->attribute_index]);
-			const char *expected_type = aws_dynamo_attribute_types[a->type];
-
-			if (len != strlen(expected_type) || strncmp(val, expected_type, len) != 0) {
+			if (!aws_dynamo_template_check_type(_ctx->template, _ctx->attribute_index, val, len)) {
 				Warnx("get_item_map_key: Unexpected attribute type.");
 				return 0;
 			}
@@ -276,47 +276,47 @@ static yajl_callbacks get_item_callbacks = {
 	.yajl_end_map = get_item_end_map,
 };
 
-struct aws_dynamo_get_item_response *aws_dynamo_parse_get_item_response(const char *response,
-	int response_len, struct aws_dynamo_attribute *attributes, int num_attributes)
+static struct aws_dynamo_get_item_response *get_item_parse(const char *response,
+	int response_len, const struct aws_dynamo_template *template, int flags)
 {
-	yajl_handle hand;
-	yajl_status stat;
 	struct get_item_ctx _ctx = {
-		.num_attributes = num_attributes,
-		.attributes = attributes,
+		.num_attributes = template->num_attributes,
+		.attributes = template->attributes,
+		.template = template,
+		.flags = flags,
 	};
 
 	_ctx.r = calloc(sizeof(*(_ctx.r)), 1);
 	if (_ctx.r == NULL) {
-		Warnx("aws_dynamo_parse_get_item_response: alloc failed.");
+		Warnx("get_item_parse: alloc failed.");
 		return NULL;
 	}
 
-#if YAJL_MAJOR == 2
-	hand = yajl_alloc(&get_item_callbacks, NULL, &_ctx);
-	yajl_parse(hand, response, response_len);
-	stat = yajl_complete_parse(hand);
-#else
-	hand = yajl_alloc(&get_item_callbacks, NULL, NULL, &_ctx);
-	yajl_parse(hand, response, response_len);
-	stat = yajl_parse_complete(hand);
-#endif
-
-	if (stat != yajl_status_ok) {
-		unsigned char * str = yajl_get_error(hand, 1, response, response_len);  
-		Warnx("aws_dynamo_parse_get_item_response: json parse failed, '%s'", (const char *) str);  
-		yajl_free_error(hand, str);  
-		yajl_free(hand);
+	if (aws_dynamo_tokenize(&get_item_callbacks, &_ctx, (const unsigned char *)response,
+		response_len) == -1) {
+		Warnx("get_item_parse: json parse failed.");
 		aws_dynamo_free_get_item_response(_ctx.r);
 		return NULL;
 	}
 
-	yajl_free(hand);
 	return _ctx.r;
 }
 
-struct aws_dynamo_get_item_response *aws_dynamo_get_item(struct aws_handle *aws,
-	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes)
+struct aws_dynamo_get_item_response *aws_dynamo_parse_get_item_response(const char *response,
+	int response_len, struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	struct aws_dynamo_template template;
+	struct aws_dynamo_get_item_response *r;
+
+	aws_dynamo_template_init(&template, attributes, num_attributes);
+	r = get_item_parse(response, response_len, &template, 0);
+	aws_dynamo_template_deinit(&template);
+
+	return r;
+}
+
+struct aws_dynamo_get_item_response *aws_dynamo_get_item_template(struct aws_handle *aws,
+	const char *request, const struct aws_dynamo_template *template)
 {
 	const char *response;
 	int response_len;
@@ -326,19 +326,35 @@ struct aws_dynamo_get_item_response *aws_dynamo_get_item(struct aws_handle *aws,
 		return NULL;
 	}
 
-	response = http_get_data(aws->http, &response_len);
+	response = http_get_data(aws_get_http(aws), &response_len);
 
 	if (response == NULL) {
 		Warnx("aws_dynamo_get_item: Failed to get response.");
 		return NULL; 
 	}
 
-	if ((r = aws_dynamo_parse_get_item_response(response, response_len,
-		attributes, num_attributes)) == NULL) {
+	if ((r = get_item_parse(response, response_len, template,
+		aws->dynamo_parse_flags)) == NULL) {
 		Warnx("aws_dynamo_get_item: Failed to parse response: '%s'", response);
+		http_release_data(aws_get_http(aws));
 		return NULL; 
 	}
 
+	http_release_data(aws_get_http(aws));
+
+	return r;
+}
+
+struct aws_dynamo_get_item_response *aws_dynamo_get_item(struct aws_handle *aws,
+	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	struct aws_dynamo_template template;
+	struct aws_dynamo_get_item_response *r;
+
+	aws_dynamo_template_init(&template, attributes, num_attributes);
+	r = aws_dynamo_get_item_template(aws, request, &template);
+	aws_dynamo_template_deinit(&template);
+
 	return r;
 }
 
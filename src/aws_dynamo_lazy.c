@@ -0,0 +1,1208 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "aws_dynamo_utils.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <yajl/yajl_parse.h>
+
+#include "http.h"
+#include "aws_dynamo.h"
+#include "aws_dynamo_lazy.h"
+#include "aws_arena.h"
+#include "aws_dynamo_template.h"
+#include "aws_dynamo_tokenizer.h"
+
+/* Initial capacity of an item array. */
+#define LAZY_MIN_ITEMS		8
+
+/*
+ * Recording and decoding items, the same for every kind of response.
+ */
+
+static void lazy_items_init(struct aws_dynamo_lazy_items *items, struct aws_arena *arena,
+	const unsigned char *data, struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	items->data = data;
+	items->attributes = attributes;
+	items->num_attributes = num_attributes;
+	items->arena = arena;
+}
+
+/* Start a new item at @offset. */
+static int lazy_item_start(struct aws_dynamo_lazy_items *items, size_t offset)
+{
+	struct aws_dynamo_lazy_item *item;
+	int i;
+
+	/* The item array doubles in size whenever the number of items
+		reaches a power of two. */
+	if (items->num_items == 0 ||
+		(items->num_items >= LAZY_MIN_ITEMS &&
+		 (items->num_items & (items->num_items - 1)) == 0)) {
+		int size = items->num_items < LAZY_MIN_ITEMS ?
+			LAZY_MIN_ITEMS : items->num_items * 2;
+		struct aws_dynamo_lazy_item *array;
+
+		array = aws_arena_realloc(items->arena, items->items,
+			sizeof(*array) * items->num_items, sizeof(*array) * size);
+		if (array == NULL) {
+			Warnx("lazy_item_start: item alloc failed.");
+			return -1;
+		}
+		items->items = array;
+	}
+
+	item = &(items->items[items->num_items]);
+	item->start = offset;
+	item->end = offset;
+	item->attributes = NULL;
+	item->values = aws_arena_alloc(items->arena,
+		sizeof(*(item->values)) * items->num_attributes);
+	if (items->num_attributes > 0 && item->values == NULL) {
+		Warnx("lazy_item_start: value alloc failed.");
+		return -1;
+	}
+	for (i = 0; i < items->num_attributes; i++) {
+		item->values[i].offset = AWS_DYNAMO_LAZY_ABSENT;
+		item->values[i].len = 0;
+		item->values[i].decoded = 0;
+	}
+
+	items->num_items++;
+	return 0;
+}
+
+/* Record a value, or a member of a set, of the current item. */
+static int lazy_value_set(struct aws_dynamo_lazy_items *items, int attribute,
+	const unsigned char *val, unsigned int len)
+{
+	struct aws_dynamo_lazy_value *v;
+	enum aws_dynamo_attribute_type type = items->attributes[attribute].type;
+
+	v = &(items->items[items->num_items - 1].values[attribute]);
+
+	if (v->offset == AWS_DYNAMO_LAZY_ABSENT) {
+		v->offset = val - items->data;
+		v->len = len;
+	} else if (type == AWS_DYNAMO_STRING_SET || type == AWS_DYNAMO_NUMBER_SET) {
+		/* The members of a set are next to each other in the response. */
+		v->len = val + len - (items->data + v->offset);
+	} else {
+		Warnx("lazy_value_set: attribute %s given twice.",
+			items->attributes[attribute].name);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Decode one string from the response into @attribute. */
+static int lazy_decode_string(struct aws_arena *arena, struct aws_dynamo_attribute *attribute,
+	const unsigned char *s, size_t len)
+{
+	unsigned char *buf;
+	size_t buf_len;
+	int ret;
+
+	if (memchr(s, '\\', len) == NULL) {
+		return aws_dynamo_parse_attribute_value_arena(arena, attribute, s, len) == 1 ? 0 : -1;
+	}
+
+	buf = malloc(len);
+	if (buf == NULL) {
+		Warnx("lazy_decode_string: alloc failed.");
+		return -1;
+	}
+
+	if (aws_dynamo_json_unescape(s, len, buf, &buf_len) == -1) {
+		free(buf);
+		return -1;
+	}
+
+	ret = aws_dynamo_parse_attribute_value_arena(arena, attribute, buf, buf_len) == 1 ? 0 : -1;
+	free(buf);
+
+	return ret;
+}
+
+/* Decode a value, splitting a set up into its members. */
+static int lazy_decode(struct aws_arena *arena, struct aws_dynamo_attribute *attribute,
+	const unsigned char *s, size_t len)
+{
+	const unsigned char *end = s + len;
+
+	if (attribute->type != AWS_DYNAMO_STRING_SET &&
+		attribute->type != AWS_DYNAMO_NUMBER_SET) {
+		return lazy_decode_string(arena, attribute, s, len);
+	}
+
+	for (;;) {
+		size_t n = 0;
+
+		/* An unescaped quote ends the member. */
+		while (s + n < end && s[n] != '"') {
+			n += s[n] == '\\' ? 2 : 1;
+		}
+		if (s + n > end) {
+			n = end - s;
+		}
+
+		if (lazy_decode_string(arena, attribute, s, n) == -1) {
+			return -1;
+		}
+
+		if (s + n >= end) {
+			break;
+		}
+
+		/* Skip the comma between the quotes. */
+		s += n + 1;
+		while (s < end && *s != '"') {
+			s++;
+		}
+		s++;
+	}
+
+	return 0;
+}
+
+struct aws_dynamo_attribute *aws_dynamo_lazy_attribute(struct aws_dynamo_lazy_items *items,
+	int item, int attribute)
+{
+	struct aws_dynamo_lazy_item *i;
+	struct aws_dynamo_lazy_value *v;
+
+	if (item < 0 || item >= items->num_items ||
+		attribute < 0 || attribute >= items->num_attributes) {
+		Warnx("aws_dynamo_lazy_attribute: item %d attribute %d out of range.",
+			item, attribute);
+		return NULL;
+	}
+	i = &(items->items[item]);
+
+	if (i->attributes == NULL) {
+		i->attributes = aws_arena_alloc(items->arena,
+			sizeof(*(i->attributes)) * items->num_attributes);
+		if (i->attributes == NULL) {
+			Warnx("aws_dynamo_lazy_attribute: attribute alloc failed.");
+			return NULL;
+		}
+
+		/* Set expected types for attributes. */
+		memcpy(i->attributes, items->attributes,
+			sizeof(*(i->attributes)) * items->num_attributes);
+	}
+
+	v = &(i->values[attribute]);
+	if (!v->decoded) {
+		if (v->offset != AWS_DYNAMO_LAZY_ABSENT &&
+			lazy_decode(items->arena, &(i->attributes[attribute]),
+				items->data + v->offset, v->len) == -1) {
+			Warnx("aws_dynamo_lazy_attribute: failed to decode item %d attribute %s.",
+				item, items->attributes[attribute].name);
+			/* Start over should it be asked for again. */
+			memcpy(&(i->attributes[attribute]), &(items->attributes[attribute]),
+				sizeof(i->attributes[attribute]));
+			return NULL;
+		}
+		v->decoded = 1;
+	}
+
+	return &(i->attributes[attribute]);
+}
+
+const unsigned char *aws_dynamo_lazy_item_json(const struct aws_dynamo_lazy_items *items,
+	int item, size_t *len)
+{
+	const struct aws_dynamo_lazy_item *i = &(items->items[item]);
+
+	*len = i->end - i->start;
+	return items->data + i->start;
+}
+
+/* Copy a string out of the response, decoding its escapes. */
+static char *lazy_strndup(struct aws_arena *arena, const unsigned char *s, size_t len)
+{
+	unsigned char *copy;
+	size_t copy_len;
+
+	if (memchr(s, '\\', len) == NULL) {
+		return aws_arena_strndup(arena, (const char *)s, len);
+	}
+
+	copy = aws_arena_alloc(arena, len + 1);
+	if (copy == NULL) {
+		return NULL;
+	}
+
+	if (aws_dynamo_json_unescape(s, len, copy, &copy_len) == -1) {
+		return NULL;
+	}
+	copy[copy_len] = '\0';
+
+	return (char *)copy;
+}
+
+/* Give a response an arena holding a reference to @body, if there is one. */
+static struct aws_arena *lazy_arena(size_t size_hint, struct http_body *body)
+{
+	struct aws_arena *arena;
+
+	arena = aws_arena_init(size_hint);
+	if (arena == NULL) {
+		Warnx("lazy_arena: arena alloc failed.");
+		return NULL;
+	}
+
+	if (body != NULL) {
+		if (aws_arena_defer(arena, http_body_put, body) == -1) {
+			Warnx("lazy_arena: body defer failed.");
+			aws_arena_deinit(arena);
+			return NULL;
+		}
+		http_body_get(body);
+	}
+
+	return arena;
+}
+
+/*
+ * Query and Scan responses.
+ */
+
+enum {
+	PARSER_STATE_NONE,
+	PARSER_STATE_ROOT_MAP,
+	PARSER_STATE_CAPACITY_KEY,
+	PARSER_STATE_COUNT_KEY,
+	PARSER_STATE_ITEMS_KEY,
+	PARSER_STATE_ITEMS_ARRAY,
+	PARSER_STATE_ITEM_MAP,
+	PARSER_STATE_SCANNED_COUNT_KEY,
+	PARSER_STATE_ATTRIBUTE_KEY,
+	PARSER_STATE_ATTRIBUTE_MAP,
+	PARSER_STATE_ATTRIBUTE_VALUE,
+	PARSER_STATE_LAST_EVALUATED_KEY,
+	PARSER_STATE_LAST_EVALUATED_MAP,
+	PARSER_STATE_LAST_EVALUATED_HASH_KEY_KEY,
+	PARSER_STATE_LAST_EVALUATED_HASH_KEY_MAP,
+	PARSER_STATE_LAST_EVALUATED_RANGE_KEY_KEY,
+	PARSER_STATE_LAST_EVALUATED_RANGE_KEY_MAP,
+};
+
+static const char *parser_state_strings[] = {
+	"none",
+	"root map",
+	"capacity key",
+	"count key",
+	"items key",
+	"items array",
+	"item map",
+	"scanned count key",
+	"attribute key",
+	"attribute map",
+	"attribute value",
+	"last evaluated",
+	"last evaluated map",
+	"last evaluated hash key key",
+	"last evaluated hash key map",
+	"last evaluated range key key",
+	"last evaluated range key map",
+};
+
+static const char *parser_state_string(int state) {
+	if (state < 0 || state >= sizeof(parser_state_strings) / sizeof(parser_state_strings[0])) {
+		return "invalid state";
+	} else {
+		return parser_state_strings[state];
+	}
+}
+
+struct lazy_ctx {
+	struct aws_dynamo_lazy_response *r;
+
+	/* The attribute template compiled for lookups. */
+	struct aws_dynamo_template template;
+
+	int attribute_index;
+
+	/* Offset of the current token, set by the tokenizer. */
+	size_t offset;
+
+	/* AWS_DYNAMO_PARSE_* flags. */
+	int flags;
+
+	int parser_state;
+};
+
+static int lazy_number(void *ctx, const char *val, unsigned int len)
+{
+	struct lazy_ctx *_ctx = (struct lazy_ctx *) ctx;
+
+	switch (_ctx->parser_state) {
+		case PARSER_STATE_COUNT_KEY: {
+			if (aws_dynamo_json_get_int(val, len, &(_ctx->r->count)) == -1) {
+				Warnx("lazy_number: failed to get count int.");
+				return 0;
+			}
+			_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			break;
+		}
+		case PARSER_STATE_SCANNED_COUNT_KEY: {
+			if (aws_dynamo_json_get_int(val, len, &(_ctx->r->scanned_count)) == -1) {
+				Warnx("lazy_number: failed to scanned count int.");
+				return 0;
+			}
+			_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			break;
+		}
+		case PARSER_STATE_CAPACITY_KEY: {
+			if (aws_dynamo_json_get_double(val, len, &(_ctx->r->consumed_capacity_units)) == -1) {
+				Warnx("lazy_number: failed to get capacity int.");
+				return 0;
+			}
+			_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			break;
+		}
+		default: {
+			Warnx("lazy_number - unexpected state '%s'", parser_state_string(_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int lazy_string(void *ctx, const unsigned char *val, unsigned int len)
+{
+	struct lazy_ctx *_ctx = (struct lazy_ctx *) ctx;
+
+	switch (_ctx->parser_state) {
+		case PARSER_STATE_ATTRIBUTE_VALUE: {
+			if (lazy_value_set(&(_ctx->r->items), _ctx->attribute_index, val, len) == -1) {
+				return 0;
+			}
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_HASH_KEY_MAP: {
+			_ctx->r->hash_key->value = lazy_strndup(_ctx->r->arena, val, len);
+			if (_ctx->r->hash_key->value == NULL) {
+				Warnx("lazy_string: failed to allocated last evaluated hash key value");
+				return 0;
+			}
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_RANGE_KEY_MAP: {
+			_ctx->r->range_key->value = lazy_strndup(_ctx->r->arena, val, len);
+			if (_ctx->r->range_key->value == NULL) {
+				Warnx("lazy_string: failed to allocated last evaluated range key value");
+				return 0;
+			}
+			break;
+		}
+		default: {
+			Warnx("lazy_string - unexpected state '%s'", parser_state_string(_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int lazy_start_map(void *ctx)
+{
+	struct lazy_ctx *_ctx = (struct lazy_ctx *) ctx;
+
+	switch (_ctx->parser_state) {
+		case PARSER_STATE_NONE: {
+			_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			break;
+		}
+		case PARSER_STATE_ITEMS_ARRAY: {
+			if (lazy_item_start(&(_ctx->r->items), _ctx->offset) == -1) {
+				return 0;
+			}
+			_ctx->parser_state = PARSER_STATE_ITEM_MAP;
+			break;
+		}
+		case PARSER_STATE_ATTRIBUTE_KEY: {
+			_ctx->parser_state = PARSER_STATE_ATTRIBUTE_MAP;
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_KEY: {
+			_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_MAP;
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_HASH_KEY_KEY: {
+			_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_HASH_KEY_MAP;
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_RANGE_KEY_KEY: {
+			_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_RANGE_KEY_MAP;
+			break;
+		}
+		default: {
+			Warnx("lazy_start_map - unexpected state '%s'", parser_state_string(_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* Start a last evaluated key of type @val. */
+static struct aws_dynamo_key *lazy_new_key(struct aws_arena *arena,
+	const unsigned char *val, unsigned int len)
+{
+	struct aws_dynamo_key *key;
+
+	key = aws_arena_calloc(arena, 1, sizeof(*key));
+	if (key == NULL) {
+		return NULL;
+	}
+
+	key->type = aws_arena_strndup(arena, (const char *)val, len);
+	if (key->type == NULL) {
+		return NULL;
+	}
+
+	return key;
+}
+
+static int lazy_map_key(void *ctx, const unsigned char *val, unsigned int len)
+{
+	struct lazy_ctx *_ctx = (struct lazy_ctx *) ctx;
+
+	switch (_ctx->parser_state) {
+		case PARSER_STATE_ROOT_MAP: {
+			if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_CONSUMED_CAPACITY, val, len)) {
+				_ctx->parser_state = PARSER_STATE_CAPACITY_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_COUNT, val, len)) {
+				_ctx->parser_state = PARSER_STATE_COUNT_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_SCANNED_COUNT, val, len)) {
+				_ctx->parser_state = PARSER_STATE_SCANNED_COUNT_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_ITEMS, val, len)) {
+				_ctx->parser_state = PARSER_STATE_ITEMS_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_LAST_EVALUATED_KEY, val, len)) {
+				_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_KEY;
+			} else if (_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+				/* The tokenizer skips the value. */
+				return AWS_DYNAMO_TOKENIZE_SKIP;
+			} else {
+				Warnx("lazy_map_key: Unknown key.");
+				return 0;
+			}
+			break;
+		}
+		case PARSER_STATE_ITEM_MAP: {
+			_ctx->attribute_index = aws_dynamo_template_lookup(&(_ctx->template), (const char *)val, len);
+			if (_ctx->attribute_index == -1) {
+				if (_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+					return AWS_DYNAMO_TOKENIZE_SKIP;
+				}
+				Warnx("lazy_map_key: Unknown attribute.");
+				return 0;
+			}
+			_ctx->parser_state = PARSER_STATE_ATTRIBUTE_KEY;
+			break;
+		}
+		case PARSER_STATE_ATTRIBUTE_MAP: {
+			if (!aws_dynamo_template_check_type(&(_ctx->template), _ctx->attribute_index,
+				(const char *)val, len)) {
+				Warnx("lazy_map_key: Unexpected attribute type.");
+				return 0;
+			}
+			_ctx->parser_state = PARSER_STATE_ATTRIBUTE_VALUE;
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_MAP: {
+			if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_HASH_KEY_ELEMENT, val, len)) {
+				_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_HASH_KEY_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_RANGE_KEY_ELEMENT, val, len)) {
+				_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_RANGE_KEY_KEY;
+			} else {
+				Warnx("lazy_map_key: Unknown last eval key.");
+				return 0;
+			}
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_HASH_KEY_MAP: {
+			if (_ctx->r->hash_key != NULL) {
+				Warnx("lazy_map_key: duplicate last evaluated hash key?");
+				return 0;
+			}
+			_ctx->r->hash_key = lazy_new_key(_ctx->r->arena, val, len);
+			if (_ctx->r->hash_key == NULL) {
+				Warnx("lazy_map_key: failed to allocated last evaluated hash key");
+				return 0;
+			}
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_RANGE_KEY_MAP: {
+			if (_ctx->r->range_key != NULL) {
+				Warnx("lazy_map_key: duplicate last evaluated range key?");
+				return 0;
+			}
+			_ctx->r->range_key = lazy_new_key(_ctx->r->arena, val, len);
+			if (_ctx->r->range_key == NULL) {
+				Warnx("lazy_map_key: failed to allocated last evaluated range key");
+				return 0;
+			}
+			break;
+		}
+		default: {
+			Warnx("lazy_map_key - unexpected state '%s'", parser_state_string(_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int lazy_end_map(void *ctx)
+{
+	struct lazy_ctx *_ctx = (struct lazy_ctx *) ctx;
+
+	switch (_ctx->parser_state) {
+		case PARSER_STATE_ATTRIBUTE_VALUE: {
+			_ctx->parser_state = PARSER_STATE_ITEM_MAP;
+			break;
+		}
+		case PARSER_STATE_ITEM_MAP: {
+			struct aws_dynamo_lazy_items *items = &(_ctx->r->items);
+
+			items->items[items->num_items - 1].end = _ctx->offset + 1;
+			_ctx->parser_state = PARSER_STATE_ITEMS_ARRAY;
+			break;
+		}
+		case PARSER_STATE_ROOT_MAP: {
+			_ctx->parser_state = PARSER_STATE_NONE;
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_HASH_KEY_MAP:
+		case PARSER_STATE_LAST_EVALUATED_RANGE_KEY_MAP: {
+			_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_MAP;
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_MAP: {
+			_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			break;
+		}
+		default: {
+			Warnx("lazy_end_map - unexpected state '%s'", parser_state_string(_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int lazy_start_array(void *ctx)
+{
+	struct lazy_ctx *_ctx = (struct lazy_ctx *) ctx;
+
+	switch (_ctx->parser_state) {
+		case PARSER_STATE_ITEMS_KEY: {
+			_ctx->parser_state = PARSER_STATE_ITEMS_ARRAY;
+			break;
+		}
+		case PARSER_STATE_ATTRIBUTE_VALUE: {
+			/* A String Set or a Number Set, no need for a state change. */
+			break;
+		}
+		default: {
+			Warnx("lazy_start_array - unexpected state '%s'", parser_state_string(_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int lazy_end_array(void *ctx)
+{
+	struct lazy_ctx *_ctx = (struct lazy_ctx *) ctx;
+
+	switch (_ctx->parser_state) {
+		case PARSER_STATE_ITEMS_ARRAY: {
+			_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			break;
+		}
+		case PARSER_STATE_ATTRIBUTE_VALUE: {
+			/* A String Set or a Number Set, no need for a state change. */
+			break;
+		}
+		default: {
+			Warnx("lazy_end_array - unexpected state '%s'", parser_state_string(_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static yajl_callbacks lazy_callbacks = {
+	.yajl_number = lazy_number,
+	.yajl_string = lazy_string,
+	.yajl_start_map = lazy_start_map,
+	.yajl_map_key = lazy_map_key,
+	.yajl_end_map = lazy_end_map,
+	.yajl_start_array = lazy_start_array,
+	.yajl_end_array = lazy_end_array,
+};
+
+/**
+ * lazy_parse - parse a complete Query or Scan response lazily
+ * @response: response body
+ * @response_len: length of @response
+ * @attributes: attribute template
+ * @num_attributes: number of attributes in @attributes
+ * @flags: AWS_DYNAMO_PARSE_* flags
+ * @body: body holding @response to take a reference to, NULL if none
+ * Returns: response, NULL on failure
+ */
+static struct aws_dynamo_lazy_response *lazy_parse(const unsigned char *response,
+	size_t response_len, struct aws_dynamo_attribute *attributes, int num_attributes,
+	int flags, struct http_body *body)
+{
+	struct lazy_ctx _ctx = {
+		.flags = flags,
+	};
+	struct aws_arena *arena;
+
+	if (response_len > INT_MAX) {
+		Warnx("aws_dynamo_parse_lazy_response: response too large.");
+		return NULL;
+	}
+
+	arena = lazy_arena(response_len / 4, body);
+	if (arena == NULL) {
+		return NULL;
+	}
+
+	_ctx.r = aws_arena_calloc(arena, 1, sizeof(*(_ctx.r)));
+	if (_ctx.r == NULL) {
+		Warnx("aws_dynamo_parse_lazy_response: alloc failed.");
+		aws_arena_deinit(arena);
+		return NULL;
+	}
+	_ctx.r->arena = arena;
+	lazy_items_init(&(_ctx.r->items), arena, response, attributes, num_attributes);
+
+	aws_dynamo_template_init(&(_ctx.template), attributes, num_attributes);
+
+	if (aws_dynamo_tokenize_raw(&lazy_callbacks, &_ctx, response, response_len,
+		&(_ctx.offset)) == -1) {
+		Warnx("aws_dynamo_parse_lazy_response: json parse failed.");
+		aws_dynamo_template_deinit(&(_ctx.template));
+		aws_dynamo_free_lazy_response(_ctx.r);
+		return NULL;
+	}
+
+	aws_dynamo_template_deinit(&(_ctx.template));
+	return _ctx.r;
+}
+
+struct aws_dynamo_lazy_response *aws_dynamo_parse_lazy_response(const unsigned char *response,
+	int response_len, struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	return lazy_parse(response, response_len, attributes, num_attributes, 0, NULL);
+}
+
+static struct aws_dynamo_lazy_response *lazy_request(struct aws_handle *aws,
+	const char *target, const char *request,
+	struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	struct http_body *body;
+	struct aws_dynamo_lazy_response *r;
+
+	if (aws_dynamo_request(aws, target, request) == -1) {
+		return NULL;
+	}
+
+	body = http_take_body(aws_get_http(aws));
+	if (body == NULL) {
+		Warnx("aws_dynamo_lazy: Failed to get response.");
+		return NULL;
+	}
+
+	r = lazy_parse(body->data, body->len, attributes, num_attributes,
+		aws->dynamo_parse_flags, body);
+	if (r == NULL) {
+		Warnx("aws_dynamo_lazy: Failed to parse response.");
+	}
+
+	http_body_put(body);
+	return r;
+}
+
+struct aws_dynamo_lazy_response *aws_dynamo_scan_lazy(struct aws_handle *aws,
+	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	return lazy_request(aws, AWS_DYNAMO_SCAN, request, attributes, num_attributes);
+}
+
+struct aws_dynamo_lazy_response *aws_dynamo_query_lazy(struct aws_handle *aws,
+	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	return lazy_request(aws, AWS_DYNAMO_QUERY, request, attributes, num_attributes);
+}
+
+void aws_dynamo_free_lazy_response(struct aws_dynamo_lazy_response *r)
+{
+	if (r == NULL) {
+		return;
+	}
+
+	/* Everything, r included, is in the arena. */
+	aws_arena_deinit(r->arena);
+}
+
+/*
+ * BatchGetItem responses.
+ */
+
+enum {
+	BATCH_STATE_NONE,
+	BATCH_STATE_ROOT_MAP,
+	BATCH_STATE_RESPONSES_KEY,
+	BATCH_STATE_CAPACITY_KEY,
+	BATCH_STATE_RESPONSES_MAP,
+	BATCH_STATE_TABLE_KEY,
+	BATCH_STATE_TABLE_MAP,
+	BATCH_STATE_ITEMS_KEY,
+	BATCH_STATE_ITEMS_ARRAY,
+	BATCH_STATE_ITEM_MAP,
+	BATCH_STATE_ATTRIBUTE_KEY,
+	BATCH_STATE_ATTRIBUTE_MAP,
+	BATCH_STATE_ATTRIBUTE_VALUE,
+	BATCH_STATE_UNPROCESSED_KEY,
+	BATCH_STATE_UNPROCESSED_MAP,
+};
+
+struct lazy_batch_ctx {
+	struct aws_dynamo_lazy_batch_get_item_response *r;
+
+	/* The attribute templates of the tables compiled for lookups. */
+	struct aws_dynamo_batch_get_item_response_table *tables;
+	struct aws_dynamo_template *templates;
+	int num_tables;
+
+	int table_index;
+	int attribute_index;
+
+	/* Offset of the current token, set by the tokenizer. */
+	size_t offset;
+
+	/* AWS_DYNAMO_PARSE_* flags. */
+	int flags;
+
+	int parser_state;
+};
+
+static int lazy_batch_number(void *ctx, const char *val, unsigned int len)
+{
+	struct lazy_batch_ctx *_ctx = (struct lazy_batch_ctx *) ctx;
+	struct aws_dynamo_lazy_table *table = &(_ctx->r->tables[_ctx->table_index]);
+
+	switch (_ctx->parser_state) {
+		case BATCH_STATE_CAPACITY_KEY: {
+			if (aws_dynamo_json_get_double(val, len, &(table->consumed_capacity_units)) == -1) {
+				Warnx("lazy_batch_number: failed to get capacity int.");
+				return 0;
+			}
+			_ctx->parser_state = BATCH_STATE_TABLE_MAP;
+			break;
+		}
+		default: {
+			Warnx("lazy_batch_number - unexpected state %d", _ctx->parser_state);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int lazy_batch_string(void *ctx, const unsigned char *val, unsigned int len)
+{
+	struct lazy_batch_ctx *_ctx = (struct lazy_batch_ctx *) ctx;
+	struct aws_dynamo_lazy_table *table = &(_ctx->r->tables[_ctx->table_index]);
+
+	switch (_ctx->parser_state) {
+		case BATCH_STATE_ATTRIBUTE_VALUE: {
+			if (lazy_value_set(&(table->items), _ctx->attribute_index, val, len) == -1) {
+				return 0;
+			}
+			break;
+		}
+		default: {
+			Warnx("lazy_batch_string - unexpected state %d", _ctx->parser_state);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int lazy_batch_start_map(void *ctx)
+{
+	struct lazy_batch_ctx *_ctx = (struct lazy_batch_ctx *) ctx;
+
+	switch (_ctx->parser_state) {
+		case BATCH_STATE_NONE: {
+			_ctx->parser_state = BATCH_STATE_ROOT_MAP;
+			break;
+		}
+		case BATCH_STATE_RESPONSES_KEY: {
+			_ctx->parser_state = BATCH_STATE_RESPONSES_MAP;
+			break;
+		}
+		case BATCH_STATE_TABLE_KEY: {
+			_ctx->parser_state = BATCH_STATE_TABLE_MAP;
+			break;
+		}
+		case BATCH_STATE_ITEMS_ARRAY: {
+			if (lazy_item_start(&(_ctx->r->tables[_ctx->table_index].items),
+				_ctx->offset) == -1) {
+				return 0;
+			}
+			_ctx->parser_state = BATCH_STATE_ITEM_MAP;
+			break;
+		}
+		case BATCH_STATE_ATTRIBUTE_KEY: {
+			_ctx->parser_state = BATCH_STATE_ATTRIBUTE_MAP;
+			break;
+		}
+		case BATCH_STATE_UNPROCESSED_KEY: {
+			_ctx->parser_state = BATCH_STATE_UNPROCESSED_MAP;
+			break;
+		}
+		default: {
+			Warnx("lazy_batch_start_map - unexpected state %d", _ctx->parser_state);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int lazy_batch_map_key(void *ctx, const unsigned char *val, unsigned int len)
+{
+	struct lazy_batch_ctx *_ctx = (struct lazy_batch_ctx *) ctx;
+
+	switch (_ctx->parser_state) {
+		case BATCH_STATE_ROOT_MAP: {
+			if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_RESPONSES, val, len)) {
+				_ctx->parser_state = BATCH_STATE_RESPONSES_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_UNPROCESSED_KEYS, val, len)) {
+				_ctx->parser_state = BATCH_STATE_UNPROCESSED_KEY;
+			} else if (_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+				return AWS_DYNAMO_TOKENIZE_SKIP;
+			} else {
+				Warnx("lazy_batch_map_key: Unknown root key.");
+				return 0;
+			}
+			break;
+		}
+		case BATCH_STATE_RESPONSES_MAP: {
+			int table;
+
+			for (table = 0; table < _ctx->num_tables; table++) {
+				if (len == _ctx->tables[table].name_len &&
+					strncmp((const char *)val, _ctx->tables[table].name, len) == 0) {
+					break;
+				}
+			}
+			if (table == _ctx->num_tables) {
+				if (_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+					return AWS_DYNAMO_TOKENIZE_SKIP;
+				}
+				Warnx("lazy_batch_map_key: Unknown table.");
+				return 0;
+			}
+			_ctx->table_index = table;
+			_ctx->parser_state = BATCH_STATE_TABLE_KEY;
+			break;
+		}
+		case BATCH_STATE_TABLE_MAP: {
+			if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_ITEMS, val, len)) {
+				_ctx->parser_state = BATCH_STATE_ITEMS_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_CONSUMED_CAPACITY, val, len)) {
+				_ctx->parser_state = BATCH_STATE_CAPACITY_KEY;
+			} else if (_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+				return AWS_DYNAMO_TOKENIZE_SKIP;
+			} else {
+				Warnx("lazy_batch_map_key: Unknown table key.");
+				return 0;
+			}
+			break;
+		}
+		case BATCH_STATE_ITEM_MAP: {
+			_ctx->attribute_index = aws_dynamo_template_lookup(
+				&(_ctx->templates[_ctx->table_index]), (const char *)val, len);
+			if (_ctx->attribute_index == -1) {
+				if (_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+					return AWS_DYNAMO_TOKENIZE_SKIP;
+				}
+				Warnx("lazy_batch_map_key: Unknown attribute.");
+				return 0;
+			}
+			_ctx->parser_state = BATCH_STATE_ATTRIBUTE_KEY;
+			break;
+		}
+		case BATCH_STATE_ATTRIBUTE_MAP: {
+			if (!aws_dynamo_template_check_type(&(_ctx->templates[_ctx->table_index]),
+				_ctx->attribute_index, (const char *)val, len)) {
+				Warnx("lazy_batch_map_key: Unexpected attribute type.");
+				return 0;
+			}
+			_ctx->parser_state = BATCH_STATE_ATTRIBUTE_VALUE;
+			break;
+		}
+		default: {
+			Warnx("lazy_batch_map_key - unexpected state %d", _ctx->parser_state);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int lazy_batch_end_map(void *ctx)
+{
+	struct lazy_batch_ctx *_ctx = (struct lazy_batch_ctx *) ctx;
+
+	switch (_ctx->parser_state) {
+		case BATCH_STATE_ATTRIBUTE_VALUE: {
+			_ctx->parser_state = BATCH_STATE_ITEM_MAP;
+			break;
+		}
+		case BATCH_STATE_ITEM_MAP: {
+			struct aws_dynamo_lazy_items *items = &(_ctx->r->tables[_ctx->table_index].items);
+
+			items->items[items->num_items - 1].end = _ctx->offset + 1;
+			_ctx->parser_state = BATCH_STATE_ITEMS_ARRAY;
+			break;
+		}
+		case BATCH_STATE_TABLE_MAP: {
+			_ctx->parser_state = BATCH_STATE_RESPONSES_MAP;
+			break;
+		}
+		case BATCH_STATE_RESPONSES_MAP:
+		case BATCH_STATE_UNPROCESSED_MAP: {
+			_ctx->parser_state = BATCH_STATE_ROOT_MAP;
+			break;
+		}
+		case BATCH_STATE_ROOT_MAP: {
+			_ctx->parser_state = BATCH_STATE_NONE;
+			break;
+		}
+		default: {
+			Warnx("lazy_batch_end_map - unexpected state %d", _ctx->parser_state);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int lazy_batch_start_array(void *ctx)
+{
+	struct lazy_batch_ctx *_ctx = (struct lazy_batch_ctx *) ctx;
+
+	switch (_ctx->parser_state) {
+		case BATCH_STATE_ITEMS_KEY: {
+			_ctx->parser_state = BATCH_STATE_ITEMS_ARRAY;
+			break;
+		}
+		case BATCH_STATE_ATTRIBUTE_VALUE: {
+			/* A String Set or a Number Set, no need for a state change. */
+			break;
+		}
+		default: {
+			Warnx("lazy_batch_start_array - unexpected state %d", _ctx->parser_state);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int lazy_batch_end_array(void *ctx)
+{
+	struct lazy_batch_ctx *_ctx = (struct lazy_batch_ctx *) ctx;
+
+	switch (_ctx->parser_state) {
+		case BATCH_STATE_ITEMS_ARRAY: {
+			_ctx->parser_state = BATCH_STATE_TABLE_MAP;
+			break;
+		}
+		case BATCH_STATE_ATTRIBUTE_VALUE: {
+			/* A String Set or a Number Set, no need for a state change. */
+			break;
+		}
+		default: {
+			Warnx("lazy_batch_end_array - unexpected state %d", _ctx->parser_state);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static yajl_callbacks lazy_batch_callbacks = {
+	.yajl_number = lazy_batch_number,
+	.yajl_string = lazy_batch_string,
+	.yajl_start_map = lazy_batch_start_map,
+	.yajl_map_key = lazy_batch_map_key,
+	.yajl_end_map = lazy_batch_end_map,
+	.yajl_start_array = lazy_batch_start_array,
+	.yajl_end_array = lazy_batch_end_array,
+};
+
+static void lazy_batch_release(struct lazy_batch_ctx *_ctx)
+{
+	int table;
+
+	for (table = 0; table < _ctx->num_tables; table++) {
+		aws_dynamo_template_deinit(&(_ctx->templates[table]));
+	}
+	free(_ctx->templates);
+}
+
+/**
+ * lazy_batch_parse - parse a complete BatchGetItem response lazily
+ * @response: response body
+ * @response_len: length of @response
+ * @tables: expected tables and their attribute templates
+ * @num_tables: number of tables in @tables
+ * @flags: AWS_DYNAMO_PARSE_* flags
+ * @body: body holding @response to take a reference to, NULL if none
+ * Returns: response, NULL on failure
+ */
+static struct aws_dynamo_lazy_batch_get_item_response *lazy_batch_parse(const unsigned char *response,
+	size_t response_len, struct aws_dynamo_batch_get_item_response_table *tables, int num_tables,
+	int flags, struct http_body *body)
+{
+	struct lazy_batch_ctx _ctx = {
+		.tables = tables,
+		.num_tables = num_tables,
+		.flags = flags,
+	};
+	struct aws_arena *arena;
+	int table;
+
+	if (response_len > INT_MAX) {
+		Warnx("aws_dynamo_parse_lazy_batch_get_item_response: response too large.");
+		return NULL;
+	}
+
+	arena = lazy_arena(response_len / 4, body);
+	if (arena == NULL) {
+		return NULL;
+	}
+
+	_ctx.r = aws_arena_calloc(arena, 1, sizeof(*(_ctx.r)));
+	if (_ctx.r == NULL) {
+		Warnx("aws_dynamo_parse_lazy_batch_get_item_response: alloc failed.");
+		aws_arena_deinit(arena);
+		return NULL;
+	}
+	_ctx.r->arena = arena;
+
+	_ctx.r->tables = aws_arena_calloc(arena, num_tables, sizeof(*(_ctx.r->tables)));
+	_ctx.templates = calloc(num_tables, sizeof(*(_ctx.templates)));
+	if ((num_tables > 0 && _ctx.r->tables == NULL) || _ctx.templates == NULL) {
+		Warnx("aws_dynamo_parse_lazy_batch_get_item_response: table alloc failed.");
+		free(_ctx.templates);
+		aws_arena_deinit(arena);
+		return NULL;
+	}
+	_ctx.r->num_tables = num_tables;
+
+	for (table = 0; table < num_tables; table++) {
+		struct aws_dynamo_lazy_table *t = &(_ctx.r->tables[table]);
+
+		t->name = tables[table].name;
+		t->name_len = tables[table].name_len;
+		lazy_items_init(&(t->items), arena, response,
+			tables[table].attributes, tables[table].num_attributes);
+		aws_dynamo_template_init(&(_ctx.templates[table]),
+			tables[table].attributes, tables[table].num_attributes);
+	}
+
+	if (aws_dynamo_tokenize_raw(&lazy_batch_callbacks, &_ctx, response, response_len,
+		&(_ctx.offset)) == -1) {
+		Warnx("aws_dynamo_parse_lazy_batch_get_item_response: json parse failed.");
+		lazy_batch_release(&_ctx);
+		aws_dynamo_free_lazy_batch_get_item_response(_ctx.r);
+		return NULL;
+	}
+
+	lazy_batch_release(&_ctx);
+	return _ctx.r;
+}
+
+struct aws_dynamo_lazy_batch_get_item_response *aws_dynamo_parse_lazy_batch_get_item_response(
+	const unsigned char *response, int response_len,
+	struct aws_dynamo_batch_get_item_response_table *tables, int num_tables)
+{
+	return lazy_batch_parse(response, response_len, tables, num_tables, 0, NULL);
+}
+
+struct aws_dynamo_lazy_batch_get_item_response *aws_dynamo_batch_get_item_lazy(struct aws_handle *aws,
+	const char *request, struct aws_dynamo_batch_get_item_response_table *tables, int num_tables)
+{
+	struct http_body *body;
+	struct aws_dynamo_lazy_batch_get_item_response *r;
+
+	if (aws_dynamo_request(aws, AWS_DYNAMO_BATCH_GET_ITEM, request) == -1) {
+		return NULL;
+	}
+
+	body = http_take_body(aws_get_http(aws));
+	if (body == NULL) {
+		Warnx("aws_dynamo_batch_get_item_lazy: Failed to get response.");
+		return NULL;
+	}
+
+	r = lazy_batch_parse(body->data, body->len, tables, num_tables,
+		aws->dynamo_parse_flags, body);
+	if (r == NULL) {
+		Warnx("aws_dynamo_batch_get_item_lazy: Failed to parse response.");
+	}
+
+	http_body_put(body);
+	return r;
+}
+
+void aws_dynamo_free_lazy_batch_get_item_response(struct aws_dynamo_lazy_batch_get_item_response *r)
+{
+	if (r == NULL) {
+		return;
+	}
+
+	/* Everything, r included, is in the arena. */
+	aws_arena_deinit(r->arena);
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AWS_DYNAMO_LAZY_H_
+#define _AWS_DYNAMO_LAZY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aws_dynamo.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A Query, Scan or BatchGetItem response can be parsed lazily: the parse
+ * only records where each item and each of its attribute values are in the
+ * response, which is kept.  A value is converted, and its string unescaped
+ * and copied, the first time aws_dynamo_lazy_attribute() is called for it.
+ * Readers that look at one attribute to decide whether they want an item
+ * never pay for the attributes of the items they skip.
+ *
+ * Lazy responses are not safe to read from several threads at once, the
+ * first read of a value writes to the response.
+ */
+
+/* Offset of a value an item does not have. */
+#define AWS_DYNAMO_LAZY_ABSENT	UINT32_MAX
+
+/**
+ * struct aws_dynamo_lazy_value - where an attribute value is in a response
+ * @offset: offset of the value after its opening quote, AWS_DYNAMO_LAZY_ABSENT
+ *	    if the item has none
+ * @len: length of the value, escapes included; for sets, from the first
+ *	 byte of the first member to the last byte of the last
+ * @decoded: whether the value has been decoded into the item's attributes
+ */
+struct aws_dynamo_lazy_value {
+	uint32_t offset;
+	uint32_t len:31;
+	uint32_t decoded:1;
+};
+
+/**
+ * struct aws_dynamo_lazy_item - an item of a lazy response
+ * @start: offset of the '{' starting the item
+ * @end: offset just past the '}' ending the item
+ * @values: where each attribute of the template is
+ * @attributes: decoded attributes, NULL until the first is asked for
+ */
+struct aws_dynamo_lazy_item {
+	uint32_t start;
+	uint32_t end;
+	struct aws_dynamo_lazy_value *values;
+	struct aws_dynamo_attribute *attributes;
+};
+
+/**
+ * struct aws_dynamo_lazy_items - the items of a table in a lazy response
+ * @data: the response the offsets are into
+ * @num_attributes: number of attributes in @attributes
+ * @attributes: attribute template, not copied
+ * @num_items: number of items
+ * @items: items
+ * @arena: the arena of the response, decoded values come from it
+ */
+struct aws_dynamo_lazy_items {
+	const unsigned char *data;
+	int num_attributes;
+	struct aws_dynamo_attribute *attributes;
+	int num_items;
+	struct aws_dynamo_lazy_item *items;
+	struct aws_arena *arena;
+};
+
+struct aws_dynamo_lazy_response {
+	double consumed_capacity_units;
+	int count;
+	int scanned_count;
+
+	struct aws_dynamo_lazy_items items;
+
+	/* Last evaluated keys, decoded. */
+	struct aws_dynamo_key *hash_key;
+	struct aws_dynamo_key *range_key;
+
+	/* Holds all of the above. */
+	struct aws_arena *arena;
+};
+
+struct aws_dynamo_lazy_table {
+	const char *name;
+	int name_len;
+	double consumed_capacity_units;
+	struct aws_dynamo_lazy_items items;
+};
+
+struct aws_dynamo_lazy_batch_get_item_response {
+	int num_tables;
+	struct aws_dynamo_lazy_table *tables;
+
+	/* Holds all of the above. */
+	struct aws_arena *arena;
+};
+
+/**
+ * aws_dynamo_lazy_attribute - get an attribute of an item, decoding it
+ * @items: items of a lazy response
+ * @item: index of the item
+ * @attribute: index of the attribute in the template
+ * Returns: the attribute, NULL if it could not be decoded
+ *
+ * An attribute the item does not have is returned as in a response parsed
+ * the usual way: with its template type and a NULL value.  The attribute
+ * lives as long as the response.
+ */
+struct aws_dynamo_attribute *aws_dynamo_lazy_attribute(struct aws_dynamo_lazy_items *items,
+	int item, int attribute);
+
+/**
+ * aws_dynamo_lazy_item_json - get the JSON text of an item
+ * @items: items of a lazy response
+ * @item: index of the item
+ * @len: length of the text (out)
+ * Returns: the text, not nul terminated
+ */
+const unsigned char *aws_dynamo_lazy_item_json(const struct aws_dynamo_lazy_items *items,
+	int item, size_t *len);
+
+/**
+ * aws_dynamo_parse_lazy_response - parse a Query or Scan response lazily
+ * @response: response body, it must outlive the result
+ * @response_len: length of @response
+ * @attributes: attribute template
+ * @num_attributes: number of attributes in @attributes
+ * Returns: response, NULL on failure
+ */
+struct aws_dynamo_lazy_response *aws_dynamo_parse_lazy_response(const unsigned char *response,
+	int response_len, struct aws_dynamo_attribute *attributes, int num_attributes);
+
+/**
+ * aws_dynamo_scan_lazy - make a Scan request, parsing the response lazily
+ * @aws: library handle
+ * @request: Scan request body
+ * @attributes: attribute template
+ * @num_attributes: number of attributes in @attributes
+ * Returns: response, NULL on failure
+ *
+ * The response holds a reference to the HTTP body.  The parse flags do not
+ * apply, the body is always received in full and the response is always
+ * allocated from an arena.
+ */
+struct aws_dynamo_lazy_response *aws_dynamo_scan_lazy(struct aws_handle *aws,
+	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes);
+
+/**
+ * aws_dynamo_query_lazy - make a Query request, parsing the response lazily
+ * @aws: library handle
+ * @request: Query request body
+ * @attributes: attribute template
+ * @num_attributes: number of attributes in @attributes
+ * Returns: response, NULL on failure
+ *
+ * As aws_dynamo_scan_lazy().
+ */
+struct aws_dynamo_lazy_response *aws_dynamo_query_lazy(struct aws_handle *aws,
+	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes);
+
+void aws_dynamo_free_lazy_response(struct aws_dynamo_lazy_response *r);
+
+/**
+ * aws_dynamo_parse_lazy_batch_get_item_response - parse a BatchGetItem
+ *	response lazily
+ * @response: response body, it must outlive the result
+ * @response_len: length of @response
+ * @tables: expected tables and their attribute templates, the items of
+ *	    the tables are not used
+ * @num_tables: number of tables in @tables
+ * Returns: response, NULL on failure
+ */
+struct aws_dynamo_lazy_batch_get_item_response *aws_dynamo_parse_lazy_batch_get_item_response(
+	const unsigned char *response, int response_len,
+	struct aws_dynamo_batch_get_item_response_table *tables, int num_tables);
+
+/**
+ * aws_dynamo_batch_get_item_lazy - make a BatchGetItem request, parsing the
+ *	response lazily
+ * @aws: library handle
+ * @request: BatchGetItem request body
+ * @tables: expected tables and their attribute templates
+ * @num_tables: number of tables in @tables
+ * Returns: response, NULL on failure
+ *
+ * As aws_dynamo_scan_lazy().
+ */
+struct aws_dynamo_lazy_batch_get_item_response *aws_dynamo_batch_get_item_lazy(struct aws_handle *aws,
+	const char *request, struct aws_dynamo_batch_get_item_response_table *tables, int num_tables);
+
+void aws_dynamo_free_lazy_batch_get_item_response(struct aws_dynamo_lazy_batch_get_item_response *r);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* _AWS_DYNAMO_LAZY_H_ */
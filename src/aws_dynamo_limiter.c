@@ -0,0 +1,485 @@
+/*
+ * Copyright (c) 2012-2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "aws_dynamo_utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "aws_dynamo_limiter.h"
+#include "aws_dynamo_tokenizer.h"
+
+/* Longest table name DynamoDB allows. */
+#define AWS_DYNAMO_TABLE_NAME_MAX	255
+
+/**
+ * struct aws_dynamo_limiter_bucket - token bucket of one table
+ * @table: table name
+ * @rate: requests per second
+ * @tokens: requests that may be sent now, negative when requests are
+ *	    waiting for tokens already handed out
+ * @last: time @tokens was last brought up to date
+ * @last_decrease: time of the last decrease of @rate
+ * @next: next bucket of the limiter
+ */
+struct aws_dynamo_limiter_bucket {
+	char table[AWS_DYNAMO_TABLE_NAME_MAX + 1];
+	double rate;
+	double tokens;
+	double last;
+	double last_decrease;
+	struct aws_dynamo_limiter_bucket *next;
+};
+
+struct aws_dynamo_limiter {
+	pthread_mutex_t lock;
+	double initial_rate;
+	double max_rate;
+	struct aws_dynamo_limiter_bucket *buckets;
+};
+
+static double aws_dynamo_limiter_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * struct aws_dynamo_limiter_tables - the tables a request is paced by
+ * @names: table names, "" for a request that names no table
+ * @n: number of @names
+ * @size: allocated length of @names
+ * @depth: maps and arrays of the request entered while parsing it
+ * @key: top level key whose value is being parsed
+ * @in_items: nonzero inside the RequestItems map of a batch request
+ * @failed: an allocation failed
+ */
+struct aws_dynamo_limiter_tables {
+	char **names;
+	int n;
+	int size;
+	int depth;
+	enum {
+		LIMITER_KEY_NONE,
+		LIMITER_KEY_TABLE_NAME,
+		LIMITER_KEY_REQUEST_ITEMS,
+	} key;
+	int in_items;
+	int failed;
+};
+
+static int aws_dynamo_limiter_add_table(struct aws_dynamo_limiter_tables *t,
+	const unsigned char *name, size_t len)
+{
+	int i;
+
+	/* Table names are limited to [a-zA-Z0-9_.-], longer ones are not. */
+	if (len > AWS_DYNAMO_TABLE_NAME_MAX) {
+		return 1;
+	}
+
+	for (i = 0; i < t->n; i++) {
+		if (strlen(t->names[i]) == len && memcmp(t->names[i], name, len) == 0) {
+			return 1;
+		}
+	}
+
+	if (t->n == t->size) {
+		int size = t->size == 0 ? 4 : t->size * 2;
+		char **names;
+
+		names = realloc(t->names, sizeof(*names) * size);
+		if (names == NULL) {
+			t->failed = 1;
+			return 0;
+		}
+		t->names = names;
+		t->size = size;
+	}
+
+	t->names[t->n] = strndup((const char *)name, len);
+	if (t->names[t->n] == NULL) {
+		t->failed = 1;
+		return 0;
+	}
+	t->n++;
+
+	return 1;
+}
+
+static int aws_dynamo_limiter_scalar(void *ctx)
+{
+	struct aws_dynamo_limiter_tables *t = ctx;
+
+	t->key = LIMITER_KEY_NONE;
+	return 1;
+}
+
+static int aws_dynamo_limiter_boolean(void *ctx, int value)
+{
+	return aws_dynamo_limiter_scalar(ctx);
+}
+
+static int aws_dynamo_limiter_number(void *ctx, const char *val, size_t len)
+{
+	return aws_dynamo_limiter_scalar(ctx);
+}
+
+static int aws_dynamo_limiter_string(void *ctx, const unsigned char *val,
+	size_t len)
+{
+	struct aws_dynamo_limiter_tables *t = ctx;
+	int rv = 1;
+
+	if (t->depth == 1 && t->key == LIMITER_KEY_TABLE_NAME) {
+		rv = aws_dynamo_limiter_add_table(t, val, len);
+	}
+	t->key = LIMITER_KEY_NONE;
+	return rv;
+}
+
+static int aws_dynamo_limiter_start(void *ctx)
+{
+	struct aws_dynamo_limiter_tables *t = ctx;
+
+	t->depth++;
+	t->in_items = t->depth == 2 && t->key == LIMITER_KEY_REQUEST_ITEMS;
+	t->key = LIMITER_KEY_NONE;
+	return 1;
+}
+
+static int aws_dynamo_limiter_start_array(void *ctx)
+{
+	struct aws_dynamo_limiter_tables *t = ctx;
+
+	t->depth++;
+	t->in_items = 0;
+	t->key = LIMITER_KEY_NONE;
+	return 1;
+}
+
+static int aws_dynamo_limiter_end(void *ctx)
+{
+	struct aws_dynamo_limiter_tables *t = ctx;
+
+	t->depth--;
+	t->in_items = 0;
+	return 1;
+}
+
+static int aws_dynamo_limiter_map_key(void *ctx, const unsigned char *key,
+	size_t len)
+{
+	struct aws_dynamo_limiter_tables *t = ctx;
+
+	if (t->depth == 1) {
+		if (len == strlen("TableName") && memcmp(key, "TableName", len) == 0) {
+			t->key = LIMITER_KEY_TABLE_NAME;
+			return 1;
+		} else if (len == strlen("RequestItems") &&
+			memcmp(key, "RequestItems", len) == 0) {
+			t->key = LIMITER_KEY_REQUEST_ITEMS;
+			return 1;
+		}
+	} else if (t->depth == 2 && t->in_items) {
+		/* The keys of RequestItems are the tables of a batch. */
+		if (!aws_dynamo_limiter_add_table(t, key, len)) {
+			return 0;
+		}
+	}
+
+	/* Nothing else in the request matters, attribute names included. */
+	return AWS_DYNAMO_TOKENIZE_SKIP;
+}
+
+static yajl_callbacks aws_dynamo_limiter_callbacks = {
+	.yajl_null = aws_dynamo_limiter_scalar,
+	.yajl_boolean = aws_dynamo_limiter_boolean,
+	.yajl_number = aws_dynamo_limiter_number,
+	.yajl_string = aws_dynamo_limiter_string,
+	.yajl_start_map = aws_dynamo_limiter_start,
+	.yajl_map_key = aws_dynamo_limiter_map_key,
+	.yajl_end_map = aws_dynamo_limiter_end,
+	.yajl_start_array = aws_dynamo_limiter_start_array,
+	.yajl_end_array = aws_dynamo_limiter_end,
+};
+
+static void aws_dynamo_limiter_tables_free(struct aws_dynamo_limiter_tables *t)
+{
+	int i;
+
+	for (i = 0; i < t->n; i++) {
+		free(t->names[i]);
+	}
+	free(t->names);
+}
+
+/**
+ * aws_dynamo_limiter_tables - find the tables of a request
+ * @body: request body
+ * @t: tables (out), free with aws_dynamo_limiter_tables_free()
+ * Returns: 0 on success, -1 on failure
+ *
+ * A request is paced by the top level TableName, a batch request by each
+ * table of its RequestItems.  Requests that name no table get "".
+ */
+static int aws_dynamo_limiter_tables(const char *body,
+	struct aws_dynamo_limiter_tables *t)
+{
+	memset(t, 0, sizeof(*t));
+
+	if (aws_dynamo_tokenize(&aws_dynamo_limiter_callbacks, t,
+		(const unsigned char *)body, strlen(body)) == -1) {
+		if (t->failed) {
+			Warnx("aws_dynamo_limiter_tables: Failed to allocate table names.");
+			aws_dynamo_limiter_tables_free(t);
+			return -1;
+		}
+		/* Let DynamoDB reject it, paced as a request without a table. */
+		aws_dynamo_limiter_tables_free(t);
+		memset(t, 0, sizeof(*t));
+	}
+
+	if (t->n == 0 && !aws_dynamo_limiter_add_table(t, (const unsigned char *)"", 0)) {
+		Warnx("aws_dynamo_limiter_tables: Failed to allocate table names.");
+		aws_dynamo_limiter_tables_free(t);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Called with the limiter lock held. */
+static struct aws_dynamo_limiter_bucket *aws_dynamo_limiter_bucket(
+	struct aws_dynamo_limiter *limiter, const char *table, int create)
+{
+	struct aws_dynamo_limiter_bucket *b;
+
+	for (b = limiter->buckets; b != NULL; b = b->next) {
+		if (strcmp(b->table, table) == 0) {
+			return b;
+		}
+	}
+
+	if (!create) {
+		return NULL;
+	}
+
+	b = calloc(1, sizeof(*b));
+	if (b == NULL) {
+		Warnx("aws_dynamo_limiter_bucket: Failed to allocate bucket.");
+		return NULL;
+	}
+	strcpy(b->table, table);
+	b->rate = limiter->initial_rate;
+	b->tokens = 1.0;
+	b->last = aws_dynamo_limiter_now();
+	b->next = limiter->buckets;
+	limiter->buckets = b;
+
+	return b;
+}
+
+struct aws_dynamo_limiter *aws_dynamo_limiter_init(double initial_rate,
+	double max_rate)
+{
+	struct aws_dynamo_limiter *limiter;
+
+	if (initial_rate < AWS_DYNAMO_LIMITER_MIN_RATE) {
+		initial_rate = AWS_DYNAMO_LIMITER_MIN_RATE;
+	}
+	if (max_rate > 0 && max_rate < initial_rate) {
+		max_rate = initial_rate;
+	}
+
+	limiter = calloc(1, sizeof(*limiter));
+	if (limiter == NULL) {
+		Warnx("aws_dynamo_limiter_init: Failed to allocate limiter.");
+		return NULL;
+	}
+	pthread_mutex_init(&limiter->lock, NULL);
+	limiter->initial_rate = initial_rate;
+	limiter->max_rate = max_rate;
+
+	return limiter;
+}
+
+void aws_dynamo_limiter_deinit(struct aws_dynamo_limiter *limiter)
+{
+	struct aws_dynamo_limiter_bucket *b;
+
+	if (limiter == NULL) {
+		return;
+	}
+
+	while ((b = limiter->buckets) != NULL) {
+		limiter->buckets = b->next;
+		free(b);
+	}
+	pthread_mutex_destroy(&limiter->lock);
+	free(limiter);
+}
+
+int aws_dynamo_limiter_acquire(struct aws_dynamo_limiter *limiter,
+	const char *body, long *wait_us)
+{
+	struct aws_dynamo_limiter_tables t;
+	double now;
+	double wait = 0;
+	int i;
+
+	if (aws_dynamo_limiter_tables(body, &t) == -1) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&limiter->lock);
+
+	/* Make the buckets first so that failing takes no tokens. */
+	for (i = 0; i < t.n; i++) {
+		if (aws_dynamo_limiter_bucket(limiter, t.names[i], 1) == NULL) {
+			pthread_mutex_unlock(&limiter->lock);
+			aws_dynamo_limiter_tables_free(&t);
+			return -1;
+		}
+	}
+
+	now = aws_dynamo_limiter_now();
+	for (i = 0; i < t.n; i++) {
+		struct aws_dynamo_limiter_bucket *b;
+
+		b = aws_dynamo_limiter_bucket(limiter, t.names[i], 0);
+		b->tokens += (now - b->last) * b->rate;
+		if (b->tokens > b->rate * AWS_DYNAMO_LIMITER_BURST) {
+			b->tokens = b->rate * AWS_DYNAMO_LIMITER_BURST;
+		}
+		b->last = now;
+
+		/* Take the token now even if it has yet to accumulate, the
+		   requests waiting on a bucket are then spaced 1 / rate apart.
+		   A batch waits for its slowest table. */
+		b->tokens -= 1.0;
+		if (b->tokens < 0 && -b->tokens / b->rate > wait) {
+			wait = -b->tokens / b->rate;
+		}
+	}
+
+	pthread_mutex_unlock(&limiter->lock);
+
+	aws_dynamo_limiter_tables_free(&t);
+
+	*wait_us = (long)(wait * 1e6);
+
+	return 0;
+}
+
+void aws_dynamo_limiter_release(struct aws_dynamo_limiter *limiter,
+	const char *body)
+{
+	struct aws_dynamo_limiter_tables t;
+	int i;
+
+	if (aws_dynamo_limiter_tables(body, &t) == -1) {
+		return;
+	}
+
+	pthread_mutex_lock(&limiter->lock);
+
+	for (i = 0; i < t.n; i++) {
+		struct aws_dynamo_limiter_bucket *b;
+
+		b = aws_dynamo_limiter_bucket(limiter, t.names[i], 0);
+		if (b == NULL) {
+			continue;
+		}
+
+		b->tokens += 1.0;
+		if (b->tokens > b->rate * AWS_DYNAMO_LIMITER_BURST) {
+			b->tokens = b->rate * AWS_DYNAMO_LIMITER_BURST;
+		}
+	}
+
+	pthread_mutex_unlock(&limiter->lock);
+
+	aws_dynamo_limiter_tables_free(&t);
+}
+
+void aws_dynamo_limiter_update(struct aws_dynamo_limiter *limiter,
+	const char *body, int throttled)
+{
+	struct aws_dynamo_limiter_tables t;
+	double now;
+	int i;
+
+	if (aws_dynamo_limiter_tables(body, &t) == -1) {
+		return;
+	}
+
+	pthread_mutex_lock(&limiter->lock);
+
+	now = aws_dynamo_limiter_now();
+	for (i = 0; i < t.n; i++) {
+		struct aws_dynamo_limiter_bucket *b;
+
+		b = aws_dynamo_limiter_bucket(limiter, t.names[i], 0);
+		if (b == NULL) {
+			continue;
+		}
+
+		if (throttled) {
+			if (now - b->last_decrease >= AWS_DYNAMO_LIMITER_COOLDOWN) {
+				b->rate *= AWS_DYNAMO_LIMITER_DECREASE;
+				if (b->rate < AWS_DYNAMO_LIMITER_MIN_RATE) {
+					b->rate = AWS_DYNAMO_LIMITER_MIN_RATE;
+				}
+				b->last_decrease = now;
+			}
+		} else {
+			b->rate += AWS_DYNAMO_LIMITER_INCREASE / b->rate;
+			if (limiter->max_rate > 0 && b->rate > limiter->max_rate) {
+				b->rate = limiter->max_rate;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&limiter->lock);
+
+	aws_dynamo_limiter_tables_free(&t);
+}
+
+double aws_dynamo_limiter_get_rate(struct aws_dynamo_limiter *limiter,
+	const char *table)
+{
+	struct aws_dynamo_limiter_bucket *b;
+	double rate = -1;
+
+	pthread_mutex_lock(&limiter->lock);
+	b = aws_dynamo_limiter_bucket(limiter, table, 0);
+	if (b != NULL) {
+		rate = b->rate;
+	}
+	pthread_mutex_unlock(&limiter->lock);
+
+	return rate;
+}
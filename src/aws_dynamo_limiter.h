@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AWS_DYNAMO_LIMITER_H_
+#define _AWS_DYNAMO_LIMITER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* After a throttle the rate is multiplied by AWS_DYNAMO_LIMITER_DECREASE,
+   at most once per AWS_DYNAMO_LIMITER_COOLDOWN seconds so that a burst of
+   throttles from requests already in flight counts once.  Each success
+   adds AWS_DYNAMO_LIMITER_INCREASE / rate, i.e. the rate grows by about
+   AWS_DYNAMO_LIMITER_INCREASE requests per second every second. */
+#define AWS_DYNAMO_LIMITER_DECREASE	0.5
+#define AWS_DYNAMO_LIMITER_COOLDOWN	0.1
+#define AWS_DYNAMO_LIMITER_INCREASE	1.0
+#define AWS_DYNAMO_LIMITER_MIN_RATE	1.0
+/* Seconds worth of requests a bucket may accumulate while idle. */
+#define AWS_DYNAMO_LIMITER_BURST	1.0
+
+struct aws_dynamo_limiter;
+
+/**
+ * aws_dynamo_limiter_init - create a rate limiter
+ * @initial_rate: requests per second allowed per table to start with
+ * @max_rate: highest rate the limiter grows to, 0 for no limit
+ * Returns: limiter, NULL on failure
+ *
+ * Each table has a token bucket of its own.  A request takes a slot from
+ * the bucket of its top level TableName, a batch request one from the
+ * bucket of each table in its RequestItems.  Requests that name no table
+ * share one bucket.
+ */
+struct aws_dynamo_limiter *aws_dynamo_limiter_init(double initial_rate,
+	double max_rate);
+
+void aws_dynamo_limiter_deinit(struct aws_dynamo_limiter *limiter);
+
+/**
+ * aws_dynamo_limiter_acquire - reserve a slot for a request
+ * @limiter: rate limiter
+ * @body: request body, the tables in it select the buckets
+ * @wait_us: time the caller must wait before sending the request (out)
+ * Returns: 0 on success, -1 on failure
+ *
+ * The wait is left to the caller so that it can be cut short by a
+ * deadline or a cancellation.  A batch request waits for the slowest of
+ * its tables.
+ */
+int aws_dynamo_limiter_acquire(struct aws_dynamo_limiter *limiter,
+	const char *body, long *wait_us);
+
+/**
+ * aws_dynamo_limiter_release - give back the slot of a request not sent
+ * @limiter: rate limiter
+ * @body: request body, as passed to aws_dynamo_limiter_acquire()
+ *
+ * For a request that gave up waiting, or failed before it was sent, so
+ * that the requests behind it need not wait for it.
+ */
+void aws_dynamo_limiter_release(struct aws_dynamo_limiter *limiter,
+	const char *body);
+
+/**
+ * aws_dynamo_limiter_update - feed the outcome of a request back
+ * @limiter: rate limiter
+ * @body: request body
+ * @throttled: 1 if the request was throttled, 0 if it succeeded
+ *
+ * The outcome of a batch request applies to each of its tables.
+ */
+void aws_dynamo_limiter_update(struct aws_dynamo_limiter *limiter,
+	const char *body, int throttled);
+
+/**
+ * aws_dynamo_limiter_get_rate - current rate of a table's bucket
+ * @limiter: rate limiter
+ * @table: table name, "" for requests without one
+ * Returns: requests per second, -1 if the table has no bucket yet
+ */
+double aws_dynamo_limiter_get_rate(struct aws_dynamo_limiter *limiter,
+	const char *table);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* _AWS_DYNAMO_LIMITER_H_ */
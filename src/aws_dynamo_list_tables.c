@@ -360,7 +360,7 @@ struct aws_dynamo_list_tables_response *aws_dynamo_list_tables(struct aws_handle
 		return NULL;
 	}
 
-	response = http_get_data(aws->http, &response_len);
+	response = http_get_data(aws_get_http(aws), &response_len);
 
 	if (response == NULL) {
 		Warnx("aws_dynamo_list_tables: Failed to get response.");
@@ -371,9 +371,12 @@ struct aws_dynamo_list_tables_response *aws_dynamo_list_tables(struct aws_handle
 	     aws_dynamo_parse_list_tables_response(response,
 						   response_len)) == NULL) {
 		Warnx("aws_dynamo_list_tables: Failed to parse response: '%s'", response);
+		http_release_data(aws_get_http(aws));
 		return NULL;
 	}
 
+	http_release_data(aws_get_http(aws));
+
 	return r;
 }
 
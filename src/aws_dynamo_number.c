@@ -0,0 +1,341 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "aws_dynamo_utils.h"
+
+#include <errno.h>
+#include <float.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aws_dynamo_number.h"
+
+/* Significant digits that always fit in a uint64_t. */
+#define MAX_DIGITS		19
+
+/* Exponents beyond this are only counted as far as telling that. */
+#define MAX_EXPONENT		100000
+
+/* Powers of ten up to 10^22 are exact in a double, and up to 10^27 in a
+   long double with a 64 bit mantissa. */
+#define DOUBLE_MAX_POWER	22
+#if LDBL_MANT_DIG >= 64
+#define LONG_DOUBLE_MAX_POWER	27
+#else
+#define LONG_DOUBLE_MAX_POWER	DOUBLE_MAX_POWER
+#endif
+
+/* Largest mantissa a long double holds exactly, all of them that fit in
+   MAX_DIGITS with a 64 bit mantissa. */
+#if LDBL_MANT_DIG >= 64
+#define LONG_DOUBLE_MAX_MANTISSA	UINT64_MAX
+#else
+#define LONG_DOUBLE_MAX_MANTISSA	((uint64_t)1 << LDBL_MANT_DIG)
+#endif
+
+static const double double_powers[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static const long double long_double_powers[] = {
+	1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L, 1e10L,
+	1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L,
+	1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L,
+};
+
+/**
+ * struct decimal - a number split up as mantissa * 10^exponent
+ * @mantissa: significant digits
+ * @exponent: power of ten to scale @mantissa by
+ * @negative: whether the number is negative
+ */
+struct decimal {
+	uint64_t mantissa;
+	int exponent;
+	int negative;
+};
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define HAVE_EIGHT_DIGITS 1
+
+/* Whether the eight bytes of @v, loaded little endian, are all digits. */
+static int is_eight_digits(uint64_t v)
+{
+	return ((v & 0xF0F0F0F0F0F0F0F0ULL) |
+		(((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) ==
+		0x3333333333333333ULL;
+}
+
+/* The value of eight digits loaded little endian, combined pairwise in
+   three multiplications rather than eight. */
+static uint32_t eight_digits(uint64_t v)
+{
+	v -= 0x3030303030303030ULL;
+	v = (v * 10) + (v >> 8);
+	v = (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+		(((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+
+	return (uint32_t)v;
+}
+#endif
+
+/**
+ * parse_digits - accumulate a run of digits
+ * @s: digits
+ * @len: bytes available at @s
+ * @m: value to append the digits to
+ * Returns: number of digits read
+ *
+ * @m wraps if more than MAX_DIGITS are read, callers must check.
+ */
+static size_t parse_digits(const char *s, size_t len, uint64_t *m)
+{
+	size_t n = 0;
+
+#ifdef HAVE_EIGHT_DIGITS
+	while (len - n >= 8) {
+		uint64_t v;
+
+		memcpy(&v, s + n, sizeof(v));
+		if (!is_eight_digits(v)) {
+			break;
+		}
+		*m = *m * 100000000 + eight_digits(v);
+		n += 8;
+	}
+#endif
+	while (n < len && (unsigned char)(s[n] - '0') <= 9) {
+		*m = *m * 10 + (s[n] - '0');
+		n++;
+	}
+
+	return n;
+}
+
+/**
+ * parse_decimal - split up a JSON number
+ * @s: number
+ * @len: length of @s
+ * @d: result
+ * Returns: 0 on success, -1 if @s is not a JSON number or has more than
+ *	    MAX_DIGITS significant digits
+ */
+static int parse_decimal(const char *s, size_t len, struct decimal *d)
+{
+	size_t pos = 0;
+	size_t digits = 0;
+	size_t n;
+
+	d->mantissa = 0;
+	d->exponent = 0;
+	d->negative = 0;
+
+	if (pos < len && s[pos] == '-') {
+		d->negative = 1;
+		pos++;
+	}
+
+	if (pos < len && s[pos] == '0') {
+		pos++;
+	} else {
+		n = parse_digits(s + pos, len - pos, &(d->mantissa));
+		if (n == 0) {
+			return -1;
+		}
+		digits += n;
+		pos += n;
+	}
+
+	if (pos < len && s[pos] == '.') {
+		size_t start = ++pos;
+
+		/* Zeros before the first significant digit only scale. */
+		if (d->mantissa == 0) {
+			while (pos < len && s[pos] == '0') {
+				pos++;
+			}
+		}
+		n = parse_digits(s + pos, len - pos, &(d->mantissa));
+		digits += n;
+		pos += n;
+		if (pos == start) {
+			return -1;
+		}
+		d->exponent -= (int)(pos - start);
+	}
+
+	if (pos < len && (s[pos] == 'e' || s[pos] == 'E')) {
+		int negative = 0;
+		int e = 0;
+		size_t start;
+
+		pos++;
+		if (pos < len && (s[pos] == '-' || s[pos] == '+')) {
+			negative = s[pos] == '-';
+			pos++;
+		}
+		for (start = pos; pos < len && (unsigned char)(s[pos] - '0') <= 9; pos++) {
+			if (e < MAX_EXPONENT) {
+				e = e * 10 + (s[pos] - '0');
+			}
+		}
+		if (pos == start) {
+			return -1;
+		}
+		d->exponent += negative ? -e : e;
+	}
+
+	if (pos != len || digits > MAX_DIGITS) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Copy @val to a nul terminated buffer for the C library. */
+static int terminate(char *buf, const char *val, size_t len)
+{
+	if (len > AWS_DYNAMO_NUMBER_MAX_LEN) {
+		Warnx("aws_dynamo_number: number too long.");
+		return -1;
+	}
+	memcpy(buf, val, len);
+	buf[len] = '\0';
+
+	return 0;
+}
+
+int aws_dynamo_number_parse_integer(const char *val, size_t len, long long *i)
+{
+	char buf[AWS_DYNAMO_NUMBER_MAX_LEN + 1];
+	char *endptr;
+	long long temp;
+	uint64_t m = 0;
+	size_t pos = 0;
+	size_t n;
+
+	if (len > 0 && val[0] == '-') {
+		pos = 1;
+	}
+	n = parse_digits(val + pos, len - pos, &m);
+
+	/* Leading zeros mean octal to strtoll(). */
+	if (n > 0 && pos + n == len && n <= MAX_DIGITS && (n == 1 || val[pos] != '0')) {
+		if (pos == 0) {
+			if (m > LLONG_MAX) {
+				return -1;
+			}
+			*i = (long long)m;
+		} else {
+			if (m > (uint64_t)LLONG_MAX + 1) {
+				return -1;
+			}
+			*i = m <= LLONG_MAX ? -(long long)m : LLONG_MIN;
+		}
+		return 0;
+	}
+
+	if (terminate(buf, val, len) == -1) {
+		return -1;
+	}
+
+	errno = 0;
+	temp = strtoll(buf, &endptr, 0);
+	if (errno != 0 || *endptr != '\0') {
+		return -1;
+	}
+
+	*i = temp;
+	return 0;
+}
+
+int aws_dynamo_number_parse_double(const char *val, size_t len, double *d)
+{
+	char buf[AWS_DYNAMO_NUMBER_MAX_LEN + 1];
+	struct decimal dec;
+	char *endptr;
+	double temp;
+
+	/* Only exact if the multiplication is not carried out with more
+		precision and then rounded again, as with x87 arithmetic. */
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+	if (parse_decimal(val, len, &dec) == 0 &&
+		dec.mantissa <= ((uint64_t)1 << DBL_MANT_DIG) &&
+		dec.exponent >= -DOUBLE_MAX_POWER && dec.exponent <= DOUBLE_MAX_POWER) {
+		temp = (double)dec.mantissa;
+		if (dec.exponent < 0) {
+			temp /= double_powers[-dec.exponent];
+		} else {
+			temp *= double_powers[dec.exponent];
+		}
+		*d = dec.negative ? -temp : temp;
+		return 0;
+	}
+#endif
+
+	if (terminate(buf, val, len) == -1) {
+		return -1;
+	}
+
+	errno = 0;
+	temp = strtod(buf, &endptr);
+	if (errno != 0 || *endptr != '\0') {
+		return -1;
+	}
+
+	*d = temp;
+	return 0;
+}
+
+int aws_dynamo_number_parse_long_double(const char *val, size_t len,
+	long double *d)
+{
+	char buf[AWS_DYNAMO_NUMBER_MAX_LEN + 1];
+	struct decimal dec;
+	char *endptr;
+	long double temp;
+
+	if (parse_decimal(val, len, &dec) == 0 &&
+		dec.mantissa <= LONG_DOUBLE_MAX_MANTISSA &&
+		dec.exponent >= -LONG_DOUBLE_MAX_POWER && dec.exponent <= LONG_DOUBLE_MAX_POWER) {
+		temp = (long double)dec.mantissa;
+		if (dec.exponent < 0) {
+			temp /= long_double_powers[-dec.exponent];
+		} else {
+			temp *= long_double_powers[dec.exponent];
+		}
+		*d = dec.negative ? -temp : temp;
+		return 0;
+	}
+
+	if (terminate(buf, val, len) == -1) {
+		return -1;
+	}
+
+	errno = 0;
+	temp = strtold(buf, &endptr);
+	if (errno != 0 || *endptr != '\0') {
+		return -1;
+	}
+
+	*d = temp;
+	return 0;
+}
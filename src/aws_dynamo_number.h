@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AWS_DYNAMO_NUMBER_H_
+#define _AWS_DYNAMO_NUMBER_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Longest number handed to the C library when the fast paths below do not
+   apply. */
+#define AWS_DYNAMO_NUMBER_MAX_LEN	255
+
+/*
+ * The functions below convert a number that is not nul terminated, as it
+ * appears in a response.  Plain decimal numbers, which is all DynamoDB
+ * sends, are converted directly from the text: integers eight digits at a
+ * time, and decimals with up to 19 significant digits and a small exponent
+ * with a single exact multiplication or division (Clinger's fast path).
+ * Anything else is passed to strtoll(), strtod() or strtold(), so the
+ * results and the numbers accepted are exactly those of the C library.
+ */
+
+/**
+ * aws_dynamo_number_parse_integer - convert an integer
+ * @val: number
+ * @len: length of @val
+ * @i: result
+ * Returns: 0 on success, -1 if @val is not an integer or out of range
+ */
+int aws_dynamo_number_parse_integer(const char *val, size_t len, long long *i);
+
+/**
+ * aws_dynamo_number_parse_double - convert a number to a double
+ * @val: number
+ * @len: length of @val
+ * @d: result, correctly rounded
+ * Returns: 0 on success, -1 if @val is not a number or out of range
+ */
+int aws_dynamo_number_parse_double(const char *val, size_t len, double *d);
+
+/**
+ * aws_dynamo_number_parse_long_double - convert a number to a long double
+ * @val: number
+ * @len: length of @val
+ * @d: result, correctly rounded
+ * Returns: 0 on success, -1 if @val is not a number or out of range
+ */
+int aws_dynamo_number_parse_long_double(const char *val, size_t len,
+	long double *d);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* _AWS_DYNAMO_NUMBER_H_ */
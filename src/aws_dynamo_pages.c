@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "aws_dynamo_utils.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aws_dynamo.h"
+#include "aws_dynamo_pages.h"
+
+/* Initial capacity of the page array. */
+#define PAGES_MIN	8
+
+static void free_query_response(void *r)
+{
+	aws_dynamo_free_query_response(r);
+}
+
+static void free_scan_response(void *r)
+{
+	aws_dynamo_free_scan_response(r);
+}
+
+/* Append a page, only the page array is ever resized. */
+static int pages_add(struct aws_dynamo_pages *pages, struct aws_dynamo_item *items,
+	int count, void *response, void (*free_response)(void *response))
+{
+	struct aws_dynamo_page *page;
+
+	if (count < 0 || count > INT_MAX - pages->num_items) {
+		Warnx("aws_dynamo_pages_add: too many items.");
+		return -1;
+	}
+
+	if (pages->num_pages == pages->size) {
+		int size = pages->size < PAGES_MIN ? PAGES_MIN : pages->size * 2;
+		struct aws_dynamo_page *array;
+
+		array = realloc(pages->pages, sizeof(*array) * size);
+		if (array == NULL) {
+			Warnx("aws_dynamo_pages_add: realloc failed.");
+			return -1;
+		}
+		pages->pages = array;
+		pages->size = size;
+	}
+
+	page = &(pages->pages[pages->num_pages++]);
+	page->first = pages->num_items;
+	page->count = count;
+	page->items = items;
+	page->response = response;
+	page->free_response = free_response;
+
+	pages->num_items += count;
+	return 0;
+}
+
+int aws_dynamo_pages_add_query(struct aws_dynamo_pages *pages,
+	struct aws_dynamo_query_response *r)
+{
+	if (pages_add(pages, r->items, r->count, r, free_query_response) == -1) {
+		return -1;
+	}
+
+	pages->consumed_capacity_units += r->consumed_capacity_units;
+	pages->hash_key = r->hash_key;
+	pages->range_key = r->range_key;
+
+	return 0;
+}
+
+int aws_dynamo_pages_add_scan(struct aws_dynamo_pages *pages,
+	struct aws_dynamo_scan_response *r)
+{
+	if (pages_add(pages, r->items, r->count, r, free_scan_response) == -1) {
+		return -1;
+	}
+
+	pages->consumed_capacity_units += r->consumed_capacity_units;
+	pages->scanned_count += r->scanned_count;
+	pages->hash_key = r->hash_key;
+	pages->range_key = r->range_key;
+
+	return 0;
+}
+
+struct aws_dynamo_item *aws_dynamo_pages_item(const struct aws_dynamo_pages *pages,
+	int index)
+{
+	int lo = 0;
+	int hi;
+
+	if (index < 0 || index >= pages->num_items) {
+		return NULL;
+	}
+
+	/* The last page starting at or before index, empty pages share their
+		first with the page after them. */
+	hi = pages->num_pages - 1;
+	while (lo < hi) {
+		int mid = lo + (hi - lo + 1) / 2;
+
+		if (pages->pages[mid].first <= index) {
+			lo = mid;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	return &(pages->pages[lo].items[index - pages->pages[lo].first]);
+}
+
+struct aws_dynamo_item *aws_dynamo_pages_next(const struct aws_dynamo_pages *pages,
+	struct aws_dynamo_pages_iter *iter)
+{
+	while (iter->page < pages->num_pages) {
+		const struct aws_dynamo_page *page = &(pages->pages[iter->page]);
+
+		if (iter->item < page->count) {
+			return &(page->items[iter->item++]);
+		}
+		iter->page++;
+		iter->item = 0;
+	}
+
+	return NULL;
+}
+
+void aws_dynamo_pages_free(struct aws_dynamo_pages *pages)
+{
+	int i;
+
+	for (i = 0; i < pages->num_pages; i++) {
+		pages->pages[i].free_response(pages->pages[i].response);
+	}
+	free(pages->pages);
+	memset(pages, 0, sizeof(*pages));
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AWS_DYNAMO_PAGES_H_
+#define _AWS_DYNAMO_PAGES_H_
+
+#include "aws_dynamo.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+struct aws_dynamo_query_response;
+struct aws_dynamo_scan_response;
+
+/*
+ * The pages of a Query or Scan that returns more than one, kept as they
+ * are.  Adding a page never moves the items of the pages before it, unlike
+ * aws_dynamo_query_combine_and_free_responses() which copies all of them
+ * every time.
+ */
+
+/**
+ * struct aws_dynamo_page - one response of a paginated result
+ * @first: index of the first item of the page in the whole result
+ * @count: number of items in the page
+ * @items: the items of the page
+ * @response: the response the page is, freed with the pages
+ * @free_response: function freeing @response
+ */
+struct aws_dynamo_page {
+	int first;
+	int count;
+	struct aws_dynamo_item *items;
+	void *response;
+	void (*free_response)(void *response);
+};
+
+/**
+ * struct aws_dynamo_pages - a paginated result
+ * @num_items: number of items in all the pages
+ * @num_pages: number of pages
+ * @pages: the pages in the order they were added
+ * @consumed_capacity_units: total of all the pages
+ * @scanned_count: total of all Scan pages
+ * @hash_key: last evaluated hash key of the last page, NULL if there is none
+ * @range_key: last evaluated range key of the last page, NULL if there is none
+ *
+ * Initialize with AWS_DYNAMO_PAGES_INIT or zeros.
+ */
+struct aws_dynamo_pages {
+	int num_items;
+	int num_pages;
+	struct aws_dynamo_page *pages;
+	double consumed_capacity_units;
+	int scanned_count;
+	struct aws_dynamo_key *hash_key;
+	struct aws_dynamo_key *range_key;
+
+	/* Capacity of pages. */
+	int size;
+};
+
+#define AWS_DYNAMO_PAGES_INIT	{ 0 }
+
+/**
+ * struct aws_dynamo_pages_iter - position in a paginated result
+ *
+ * Initialize with AWS_DYNAMO_PAGES_ITER_INIT or zeros to start at the first
+ * item.
+ */
+struct aws_dynamo_pages_iter {
+	int page;
+	int item;
+};
+
+#define AWS_DYNAMO_PAGES_ITER_INIT	{ 0, 0 }
+
+/**
+ * aws_dynamo_pages_add_query - append a Query response
+ * @pages: paginated result
+ * @r: response, owned by @pages on success
+ * Returns: 0 on success, -1 on failure with @r still the caller's
+ */
+int aws_dynamo_pages_add_query(struct aws_dynamo_pages *pages,
+	struct aws_dynamo_query_response *r);
+
+/**
+ * aws_dynamo_pages_add_scan - append a Scan response
+ * @pages: paginated result
+ * @r: response, owned by @pages on success
+ * Returns: 0 on success, -1 on failure with @r still the caller's
+ */
+int aws_dynamo_pages_add_scan(struct aws_dynamo_pages *pages,
+	struct aws_dynamo_scan_response *r);
+
+/**
+ * aws_dynamo_pages_item - get an item by its index in the whole result
+ * @pages: paginated result
+ * @index: index of the item
+ * Returns: the item, NULL if @index is out of range
+ *
+ * The page is found by a binary search of the pages.
+ */
+struct aws_dynamo_item *aws_dynamo_pages_item(const struct aws_dynamo_pages *pages,
+	int index);
+
+/**
+ * aws_dynamo_pages_next - get the next item
+ * @pages: paginated result
+ * @iter: position, moved past the item returned
+ * Returns: the item, NULL after the last one
+ *
+ * Pages added while iterating are visited too.
+ */
+struct aws_dynamo_item *aws_dynamo_pages_next(const struct aws_dynamo_pages *pages,
+	struct aws_dynamo_pages_iter *iter);
+
+/**
+ * aws_dynamo_pages_free - free the pages of a paginated result
+ * @pages: paginated result, left empty
+ */
+void aws_dynamo_pages_free(struct aws_dynamo_pages *pages);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* _AWS_DYNAMO_PAGES_H_ */
@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "aws_dynamo_utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <yajl/yajl_parse.h>
+
+#include "aws_dynamo.h"
+#include "aws_dynamo_prepared.h"
+#include "aws_dynamo_splice.h"
+#include "aws_dynamo_template.h"
+#include "aws_dynamo_tokenizer.h"
+
+#define PLACEHOLDER	'?'
+
+/**
+ * struct prepared_piece - the part of a request after a placeholder
+ * @json: start of the piece in the request
+ * @len: length of the piece
+ */
+struct prepared_piece {
+	const char *json;
+	size_t len;
+};
+
+/**
+ * struct aws_dynamo_prepared - request prepared for repeated use
+ * @target: DynamoDB operation
+ * @json: the request, its placeholders overwritten
+ * @prefix: the request up to its first placeholder, hashed
+ * @num_values: number of placeholders
+ * @pieces: the request after each placeholder, the last without the
+ *	    closing brace of the request
+ * @template: attribute template of the response
+ */
+struct aws_dynamo_prepared {
+	const char *target;
+	char *json;
+	struct aws_dynamo_builder_prefix prefix;
+	int num_values;
+	struct prepared_piece *pieces;
+	struct aws_dynamo_template template;
+};
+
+/* No callbacks, the request is only checked to be valid JSON. */
+static yajl_callbacks prepared_check_callbacks;
+
+/**
+ * prepared_split - find the placeholders of a request
+ * @json: request, its placeholders are overwritten with '0'
+ * @len: length of @json
+ * @pieces: array for the piece after each placeholder, NULL to count them
+ * Returns: number of placeholders
+ */
+static int prepared_split(char *json, size_t len, struct prepared_piece *pieces)
+{
+	int in_string = 0;
+	int n = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (in_string) {
+			if (json[i] == '\\') {
+				i++;
+			} else if (json[i] == '"') {
+				in_string = 0;
+			}
+		} else if (json[i] == '"') {
+			in_string = 1;
+		} else if (json[i] == PLACEHOLDER) {
+			if (pieces != NULL) {
+				json[i] = '0';
+				pieces[n].json = json + i + 1;
+				if (n > 0) {
+					pieces[n - 1].len = json + i - pieces[n - 1].json;
+				}
+			}
+			n++;
+		}
+	}
+
+	return n;
+}
+
+static struct aws_dynamo_prepared *prepare(const char *target, const char *request,
+	struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	struct aws_dynamo_prepared *p;
+	const char *start;
+	const char *end;
+	size_t len;
+
+	p = calloc(1, sizeof(*p));
+	if (p == NULL) {
+		Warnx("prepare: alloc failed.");
+		return NULL;
+	}
+	p->target = target;
+
+	len = strlen(request);
+	p->json = strdup(request);
+	if (p->json == NULL) {
+		Warnx("prepare: alloc failed.");
+		goto error;
+	}
+
+	p->num_values = prepared_split(p->json, len, NULL);
+	if (p->num_values > 0) {
+		p->pieces = calloc(p->num_values, sizeof(*(p->pieces)));
+		if (p->pieces == NULL) {
+			Warnx("prepare: alloc failed.");
+			goto error;
+		}
+		prepared_split(p->json, len, p->pieces);
+	}
+
+	/* With its placeholders filled in the request must be an object. */
+	for (start = p->json; *start == ' ' || *start == '\t' || *start == '\r' ||
+		*start == '\n'; start++) {
+	}
+	end = strrchr(p->json, '}');
+	if (*start != '{' || end == NULL ||
+	    aws_dynamo_tokenize(&prepared_check_callbacks, NULL,
+		(const unsigned char *)p->json, len) == -1) {
+		Warnx("prepare: the request is not a JSON object: %s", request);
+		goto error;
+	}
+
+	/* The builder closes the request. */
+	if (p->num_values > 0) {
+		aws_dynamo_builder_prefix_init(&(p->prefix), start,
+			p->pieces[0].json - 1 - start);
+		p->pieces[p->num_values - 1].len = end - p->pieces[p->num_values - 1].json;
+	} else {
+		aws_dynamo_builder_prefix_init(&(p->prefix), start, end - start);
+	}
+
+	aws_dynamo_template_init(&(p->template), attributes, num_attributes);
+
+	return p;
+
+error:
+	free(p->pieces);
+	free(p->json);
+	free(p);
+	return NULL;
+}
+
+struct aws_dynamo_prepared *aws_dynamo_prepare_get_item(const char *request,
+	struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	return prepare(AWS_DYNAMO_GET_ITEM, request, attributes, num_attributes);
+}
+
+struct aws_dynamo_prepared *aws_dynamo_prepare_query(const char *request,
+	struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	return prepare(AWS_DYNAMO_QUERY, request, attributes, num_attributes);
+}
+
+struct aws_dynamo_prepared *aws_dynamo_prepare_update_item(const char *request,
+	struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	return prepare(AWS_DYNAMO_UPDATE_ITEM, request, attributes, num_attributes);
+}
+
+int aws_dynamo_prepared_num_values(const struct aws_dynamo_prepared *p)
+{
+	return p->num_values;
+}
+
+const char *aws_dynamo_prepared_request(struct aws_handle *aws,
+	const struct aws_dynamo_prepared *p,
+	const struct aws_dynamo_attribute *values, int num_values)
+{
+	struct aws_dynamo_builder *b;
+	int i;
+
+	if (num_values != p->num_values) {
+		Warnx("aws_dynamo_prepared_request: %d values for %d placeholders.",
+			num_values, p->num_values);
+		return NULL;
+	}
+
+	b = aws_dynamo_builder_get(aws);
+	if (b == NULL) {
+		return NULL;
+	}
+
+	if (aws_dynamo_builder_start(b, &(p->prefix)) == -1) {
+		return NULL;
+	}
+
+	for (i = 0; i < num_values; i++) {
+		if (aws_dynamo_builder_splice_value(b, &(values[i])) == -1 ||
+		    aws_dynamo_builder_splice(b, p->pieces[i].json, p->pieces[i].len) == -1) {
+			return NULL;
+		}
+	}
+
+	return aws_dynamo_builder_finish(b, NULL);
+}
+
+/* Check @p was prepared for @target. */
+static int prepared_check(const struct aws_dynamo_prepared *p, const char *target)
+{
+	if (strcmp(p->target, target) != 0) {
+		Warnx("prepared_check: request prepared for %s, not %s.",
+			p->target, target);
+		return -1;
+	}
+
+	return 0;
+}
+
+struct aws_dynamo_get_item_response *aws_dynamo_prepared_get_item(struct aws_handle *aws,
+	const struct aws_dynamo_prepared *p,
+	const struct aws_dynamo_attribute *values, int num_values)
+{
+	const char *request;
+
+	if (prepared_check(p, AWS_DYNAMO_GET_ITEM) == -1) {
+		return NULL;
+	}
+
+	request = aws_dynamo_prepared_request(aws, p, values, num_values);
+	if (request == NULL) {
+		return NULL;
+	}
+
+	return aws_dynamo_get_item_template(aws, request, &(p->template));
+}
+
+struct aws_dynamo_query_response *aws_dynamo_prepared_query(struct aws_handle *aws,
+	const struct aws_dynamo_prepared *p,
+	const struct aws_dynamo_attribute *values, int num_values)
+{
+	const char *request;
+
+	if (prepared_check(p, AWS_DYNAMO_QUERY) == -1) {
+		return NULL;
+	}
+
+	request = aws_dynamo_prepared_request(aws, p, values, num_values);
+	if (request == NULL) {
+		return NULL;
+	}
+
+	return aws_dynamo_query_template(aws, request, &(p->template));
+}
+
+struct aws_dynamo_update_item_response *aws_dynamo_prepared_update_item(struct aws_handle *aws,
+	const struct aws_dynamo_prepared *p,
+	const struct aws_dynamo_attribute *values, int num_values)
+{
+	const char *request;
+
+	if (prepared_check(p, AWS_DYNAMO_UPDATE_ITEM) == -1) {
+		return NULL;
+	}
+
+	request = aws_dynamo_prepared_request(aws, p, values, num_values);
+	if (request == NULL) {
+		return NULL;
+	}
+
+	return aws_dynamo_update_item_template(aws, request, &(p->template));
+}
+
+void aws_dynamo_prepared_free(struct aws_dynamo_prepared *p)
+{
+	if (p == NULL) {
+		return;
+	}
+
+	aws_dynamo_template_deinit(&(p->template));
+	free(p->pieces);
+	free(p->json);
+	free(p);
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AWS_DYNAMO_PREPARED_H_
+#define _AWS_DYNAMO_PREPARED_H_
+
+#include "aws_dynamo.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A request made over and over with only its key values changing can be
+ * prepared once.  The request is given with a '?' in place of each value
+ * that changes, each standing for an attribute value such as {"S":"abc"}:
+ *
+ *	{"TableName":"users","Key":{"HashKeyElement":?},
+ *	 "AttributesToGet":["name","city"]}
+ *
+ * Preparing checks the request, splits it at its placeholders, hashes its
+ * start for the signature and compiles the attribute template of the
+ * response.  Each request made with it then copies the pieces of the
+ * request around the new values into the calling thread's builder, see
+ * aws_dynamo_builder.h, and parses the response with the compiled template.
+ *
+ * A prepared request is not changed by its use and can be shared by any
+ * number of threads.
+ */
+
+struct aws_dynamo_prepared;
+
+/**
+ * aws_dynamo_prepare_get_item - prepare a GetItem
+ * @request: GetItem request with '?' placeholders for attribute values
+ * @attributes: attribute template of the item, it must outlive the
+ *		prepared request
+ * @num_attributes: number of attributes in @attributes
+ * Returns: prepared request, NULL if @request is not a JSON object or on
+ *	    failure to allocate
+ */
+struct aws_dynamo_prepared *aws_dynamo_prepare_get_item(const char *request,
+	struct aws_dynamo_attribute *attributes, int num_attributes);
+
+/**
+ * aws_dynamo_prepare_query - prepare a Query
+ * @request: Query request with '?' placeholders for attribute values
+ * @attributes: attribute template of the items, it must outlive the
+ *		prepared request
+ * @num_attributes: number of attributes in @attributes
+ * Returns: prepared request, NULL if @request is not a JSON object or on
+ *	    failure to allocate
+ */
+struct aws_dynamo_prepared *aws_dynamo_prepare_query(const char *request,
+	struct aws_dynamo_attribute *attributes, int num_attributes);
+
+/**
+ * aws_dynamo_prepare_update_item - prepare an UpdateItem
+ * @request: UpdateItem request with '?' placeholders for attribute values
+ * @attributes: attribute template of the returned attributes, it must
+ *		outlive the prepared request
+ * @num_attributes: number of attributes in @attributes
+ * Returns: prepared request, NULL if @request is not a JSON object or on
+ *	    failure to allocate
+ */
+struct aws_dynamo_prepared *aws_dynamo_prepare_update_item(const char *request,
+	struct aws_dynamo_attribute *attributes, int num_attributes);
+
+/**
+ * aws_dynamo_prepared_num_values - get the number of placeholders
+ * @p: prepared request
+ * Returns: the number of values each request made with @p takes
+ */
+int aws_dynamo_prepared_num_values(const struct aws_dynamo_prepared *p);
+
+/**
+ * aws_dynamo_prepared_request - write a prepared request
+ * @aws: library handle
+ * @p: prepared request
+ * @values: attributes whose values replace the placeholders, in order;
+ *	    their names are not used
+ * @num_values: number of values in @values
+ * Returns: the request in the calling thread's builder, NULL on failure
+ */
+const char *aws_dynamo_prepared_request(struct aws_handle *aws,
+	const struct aws_dynamo_prepared *p,
+	const struct aws_dynamo_attribute *values, int num_values);
+
+/**
+ * aws_dynamo_prepared_get_item - make a prepared GetItem
+ * @aws: library handle
+ * @p: request prepared with aws_dynamo_prepare_get_item()
+ * @values: attributes whose values replace the placeholders, in order
+ * @num_values: number of values in @values
+ * Returns: as aws_dynamo_get_item()
+ */
+struct aws_dynamo_get_item_response *aws_dynamo_prepared_get_item(struct aws_handle *aws,
+	const struct aws_dynamo_prepared *p,
+	const struct aws_dynamo_attribute *values, int num_values);
+
+/**
+ * aws_dynamo_prepared_query - make a prepared Query
+ * @aws: library handle
+ * @p: request prepared with aws_dynamo_prepare_query()
+ * @values: attributes whose values replace the placeholders, in order
+ * @num_values: number of values in @values
+ * Returns: as aws_dynamo_query()
+ */
+struct aws_dynamo_query_response *aws_dynamo_prepared_query(struct aws_handle *aws,
+	const struct aws_dynamo_prepared *p,
+	const struct aws_dynamo_attribute *values, int num_values);
+
+/**
+ * aws_dynamo_prepared_update_item - make a prepared UpdateItem
+ * @aws: library handle
+ * @p: request prepared with aws_dynamo_prepare_update_item()
+ * @values: attributes whose values replace the placeholders, in order
+ * @num_values: number of values in @values
+ * Returns: as aws_dynamo_update_item()
+ */
+struct aws_dynamo_update_item_response *aws_dynamo_prepared_update_item(struct aws_handle *aws,
+	const struct aws_dynamo_prepared *p,
+	const struct aws_dynamo_attribute *values, int num_values);
+
+/**
+ * aws_dynamo_prepared_free - free a prepared request
+ * @p: prepared request, may be NULL
+ */
+void aws_dynamo_prepared_free(struct aws_dynamo_prepared *p);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* _AWS_DYNAMO_PREPARED_H_ */
@@ -27,6 +27,7 @@
 #include "http.h"
 #include "aws_dynamo.h"
 #include "aws_dynamo_put_item.h"
+#include "aws_dynamo_template.h"
 
 enum {
 	PARSER_STATE_NONE = 0,
@@ -46,6 +47,9 @@ struct put_item_ctx {
 	/* Index into the response structure. */
 	int attribute_index;
 
+	/* The attribute template compiled for lookups. */
+	struct aws_dynamo_template template;
+
 	int parser_state;
 };
 
@@ -185,21 +189,9 @@ static int put_item_map_key(void *ctx, const unsigned char *val,
 		}
 	case PARSER_STATE_ATTRIBUTES_MAP:{
 			/* Set the attribute index based on the name. */
-			int attribute;
-
-			for (attribute = 0; attribute < _ctx->r->num_attributes;
-			     attribute++) {
-				struct aws_dynamo_attribute *a =
-				    &(_ctx->r->attributes[attribute]);
-
-				if (len == a->name_len
-				    && strncmp(val, a->name, len) == 0) {
-					_ctx->attribute_index = attribute;
-					break;
-				}
-			}
-
-			if (attribute == _ctx->r->num_attributes) {
+			_ctx->attribute_index = aws_dynamo_template_lookup(&(_ctx->template),
+				val, len);
+			if (_ctx->attribute_index == -1) {
 				char attr[len + 1];
 				snprintf(attr, len + 1, "%s", val);
 
@@ -211,19 +203,15 @@ static int put_item_map_key(void *ctx, const unsigned char *val,
 		}
 	case PARSER_STATE_ATTRIBUTE_MAP:{
 			/* verify the attribute is of the expected type. */
-			struct aws_dynamo_attribute *a;
-			const char *expected_type;
-
-			a = &(_ctx->r->attributes[_ctx->attribute_index]);
-			expected_type = aws_dynamo_attribute_types[a->type];
-
-			if (len != strlen(expected_type)
-			    || strncmp(val, expected_type, len) != 0) {
+			if (!aws_dynamo_template_check_type(&(_ctx->template),
+				_ctx->attribute_index, val, len)) {
+				struct aws_dynamo_attribute *a;
 				char type[len + 1];
 				snprintf(type, len + 1, "%s", val);
 
+				a = &(_ctx->r->attributes[_ctx->attribute_index]);
 				Warnx("put_item_map_key: Unexpected type for attribute %s.  Got %s, expected %s.",
-					a->name, type, expected_type);
+					a->name, type, aws_dynamo_attribute_types[a->type]);
 				return 0;
 			}
 			_ctx->parser_state = PARSER_STATE_ATTRIBUTE_VALUE;
@@ -361,6 +349,8 @@ struct aws_dynamo_put_item_response * aws_dynamo_parse_put_item_response(const c
 		_ctx.r->num_attributes = num_attributes;
 	}
 
+	aws_dynamo_template_init(&(_ctx.template), attributes, num_attributes);
+
 #if YAJL_MAJOR == 2
 	hand = yajl_alloc(&put_item_callbacks, NULL, &_ctx);
 	yajl_parse(hand, response, response_len);
@@ -377,11 +367,13 @@ struct aws_dynamo_put_item_response * aws_dynamo_parse_put_item_response(const c
 		Warnx("aws_dynamo_parse_put_item_response: json parse failed, '%s'", (const char *)str);
 		yajl_free_error(hand, str);
 		yajl_free(hand);
+		aws_dynamo_template_deinit(&(_ctx.template));
 		aws_dynamo_free_put_item_response(_ctx.r);
 		return NULL;
 	}
 
 	yajl_free(hand);
+	aws_dynamo_template_deinit(&(_ctx.template));
 	return _ctx.r;
 }
 
@@ -395,7 +387,7 @@ struct aws_dynamo_put_item_response *aws_dynamo_put_item(struct aws_handle *aws,
 		return NULL;
 	}
 
-	response = http_get_data(aws->http, &response_len);
+	response = http_get_data(aws_get_http(aws), &response_len);
 
 	if (response == NULL) {
 		Warnx("aws_dynamo_put_item: Failed to get response.");
@@ -405,9 +397,12 @@ struct aws_dynamo_put_item_response *aws_dynamo_put_item(struct aws_handle *aws,
 	if ((r = aws_dynamo_parse_put_item_response(response, response_len,
 						      attributes, num_attributes)) == NULL) {
 		Warnx("aws_dynamo_put_item: Failed to parse response: '%s'", response);
+		http_release_data(aws_get_http(aws));
 		return NULL;
 	}
 
+	http_release_data(aws_get_http(aws));
+
 	return r;
 }
 
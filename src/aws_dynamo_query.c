@@ -27,6 +27,10 @@
 #include "http.h"
 #include "aws_dynamo.h"
 #include "aws_dynamo_query.h"
+#include "aws_dynamo_stream.h"
+#include "aws_arena.h"
+#include "aws_dynamo_template.h"
+#include "aws_dynamo_tokenizer.h"
 
 enum {
 	PARSER_STATE_NONE,
@@ -84,6 +88,17 @@ struct query_ctx {
 	/* These define the expected attributes for each item. */
 	struct aws_dynamo_attribute *attributes; /* attribute template */
 	int num_attributes; /* number of attributes for each item. */
+	const struct aws_dynamo_template *template; /* the template compiled for lookups */
+
+	/* AWS_DYNAMO_PARSE_* flags and the expected size of the response. */
+	int flags;
+	size_t size_hint;
+
+	/* Body strings are borrowed from with AWS_DYNAMO_PARSE_BORROW. */
+	struct http_body *body;
+
+	/* Unknown keys skipped with AWS_DYNAMO_PARSE_SKIP_UNKNOWN. */
+	struct aws_dynamo_skip skip;
 
 	int parser_state;
 };
@@ -98,6 +113,10 @@ static int query_number(void * ctx, const char *val, unsigned int len)
 	Debug("query_number, val = %s, enter state '%s'", buf, parser_state_string(q_ctx->parser_state));
 #endif /* DEBUG_PARSER */
 
+	if (aws_dynamo_skip_event(&(q_ctx->skip), AWS_DYNAMO_SKIP_SCALAR)) {
+		return 1;
+	}
+
 	switch (q_ctx->parser_state) {
 		case PARSER_STATE_COUNT_KEY: {
 			if (aws_dynamo_json_get_int(val, len, &(q_ctx->r->count)) == -1) {
@@ -107,40 +126,16 @@ static int query_number(void * ctx, const char *val, unsigned int len)
 				/* Assume we can depend on getting the Count attribute before any Items.
 					If this is an invalid assumption then we'll need to add new items using
 					realloc. */
-
-				struct aws_dynamo_item *items;
-
-				items = calloc(sizeof(*items), q_ctx->r->count);
-				if (items == NULL) {
+				if (aws_dynamo_alloc_item_matrix(q_ctx->r->arena, q_ctx->r->count,
+					q_ctx->attributes, q_ctx->num_attributes,
+					&(q_ctx->r->items), &(q_ctx->r->attributes)) == -1) {
 					Warnx("query_number: item alloc failed.");
 					return 0;
-				} else {
-					int item;
-
-					q_ctx->r->items = items;
-
-					for (item = 0; item < q_ctx->r->count; item++) {
-						struct aws_dynamo_attribute *attributes;
-
-						attributes = malloc(sizeof(*attributes) * q_ctx->num_attributes);
-						if (attributes == NULL) {
-							Warnx("query_number: attribute alloc failed.");
-							for (item = item - 1; item >= 0; item--) {
-								free(q_ctx->r->items[item].attributes);
-							}
-							free(q_ctx->r->items);	
-							return 0;
-						}
-
-						/* Set expected types for attributes. */
-						memcpy(attributes, q_ctx->attributes,
-							sizeof(*attributes) * q_ctx->num_attributes);
-						q_ctx->r->items[item].attributes = attributes;
-						q_ctx->r->items[item].num_attributes = q_ctx->num_attributes;
-					}
-					/* We haven't started any items yet. */
-					q_ctx->item_index = -1;
 				}
+				q_ctx->r->num_attributes = q_ctx->num_attributes;
+
+				/* We haven't started any items yet. */
+				q_ctx->item_index = -1;
 			}
 			q_ctx->parser_state = PARSER_STATE_ROOT_MAP;
 			break;
@@ -170,8 +165,6 @@ static int query_number(void * ctx, const char *val, unsigned int len)
 static int query_string(void *ctx, const unsigned char *val,  unsigned int len)
 {  
 	struct query_ctx *q_ctx = (struct query_ctx *) ctx;
-	struct aws_dynamo_item *item;
-	struct aws_dynamo_attribute *attribute;
 #ifdef DEBUG_PARSER
 	char buf[len + 1];
 	snprintf(buf, len + 1, "%s", val);
@@ -179,17 +172,29 @@ static int query_string(void *ctx, const unsigned char *val,  unsigned int len)
 	Debug("query_string, val = %s, enter state '%s'", buf, parser_state_string(q_ctx->parser_state));
 #endif /* DEBUG_PARSER */
 
-	if (q_ctx->r->items == NULL) {
-		Warnx("query_string - items is NULL, have we not gotten Count yet?");
-		return 0;
+	if (aws_dynamo_skip_event(&(q_ctx->skip), AWS_DYNAMO_SKIP_SCALAR)) {
+		return 1;
 	}
 
-	item = &(q_ctx->r->items[q_ctx->item_index]);
-	attribute = &(item->attributes[q_ctx->attribute_index]);
-
 	switch (q_ctx->parser_state) {
 		case PARSER_STATE_ATTRIBUTE_VALUE: {
-			if (aws_dynamo_parse_attribute_value(attribute, val, len) != 1) {
+			struct aws_dynamo_item *item;
+			struct aws_dynamo_attribute *attribute;
+
+			if (q_ctx->r->items == NULL) {
+				Warnx("query_string - items is NULL, have we not gotten Count yet?");
+				return 0;
+			}
+
+			if (q_ctx->item_index == -1) {
+				Warnx("query_string - item_index is not set.");
+				return 0;
+			}
+
+			item = &(q_ctx->r->items[q_ctx->item_index]);
+			attribute = &(item->attributes[q_ctx->attribute_index]);
+			if (aws_dynamo_parse_attribute_value_borrow(q_ctx->r->arena, q_ctx->body,
+				attribute, val, len) != 1) {
 				Warnx("query_string - attribute parse failed, item %d, attribute %d",
 					q_ctx->item_index, q_ctx->attribute_index);
 				return 0;
@@ -197,7 +202,7 @@ static int query_string(void *ctx, const unsigned char *val,  unsigned int len)
 			break;
 		}
 		case PARSER_STATE_LAST_EVALUATED_HASH_KEY_MAP: {
-			q_ctx->r->hash_key->value = strndup(val, len);
+			q_ctx->r->hash_key->value = aws_dynamo_strndup_borrow(q_ctx->r->arena, q_ctx->body, val, len);
 			if (q_ctx->r->hash_key->value == NULL) {
 				Warnx("query_string: failed to allocated last evaluated hash key value");
 				return 0;
@@ -205,7 +210,7 @@ static int query_string(void *ctx, const unsigned char *val,  unsigned int len)
 			break;
 		}
 		case PARSER_STATE_LAST_EVALUATED_RANGE_KEY_MAP: {
-			q_ctx->r->range_key->value = strndup(val, len);
+			q_ctx->r->range_key->value = aws_dynamo_strndup_borrow(q_ctx->r->arena, q_ctx->body, val, len);
 			if (q_ctx->r->range_key->value == NULL) {
 				Warnx("query_string: failed to allocated last evaluated range key value");
 				return 0;
@@ -234,6 +239,10 @@ static int query_start_map(void *ctx)
 	Debug("query_start_map, enter state '%s'", parser_state_string(q_ctx->parser_state));
 #endif /* DEBUG_PARSER */
 
+	if (aws_dynamo_skip_event(&(q_ctx->skip), AWS_DYNAMO_SKIP_START)) {
+		return 1;
+	}
+
 	switch (q_ctx->parser_state) {
 		case PARSER_STATE_NONE: {
 			q_ctx->parser_state = PARSER_STATE_ROOT_MAP;
@@ -288,6 +297,10 @@ static int query_map_key(void *ctx, const unsigned char *val,
 	Debug("query_map_key, val = %s, enter state '%s'", buf, parser_state_string(q_ctx->parser_state));
 #endif /* DEBUG_PARSER */
 
+	if (aws_dynamo_skip_event(&(q_ctx->skip), AWS_DYNAMO_SKIP_KEY)) {
+		return 1;
+	}
+
 	switch (q_ctx->parser_state) {
 		case PARSER_STATE_ROOT_MAP: {
 			if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_CONSUMED_CAPACITY, val, len)) {
@@ -298,6 +311,8 @@ static int query_map_key(void *ctx, const unsigned char *val,
 				q_ctx->parser_state = PARSER_STATE_ITEMS_KEY;
 			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_LAST_EVALUATED_KEY, val, len)) {
 				q_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_KEY;
+			} else if (q_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+				return aws_dynamo_skip_start(&(q_ctx->skip));
 			} else {
 				Warnx("query_map_key: Unknown key.");
 				return 0;
@@ -306,18 +321,11 @@ static int query_map_key(void *ctx, const unsigned char *val,
 		}
 		case PARSER_STATE_ITEM_MAP: {
 			/* Set the attribute index based on the name. */
-			int attribute;
-
-			for (attribute = 0; attribute < q_ctx->num_attributes; attribute++) {
-				struct aws_dynamo_attribute *a = &(q_ctx->attributes[attribute]);
-
-				if (len == a->name_len && strncmp(val, a->name, len) == 0) {
-					q_ctx->attribute_index = attribute;
-					break;
+			q_ctx->attribute_index = aws_dynamo_template_lookup(q_ctx->template, val, len);
+			if (q_ctx->attribute_index == -1) {
+				if (q_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+					return aws_dynamo_skip_start(&(q_ctx->skip));
 				}
-			}
-
-			if (attribute == q_ctx->num_attributes) {
 				Warnx("query_map_key: Unknown attribute.");
 				return 0;
 			}
@@ -325,10 +333,7 @@ static int query_map_key(void *ctx, const unsigned char *val,
 			break;
 		}
 		case PARSER_STATE_ATTRIBUTE_MAP: {
-			struct aws_dynamo_attribute *a = &(q_ctx->attributes[q_ctx->attribute_index]);
-			const char *expected_type = aws_dynamo_attribute_types[a->type];
-
-			if (len != strlen(expected_type) || strncmp(val, expected_type, len) != 0) {
+			if (!aws_dynamo_template_check_type(q_ctx->template, q_ctx->attribute_index, val, len)) {
 				Warnx("query_map_key: Unexpected attribute type.");
 				return 0;
 			}
@@ -352,13 +357,13 @@ static int query_map_key(void *ctx, const unsigned char *val,
 				return 0;
 			}
 
-			q_ctx->r->hash_key = calloc(1, sizeof(*(q_ctx->r->hash_key)));
+			q_ctx->r->hash_key = aws_arena_calloc(q_ctx->r->arena, 1, sizeof(*(q_ctx->r->hash_key)));
 			if (q_ctx->r->hash_key == NULL) {
 				Warnx("query_map_key: failed to allocated last evaluated hash key");
 				return 0;
 			}
 
-			q_ctx->r->hash_key->type = strndup(val, len);
+			q_ctx->r->hash_key->type = aws_dynamo_strndup_borrow(q_ctx->r->arena, q_ctx->body, val, len);
 			if (q_ctx->r->hash_key->type == NULL) {
 				Warnx("query_map_key: failed to allocated last evaluated hash key type");
 				return 0;
@@ -372,13 +377,13 @@ static int query_map_key(void *ctx, const unsigned char *val,
 				return 0;
 			}
 
-			q_ctx->r->range_key = calloc(1, sizeof(*(q_ctx->r->range_key)));
+			q_ctx->r->range_key = aws_arena_calloc(q_ctx->r->arena, 1, sizeof(*(q_ctx->r->range_key)));
 			if (q_ctx->r->range_key == NULL) {
 				Warnx("query_map_key: failed to allocated last evaluated range key");
 				return 0;
 			}
 
-			q_ctx->r->range_key->type = strndup(val, len);
+			q_ctx->r->range_key->type = aws_dynamo_strndup_borrow(q_ctx->r->arena, q_ctx->body, val, len);
 			if (q_ctx->r->range_key->type == NULL) {
 				Warnx("query_map_key: failed to allocated last evaluated range key type");
 				return 0;
@@ -406,6 +411,10 @@ static int query_end_map(void *ctx)
 	Debug("query_end_map enter '%s'", parser_state_string(q_ctx->parser_state));
 #endif /* DEBUG_PARSER */
 
+	if (aws_dynamo_skip_event(&(q_ctx->skip), AWS_DYNAMO_SKIP_END)) {
+		return 1;
+	}
+
 	switch (q_ctx->parser_state) {
 		case PARSER_STATE_ATTRIBUTE_VALUE: {
 				q_ctx->parser_state = PARSER_STATE_ITEM_MAP;
@@ -452,6 +461,10 @@ static int query_start_array(void *ctx)
 	Debug("query_start_array enter state '%s'", parser_state_string(_ctx->parser_state));
 #endif				/* DEBUG_PARSER */
 
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_START)) {
+		return 1;
+	}
+
 	switch (_ctx->parser_state) {
 	case PARSER_STATE_ITEMS_KEY:{
 			_ctx->parser_state = PARSER_STATE_ITEMS_ARRAY;
@@ -482,6 +495,10 @@ static int query_end_array(void *ctx)
 	Debug("query_end_array enter state '%s'", parser_state_string(_ctx->parser_state));
 #endif				/* DEBUG_PARSER */
 
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_END)) {
+		return 1;
+	}
+
 	switch (_ctx->parser_state) {
 	case PARSER_STATE_ITEMS_ARRAY:{
 			_ctx->parser_state = PARSER_STATE_ROOT_MAP;
@@ -515,69 +532,301 @@ static yajl_callbacks query_callbacks = {
 	.yajl_end_array = query_end_array,
 };
 
-struct aws_dynamo_query_response *aws_dynamo_parse_query_response(const char *response, int response_len,
-	struct aws_dynamo_attribute *attributes, int num_attributes)
+/* Start a new response, dropping any from an earlier parse. */
+static int query_reset(void *ctx)
+{
+	struct query_ctx *q_ctx = (struct query_ctx *) ctx;
+
+	aws_dynamo_free_query_response(q_ctx->r);
+	q_ctx->r = NULL;
+	q_ctx->item_index = 0;
+	q_ctx->attribute_index = 0;
+	q_ctx->parser_state = PARSER_STATE_NONE;
+	memset(&(q_ctx->skip), 0, sizeof(q_ctx->skip));
+
+	if (q_ctx->flags & (AWS_DYNAMO_PARSE_ARENA | AWS_DYNAMO_PARSE_BORROW)) {
+		struct aws_arena *arena;
+
+		/* The response itself comes from its arena. */
+		arena = aws_arena_init(q_ctx->size_hint);
+		if (arena == NULL) {
+			Warnx("query_reset: arena alloc failed.");
+			return -1;
+		}
+		q_ctx->r = aws_arena_calloc(arena, 1, sizeof(*(q_ctx->r)));
+		if (q_ctx->r == NULL) {
+			Warnx("query_reset: alloc failed.");
+			aws_arena_deinit(arena);
+			return -1;
+		}
+		q_ctx->r->arena = arena;
+		if (q_ctx->body != NULL) {
+			if (aws_arena_defer(arena, http_body_put, q_ctx->body) == -1) {
+				Warnx("query_reset: body defer failed.");
+				aws_arena_deinit(arena);
+				q_ctx->r = NULL;
+				return -1;
+			}
+			http_body_get(q_ctx->body);
+		}
+		return 0;
+	}
+
+	q_ctx->r = calloc(sizeof(*(q_ctx->r)), 1);
+	if (q_ctx->r == NULL) {
+		Warnx("query_reset: alloc failed.");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * aws_dynamo_query_parse - parse a complete query response
+ * @response: response body
+ * @response_len: length of @response
+ * @template: compiled attribute template of the items
+ * @flags: AWS_DYNAMO_PARSE_* flags
+ * @body: body holding @response to borrow strings from, NULL to copy them
+ * Returns: response, NULL on failure
+ */
+static struct aws_dynamo_query_response *aws_dynamo_query_parse(const char *response, int response_len,
+	const struct aws_dynamo_template *template, int flags, struct http_body *body)
 {
-	yajl_handle hand;
-	yajl_status stat;
 	struct query_ctx q_ctx = {
-		.num_attributes = num_attributes,
-		.attributes = attributes,
+		.num_attributes = template->num_attributes,
+		.attributes = template->attributes,
+		.template = template,
+		.flags = flags,
+		.size_hint = response_len,
+		.body = body,
 	};
 
-	q_ctx.r = calloc(sizeof(*(q_ctx.r)), 1);
-	if (q_ctx.r == NULL) {
+	if (query_reset(&q_ctx) == -1) {
 		Warnx("aws_dynamo_parse_query_response: alooc failed.");
 		return NULL;
 	}
 
-#if YAJL_MAJOR == 2
-	hand = yajl_alloc(&query_callbacks, NULL, &q_ctx);
-	yajl_parse(hand, response, response_len);
-	stat = yajl_complete_parse(hand);
-#else
-	hand = yajl_alloc(&query_callbacks, NULL, NULL, &q_ctx);
-	yajl_parse(hand, response, response_len);
-	stat = yajl_parse_complete(hand);
-#endif
+	if (aws_dynamo_tokenize(&query_callbacks, &q_ctx, (const unsigned char *)response,
+		response_len) == -1) {
+		Warnx("aws_dynamo_parse_query_response: json parse failed.");
+		aws_dynamo_free_query_response(q_ctx.r);
+		return NULL;
+	}
+
+	return q_ctx.r;
+}
+
+struct aws_dynamo_query_response *aws_dynamo_parse_query_response(const char *response, int response_len,
+	struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	struct aws_dynamo_template template;
+	struct aws_dynamo_query_response *r;
+
+	aws_dynamo_template_init(&template, attributes, num_attributes);
+	r = aws_dynamo_query_parse(response, response_len, &template, 0, NULL);
+	aws_dynamo_template_deinit(&template);
+
+	return r;
+}
 
-	if (stat != yajl_status_ok) {
-		unsigned char * str = yajl_get_error(hand, 1, response, response_len);  
-		Warnx("aws_dynamo_parse_query_response: json parse failed, '%s'", (const char *) str);  
-		yajl_free_error(hand, str);  
-		yajl_free(hand);
+static struct aws_dynamo_query_response *aws_dynamo_query_stream(struct aws_handle *aws,
+	const char *request, const struct aws_dynamo_template *template)
+{
+	struct query_ctx q_ctx = {
+		.num_attributes = template->num_attributes,
+		.attributes = template->attributes,
+		.template = template,
+		.flags = aws->dynamo_parse_flags,
+	};
+
+	if (aws_dynamo_request_stream(aws, AWS_DYNAMO_QUERY, request,
+		&query_callbacks, query_reset, &q_ctx) == -1) {
+		Warnx("aws_dynamo_query: Failed to get or parse response.");
 		aws_dynamo_free_query_response(q_ctx.r);
 		return NULL;
 	}
 
-	yajl_free(hand);
 	return q_ctx.r;
 }
 
-struct aws_dynamo_query_response *aws_dynamo_query(struct aws_handle *aws,
-	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes)
+/* Parse the response of a request made with AWS_DYNAMO_PARSE_BORROW, the
+   response takes a reference to the body. */
+static struct aws_dynamo_query_response *aws_dynamo_query_borrow(struct aws_handle *aws,
+	const struct aws_dynamo_template *template)
+{
+	struct http_body *body;
+	struct aws_dynamo_query_response *r;
+
+	body = http_take_body(aws_get_http(aws));
+	if (body == NULL) {
+		Warnx("aws_dynamo_query: Failed to get response.");
+		return NULL;
+	}
+
+	r = aws_dynamo_query_parse((const char *)body->data, body->len,
+		template, aws->dynamo_parse_flags, body);
+	if (r == NULL) {
+		Warnx("aws_dynamo_query: Failed to parse response.");
+	}
+
+	http_body_put(body);
+	return r;
+}
+
+struct aws_dynamo_query_response *aws_dynamo_query_template(struct aws_handle *aws,
+	const char *request, const struct aws_dynamo_template *template)
 {
 	const char *response;
 	int response_len;
 	struct aws_dynamo_query_response *r;
 
+	if (aws->dynamo_parse_flags & AWS_DYNAMO_PARSE_STREAM) {
+		return aws_dynamo_query_stream(aws, request, template);
+	}
+
 	if (aws_dynamo_request(aws, AWS_DYNAMO_QUERY, request) == -1) {
 		return NULL;
 	}
 
-	response = http_get_data(aws->http, &response_len);
+	if (aws->dynamo_parse_flags & AWS_DYNAMO_PARSE_BORROW) {
+		return aws_dynamo_query_borrow(aws, template);
+	}
+
+	response = http_get_data(aws_get_http(aws), &response_len);
 
 	if (response == NULL) {
 		Warnx("aws_dynamo_query: Failed to get response.");
 		return NULL; 
 	}
 
-	if ((r = aws_dynamo_parse_query_response(response, response_len,
-		attributes, num_attributes)) == NULL) {
+	if ((r = aws_dynamo_query_parse(response, response_len,
+		template, aws->dynamo_parse_flags, NULL)) == NULL) {
 		Warnx("aws_dynamo_query: Failed to parse response: '%s'", response);
+		http_release_data(aws_get_http(aws));
 		return NULL; 
 	}
 
+	http_release_data(aws_get_http(aws));
+
+	return r;
+}
+
+struct aws_dynamo_query_response *aws_dynamo_query(struct aws_handle *aws,
+	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	struct aws_dynamo_template template;
+	struct aws_dynamo_query_response *r;
+
+	aws_dynamo_template_init(&template, attributes, num_attributes);
+	r = aws_dynamo_query_template(aws, request, &template);
+	aws_dynamo_template_deinit(&template);
+
+	return r;
+}
+
+/**
+ * query_combine_items - lay out the items of two responses in one block
+ * @arena: arena of the combined response, NULL for the heap
+ * @r: combined response
+ * @current: response whose items come first
+ * @next: response whose items follow
+ * Returns: 0 on success, -1 on failure with nothing changed
+ *
+ * The attribute values move to @r, the item arrays and attribute blocks of
+ * @current and @next are left for the caller to free.
+ */
+static int query_combine_items(struct aws_arena *arena,
+	struct aws_dynamo_query_response *r,
+	struct aws_dynamo_query_response *current,
+	struct aws_dynamo_query_response *next)
+{
+	struct aws_dynamo_query_response *parts[] = { current, next };
+	struct aws_dynamo_attribute *attributes = NULL;
+	struct aws_dynamo_item *items;
+	int num_attributes;
+	size_t offset = 0;
+	int count;
+	int part;
+	int i;
+
+	num_attributes = current->count > 0 ? current->num_attributes : next->num_attributes;
+	if (current->count > 0 && next->count > 0 &&
+		current->num_attributes != next->num_attributes) {
+		Warnx("aws_dynamo_query_combine_and_free_responses: attribute counts differ");
+		return -1;
+	}
+	count = current->count + next->count;
+
+	items = aws_arena_calloc(arena, count, sizeof(*items));
+	if (items == NULL) {
+		Warnx("aws_dynamo_query_combine_and_free_responses: alloc failed");
+		return -1;
+	}
+
+	if (count > 0 && num_attributes > 0) {
+		attributes = aws_arena_alloc(arena, sizeof(*attributes) * (size_t)count * num_attributes);
+		if (attributes == NULL) {
+			Warnx("aws_dynamo_query_combine_and_free_responses: alloc failed");
+			aws_arena_free(arena, items);
+			return -1;
+		}
+	}
+
+	for (part = 0; part < 2; part++) {
+		struct aws_dynamo_attribute *from = parts[part]->attributes;
+		size_t n = (size_t)parts[part]->count * num_attributes;
+
+		if (n == 0) {
+			continue;
+		}
+		memcpy(attributes + offset, from, sizeof(*attributes) * n);
+		offset += n;
+	}
+
+	for (i = 0; i < count; i++) {
+		items[i].attributes = attributes + (size_t)i * num_attributes;
+		items[i].num_attributes = num_attributes;
+	}
+
+	r->count = count;
+	r->items = items;
+	r->attributes = attributes;
+	r->num_attributes = num_attributes;
+
+	return 0;
+}
+
+/* Combine responses parsed with AWS_DYNAMO_PARSE_ARENA, the result owns
+   the memory of both. */
+static struct aws_dynamo_query_response *aws_dynamo_query_combine_arenas(
+					 struct aws_dynamo_query_response *current,
+					 struct aws_dynamo_query_response *next) {
+	struct aws_dynamo_query_response *r;
+	struct aws_arena *arena = current->arena;
+
+	if (current->arena == NULL || next->arena == NULL) {
+		Warnx("aws_dynamo_query_combine_and_free_responses: can't combine arena and heap responses");
+		return NULL;
+	}
+
+	r = aws_arena_calloc(arena, 1, sizeof(*r));
+	if (r == NULL) {
+		Warnx("aws_dynamo_query_combine_and_free_responses: alloc failed");
+		return NULL;
+	}
+
+	if (query_combine_items(arena, r, current, next) == -1) {
+		return NULL;
+	}
+
+	r->consumed_capacity_units = current->consumed_capacity_units + next->consumed_capacity_units;
+	r->hash_key = next->hash_key;
+	r->range_key = next->range_key;
+	r->arena = arena;
+
+	aws_arena_adopt(arena, next->arena);
+
 	return r;
 }
 
@@ -586,28 +835,27 @@ struct aws_dynamo_query_response *aws_dynamo_query_combine_and_free_responses(
 					 struct aws_dynamo_query_response *next) {
 	struct aws_dynamo_query_response *r;
 
+	if (current->arena != NULL || next->arena != NULL) {
+		return aws_dynamo_query_combine_arenas(current, next);
+	}
+
 	r = calloc(1, sizeof(*r));
 	if (r == NULL) {
 		Warnx("aws_dynamo_query_combine_and_free_responses: calloc() failed");
 		return NULL;
 	}
 
-	r->consumed_capacity_units = current->consumed_capacity_units + next->consumed_capacity_units;
-	r->count = current->count + next->count;
-	r->items = realloc(current->items, sizeof(*(current->items)) * (r->count));
-	if (r->items == NULL) {
-		Warnx("aws_dynamo_query_combine_and_free_responses: realloc() failed");
+	if (query_combine_items(NULL, r, current, next) == -1) {
 		free(r);
 		return NULL;
 	}
 
-	/* copy items from 'next' to the new array. */
-  	memcpy(r->items + current->count, next->items, next->count * sizeof(*(next->items)));	
-
+	r->consumed_capacity_units = current->consumed_capacity_units + next->consumed_capacity_units;
 	r->hash_key = next->hash_key;
 	r->range_key = next->range_key;
 
-	/* Free the pieces we aren't using. */
+	/* Free the pieces we aren't using, the attribute values moved. */
+	free(next->attributes);
 	free(next->items);
 	free(next);
 
@@ -622,6 +870,8 @@ struct aws_dynamo_query_response *aws_dynamo_query_combine_and_free_responses(
 		free(current->range_key->value);
 		free(current->range_key);
 	}
+	free(current->attributes);
+	free(current->items);
 	free(current);
 
 	return r;
@@ -660,20 +910,18 @@ void aws_dynamo_dump_query_response(struct aws_dynamo_query_response *r) {
 
 
 void aws_dynamo_free_query_response(struct aws_dynamo_query_response *r) {
-	int i;
-	struct aws_dynamo_item *items;
-
 	if (r == NULL) {
 		return;
 	}
 
-	items = r->items;
-	for (i = 0; i < r->count; i++) {
-		struct aws_dynamo_item *item = &(items[i]);
-
-		aws_dynamo_free_attributes(item->attributes, item->num_attributes);
+	if (r->arena != NULL) {
+		/* Everything, r included, is in the arena. */
+		aws_arena_deinit(r->arena);
+		return;
 	}
 
+	aws_dynamo_free_item_matrix(r->attributes, r->count, r->num_attributes);
+
 	if (r->hash_key) {
 		free(r->hash_key->type);
 		free(r->hash_key->value);
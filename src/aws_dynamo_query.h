@@ -31,9 +31,20 @@ struct aws_dynamo_query_response {
 		
 	struct aws_dynamo_item *items;
 
+	/* The attributes of all the items in one block, row by row: item i
+		has attributes[i * num_attributes] up to but not including
+		attributes[(i + 1) * num_attributes], which items[i].attributes
+		points to. */
+	struct aws_dynamo_attribute *attributes;
+	int num_attributes;
+
 	/* Last evaluated keys. */
 	struct aws_dynamo_key *hash_key;
 	struct aws_dynamo_key *range_key;
+
+	/* Holds all of the above when parsed with AWS_DYNAMO_PARSE_ARENA or
+		AWS_DYNAMO_PARSE_BORROW, NULL otherwise. */
+	struct aws_arena *arena;
 };
 
 struct aws_dynamo_query_response *aws_dynamo_parse_query_response(const char *response,
@@ -42,6 +53,8 @@ struct aws_dynamo_query_response *aws_dynamo_parse_query_response(const char *re
 struct aws_dynamo_query_response *aws_dynamo_query(struct aws_handle *aws,
 	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes);
 
+/* Copies the items of both responses, to collect many pages use struct
+   aws_dynamo_pages instead. */
 struct aws_dynamo_query_response *aws_dynamo_query_combine_and_free_responses(
 					 struct aws_dynamo_query_response *current,
 					 struct aws_dynamo_query_response *next);
@@ -27,6 +27,10 @@
 #include "http.h"
 #include "aws_dynamo.h"
 #include "aws_dynamo_scan.h"
+#include "aws_dynamo_stream.h"
+#include "aws_arena.h"
+#include "aws_dynamo_template.h"
+#include "aws_dynamo_tokenizer.h"
 
 enum {
 	PARSER_STATE_NONE,
@@ -86,6 +90,17 @@ struct scan_ctx {
 	/* These define the expected attributes for each item. */
 	struct aws_dynamo_attribute *attributes; /* attribute template */
 	int num_attributes; /* number of attributes for each item. */
+	struct aws_dynamo_template template; /* the template compiled for lookups */
+
+	/* AWS_DYNAMO_PARSE_* flags and the expected size of the response. */
+	int flags;
+	size_t size_hint;
+
+	/* Body strings are borrowed from with AWS_DYNAMO_PARSE_BORROW. */
+	struct http_body *body;
+
+	/* Unknown keys skipped with AWS_DYNAMO_PARSE_SKIP_UNKNOWN. */
+	struct aws_dynamo_skip skip;
 
 	int parser_state;
 };
@@ -100,6 +115,10 @@ static int scan_number(void * ctx, const char *val, unsigned int len)
 	Debug("scan_number, val = %s, enter state '%s'", buf, parser_state_string(_ctx->parser_state));
 #endif /* DEBUG_PARSER */
 
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_SCALAR)) {
+		return 1;
+	}
+
 	switch (_ctx->parser_state) {
 		case PARSER_STATE_COUNT_KEY: {
 			if (aws_dynamo_json_get_int(val, len, &(_ctx->r->count)) == -1) {
@@ -109,40 +128,16 @@ static int scan_number(void * ctx, const char *val, unsigned int len)
 				/* Assume we can depend on getting the Count attribute before any Items.
 					If this is an invalid assumption then we'll need to add new items using
 					realloc. */
-
-				struct aws_dynamo_item *items;
-
-				items = calloc(sizeof(*items), _ctx->r->count);
-				if (items == NULL) {
+				if (aws_dynamo_alloc_item_matrix(_ctx->r->arena, _ctx->r->count,
+					_ctx->attributes, _ctx->num_attributes,
+					&(_ctx->r->items), &(_ctx->r->attributes)) == -1) {
 					Warnx("scan_number: item alloc failed.");
 					return 0;
-				} else {
-					int item;
-
-					_ctx->r->items = items;
-
-					for (item = 0; item < _ctx->r->count; item++) {
-						struct aws_dynamo_attribute *attributes;
-
-						attributes = malloc(sizeof(*attributes) * _ctx->num_attributes);
-						if (attributes == NULL) {
-							Warnx("scan_number: attribute alloc failed.");
-							for (item = item - 1; item >= 0; item--) {
-								free(_ctx->r->items[item].attributes);
-							}
-							free(_ctx->r->items);	
-							return 0;
-						}
-
-						/* Set expected types for attributes. */
-						memcpy(attributes, _ctx->attributes,
-							sizeof(*attributes) * _ctx->num_attributes);
-						_ctx->r->items[item].attributes = attributes;
-						_ctx->r->items[item].num_attributes = _ctx->num_attributes;
-					}
-					/* We haven't started any items yet. */
-					_ctx->item_index = -1;
 				}
+				_ctx->r->num_attributes = _ctx->num_attributes;
+
+				/* We haven't started any items yet. */
+				_ctx->item_index = -1;
 			}
 			_ctx->parser_state = PARSER_STATE_ROOT_MAP;
 			break;
@@ -187,6 +182,10 @@ static int scan_string(void *ctx, const unsigned char *val,  unsigned int len)
 	Debug("scan_string, val = %s, enter state '%s'", buf, parser_state_string(_ctx->parser_state));
 #endif /* DEBUG_PARSER */
 
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_SCALAR)) {
+		return 1;
+	}
+
 	switch (_ctx->parser_state) {
 		case PARSER_STATE_ATTRIBUTE_VALUE: {
 			struct aws_dynamo_item *item;
@@ -204,7 +203,8 @@ static int scan_string(void *ctx, const unsigned char *val,  unsigned int len)
 
 			item = &(_ctx->r->items[_ctx->item_index]);
 			attribute = &(item->attributes[_ctx->attribute_index]);
-			if (aws_dynamo_parse_attribute_value(attribute, val, len) != 1) {
+			if (aws_dynamo_parse_attribute_value_borrow(_ctx->r->arena, _ctx->body,
+				attribute, val, len) != 1) {
 				Warnx("scan_string - attribute parse failed, item %d, attribute %d",
 					_ctx->item_index, _ctx->attribute_index);
 				return 0;
@@ -212,7 +212,7 @@ static int scan_string(void *ctx, const unsigned char *val,  unsigned int len)
 			break;
 		}
 		case PARSER_STATE_LAST_EVALUATED_HASH_KEY_MAP: {
-			_ctx->r->hash_key->value = strndup(val, len);
+			_ctx->r->hash_key->value = aws_dynamo_strndup_borrow(_ctx->r->arena, _ctx->body, val, len);
 			if (_ctx->r->hash_key->value == NULL) {
 				Warnx("scan_string: failed to allocated last evaluated hash key value");
 				return 0;
@@ -220,7 +220,7 @@ static int scan_string(void *ctx, const unsigned char *val,  unsigned int len)
 			break;
 		}
 		case PARSER_STATE_LAST_EVALUATED_RANGE_KEY_MAP: {
-			_ctx->r->range_key->value = strndup(val, len);
+			_ctx->r->range_key->value = aws_dynamo_strndup_borrow(_ctx->r->arena, _ctx->body, val, len);
 			if (_ctx->r->range_key->value == NULL) {
 				Warnx("scan_string: failed to allocated last evaluated range key value");
 				return 0;
@@ -249,6 +249,10 @@ static int scan_start_map(void *ctx)
 	Debug("scan_start_map, enter state '%s'", parser_state_string(_ctx->parser_state));
 #endif /* DEBUG_PARSER */
 
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_START)) {
+		return 1;
+	}
+
 	switch (_ctx->parser_state) {
 		case PARSER_STATE_NONE: {
 			_ctx->parser_state = PARSER_STATE_ROOT_MAP;
@@ -303,6 +307,10 @@ static int scan_map_key(void *ctx, const unsigned char *val,
 	Debug("scan_map_key, val = %s, enter state '%s'", buf, parser_state_string(_ctx->parser_state));
 #endif /* DEBUG_PARSER */
 
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_KEY)) {
+		return 1;
+	}
+
 	switch (_ctx->parser_state) {
 		case PARSER_STATE_ROOT_MAP: {
 			if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_CONSUMED_CAPACITY, val, len)) {
@@ -315,6 +323,8 @@ static int scan_map_key(void *ctx, const unsigned char *val,
 				_ctx->parser_state = PARSER_STATE_ITEMS_KEY;
 			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_LAST_EVALUATED_KEY, val, len)) {
 				_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_KEY;
+			} else if (_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+				return aws_dynamo_skip_start(&(_ctx->skip));
 			} else {
 				Warnx("scan_map_key: Unknown key.");
 				return 0;
@@ -323,18 +333,11 @@ static int scan_map_key(void *ctx, const unsigned char *val,
 		}
 		case PARSER_STATE_ITEM_MAP: {
 			/* Set the attribute index based on the name. */
-			int attribute;
-
-			for (attribute = 0; attribute < _ctx->num_attributes; attribute++) {
-				struct aws_dynamo_attribute *a = &(_ctx->attributes[attribute]);
-
-				if (len == a->name_len && strncmp(val, a->name, len) == 0) {
-					_ctx->attribute_index = attribute;
-					break;
+			_ctx->attribute_index = aws_dynamo_template_lookup(&(_ctx->template), val, len);
+			if (_ctx->attribute_index == -1) {
+				if (_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+					return aws_dynamo_skip_start(&(_ctx->skip));
 				}
-			}
-
-			if (attribute == _ctx->num_attributes) {
 				Warnx("scan_map_key: Unknown attribute.");
 				return 0;
 			}
@@ -342,10 +345,7 @@ static int scan_map_key(void *ctx, const unsigned char *val,
 			break;
 		}
 		case PARSER_STATE_ATTRIBUTE_MAP: {
-			struct aws_dynamo_attribute *a = &(_ctx->attributes[_ctx->attribute_index]);
-			const char *expected_type = aws_dynamo_attribute_types[a->type];
-
-			if (len != strlen(expected_type) || strncmp(val, expected_type, len) != 0) {
+			if (!aws_dynamo_template_check_type(&(_ctx->template), _ctx->attribute_index, val, len)) {
 				Warnx("scan_map_key: Unexpected attribute type.");
 				return 0;
 			}
@@ -369,13 +369,13 @@ static int scan_map_key(void *ctx, const unsigned char *val,
 				return 0;
 			}
 
-			_ctx->r->hash_key = calloc(1, sizeof(*(_ctx->r->hash_key)));
+			_ctx->r->hash_key = aws_arena_calloc(_ctx->r->arena, 1, sizeof(*(_ctx->r->hash_key)));
 			if (_ctx->r->hash_key == NULL) {
 				Warnx("scan_map_key: failed to allocated last evaluated hash key");
 				return 0;
 			}
 
-			_ctx->r->hash_key->type = strndup(val, len);
+			_ctx->r->hash_key->type = aws_dynamo_strndup_borrow(_ctx->r->arena, _ctx->body, val, len);
 			if (_ctx->r->hash_key->type == NULL) {
 				Warnx("scan_map_key: failed to allocated last evaluated hash key type");
 				return 0;
@@ -389,13 +389,13 @@ static int scan_map_key(void *ctx, const unsigned char *val,
 				return 0;
 			}
 
-			_ctx->r->range_key = calloc(1, sizeof(*(_ctx->r->range_key)));
+			_ctx->r->range_key = aws_arena_calloc(_ctx->r->arena, 1, sizeof(*(_ctx->r->range_key)));
 			if (_ctx->r->range_key == NULL) {
 				Warnx("scan_map_key: failed to allocated last evaluated range key");
 				return 0;
 			}
 
-			_ctx->r->range_key->type = strndup(val, len);
+			_ctx->r->range_key->type = aws_dynamo_strndup_borrow(_ctx->r->arena, _ctx->body, val, len);
 			if (_ctx->r->range_key->type == NULL) {
 				Warnx("scan_map_key: failed to allocated last evaluated range key type");
 				return 0;
@@ -423,6 +423,10 @@ static int scan_end_map(void *ctx)
 	Debug("scan_end_map enter state '%s'", parser_state_string(_ctx->parser_state));
 #endif /* DEBUG_PARSER */
 
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_END)) {
+		return 1;
+	}
+
 	switch (_ctx->parser_state) {
 		case PARSER_STATE_ATTRIBUTE_VALUE: {
 				_ctx->parser_state = PARSER_STATE_ITEM_MAP;
@@ -469,6 +473,10 @@ static int scan_start_array(void *ctx)
 	Debug("scan_start_array enter state '%s'", parser_state_string(_ctx->parser_state));
 #endif				/* DEBUG_PARSER */
 
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_START)) {
+		return 1;
+	}
+
 	switch (_ctx->parser_state) {
 	case PARSER_STATE_ITEMS_KEY:{
 			_ctx->parser_state = PARSER_STATE_ITEMS_ARRAY;
@@ -499,6 +507,10 @@ static int scan_end_array(void *ctx)
 	Debug("scan_end_array enter state '%s'", parser_state_string(_ctx->parser_state));
 #endif				/* DEBUG_PARSER */
 
+	if (aws_dynamo_skip_event(&(_ctx->skip), AWS_DYNAMO_SKIP_END)) {
+		return 1;
+	}
+
 	switch (_ctx->parser_state) {
 	case PARSER_STATE_ITEMS_ARRAY:{
 			_ctx->parser_state = PARSER_STATE_ROOT_MAP;
@@ -532,45 +544,151 @@ static yajl_callbacks scan_callbacks = {
 	.yajl_end_array = scan_end_array,
 };
 
-struct aws_dynamo_scan_response *aws_dynamo_parse_scan_response(const char *response, int response_len,
-	struct aws_dynamo_attribute *attributes, int num_attributes)
+/* Start a new response, dropping any from an earlier parse. */
+static int scan_reset(void *ctx)
+{
+	struct scan_ctx *_ctx = (struct scan_ctx *) ctx;
+
+	aws_dynamo_free_scan_response(_ctx->r);
+	_ctx->r = NULL;
+	_ctx->item_index = 0;
+	_ctx->attribute_index = 0;
+	_ctx->parser_state = PARSER_STATE_NONE;
+	memset(&(_ctx->skip), 0, sizeof(_ctx->skip));
+
+	if (_ctx->flags & (AWS_DYNAMO_PARSE_ARENA | AWS_DYNAMO_PARSE_BORROW)) {
+		struct aws_arena *arena;
+
+		/* The response itself comes from its arena. */
+		arena = aws_arena_init(_ctx->size_hint);
+		if (arena == NULL) {
+			Warnx("scan_reset: arena alloc failed.");
+			return -1;
+		}
+		_ctx->r = aws_arena_calloc(arena, 1, sizeof(*(_ctx->r)));
+		if (_ctx->r == NULL) {
+			Warnx("scan_reset: alloc failed.");
+			aws_arena_deinit(arena);
+			return -1;
+		}
+		_ctx->r->arena = arena;
+		if (_ctx->body != NULL) {
+			if (aws_arena_defer(arena, http_body_put, _ctx->body) == -1) {
+				Warnx("scan_reset: body defer failed.");
+				aws_arena_deinit(arena);
+				_ctx->r = NULL;
+				return -1;
+			}
+			http_body_get(_ctx->body);
+		}
+		return 0;
+	}
+
+	_ctx->r = calloc(sizeof(*(_ctx->r)), 1);
+	if (_ctx->r == NULL) {
+		Warnx("scan_reset: alloc failed.");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * aws_dynamo_scan_parse - parse a complete scan response
+ * @response: response body
+ * @response_len: length of @response
+ * @attributes: attribute template of the items
+ * @num_attributes: number of attributes in @attributes
+ * @flags: AWS_DYNAMO_PARSE_* flags
+ * @body: body holding @response to borrow strings from, NULL to copy them
+ * Returns: response, NULL on failure
+ */
+static struct aws_dynamo_scan_response *aws_dynamo_scan_parse(const char *response, int response_len,
+	struct aws_dynamo_attribute *attributes, int num_attributes, int flags,
+	struct http_body *body)
 {
-	yajl_handle hand;
-	yajl_status stat;
 	struct scan_ctx _ctx = {
 		.num_attributes = num_attributes,
 		.attributes = attributes,
+		.flags = flags,
+		.size_hint = response_len,
+		.body = body,
 	};
 
-	_ctx.r = calloc(sizeof(*(_ctx.r)), 1);
-	if (_ctx.r == NULL) {
+	aws_dynamo_template_init(&(_ctx.template), attributes, num_attributes);
+
+	if (scan_reset(&_ctx) == -1) {
 		Warnx("aws_dynamo_parse_scan_response: alooc failed.");
+		aws_dynamo_template_deinit(&(_ctx.template));
 		return NULL;
 	}
 
-#if YAJL_MAJOR == 2
-	hand = yajl_alloc(&scan_callbacks, NULL, &_ctx);
-	yajl_parse(hand, response, response_len);
-	stat = yajl_complete_parse(hand);
-#else
-	hand = yajl_alloc(&scan_callbacks, NULL, NULL, &_ctx);
-	yajl_parse(hand, response, response_len);
-	stat = yajl_parse_complete(hand);
-#endif
+	if (aws_dynamo_tokenize(&scan_callbacks, &_ctx, (const unsigned char *)response,
+		response_len) == -1) {
+		Warnx("aws_dynamo_parse_scan_response: json parse failed.");
+		aws_dynamo_template_deinit(&(_ctx.template));
+		aws_dynamo_free_scan_response(_ctx.r);
+		return NULL;
+	}
 
-	if (stat != yajl_status_ok) {
-		unsigned char * str = yajl_get_error(hand, 1, response, response_len);  
-		Warnx("aws_dynamo_parse_scan_response: json parse failed, '%s'", (const char *) str);  
-		yajl_free_error(hand, str);  
-		yajl_free(hand);
+	aws_dynamo_template_deinit(&(_ctx.template));
+	return _ctx.r;
+}
+
+struct aws_dynamo_scan_response *aws_dynamo_parse_scan_response(const char *response, int response_len,
+	struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	return aws_dynamo_scan_parse(response, response_len, attributes,
+		num_attributes, 0, NULL);
+}
+
+static struct aws_dynamo_scan_response *aws_dynamo_scan_stream(struct aws_handle *aws,
+	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	struct scan_ctx _ctx = {
+		.num_attributes = num_attributes,
+		.attributes = attributes,
+		.flags = aws->dynamo_parse_flags,
+	};
+
+	aws_dynamo_template_init(&(_ctx.template), attributes, num_attributes);
+
+	if (aws_dynamo_request_stream(aws, AWS_DYNAMO_SCAN, request,
+		&scan_callbacks, scan_reset, &_ctx) == -1) {
+		Warnx("aws_dynamo_scan: Failed to get or parse response.");
+		aws_dynamo_template_deinit(&(_ctx.template));
 		aws_dynamo_free_scan_response(_ctx.r);
 		return NULL;
 	}
 
-	yajl_free(hand);
+	aws_dynamo_template_deinit(&(_ctx.template));
 	return _ctx.r;
 }
 
+/* Parse the response of a request made with AWS_DYNAMO_PARSE_BORROW, the
+   response takes a reference to the body. */
+static struct aws_dynamo_scan_response *aws_dynamo_scan_borrow(struct aws_handle *aws,
+	struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	struct http_body *body;
+	struct aws_dynamo_scan_response *r;
+
+	body = http_take_body(aws_get_http(aws));
+	if (body == NULL) {
+		Warnx("aws_dynamo_scan: Failed to get response.");
+		return NULL;
+	}
+
+	r = aws_dynamo_scan_parse((const char *)body->data, body->len,
+		attributes, num_attributes, aws->dynamo_parse_flags, body);
+	if (r == NULL) {
+		Warnx("aws_dynamo_scan: Failed to parse response.");
+	}
+
+	http_body_put(body);
+	return r;
+}
+
 struct aws_dynamo_scan_response *aws_dynamo_scan(struct aws_handle *aws,
 	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes)
 {
@@ -578,23 +696,34 @@ struct aws_dynamo_scan_response *aws_dynamo_scan(struct aws_handle *aws,
 	int response_len;
 	struct aws_dynamo_scan_response *r;
 
+	if (aws->dynamo_parse_flags & AWS_DYNAMO_PARSE_STREAM) {
+		return aws_dynamo_scan_stream(aws, request, attributes, num_attributes);
+	}
+
 	if (aws_dynamo_request(aws, AWS_DYNAMO_SCAN, request) == -1) {
 		return NULL;
 	}
 
-	response = http_get_data(aws->http, &response_len);
+	if (aws->dynamo_parse_flags & AWS_DYNAMO_PARSE_BORROW) {
+		return aws_dynamo_scan_borrow(aws, attributes, num_attributes);
+	}
+
+	response = http_get_data(aws_get_http(aws), &response_len);
 
 	if (response == NULL) {
 		Warnx("aws_dynamo_scan: Failed to get response.");
 		return NULL; 
 	}
 
-	if ((r = aws_dynamo_parse_scan_response(response, response_len,
-		attributes, num_attributes)) == NULL) {
+	if ((r = aws_dynamo_scan_parse(response, response_len,
+		attributes, num_attributes, aws->dynamo_parse_flags, NULL)) == NULL) {
 		Warnx("aws_dynamo_scan: Failed to parse response: '%s'", response);
+		http_release_data(aws_get_http(aws));
 		return NULL; 
 	}
 
+	http_release_data(aws_get_http(aws));
+
 	return r;
 }
 
@@ -631,20 +760,18 @@ void aws_dynamo_dump_scan_response(struct aws_dynamo_scan_response *r) {
 
 
 void aws_dynamo_free_scan_response(struct aws_dynamo_scan_response *r) {
-	int i;
-	struct aws_dynamo_item *items;
-
 	if (r == NULL) {
 		return;
 	}
 
-	items = r->items;
-	for (i = 0; i < r->count; i++) {
-		struct aws_dynamo_item *item = &(items[i]);
-
-		aws_dynamo_free_attributes(item->attributes, item->num_attributes);
+	if (r->arena != NULL) {
+		/* Everything, r included, is in the arena. */
+		aws_arena_deinit(r->arena);
+		return;
 	}
 
+	aws_dynamo_free_item_matrix(r->attributes, r->count, r->num_attributes);
+
 	if (r->hash_key) {
 		free(r->hash_key->type);
 		free(r->hash_key->value);
@@ -32,9 +32,20 @@ struct aws_dynamo_scan_response {
 		
 	struct aws_dynamo_item *items;
 
+	/* The attributes of all the items in one block, row by row: item i
+		has attributes[i * num_attributes] up to but not including
+		attributes[(i + 1) * num_attributes], which items[i].attributes
+		points to. */
+	struct aws_dynamo_attribute *attributes;
+	int num_attributes;
+
 	/* Last evaluated keys. */
 	struct aws_dynamo_key *hash_key;
 	struct aws_dynamo_key *range_key;
+
+	/* Holds all of the above when parsed with AWS_DYNAMO_PARSE_ARENA or
+		AWS_DYNAMO_PARSE_BORROW, NULL otherwise. */
+	struct aws_arena *arena;
 };
 
 struct aws_dynamo_scan_response *aws_dynamo_parse_scan_response(const char *response,
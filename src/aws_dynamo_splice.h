@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AWS_DYNAMO_SPLICE_H_
+#define _AWS_DYNAMO_SPLICE_H_
+
+#include <stddef.h>
+
+#include <openssl/sha.h>
+
+#include "aws_dynamo.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A request prepared ahead of time is written into a builder from pieces of
+ * JSON copied as they are, with attribute values between them.  The pieces
+ * must make a valid request, the builder does not check them.
+ */
+
+/**
+ * struct aws_dynamo_builder_prefix - start of a request, hashed once
+ * @json: the start of the request, "{" and what follows up to the first
+ *	  value
+ * @len: length of @json
+ * @sha: hash state after @json
+ */
+struct aws_dynamo_builder_prefix {
+	const char *json;
+	size_t len;
+	SHA256_CTX sha;
+};
+
+/**
+ * aws_dynamo_builder_prefix_init - hash the start of a request
+ * @prefix: prefix to initialise
+ * @json: the start of the request, it must outlive @prefix
+ * @len: length of @json
+ */
+void aws_dynamo_builder_prefix_init(struct aws_dynamo_builder_prefix *prefix,
+	const char *json, size_t len);
+
+/**
+ * aws_dynamo_builder_start - start a request with a prefix
+ * @b: builder, emptied
+ * @prefix: start of the request
+ * Returns: 0 on success, -1 on failure
+ *
+ * The prefix is copied but not hashed again.  The request is closed by
+ * aws_dynamo_builder_finish() as usual.
+ */
+int aws_dynamo_builder_start(struct aws_dynamo_builder *b,
+	const struct aws_dynamo_builder_prefix *prefix);
+
+/**
+ * aws_dynamo_builder_splice - copy JSON into the request
+ * @b: builder
+ * @json: JSON
+ * @len: length of @json
+ * Returns: 0 on success, -1 on failure
+ */
+int aws_dynamo_builder_splice(struct aws_dynamo_builder *b, const char *json,
+	size_t len);
+
+/**
+ * aws_dynamo_builder_splice_value - write an attribute value into the request
+ * @b: builder
+ * @attribute: attribute whose value is written, such as {"S":"abc"}
+ * Returns: 0 on success, -1 on failure
+ */
+int aws_dynamo_builder_splice_value(struct aws_dynamo_builder *b,
+	const struct aws_dynamo_attribute *attribute);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* _AWS_DYNAMO_SPLICE_H_ */
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AWS_DYNAMO_STREAM_H_
+#define _AWS_DYNAMO_STREAM_H_
+
+#include <yajl/yajl_parse.h>
+
+#include "aws_dynamo.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * aws_dynamo_request_stream - make a request, parsing the response as it
+ *	arrives
+ * @aws: library handle
+ * @target: DynamoDB operation
+ * @body: request body
+ * @callbacks: parser callbacks for the response
+ * @reset: called before the parse of each response body starts, it must
+ *	   discard anything built from an earlier body; returns 0 on success,
+ *	   -1 on failure
+ * @ctx: parser context passed to @callbacks and @reset
+ * Returns: 0 if the response was received and parsed, -1 on failure
+ *
+ * The response body is fed to the parser a chunk at a time as it is read
+ * from the network instead of being buffered first.  Error responses are
+ * handled as by aws_dynamo_request().  A parse or @reset that fails aborts
+ * the transfer, and the request is not retried.
+ */
+int aws_dynamo_request_stream(struct aws_handle *aws, const char *target,
+	const char *body, const yajl_callbacks *callbacks,
+	int (*reset)(void *ctx), void *ctx);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* _AWS_DYNAMO_STREAM_H_ */
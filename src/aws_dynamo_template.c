@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "aws_dynamo_utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "aws_dynamo_template.h"
+
+#define TYPE_TAG(s)	{ s, sizeof(s) - 1 }
+
+/* XXX: The indexes in this array must correspond to
+	to the aws_dynamo_attribute_type enum. */
+static const struct {
+	const char *tag;
+	size_t len;
+} type_tags[] = {
+	TYPE_TAG(AWS_DYNAMO_JSON_TYPE_STRING),
+	TYPE_TAG(AWS_DYNAMO_JSON_TYPE_STRING_SET),
+	TYPE_TAG(AWS_DYNAMO_JSON_TYPE_NUMBER),
+	TYPE_TAG(AWS_DYNAMO_JSON_TYPE_NUMBER_SET),
+	TYPE_TAG(AWS_DYNAMO_JSON_TYPE_BINARY),
+	TYPE_TAG(AWS_DYNAMO_JSON_TYPE_BINARY_SET),
+	TYPE_TAG(AWS_DYNAMO_JSON_TYPE_BOOLEAN),
+	TYPE_TAG(AWS_DYNAMO_JSON_TYPE_NULL),
+	TYPE_TAG(AWS_DYNAMO_JSON_TYPE_LIST),
+	TYPE_TAG(AWS_DYNAMO_JSON_TYPE_MAP),
+};
+
+/* FNV-1a */
+static unsigned int name_hash(const char *name, size_t len)
+{
+	unsigned int h = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)name[i];
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+void aws_dynamo_template_init(struct aws_dynamo_template *t,
+	struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	unsigned int size;
+	unsigned int slot;
+	int i;
+
+	t->attributes = attributes;
+	t->num_attributes = num_attributes;
+	t->mask = 0;
+	t->slots = NULL;
+
+	if (num_attributes <= AWS_DYNAMO_TEMPLATE_LINEAR) {
+		return;
+	}
+
+	for (size = AWS_DYNAMO_TEMPLATE_LINEAR * 2; size < (unsigned int)num_attributes * 2; size *= 2)
+		;
+
+	if (size <= AWS_DYNAMO_TEMPLATE_INLINE_SLOTS) {
+		t->slots = t->inline_slots;
+	} else {
+		t->slots = malloc(sizeof(*(t->slots)) * size);
+		if (t->slots == NULL) {
+			Warnx("aws_dynamo_template_init: slot alloc failed, using a linear search.");
+			return;
+		}
+	}
+	t->mask = size - 1;
+
+	for (slot = 0; slot < size; slot++) {
+		t->slots[slot].index = -1;
+	}
+
+	for (i = 0; i < num_attributes; i++) {
+		struct aws_dynamo_attribute *a = &(attributes[i]);
+		unsigned int h;
+
+		/* Keep the first of several attributes of the same name, as
+			a linear search would find. */
+		if (aws_dynamo_template_lookup(t, a->name, a->name_len) != -1) {
+			continue;
+		}
+
+		h = name_hash(a->name, a->name_len);
+		for (slot = h & t->mask; t->slots[slot].index != -1; slot = (slot + 1) & t->mask)
+			;
+		t->slots[slot].hash = h;
+		t->slots[slot].index = i;
+	}
+}
+
+void aws_dynamo_template_deinit(struct aws_dynamo_template *t)
+{
+	if (t->slots != t->inline_slots) {
+		free(t->slots);
+	}
+	t->slots = NULL;
+}
+
+int aws_dynamo_template_lookup(const struct aws_dynamo_template *t,
+	const char *name, size_t len)
+{
+	unsigned int h;
+	unsigned int i;
+
+	if (t->slots == NULL) {
+		int attribute;
+
+		for (attribute = 0; attribute < t->num_attributes; attribute++) {
+			struct aws_dynamo_attribute *a = &(t->attributes[attribute]);
+
+			if (len == a->name_len && memcmp(name, a->name, len) == 0) {
+				return attribute;
+			}
+		}
+		return -1;
+	}
+
+	h = name_hash(name, len);
+	for (i = h & t->mask; t->slots[i].index != -1; i = (i + 1) & t->mask) {
+		struct aws_dynamo_attribute *a = &(t->attributes[t->slots[i].index]);
+
+		if (t->slots[i].hash == h && len == a->name_len &&
+			memcmp(name, a->name, len) == 0) {
+			return t->slots[i].index;
+		}
+	}
+
+	return -1;
+}
+
+int aws_dynamo_template_check_type(const struct aws_dynamo_template *t,
+	int index, const char *type, size_t len)
+{
+	enum aws_dynamo_attribute_type a_type = t->attributes[index].type;
+
+	if (a_type < 0 || a_type >= sizeof(type_tags) / sizeof(type_tags[0])) {
+		return 0;
+	}
+
+	return len == type_tags[a_type].len &&
+		memcmp(type, type_tags[a_type].tag, len) == 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AWS_DYNAMO_TEMPLATE_H_
+#define _AWS_DYNAMO_TEMPLATE_H_
+
+#include <stddef.h>
+
+#include "aws_dynamo.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Templates of up to AWS_DYNAMO_TEMPLATE_LINEAR attributes are searched
+   linearly, larger ones through an open addressed hash table at most half
+   full.  Tables of up to AWS_DYNAMO_TEMPLATE_INLINE_SLOTS slots live in the
+   template itself. */
+#define AWS_DYNAMO_TEMPLATE_LINEAR		4
+#define AWS_DYNAMO_TEMPLATE_INLINE_SLOTS	64
+
+/**
+ * struct aws_dynamo_template_slot - hash table slot
+ * @hash: hash of the attribute name
+ * @index: index of the attribute in the template, -1 for an empty slot
+ */
+struct aws_dynamo_template_slot {
+	unsigned int hash;
+	int index;
+};
+
+/**
+ * struct aws_dynamo_template - attribute template compiled for parsing
+ * @attributes: the attribute template
+ * @num_attributes: number of attributes in @attributes
+ * @mask: number of slots in @slots minus one
+ * @slots: hash table of the attribute names, NULL for a linear search
+ * @inline_slots: storage for small hash tables
+ */
+struct aws_dynamo_template {
+	struct aws_dynamo_attribute *attributes;
+	int num_attributes;
+	unsigned int mask;
+	struct aws_dynamo_template_slot *slots;
+	struct aws_dynamo_template_slot inline_slots[AWS_DYNAMO_TEMPLATE_INLINE_SLOTS];
+};
+
+/**
+ * aws_dynamo_template_init - compile an attribute template
+ * @t: template to initialise
+ * @attributes: the attribute template, it must outlive @t
+ * @num_attributes: number of attributes in @attributes
+ *
+ * Should the hash table not fit in @t and its allocation fail, lookups fall
+ * back to a linear search.
+ */
+void aws_dynamo_template_init(struct aws_dynamo_template *t,
+	struct aws_dynamo_attribute *attributes, int num_attributes);
+
+/**
+ * aws_dynamo_template_deinit - free a compiled template
+ * @t: template
+ */
+void aws_dynamo_template_deinit(struct aws_dynamo_template *t);
+
+/**
+ * aws_dynamo_template_lookup - find an attribute by name
+ * @t: template
+ * @name: attribute name, not nul terminated
+ * @len: length of @name
+ * Returns: index of the first attribute of the template named @name, -1 if
+ *	    there is none
+ */
+int aws_dynamo_template_lookup(const struct aws_dynamo_template *t,
+	const char *name, size_t len);
+
+/**
+ * aws_dynamo_template_check_type - check the type key of an attribute value
+ * @t: template
+ * @index: index of the attribute
+ * @type: type key from the response, for example "N", not nul terminated
+ * @len: length of @type
+ * Returns: 1 if @type is the type of the attribute, 0 if it is not
+ */
+int aws_dynamo_template_check_type(const struct aws_dynamo_template *t,
+	int index, const char *type, size_t len);
+
+/*
+ * Requests whose responses are parsed with a template compiled beforehand,
+ * for prepared requests.  Otherwise as aws_dynamo_get_item(),
+ * aws_dynamo_query() and aws_dynamo_update_item().
+ */
+struct aws_dynamo_get_item_response *aws_dynamo_get_item_template(struct aws_handle *aws,
+	const char *request, const struct aws_dynamo_template *template);
+
+struct aws_dynamo_query_response *aws_dynamo_query_template(struct aws_handle *aws,
+	const char *request, const struct aws_dynamo_template *template);
+
+struct aws_dynamo_update_item_response *aws_dynamo_update_item_template(struct aws_handle *aws,
+	const char *request, const struct aws_dynamo_template *template);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* _AWS_DYNAMO_TEMPLATE_H_ */
@@ -0,0 +1,979 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The document is parsed in two stages.  The first classifies 64 bytes at a
+ * time into bitmasks of quotes, backslashes, structural characters and
+ * whitespace, works out which bytes are inside strings and keeps a mask of
+ * where tokens start: the structural characters outside strings, the quotes
+ * around strings and the first byte of each number or literal.  The second
+ * walks those token starts in order, checks the grammar and calls the yajl
+ * callbacks.  Only the bytes of numbers, literals and strings holding
+ * escapes are looked at one at a time.
+ */
+
+#include "aws_dynamo_utils.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "aws_dynamo_number.h"
+#include "aws_dynamo_tokenizer.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+	(defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define TOKENIZER_X86
+#include <immintrin.h>
+#endif
+
+#define BLOCK_SIZE	64
+
+/**
+ * struct block_masks - classification of the bytes of a block, bit n of
+ *			each mask is for byte n
+ * @quote: '"'
+ * @backslash: '\\'
+ * @op: '{', '}', '[', ']', ':' and ','
+ * @ws: ' ', '\t', '\n' and '\r'
+ * @ctrl: bytes below 0x20
+ */
+struct block_masks {
+	uint64_t quote;
+	uint64_t backslash;
+	uint64_t op;
+	uint64_t ws;
+	uint64_t ctrl;
+};
+
+typedef void (*classify_fn)(const unsigned char *in, struct block_masks *m);
+
+/**
+ * struct tokenizer - state of the first stage
+ * @json: document
+ * @len: length of @json
+ * @base: offset of the current block
+ * @tokens: token starts of the current block not yet handed out
+ * @in_string: all ones if the previous block ended inside a string
+ * @escaped: 1 if the first byte of the next block is escaped
+ * @scalar: 1 if the previous block ended inside a number or literal
+ * @classify: block classifier
+ * @error: reason the document was rejected
+ * @buf: scratch space for unescaped strings and numbers
+ * @buf_size: size of @buf
+ */
+struct tokenizer {
+	const unsigned char *json;
+	size_t len;
+	size_t base;
+	uint64_t tokens;
+	uint64_t in_string;
+	uint64_t escaped;
+	uint64_t scalar;
+	classify_fn classify;
+	const char *error;
+	unsigned char *buf;
+	size_t buf_size;
+
+	/* Set by aws_dynamo_tokenize_raw(). */
+	int raw;
+	size_t *offset;
+};
+
+static void classify_scalar(const unsigned char *in, struct block_masks *m)
+{
+	int i;
+
+	memset(m, 0, sizeof(*m));
+	for (i = 0; i < BLOCK_SIZE; i++) {
+		uint64_t bit = 1ULL << i;
+
+		switch (in[i]) {
+			case '"':
+				m->quote |= bit;
+				break;
+			case '\\':
+				m->backslash |= bit;
+				break;
+			case '{':
+			case '}':
+			case '[':
+			case ']':
+			case ':':
+			case ',':
+				m->op |= bit;
+				break;
+			case ' ':
+				m->ws |= bit;
+				break;
+			case '\t':
+			case '\n':
+			case '\r':
+				m->ws |= bit;
+				m->ctrl |= bit;
+				break;
+			default:
+				if (in[i] < 0x20) {
+					m->ctrl |= bit;
+				}
+				break;
+		}
+	}
+}
+
+#ifdef TOKENIZER_X86
+
+/* '{' and '[', and '}' and ']', differ only in bit 5. */
+
+__attribute__((target("sse2")))
+static void classify_sse2(const unsigned char *in, struct block_masks *m)
+{
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i bit5 = _mm_set1_epi8(0x20);
+	const __m128i open = _mm_set1_epi8('{');
+	const __m128i close = _mm_set1_epi8('}');
+	const __m128i colon = _mm_set1_epi8(':');
+	const __m128i comma = _mm_set1_epi8(',');
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i nl = _mm_set1_epi8('\n');
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i ctrl = _mm_set1_epi8(0x1f);
+	int i;
+
+	memset(m, 0, sizeof(*m));
+	for (i = 0; i < BLOCK_SIZE; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		__m128i v5 = _mm_or_si128(v, bit5);
+		__m128i op;
+		__m128i ws;
+
+		op = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v5, open), _mm_cmpeq_epi8(v5, close)),
+			_mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, comma)));
+		ws = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+			_mm_or_si128(_mm_cmpeq_epi8(v, nl), _mm_cmpeq_epi8(v, cr)));
+
+		m->quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << i;
+		m->backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)) << i;
+		m->op |= (uint64_t)(uint16_t)_mm_movemask_epi8(op) << i;
+		m->ws |= (uint64_t)(uint16_t)_mm_movemask_epi8(ws) << i;
+		/* v <= 0x1f, unsigned */
+		m->ctrl |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+			_mm_cmpeq_epi8(_mm_min_epu8(v, ctrl), v)) << i;
+	}
+}
+
+__attribute__((target("avx2")))
+static void classify_avx2(const unsigned char *in, struct block_masks *m)
+{
+	const __m256i quote = _mm256_set1_epi8('"');
+	const __m256i backslash = _mm256_set1_epi8('\\');
+	const __m256i bit5 = _mm256_set1_epi8(0x20);
+	const __m256i open = _mm256_set1_epi8('{');
+	const __m256i close = _mm256_set1_epi8('}');
+	const __m256i colon = _mm256_set1_epi8(':');
+	const __m256i comma = _mm256_set1_epi8(',');
+	const __m256i space = _mm256_set1_epi8(' ');
+	const __m256i tab = _mm256_set1_epi8('\t');
+	const __m256i nl = _mm256_set1_epi8('\n');
+	const __m256i cr = _mm256_set1_epi8('\r');
+	const __m256i ctrl = _mm256_set1_epi8(0x1f);
+	int i;
+
+	memset(m, 0, sizeof(*m));
+	for (i = 0; i < BLOCK_SIZE; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+		__m256i v5 = _mm256_or_si256(v, bit5);
+		__m256i op;
+		__m256i ws;
+
+		op = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v5, open), _mm256_cmpeq_epi8(v5, close)),
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, colon), _mm256_cmpeq_epi8(v, comma)));
+		ws = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(v, tab)),
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, nl), _mm256_cmpeq_epi8(v, cr)));
+
+		m->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)) << i;
+		m->backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash)) << i;
+		m->op |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op) << i;
+		m->ws |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << i;
+		m->ctrl |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(_mm256_min_epu8(v, ctrl), v)) << i;
+	}
+}
+
+#endif /* TOKENIZER_X86 */
+
+static pthread_once_t classify_once = PTHREAD_ONCE_INIT;
+static classify_fn classify = classify_scalar;
+
+static void classify_select_auto(void)
+{
+#ifdef TOKENIZER_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		classify = classify_avx2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		classify = classify_sse2;
+	}
+#endif
+}
+
+int aws_dynamo_tokenizer_select(enum aws_dynamo_tokenizer_impl impl)
+{
+	pthread_once(&classify_once, classify_select_auto);
+
+	switch (impl) {
+		case AWS_DYNAMO_TOKENIZER_AUTO: {
+			classify = classify_scalar;
+			classify_select_auto();
+			return 0;
+		}
+		case AWS_DYNAMO_TOKENIZER_SCALAR: {
+			classify = classify_scalar;
+			return 0;
+		}
+#ifdef TOKENIZER_X86
+		case AWS_DYNAMO_TOKENIZER_SSE2: {
+			if (!__builtin_cpu_supports("sse2")) {
+				return -1;
+			}
+			classify = classify_sse2;
+			return 0;
+		}
+		case AWS_DYNAMO_TOKENIZER_AVX2: {
+			if (!__builtin_cpu_supports("avx2")) {
+				return -1;
+			}
+			classify = classify_avx2;
+			return 0;
+		}
+#endif
+		default: {
+			return -1;
+		}
+	}
+}
+
+/* Each bit set in the result is set in x or in an odd number of the bits
+   below it. */
+static uint64_t prefix_xor(uint64_t x)
+{
+	x ^= x << 1;
+	x ^= x << 2;
+	x ^= x << 4;
+	x ^= x << 8;
+	x ^= x << 16;
+	x ^= x << 32;
+	return x;
+}
+
+/* Find the bytes escaped by a backslash.  Backslashes are rare in DynamoDB
+   responses, so they are walked one at a time. */
+static uint64_t find_escaped(uint64_t backslash, uint64_t *carry)
+{
+	uint64_t escaped = *carry;
+
+	/* An escaped backslash escapes nothing. */
+	backslash &= ~escaped;
+	*carry = 0;
+
+	while (backslash != 0) {
+		uint64_t bit = backslash & -backslash;
+
+		backslash ^= bit;
+		if (bit == 1ULL << 63) {
+			*carry = 1;
+		} else {
+			escaped |= bit << 1;
+			backslash &= ~(bit << 1);
+		}
+	}
+
+	return escaped;
+}
+
+static int index_block(struct tokenizer *t)
+{
+	unsigned char pad[BLOCK_SIZE];
+	const unsigned char *in = t->json + t->base;
+	struct block_masks m;
+	uint64_t quotes;
+	uint64_t in_string;
+	uint64_t scalar;
+	uint64_t starts;
+
+	if (t->len - t->base < BLOCK_SIZE) {
+		/* Spaces are not tokens. */
+		memset(pad, ' ', sizeof(pad));
+		memcpy(pad, in, t->len - t->base);
+		in = pad;
+	}
+
+	t->classify(in, &m);
+
+	quotes = m.quote & ~find_escaped(m.backslash, &(t->escaped));
+
+	/* Set from each opening quote up to, not including, its closing
+		quote. */
+	in_string = prefix_xor(quotes) ^ t->in_string;
+	t->in_string = (uint64_t)((int64_t)in_string >> 63);
+
+	if (m.ctrl & in_string) {
+		t->error = "invalid character inside string";
+		return -1;
+	}
+
+	scalar = ~(m.op | m.ws | m.quote);
+	starts = scalar & ~((scalar << 1) | t->scalar);
+	t->scalar = scalar >> 63;
+
+	t->tokens = ((m.op | starts) & ~in_string) | quotes;
+	return 0;
+}
+
+/* Returns the offset of the next token, -1 at the end of the document or
+   -2 on error. */
+static long next_token(struct tokenizer *t)
+{
+	int bit;
+
+	while (t->tokens == 0) {
+		if (t->len - t->base <= BLOCK_SIZE) {
+			return -1;
+		}
+		t->base += BLOCK_SIZE;
+		if (index_block(t) == -1) {
+			return -2;
+		}
+	}
+
+	bit = __builtin_ctzll(t->tokens);
+	t->tokens &= t->tokens - 1;
+
+	return t->base + bit;
+}
+
+static unsigned char *scratch(struct tokenizer *t, size_t size)
+{
+	if (size > t->buf_size) {
+		unsigned char *buf;
+
+		buf = realloc(t->buf, size);
+		if (buf == NULL) {
+			t->error = "out of memory";
+			return NULL;
+		}
+		t->buf = buf;
+		t->buf_size = size;
+	}
+
+	return t->buf;
+}
+
+static int hex4(const unsigned char *s, unsigned int *cp)
+{
+	int i;
+
+	*cp = 0;
+	for (i = 0; i < 4; i++) {
+		unsigned char c = s[i];
+
+		*cp <<= 4;
+		if (c >= '0' && c <= '9') {
+			*cp |= c - '0';
+		} else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+			*cp |= (c | 0x20) - 'a' + 10;
+		} else {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static size_t utf8_encode(unsigned int cp, unsigned char *out)
+{
+	if (cp < 0x80) {
+		out[0] = cp;
+		return 1;
+	} else if (cp < 0x800) {
+		out[0] = 0xc0 | (cp >> 6);
+		out[1] = 0x80 | (cp & 0x3f);
+		return 2;
+	} else if (cp < 0x10000) {
+		out[0] = 0xe0 | (cp >> 12);
+		out[1] = 0x80 | ((cp >> 6) & 0x3f);
+		out[2] = 0x80 | (cp & 0x3f);
+		return 3;
+	}
+	out[0] = 0xf0 | (cp >> 18);
+	out[1] = 0x80 | ((cp >> 12) & 0x3f);
+	out[2] = 0x80 | ((cp >> 6) & 0x3f);
+	out[3] = 0x80 | (cp & 0x3f);
+	return 4;
+}
+
+/* Decode the escapes of a string into @out, returning an error message or
+   NULL.  An escape never decodes to more bytes than it takes up. */
+static const char *unescape_into(const unsigned char *s, size_t len,
+	unsigned char *out, size_t *out_len)
+{
+	size_t i = 0;
+	size_t o = 0;
+
+	while (i < len) {
+		unsigned int cp;
+
+		if (s[i] != '\\') {
+			out[o++] = s[i++];
+			continue;
+		}
+
+		if (i + 1 == len) {
+			return "invalid escaped character";
+		}
+
+		switch (s[i + 1]) {
+			case '"': out[o++] = '"'; break;
+			case '\\': out[o++] = '\\'; break;
+			case '/': out[o++] = '/'; break;
+			case 'b': out[o++] = '\b'; break;
+			case 'f': out[o++] = '\f'; break;
+			case 'n': out[o++] = '\n'; break;
+			case 'r': out[o++] = '\r'; break;
+			case 't': out[o++] = '\t'; break;
+			case 'u': {
+				if (len - i < 6 || hex4(s + i + 2, &cp) == -1) {
+					return "invalid unicode escape";
+				}
+				i += 6;
+
+				if ((cp & 0xfc00) == 0xd800) {
+					unsigned int low;
+
+					/* A high surrogate must be followed by a low
+						one. */
+					if (len - i >= 6 && s[i] == '\\' && s[i + 1] == 'u' &&
+						hex4(s + i + 2, &low) == 0 && (low & 0xfc00) == 0xdc00) {
+						cp = 0x10000 + ((cp & 0x3ff) << 10) + (low & 0x3ff);
+						i += 6;
+					} else {
+						cp = '?';
+					}
+				} else if ((cp & 0xfc00) == 0xdc00) {
+					cp = '?';
+				}
+
+				o += utf8_encode(cp, out + o);
+				continue;
+			}
+			default: {
+				return "invalid escaped character";
+			}
+		}
+		i += 2;
+	}
+
+	*out_len = o;
+	return NULL;
+}
+
+/* Decode the escapes of a string into the scratch buffer. */
+static unsigned char *unescape(struct tokenizer *t, const unsigned char *s,
+	size_t len, size_t *out_len)
+{
+	unsigned char *out;
+
+	out = scratch(t, len);
+	if (out == NULL) {
+		return NULL;
+	}
+
+	t->error = unescape_into(s, len, out, out_len);
+	if (t->error != NULL) {
+		return NULL;
+	}
+
+	return out;
+}
+
+int aws_dynamo_json_unescape(const unsigned char *s, size_t len,
+	unsigned char *out, size_t *out_len)
+{
+	const char *error;
+
+	error = unescape_into(s, len, out, out_len);
+	if (error != NULL) {
+		Warnx("aws_dynamo_json_unescape: %s.", error);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* The bytes that end a number or literal, as classified above. */
+static int is_delimiter(unsigned char c)
+{
+	switch (c) {
+		case '"':
+		case '{':
+		case '}':
+		case '[':
+		case ']':
+		case ':':
+		case ',':
+		case ' ':
+		case '\t':
+		case '\n':
+		case '\r':
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+/* Check a number against the JSON grammar.  Returns 1 for an integer, 2
+   for a number with a fraction or exponent, 0 if it is not a number. */
+static int number_kind(const unsigned char *s, size_t len)
+{
+	size_t i = 0;
+	int kind = 1;
+
+	if (i < len && s[i] == '-') {
+		i++;
+	}
+	if (i == len) {
+		return 0;
+	}
+	if (s[i] == '0') {
+		i++;
+	} else if (s[i] >= '1' && s[i] <= '9') {
+		while (i < len && s[i] >= '0' && s[i] <= '9') {
+			i++;
+		}
+	} else {
+		return 0;
+	}
+
+	if (i < len && s[i] == '.') {
+		size_t digits = ++i;
+
+		while (i < len && s[i] >= '0' && s[i] <= '9') {
+			i++;
+		}
+		if (i == digits) {
+			return 0;
+		}
+		kind = 2;
+	}
+
+	if (i < len && (s[i] == 'e' || s[i] == 'E')) {
+		size_t digits;
+
+		i++;
+		if (i < len && (s[i] == '+' || s[i] == '-')) {
+			i++;
+		}
+		digits = i;
+		while (i < len && s[i] >= '0' && s[i] <= '9') {
+			i++;
+		}
+		if (i == digits) {
+			return 0;
+		}
+		kind = 2;
+	}
+
+	return i == len ? kind : 0;
+}
+
+#define CALL(f, ...) \
+	do { \
+		if (callbacks->f != NULL && !callbacks->f(ctx, ##__VA_ARGS__)) { \
+			t.error = "client cancelled parse via callback return value"; \
+			goto error; \
+		} \
+	} while (0)
+
+/* Jump over the value that starts at the next token, checking only that
+   its maps and arrays are balanced.  No callbacks are made for it. */
+static int skip_value(struct tokenizer *t, unsigned char *stack, int depth)
+{
+	int base = depth;
+
+	do {
+		long pos;
+		unsigned char c;
+
+		pos = next_token(t);
+		if (pos < 0) {
+			t->error = t->error ? t->error : "premature EOF";
+			return -1;
+		}
+		c = t->json[pos];
+
+		switch (c) {
+			case '{':
+			case '[': {
+				if (depth == AWS_DYNAMO_TOKENIZER_MAX_DEPTH) {
+					t->error = "max nesting depth exceeded";
+					return -1;
+				}
+				stack[depth++] = c;
+				break;
+			}
+			case '}':
+			case ']': {
+				if (depth == base ||
+					stack[--depth] != (c == '}' ? '{' : '[')) {
+					t->error = "unbalanced map or array in skipped value";
+					return -1;
+				}
+				break;
+			}
+			case ':':
+			case ',': {
+				if (depth == base) {
+					t->error = "unallowed token at this point in JSON text";
+					return -1;
+				}
+				break;
+			}
+			case '"': {
+				if (next_token(t) < 0) {
+					t->error = t->error ? t->error : "premature EOF";
+					return -1;
+				}
+				break;
+			}
+			default: {
+				/* A number or literal. */
+				break;
+			}
+		}
+	} while (depth > base);
+
+	return 0;
+}
+
+enum {
+	EXPECT_VALUE,
+	EXPECT_VALUE_OR_END,	/* after '[' */
+	EXPECT_KEY,		/* after ',' in a map */
+	EXPECT_KEY_OR_END,	/* after '{' */
+	EXPECT_COLON,
+	EXPECT_COMMA_OR_END,
+	EXPECT_NOTHING,		/* after the top level value */
+};
+
+static int tokenize(const yajl_callbacks *callbacks, void *ctx,
+	const unsigned char *json, size_t len, int raw, size_t *offset)
+{
+	struct tokenizer t = {
+		.json = json,
+		.len = len,
+		.raw = raw,
+		.offset = offset,
+	};
+	unsigned char stack[AWS_DYNAMO_TOKENIZER_MAX_DEPTH];
+	int depth = 0;
+	int state = EXPECT_VALUE;
+	int skip = 0;
+	long pos = 0;
+
+	pthread_once(&classify_once, classify_select_auto);
+	t.classify = classify;
+
+	if (len > 0 && index_block(&t) == -1) {
+		goto error;
+	}
+
+	for (;;) {
+		unsigned char c;
+
+		pos = next_token(&t);
+		if (pos == -2) {
+			goto error;
+		} else if (pos == -1) {
+			if (state != EXPECT_NOTHING) {
+				pos = len;
+				t.error = "premature EOF";
+				goto error;
+			}
+			break;
+		}
+		c = json[pos];
+		if (t.offset != NULL) {
+			*(t.offset) = pos;
+		}
+
+		switch (state) {
+			case EXPECT_NOTHING: {
+				t.error = "trailing garbage";
+				goto error;
+			}
+			case EXPECT_COLON: {
+				if (c != ':') {
+					t.error = "object key and value must be separated by a colon (':')";
+					goto error;
+				}
+				if (skip) {
+					skip = 0;
+					if (skip_value(&t, stack, depth) == -1) {
+						goto error;
+					}
+					state = EXPECT_COMMA_OR_END;
+					continue;
+				}
+				state = EXPECT_VALUE;
+				continue;
+			}
+			case EXPECT_COMMA_OR_END: {
+				if (c == ',') {
+					state = stack[depth - 1] == '{' ? EXPECT_KEY : EXPECT_VALUE;
+					continue;
+				}
+				if (c != (stack[depth - 1] == '{' ? '}' : ']')) {
+					t.error = "after a value a separator (',') or the end of the container must follow";
+					goto error;
+				}
+				goto end_container;
+			}
+			case EXPECT_KEY_OR_END: {
+				if (c == '}') {
+					goto end_container;
+				}
+			}
+			/* fall through */
+			case EXPECT_KEY: {
+				const unsigned char *s;
+				size_t s_len;
+				long close;
+
+				if (c != '"') {
+					t.error = "invalid object key (must be a string)";
+					goto error;
+				}
+				close = next_token(&t);
+				if (close < 0) {
+					t.error = t.error ? t.error : "premature EOF";
+					goto error;
+				}
+				s = json + pos + 1;
+				s_len = close - pos - 1;
+				if (memchr(s, '\\', s_len) != NULL &&
+					(s = unescape(&t, s, s_len, &s_len)) == NULL) {
+					goto error;
+				}
+				if (callbacks->yajl_map_key != NULL) {
+					int rv = callbacks->yajl_map_key(ctx, s, s_len);
+
+					if (rv == 0) {
+						t.error = "client cancelled parse via callback return value";
+						goto error;
+					}
+					skip = rv == AWS_DYNAMO_TOKENIZE_SKIP;
+				}
+				state = EXPECT_COLON;
+				continue;
+			}
+			case EXPECT_VALUE_OR_END: {
+				if (c == ']') {
+					goto end_container;
+				}
+				break;
+			}
+			default: {
+				break;
+			}
+		}
+
+		/* A value. */
+		switch (c) {
+			case '{':
+			case '[': {
+				if (depth == AWS_DYNAMO_TOKENIZER_MAX_DEPTH) {
+					t.error = "max nesting depth exceeded";
+					goto error;
+				}
+				stack[depth++] = c;
+				if (c == '{') {
+					CALL(yajl_start_map);
+					state = EXPECT_KEY_OR_END;
+				} else {
+					CALL(yajl_start_array);
+					state = EXPECT_VALUE_OR_END;
+				}
+				continue;
+			}
+			case '"': {
+				const unsigned char *s;
+				size_t s_len;
+				long close;
+
+				close = next_token(&t);
+				if (close < 0) {
+					t.error = t.error ? t.error : "premature EOF";
+					goto error;
+				}
+				s = json + pos + 1;
+				s_len = close - pos - 1;
+				if (!t.raw && memchr(s, '\\', s_len) != NULL &&
+					(s = unescape(&t, s, s_len, &s_len)) == NULL) {
+					goto error;
+				}
+				CALL(yajl_string, s, s_len);
+				break;
+			}
+			case '}':
+			case ']':
+			case ':':
+			case ',': {
+				t.error = "unallowed token at this point in JSON text";
+				goto error;
+			}
+			default: {
+				const unsigned char *s = json + pos;
+				size_t s_len = 0;
+				int kind;
+
+				/* Numbers and literals run up to the next delimiter. */
+				while (pos + s_len < len && !is_delimiter(s[s_len])) {
+					s_len++;
+				}
+
+				if (s_len == 4 && memcmp(s, "true", 4) == 0) {
+					CALL(yajl_boolean, 1);
+				} else if (s_len == 5 && memcmp(s, "false", 5) == 0) {
+					CALL(yajl_boolean, 0);
+				} else if (s_len == 4 && memcmp(s, "null", 4) == 0) {
+					CALL(yajl_null);
+				} else if ((kind = number_kind(s, s_len)) == 0) {
+					t.error = "invalid number or literal";
+					goto error;
+				} else if (callbacks->yajl_number != NULL) {
+					CALL(yajl_number, (const char *)s, s_len);
+				} else if (kind == 1 && callbacks->yajl_integer != NULL) {
+					long long i;
+
+					if (aws_dynamo_number_parse_integer((const char *)s, s_len, &i) == -1) {
+						t.error = "integer overflow";
+						goto error;
+					}
+					CALL(yajl_integer, i);
+				} else if (kind == 2 && callbacks->yajl_double != NULL) {
+					double d;
+
+					if (aws_dynamo_number_parse_double((const char *)s, s_len, &d) == -1) {
+						t.error = "numeric (floating point) overflow";
+						goto error;
+					}
+					CALL(yajl_double, d);
+				}
+				break;
+			}
+		}
+
+		state = depth == 0 ? EXPECT_NOTHING : EXPECT_COMMA_OR_END;
+		continue;
+
+end_container:
+		if (stack[--depth] == '{') {
+			CALL(yajl_end_map);
+		} else {
+			CALL(yajl_end_array);
+		}
+		state = depth == 0 ? EXPECT_NOTHING : EXPECT_COMMA_OR_END;
+	}
+
+	free(t.buf);
+	return 0;
+
+error:
+	Warnx("aws_dynamo_tokenize: %s at offset %ld.", t.error, pos);
+	free(t.buf);
+	return -1;
+}
+
+int aws_dynamo_tokenize(const yajl_callbacks *callbacks, void *ctx,
+	const unsigned char *json, size_t len)
+{
+	return tokenize(callbacks, ctx, json, len, 0, NULL);
+}
+
+int aws_dynamo_tokenize_raw(const yajl_callbacks *callbacks, void *ctx,
+	const unsigned char *json, size_t len, size_t *offset)
+{
+	return tokenize(callbacks, ctx, json, len, 1, offset);
+}
+
+int aws_dynamo_skip_start(struct aws_dynamo_skip *skip)
+{
+	skip->active = 1;
+	skip->depth = 0;
+	return AWS_DYNAMO_TOKENIZE_SKIP;
+}
+
+int aws_dynamo_skip_event(struct aws_dynamo_skip *skip,
+	enum aws_dynamo_skip_event event)
+{
+	if (!skip->active) {
+		return 0;
+	}
+
+	switch (event) {
+		case AWS_DYNAMO_SKIP_START: {
+			skip->depth++;
+			return 1;
+		}
+		case AWS_DYNAMO_SKIP_END: {
+			if (skip->depth == 0) {
+				/* The end of the map holding the key, the
+				   tokenizer skipped the value itself. */
+				skip->active = 0;
+				return 0;
+			}
+			skip->depth--;
+			break;
+		}
+		case AWS_DYNAMO_SKIP_KEY: {
+			if (skip->depth == 0) {
+				/* The next key of the map holding the key. */
+				skip->active = 0;
+				return 0;
+			}
+			return 1;
+		}
+		case AWS_DYNAMO_SKIP_SCALAR: {
+			break;
+		}
+	}
+
+	/* A scalar value, or the end of a skipped map or array, finishes the
+	   value when it is not nested. */
+	if (skip->depth == 0) {
+		skip->active = 0;
+	}
+	return 1;
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AWS_DYNAMO_TOKENIZER_H_
+#define _AWS_DYNAMO_TOKENIZER_H_
+
+#include <stddef.h>
+
+#include <yajl/yajl_parse.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Deepest nesting of maps and arrays accepted. */
+#define AWS_DYNAMO_TOKENIZER_MAX_DEPTH	256
+
+/* Returned by a yajl_map_key callback to have the value of the key skipped
+   in one scan, without callbacks for any of it. */
+#define AWS_DYNAMO_TOKENIZE_SKIP	2
+
+/* Ways of finding the structural characters of a document. */
+enum aws_dynamo_tokenizer_impl {
+	AWS_DYNAMO_TOKENIZER_AUTO = 0,	/* the fastest the CPU supports */
+	AWS_DYNAMO_TOKENIZER_SCALAR,
+	AWS_DYNAMO_TOKENIZER_SSE2,
+	AWS_DYNAMO_TOKENIZER_AVX2,
+};
+
+/**
+ * aws_dynamo_tokenize - parse a complete JSON document
+ * @callbacks: yajl callbacks to call for each value of the document
+ * @ctx: context passed to @callbacks
+ * @json: document
+ * @len: length of @json
+ * Returns: 0 on success, -1 if the document is not valid JSON or a callback
+ *	    returned 0
+ *
+ * The callbacks are called as yajl_parse() and yajl_complete_parse() would
+ * call them, so a yajl parser state machine can be driven by either.  The
+ * document is scanned 64 bytes at a time with SIMD instructions where the
+ * CPU has them.  Strings are not checked to be valid UTF-8, as with
+ * yajl_dont_validate_strings.
+ *
+ * When the yajl_map_key callback returns AWS_DYNAMO_TOKENIZE_SKIP the value
+ * of the key is skipped without being decoded, only its nesting is checked.
+ */
+int aws_dynamo_tokenize(const yajl_callbacks *callbacks, void *ctx,
+	const unsigned char *json, size_t len);
+
+/**
+ * aws_dynamo_tokenize_raw - parse a complete JSON document, leaving strings
+ *	as they are
+ * @callbacks: yajl callbacks to call for each value of the document
+ * @ctx: context passed to @callbacks
+ * @json: document
+ * @len: length of @json
+ * @offset: if not NULL, set to the offset in @json of the token a callback
+ *	    is made for before making it
+ * Returns: 0 on success, -1 if the document is not valid JSON or a callback
+ *	    returned 0
+ *
+ * As aws_dynamo_tokenize(), except that string values are passed with
+ * their escapes in them, always pointing into @json, and are not checked
+ * until aws_dynamo_json_unescape() is used on them.  Map keys are decoded.
+ */
+int aws_dynamo_tokenize_raw(const yajl_callbacks *callbacks, void *ctx,
+	const unsigned char *json, size_t len, size_t *offset);
+
+/**
+ * aws_dynamo_json_unescape - decode the escapes of a JSON string
+ * @s: string without its quotes
+ * @len: length of @s
+ * @out: at least @len bytes for the result, not nul terminated
+ * @out_len: length of the result
+ * Returns: 0 on success, -1 if an escape is invalid
+ */
+int aws_dynamo_json_unescape(const unsigned char *s, size_t len,
+	unsigned char *out, size_t *out_len);
+
+/**
+ * struct aws_dynamo_skip - a map value being skipped by a parser
+ * @active: nonzero while the value is being skipped
+ * @depth: maps and arrays of the value entered and not yet left
+ *
+ * yajl, which parses streamed responses, takes AWS_DYNAMO_TOKENIZE_SKIP as
+ * any other nonzero return and calls back for every part of the value.  A
+ * parser that skips values passes each of its callbacks through
+ * aws_dynamo_skip_event() first to swallow those.  Zero initialize.
+ */
+struct aws_dynamo_skip {
+	int active;
+	int depth;
+};
+
+enum aws_dynamo_skip_event {
+	AWS_DYNAMO_SKIP_SCALAR,
+	AWS_DYNAMO_SKIP_START,	/* start of a map or array */
+	AWS_DYNAMO_SKIP_END,	/* end of a map or array */
+	AWS_DYNAMO_SKIP_KEY,
+};
+
+/**
+ * aws_dynamo_skip_start - skip the value of the map key being parsed
+ * @skip: skip state of the parser
+ * Returns: AWS_DYNAMO_TOKENIZE_SKIP, for the yajl_map_key callback to return
+ */
+int aws_dynamo_skip_start(struct aws_dynamo_skip *skip);
+
+/**
+ * aws_dynamo_skip_event - check whether a callback is for a skipped value
+ * @skip: skip state of the parser
+ * @event: AWS_DYNAMO_SKIP_* the callback is for
+ * Returns: 1 if the callback is part of the skipped value and should just
+ *	    return 1, 0 if it should be handled
+ */
+int aws_dynamo_skip_event(struct aws_dynamo_skip *skip,
+	enum aws_dynamo_skip_event event);
+
+/**
+ * aws_dynamo_tokenizer_select - choose how documents are scanned
+ * @impl: AWS_DYNAMO_TOKENIZER_* implementation
+ * Returns: 0 on success, -1 if the CPU or compiler does not support @impl
+ *
+ * For tests and benchmarks, the default of AWS_DYNAMO_TOKENIZER_AUTO is
+ * best otherwise.  The choice applies to every thread; it must not be made
+ * while documents are being parsed.
+ */
+int aws_dynamo_tokenizer_select(enum aws_dynamo_tokenizer_impl impl);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* _AWS_DYNAMO_TOKENIZER_H_ */
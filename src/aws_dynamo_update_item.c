@@ -27,6 +27,7 @@
 #include "http.h"
 #include "aws_dynamo.h"
 #include "aws_dynamo_update_item.h"
+#include "aws_dynamo_template.h"
 
 enum {
 	PARSER_STATE_NONE = 0,
@@ -46,6 +47,9 @@ struct update_item_ctx {
 	/* Index into the response structure. */
 	int attribute_index;
 
+	/* The attribute template compiled for lookups. */
+	const struct aws_dynamo_template *template;
+
 	int parser_state;
 };
 
@@ -185,21 +189,9 @@ static int update_item_map_key(void *ctx, const unsigned char *val,
 		}
 	case PARSER_STATE_ATTRIBUTES_MAP:{
 			/* Set the attribute index based on the name. */
-			int attribute;
-
-			for (attribute = 0; attribute < _ctx->r->num_attributes;
-			     attribute++) {
-				struct aws_dynamo_attribute *a =
-				    &(_ctx->r->attributes[attribute]);
-
-				if (len == a->name_len
-				    && strncmp(val, a->name, len) == 0) {
-					_ctx->attribute_index = attribute;
-					break;
-				}
-			}
-
-			if (attribute == _ctx->r->num_attributes) {
+			_ctx->attribute_index = aws_dynamo_template_lookup(_ctx->template,
+				val, len);
+			if (_ctx->attribute_index == -1) {
 				char attr[len + 1];
 				snprintf(attr, len + 1, "%s", val);
 
@@ -211,19 +203,15 @@ static int update_item_map_key(void *ctx, const unsigned char *val,
 		}
 	case PARSER_STATE_ATTRIBUTE_MAP:{
 			/* verify the attribute is of the expected type. */
-			struct aws_dynamo_attribute *a;
-			const char *expected_type;
-
-			a = &(_ctx->r->attributes[_ctx->attribute_index]);
-			expected_type = aws_dynamo_attribute_types[a->type];
-
-			if (len != strlen(expected_type)
-			    || strncmp(val, expected_type, len) != 0) {
+			if (!aws_dynamo_template_check_type(_ctx->template,
+				_ctx->attribute_index, val, len)) {
+				struct aws_dynamo_attribute *a;
 				char type[len + 1];
 				snprintf(type, len + 1, "%s", val);
 
+				a = &(_ctx->r->attributes[_ctx->attribute_index]);
 				Warnx("update_item_map_key: Unexpected type for attribute %s.  Got %s, expected %s.",
-					a->name, type, expected_type);
+					a->name, type, aws_dynamo_attribute_types[a->type]);
 				return 0;
 			}
 			_ctx->parser_state = PARSER_STATE_ATTRIBUTE_VALUE;
@@ -338,11 +326,16 @@ static yajl_callbacks update_item_callbacks = {
 	.yajl_end_array = update_item_end_array,
 };
 
-struct aws_dynamo_update_item_response * aws_dynamo_parse_update_item_response(const char *response, int response_len, struct aws_dynamo_attribute *attributes, int num_attributes)
+static struct aws_dynamo_update_item_response *update_item_parse(const char *response,
+	int response_len, const struct aws_dynamo_template *template)
 {
+	struct aws_dynamo_attribute *attributes = template->attributes;
+	int num_attributes = template->num_attributes;
 	yajl_handle hand;
 	yajl_status stat;
-	struct update_item_ctx _ctx = { 0 };
+	struct update_item_ctx _ctx = {
+		.template = template,
+	};
 
 	_ctx.r = calloc(sizeof(*(_ctx.r)), 1);
 	if (_ctx.r == NULL) {
@@ -385,7 +378,20 @@ struct aws_dynamo_update_item_response * aws_dynamo_parse_update_item_response(c
 	return _ctx.r;
 }
 
-struct aws_dynamo_update_item_response *aws_dynamo_update_item(struct aws_handle *aws, const char *request, struct aws_dynamo_attribute *attributes, int num_attributes)
+struct aws_dynamo_update_item_response * aws_dynamo_parse_update_item_response(const char *response, int response_len, struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	struct aws_dynamo_template template;
+	struct aws_dynamo_update_item_response *r;
+
+	aws_dynamo_template_init(&template, attributes, num_attributes);
+	r = update_item_parse(response, response_len, &template);
+	aws_dynamo_template_deinit(&template);
+
+	return r;
+}
+
+struct aws_dynamo_update_item_response *aws_dynamo_update_item_template(struct aws_handle *aws,
+	const char *request, const struct aws_dynamo_template *template)
 {
 	const char *response;
 	int response_len;
@@ -395,19 +401,33 @@ struct aws_dynamo_update_item_response *aws_dynamo_update_item(struct aws_handle
 		return NULL;
 	}
 
-	response = http_get_data(aws->http, &response_len);
+	response = http_get_data(aws_get_http(aws), &response_len);
 
 	if (response == NULL) {
 		Warnx("aws_dynamo_update_item: Failed to get response.");
 		return NULL;
 	}
 
-	if ((r = aws_dynamo_parse_update_item_response(response, response_len,
-						      attributes, num_attributes)) == NULL) {
+	if ((r = update_item_parse(response, response_len, template)) == NULL) {
 		Warnx("aws_dynamo_update_item: Failed to parse response: '%s'", response);
+		http_release_data(aws_get_http(aws));
 		return NULL;
 	}
 
+	http_release_data(aws_get_http(aws));
+
+	return r;
+}
+
+struct aws_dynamo_update_item_response *aws_dynamo_update_item(struct aws_handle *aws, const char *request, struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	struct aws_dynamo_template template;
+	struct aws_dynamo_update_item_response *r;
+
+	aws_dynamo_template_init(&template, attributes, num_attributes);
+	r = aws_dynamo_update_item_template(aws, request, &template);
+	aws_dynamo_template_deinit(&template);
+
 	return r;
 }
 
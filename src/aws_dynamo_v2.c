@@ -0,0 +1,1388 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "aws_dynamo_utils.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <yajl/yajl_parse.h>
+
+#include "http.h"
+#include "aws_dynamo.h"
+#include "aws_dynamo_v2.h"
+#include "aws_dynamo_stream.h"
+#include "aws_arena.h"
+#include "aws_dynamo_number.h"
+#include "aws_dynamo_template.h"
+#include "aws_dynamo_tokenizer.h"
+
+/* Initial capacity of the item, index, list, map and set arrays. */
+#define V2_MIN_SIZE	4
+
+/* Lists and maps nest up to 32 levels below the attribute holding them. */
+#define V2_MAX_DEPTH	34
+
+enum {
+	PARSER_STATE_NONE,
+	PARSER_STATE_ROOT_MAP,
+	PARSER_STATE_COUNT_KEY,
+	PARSER_STATE_SCANNED_COUNT_KEY,
+	PARSER_STATE_ITEMS_KEY,
+	PARSER_STATE_ITEMS_ARRAY,
+	PARSER_STATE_ITEM_KEY,
+	PARSER_STATE_ITEM_MAP,
+	PARSER_STATE_ATTRIBUTE_KEY,
+	PARSER_STATE_VALUE,
+	PARSER_STATE_LAST_EVALUATED_KEY,
+	PARSER_STATE_CAPACITY_KEY,
+	PARSER_STATE_CAPACITY_MAP,
+	PARSER_STATE_CAPACITY_NUMBER,
+	PARSER_STATE_CAPACITY_TABLE_NAME,
+	PARSER_STATE_CAPACITY_TABLE_KEY,
+	PARSER_STATE_CAPACITY_INDEXES_KEY,
+	PARSER_STATE_CAPACITY_INDEXES_MAP,
+	PARSER_STATE_CAPACITY_INDEX_KEY,
+};
+
+static const char *parser_state_strings[] = {
+	"none",
+	"root map",
+	"count key",
+	"scanned count key",
+	"items key",
+	"items array",
+	"item key",
+	"item map",
+	"attribute key",
+	"value",
+	"last evaluated key",
+	"capacity key",
+	"capacity map",
+	"capacity number",
+	"capacity table name",
+	"capacity table key",
+	"capacity indexes key",
+	"capacity indexes map",
+	"capacity index key",
+};
+
+static const char *parser_state_string(int state) {
+	if (state < 0 || state >= sizeof(parser_state_strings) / sizeof(parser_state_strings[0])) {
+		return "invalid state";
+	} else {
+		return parser_state_strings[state];
+	}
+}
+
+/* States of a value, {"<type>":<value>}, at one level of nesting. */
+enum {
+	VALUE_STATE_TYPE_KEY,	/* expecting the type */
+	VALUE_STATE_SCALAR,	/* expecting the string of an S, N or B */
+	VALUE_STATE_BOOLEAN,	/* expecting the literal of a BOOL */
+	VALUE_STATE_NULL,	/* expecting the literal of a NULL */
+	VALUE_STATE_SET_START,	/* expecting the array of an SS, NS or BS */
+	VALUE_STATE_SET,	/* expecting a member of a set or its end */
+	VALUE_STATE_LIST_START,	/* expecting the array of an L */
+	VALUE_STATE_LIST,	/* expecting a value of a list or its end */
+	VALUE_STATE_MAP_START,	/* expecting the map of an M */
+	VALUE_STATE_MAP,	/* expecting a member name of a map or its end */
+	VALUE_STATE_MAP_MEMBER,	/* expecting the value of a member */
+	VALUE_STATE_END,	/* expecting the end of the value */
+};
+
+/**
+ * struct v2_frame - a value being parsed
+ * @attribute: the value
+ * @state: VALUE_STATE_*
+ * @size: capacity of the array of a list, map or number or binary set
+ * @typed: whether the type comes from the template
+ * @bare: whether the value is a map without a type around it
+ */
+struct v2_frame {
+	struct aws_dynamo_attribute *attribute;
+	int state;
+	int size;
+	int typed;
+	int bare;
+};
+
+struct v2_ctx {
+	struct aws_dynamo_v2_response *r;
+
+	/* These define the expected attributes for each item. */
+	struct aws_dynamo_attribute *attributes; /* attribute template */
+	int num_attributes; /* number of attributes for each item. */
+	struct aws_dynamo_template template; /* the template compiled for lookups */
+
+	/* Capacity of r->items, and whether the item is that of a GetItem. */
+	int items_size;
+	int single;
+	int attribute_index;
+
+	/* The values being parsed, an attribute of an item or the last
+		evaluated key at the bottom. */
+	struct v2_frame stack[V2_MAX_DEPTH];
+	int depth;
+	struct aws_dynamo_attribute last_evaluated_key;
+
+	/* The capacity object being parsed and the number being set in it. */
+	struct aws_dynamo_v2_capacity *capacity;
+	double *capacity_number;
+	int indexes_size;
+	int indexes_global;
+
+	/* AWS_DYNAMO_PARSE_* flags and the expected size of the response. */
+	int flags;
+	size_t size_hint;
+
+	/* Body strings are borrowed from with AWS_DYNAMO_PARSE_BORROW. */
+	struct http_body *body;
+
+	/* Unknown keys skipped with AWS_DYNAMO_PARSE_SKIP_UNKNOWN. */
+	struct aws_dynamo_skip skip;
+
+	int parser_state;
+};
+
+/* Make room for one more element in an array that doubles in size. */
+static void *v2_grow(struct aws_arena *arena, void *array, size_t elem_size,
+	int n, int *size)
+{
+	int new_size;
+
+	if (n < *size) {
+		return array;
+	}
+
+	if (*size > INT_MAX / 2) {
+		Warnx("v2_grow: too many elements.");
+		return NULL;
+	}
+	new_size = *size == 0 ? V2_MIN_SIZE : *size * 2;
+
+	array = aws_arena_realloc(arena, array, elem_size * *size, elem_size * new_size);
+	if (array == NULL) {
+		Warnx("v2_grow: alloc failed.");
+		return NULL;
+	}
+	*size = new_size;
+
+	return array;
+}
+
+/* Add a zeroed attribute to the values of a list or the members of a map. */
+static struct aws_dynamo_attribute *v2_append_attribute(struct aws_arena *arena,
+	struct aws_dynamo_attribute **array, int *n, int *size)
+{
+	struct aws_dynamo_attribute *a;
+
+	a = v2_grow(arena, *array, sizeof(*a), *n, size);
+	if (a == NULL) {
+		return NULL;
+	}
+	*array = a;
+
+	memset(&(a[*n]), 0, sizeof(*a));
+	return &(a[(*n)++]);
+}
+
+static int v2_base64_value(unsigned char c)
+{
+	if (c >= 'A' && c <= 'Z') {
+		return c - 'A';
+	} else if (c >= 'a' && c <= 'z') {
+		return c - 'a' + 26;
+	} else if (c >= '0' && c <= '9') {
+		return c - '0' + 52;
+	} else if (c == '+') {
+		return 62;
+	} else if (c == '/') {
+		return 63;
+	}
+	return -1;
+}
+
+/* Decode a B value, the data is nul terminated for convenience. */
+static int v2_base64_decode(struct aws_arena *arena, struct aws_dynamo_binary *b,
+	const unsigned char *val, size_t len)
+{
+	unsigned char *out;
+	size_t pad = 0;
+	size_t n = 0;
+	size_t i;
+
+	if (len % 4 != 0) {
+		Warnx("v2_base64_decode: bad length.");
+		return -1;
+	}
+	if (len > 0 && val[len - 1] == '=') {
+		pad++;
+		if (val[len - 2] == '=') {
+			pad++;
+		}
+	}
+
+	out = aws_arena_alloc(arena, len / 4 * 3 + 1);
+	if (out == NULL) {
+		Warnx("v2_base64_decode: alloc failed.");
+		return -1;
+	}
+
+	for (i = 0; i < len; i += 4) {
+		unsigned int bits = 0;
+		int j;
+
+		for (j = 0; j < 4; j++) {
+			int c = 0;
+
+			if (i + j < len - pad && (c = v2_base64_value(val[i + j])) == -1) {
+				Warnx("v2_base64_decode: bad character.");
+				return -1;
+			}
+			bits = bits << 6 | c;
+		}
+
+		out[n++] = (unsigned char)(bits >> 16);
+		if (i + 2 < len - pad) {
+			out[n++] = (unsigned char)(bits >> 8);
+		}
+		if (i + 3 < len - pad) {
+			out[n++] = (unsigned char)bits;
+		}
+	}
+	out[n] = '\0';
+
+	b->data = out;
+	b->len = n;
+	return 0;
+}
+
+/* A number whose type is not in the template is an integer if it can be. */
+static int v2_number(struct aws_arena *arena, struct aws_dynamo_number *number,
+	const unsigned char *val, size_t len)
+{
+	long long i;
+	long double d;
+
+	if (aws_dynamo_number_parse_integer((const char *)val, len, &i) == 0) {
+		return aws_dynamo_number_set_integer(arena, number, i);
+	} else if (aws_dynamo_number_parse_long_double((const char *)val, len, &d) == 0) {
+		return aws_dynamo_number_set_double(arena, number, d);
+	}
+
+	Warnx("v2_number: failed to parse number.");
+	return -1;
+}
+
+static int v2_number_set_add(struct v2_ctx *v_ctx, struct v2_frame *f,
+	const unsigned char *val, size_t len)
+{
+	struct aws_dynamo_number_set *set = &(f->attribute->value.number_set);
+	struct aws_arena *arena = v_ctx->r->arena;
+	struct aws_dynamo_number *numbers;
+	long long i;
+	long double d;
+	int j;
+
+	numbers = v2_grow(arena, set->numbers, sizeof(*numbers), set->n, &(f->size));
+	if (numbers == NULL) {
+		return -1;
+	}
+	set->numbers = numbers;
+
+	if (set->type == AWS_DYNAMO_NUMBER_INTEGER &&
+		aws_dynamo_number_parse_integer((const char *)val, len, &i) == 0) {
+		if (aws_dynamo_number_set_integer(arena, &(numbers[set->n]), i) == -1) {
+			return -1;
+		}
+		set->n++;
+		return 0;
+	}
+
+	if (set->type == AWS_DYNAMO_NUMBER_INTEGER && f->typed) {
+		Warnx("v2_number_set_add: failed to parse integer.");
+		return -1;
+	}
+
+	if (aws_dynamo_number_parse_long_double((const char *)val, len, &d) == -1) {
+		Warnx("v2_number_set_add: failed to parse number.");
+		return -1;
+	}
+
+	if (set->type == AWS_DYNAMO_NUMBER_INTEGER) {
+		/* The set holds doubles from now on. */
+		for (j = 0; j < set->n; j++) {
+			if (aws_dynamo_number_set_double(arena, &(numbers[j]),
+				aws_dynamo_number_get_double(&(numbers[j]))) == -1) {
+				return -1;
+			}
+		}
+		set->type = AWS_DYNAMO_NUMBER_DOUBLE;
+	}
+	if (aws_dynamo_number_set_double(arena, &(numbers[set->n]), d) == -1) {
+		return -1;
+	}
+	set->n++;
+
+	return 0;
+}
+
+static int v2_binary_set_add(struct v2_ctx *v_ctx, struct v2_frame *f,
+	const unsigned char *val, size_t len)
+{
+	struct aws_dynamo_binary_set *set = &(f->attribute->value.binary_set);
+	struct aws_dynamo_binary *binaries;
+
+	binaries = v2_grow(v_ctx->r->arena, set->binaries, sizeof(*binaries),
+		set->num_binaries, &(f->size));
+	if (binaries == NULL) {
+		return -1;
+	}
+	set->binaries = binaries;
+
+	if (v2_base64_decode(v_ctx->r->arena, &(binaries[set->num_binaries]), val, len) == -1) {
+		return -1;
+	}
+	set->num_binaries++;
+
+	return 0;
+}
+
+static int v2_push(struct v2_ctx *v_ctx, struct aws_dynamo_attribute *attribute,
+	int state, int typed)
+{
+	struct v2_frame *f;
+
+	if (v_ctx->depth == V2_MAX_DEPTH) {
+		Warnx("v2_push: value nested too deeply.");
+		return -1;
+	}
+
+	f = &(v_ctx->stack[v_ctx->depth++]);
+	f->attribute = attribute;
+	f->state = state;
+	f->size = 0;
+	f->typed = typed;
+	f->bare = 0;
+
+	return 0;
+}
+
+/* A value is complete, go back to the one holding it. */
+static void v2_pop(struct v2_ctx *v_ctx)
+{
+	v_ctx->depth--;
+	if (v_ctx->depth > 0) {
+		return;
+	}
+
+	if (v_ctx->stack[0].attribute == &(v_ctx->last_evaluated_key)) {
+		v_ctx->r->last_evaluated_key.num_attributes =
+			v_ctx->last_evaluated_key.value.map.num_attributes;
+		v_ctx->r->last_evaluated_key.attributes =
+			v_ctx->last_evaluated_key.value.map.attributes;
+		v_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+	} else {
+		v_ctx->parser_state = PARSER_STATE_ITEM_MAP;
+	}
+}
+
+static int v2_value_type(struct v2_ctx *v_ctx, struct v2_frame *f,
+	const unsigned char *val, size_t len)
+{
+	struct aws_dynamo_attribute *a = f->attribute;
+
+	if (f->typed) {
+		if (!aws_dynamo_template_check_type(&(v_ctx->template), v_ctx->attribute_index,
+			(const char *)val, len)) {
+			Warnx("v2_value_type: Unexpected attribute type.");
+			return -1;
+		}
+	} else {
+		int type;
+
+		for (type = AWS_DYNAMO_STRING; type <= AWS_DYNAMO_MAP; type++) {
+			if (AWS_DYNAMO_VALCMP(aws_dynamo_attribute_types[type], (const char *)val, len)) {
+				break;
+			}
+		}
+		if (type > AWS_DYNAMO_MAP) {
+			Warnx("v2_value_type: Unknown type.");
+			return -1;
+		}
+		a->type = type;
+	}
+
+	switch (a->type) {
+		case AWS_DYNAMO_STRING:
+		case AWS_DYNAMO_NUMBER:
+		case AWS_DYNAMO_BINARY: {
+			f->state = VALUE_STATE_SCALAR;
+			break;
+		}
+		case AWS_DYNAMO_BOOLEAN: {
+			f->state = VALUE_STATE_BOOLEAN;
+			break;
+		}
+		case AWS_DYNAMO_NULL: {
+			f->state = VALUE_STATE_NULL;
+			break;
+		}
+		case AWS_DYNAMO_STRING_SET:
+		case AWS_DYNAMO_NUMBER_SET:
+		case AWS_DYNAMO_BINARY_SET: {
+			f->state = VALUE_STATE_SET_START;
+			break;
+		}
+		case AWS_DYNAMO_LIST: {
+			f->state = VALUE_STATE_LIST_START;
+			break;
+		}
+		case AWS_DYNAMO_MAP: {
+			f->state = VALUE_STATE_MAP_START;
+			break;
+		}
+		default: {
+			Warnx("v2_value_type: unsupported attribute type - %d", a->type);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * The callbacks below parse a value, they are called by those of the
+ * response while it is in PARSER_STATE_VALUE.
+ */
+
+static int v2_value_string(struct v2_ctx *v_ctx, const unsigned char *val, size_t len)
+{
+	struct v2_frame *f = &(v_ctx->stack[v_ctx->depth - 1]);
+	struct aws_dynamo_attribute *a = f->attribute;
+	struct aws_arena *arena = v_ctx->r->arena;
+
+	switch (f->state) {
+		case VALUE_STATE_SCALAR: {
+			if (a->type == AWS_DYNAMO_BINARY) {
+				if (v2_base64_decode(arena, &(a->value.binary), val, len) == -1) {
+					return 0;
+				}
+			} else if (a->type == AWS_DYNAMO_NUMBER && !f->typed) {
+				if (v2_number(arena, &(a->value.number), val, len) == -1) {
+					return 0;
+				}
+			} else if (aws_dynamo_parse_attribute_value_borrow(arena, v_ctx->body,
+				a, val, len) != 1) {
+				Warnx("v2_value_string: attribute parse failed.");
+				return 0;
+			}
+			f->state = VALUE_STATE_END;
+			break;
+		}
+		case VALUE_STATE_SET: {
+			int rv;
+
+			if (a->type == AWS_DYNAMO_NUMBER_SET) {
+				rv = v2_number_set_add(v_ctx, f, val, len);
+			} else if (a->type == AWS_DYNAMO_BINARY_SET) {
+				rv = v2_binary_set_add(v_ctx, f, val, len);
+			} else {
+				rv = aws_dynamo_parse_attribute_value_borrow(arena, v_ctx->body,
+					a, val, len) == 1 ? 0 : -1;
+			}
+			if (rv == -1) {
+				Warnx("v2_value_string: set member parse failed.");
+				return 0;
+			}
+			break;
+		}
+		default: {
+			Warnx("v2_value_string - unexpected value state %d", f->state);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int v2_value_boolean(struct v2_ctx *v_ctx, int b)
+{
+	struct v2_frame *f = &(v_ctx->stack[v_ctx->depth - 1]);
+
+	switch (f->state) {
+		case VALUE_STATE_BOOLEAN: {
+			f->attribute->value.boolean = b;
+			f->state = VALUE_STATE_END;
+			break;
+		}
+		case VALUE_STATE_NULL: {
+			f->state = VALUE_STATE_END;
+			break;
+		}
+		default: {
+			Warnx("v2_value_boolean - unexpected value state %d", f->state);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int v2_value_start_map(struct v2_ctx *v_ctx)
+{
+	struct v2_frame *f = &(v_ctx->stack[v_ctx->depth - 1]);
+	struct aws_dynamo_attribute *a = f->attribute;
+
+	switch (f->state) {
+		case VALUE_STATE_LIST: {
+			struct aws_dynamo_attribute *value;
+
+			value = v2_append_attribute(v_ctx->r->arena, &(a->value.list.values),
+				&(a->value.list.num_values), &(f->size));
+			if (value == NULL || v2_push(v_ctx, value, VALUE_STATE_TYPE_KEY, 0) == -1) {
+				return 0;
+			}
+			break;
+		}
+		case VALUE_STATE_MAP_START: {
+			f->state = VALUE_STATE_MAP;
+			break;
+		}
+		case VALUE_STATE_MAP_MEMBER: {
+			f->state = VALUE_STATE_MAP;
+			if (v2_push(v_ctx, &(a->value.map.attributes[a->value.map.num_attributes - 1]),
+				VALUE_STATE_TYPE_KEY, 0) == -1) {
+				return 0;
+			}
+			break;
+		}
+		default: {
+			Warnx("v2_value_start_map - unexpected value state %d", f->state);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int v2_value_map_key(struct v2_ctx *v_ctx, const unsigned char *val, size_t len)
+{
+	struct v2_frame *f = &(v_ctx->stack[v_ctx->depth - 1]);
+	struct aws_dynamo_attribute *a = f->attribute;
+
+	switch (f->state) {
+		case VALUE_STATE_TYPE_KEY: {
+			if (v2_value_type(v_ctx, f, val, len) == -1) {
+				return 0;
+			}
+			break;
+		}
+		case VALUE_STATE_MAP: {
+			struct aws_dynamo_attribute *member;
+			char *name;
+
+			member = v2_append_attribute(v_ctx->r->arena, &(a->value.map.attributes),
+				&(a->value.map.num_attributes), &(f->size));
+			if (member == NULL) {
+				return 0;
+			}
+			name = aws_dynamo_strndup_borrow(v_ctx->r->arena, v_ctx->body, val, len);
+			if (name == NULL) {
+				Warnx("v2_value_map_key: name alloc failed.");
+				return 0;
+			}
+			member->name = name;
+			member->name_len = len;
+			f->state = VALUE_STATE_MAP_MEMBER;
+			break;
+		}
+		default: {
+			Warnx("v2_value_map_key - unexpected value state %d", f->state);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int v2_value_end_map(struct v2_ctx *v_ctx)
+{
+	struct v2_frame *f = &(v_ctx->stack[v_ctx->depth - 1]);
+
+	switch (f->state) {
+		case VALUE_STATE_MAP: {
+			if (f->bare) {
+				v2_pop(v_ctx);
+			} else {
+				f->state = VALUE_STATE_END;
+			}
+			break;
+		}
+		case VALUE_STATE_END: {
+			v2_pop(v_ctx);
+			break;
+		}
+		default: {
+			Warnx("v2_value_end_map - unexpected value state %d", f->state);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int v2_value_start_array(struct v2_ctx *v_ctx)
+{
+	struct v2_frame *f = &(v_ctx->stack[v_ctx->depth - 1]);
+
+	switch (f->state) {
+		case VALUE_STATE_SET_START: {
+			f->state = VALUE_STATE_SET;
+			break;
+		}
+		case VALUE_STATE_LIST_START: {
+			f->state = VALUE_STATE_LIST;
+			break;
+		}
+		default: {
+			Warnx("v2_value_start_array - unexpected value state %d", f->state);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int v2_value_end_array(struct v2_ctx *v_ctx)
+{
+	struct v2_frame *f = &(v_ctx->stack[v_ctx->depth - 1]);
+
+	switch (f->state) {
+		case VALUE_STATE_SET:
+		case VALUE_STATE_LIST: {
+			f->state = VALUE_STATE_END;
+			break;
+		}
+		default: {
+			Warnx("v2_value_end_array - unexpected value state %d", f->state);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * The callbacks of the response.
+ */
+
+static struct aws_dynamo_item *v2_new_item(struct v2_ctx *v_ctx)
+{
+	struct aws_dynamo_v2_response *r = v_ctx->r;
+	struct aws_dynamo_item *items;
+	struct aws_dynamo_item *item;
+
+	items = v2_grow(r->arena, r->items, sizeof(*items), r->num_items, &(v_ctx->items_size));
+	if (items == NULL) {
+		return NULL;
+	}
+	r->items = items;
+
+	item = &(items[r->num_items]);
+	item->num_attributes = v_ctx->num_attributes;
+	item->attributes = aws_arena_alloc(r->arena,
+		sizeof(*(item->attributes)) * v_ctx->num_attributes);
+	if (v_ctx->num_attributes > 0 && item->attributes == NULL) {
+		Warnx("v2_new_item: attribute alloc failed.");
+		return NULL;
+	}
+	/* Set expected types for attributes. */
+	memcpy(item->attributes, v_ctx->attributes,
+		sizeof(*(item->attributes)) * v_ctx->num_attributes);
+
+	r->num_items++;
+	return item;
+}
+
+static int v2_number_cb(void *ctx, const char *val, unsigned int len)
+{
+	struct v2_ctx *v_ctx = (struct v2_ctx *) ctx;
+
+	if (aws_dynamo_skip_event(&(v_ctx->skip), AWS_DYNAMO_SKIP_SCALAR)) {
+		return 1;
+	}
+
+	switch (v_ctx->parser_state) {
+		case PARSER_STATE_COUNT_KEY: {
+			if (aws_dynamo_json_get_int((const unsigned char *)val, len, &(v_ctx->r->count)) == -1) {
+				Warnx("v2_number: failed to get count int.");
+				return 0;
+			}
+			v_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			break;
+		}
+		case PARSER_STATE_SCANNED_COUNT_KEY: {
+			if (aws_dynamo_json_get_int((const unsigned char *)val, len,
+				&(v_ctx->r->scanned_count)) == -1) {
+				Warnx("v2_number: failed to get scanned count int.");
+				return 0;
+			}
+			v_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			break;
+		}
+		case PARSER_STATE_CAPACITY_NUMBER: {
+			if (aws_dynamo_json_get_double(val, len, v_ctx->capacity_number) == -1) {
+				Warnx("v2_number: failed to get capacity.");
+				return 0;
+			}
+			v_ctx->parser_state = PARSER_STATE_CAPACITY_MAP;
+			break;
+		}
+		default: {
+			Warnx("v2_number - unexpected state '%s'",
+				parser_state_string(v_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int v2_string(void *ctx, const unsigned char *val, unsigned int len)
+{
+	struct v2_ctx *v_ctx = (struct v2_ctx *) ctx;
+
+	if (aws_dynamo_skip_event(&(v_ctx->skip), AWS_DYNAMO_SKIP_SCALAR)) {
+		return 1;
+	}
+
+	switch (v_ctx->parser_state) {
+		case PARSER_STATE_VALUE: {
+			return v2_value_string(v_ctx, val, len);
+		}
+		case PARSER_STATE_CAPACITY_TABLE_NAME: {
+			v_ctx->r->consumed_capacity->table_name =
+				aws_dynamo_strndup_borrow(v_ctx->r->arena, v_ctx->body, val, len);
+			if (v_ctx->r->consumed_capacity->table_name == NULL) {
+				Warnx("v2_string: table name alloc failed.");
+				return 0;
+			}
+			v_ctx->parser_state = PARSER_STATE_CAPACITY_MAP;
+			break;
+		}
+		default: {
+			Warnx("v2_string - unexpected state '%s'",
+				parser_state_string(v_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int v2_boolean(void *ctx, int b)
+{
+	struct v2_ctx *v_ctx = (struct v2_ctx *) ctx;
+
+	if (aws_dynamo_skip_event(&(v_ctx->skip), AWS_DYNAMO_SKIP_SCALAR)) {
+		return 1;
+	}
+
+	if (v_ctx->parser_state != PARSER_STATE_VALUE) {
+		Warnx("v2_boolean - unexpected state '%s'",
+			parser_state_string(v_ctx->parser_state));
+		return 0;
+	}
+
+	return v2_value_boolean(v_ctx, b);
+}
+
+static int v2_null(void *ctx)
+{
+	struct v2_ctx *v_ctx = (struct v2_ctx *) ctx;
+
+	if (aws_dynamo_skip_event(&(v_ctx->skip), AWS_DYNAMO_SKIP_SCALAR)) {
+		return 1;
+	}
+
+	Warnx("v2_null - unexpected null in state '%s'",
+		parser_state_string(v_ctx->parser_state));
+	return 0;
+}
+
+static int v2_start_map(void *ctx)
+{
+	struct v2_ctx *v_ctx = (struct v2_ctx *) ctx;
+	struct aws_dynamo_v2_response *r = v_ctx->r;
+
+	if (aws_dynamo_skip_event(&(v_ctx->skip), AWS_DYNAMO_SKIP_START)) {
+		return 1;
+	}
+
+	switch (v_ctx->parser_state) {
+		case PARSER_STATE_NONE: {
+			v_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			break;
+		}
+		case PARSER_STATE_ITEMS_ARRAY: {
+			if (v2_new_item(v_ctx) == NULL) {
+				return 0;
+			}
+			v_ctx->parser_state = PARSER_STATE_ITEM_MAP;
+			break;
+		}
+		case PARSER_STATE_ITEM_KEY: {
+			r->item = v2_new_item(v_ctx);
+			if (r->item == NULL) {
+				return 0;
+			}
+			v_ctx->single = 1;
+			v_ctx->parser_state = PARSER_STATE_ITEM_MAP;
+			break;
+		}
+		case PARSER_STATE_ATTRIBUTE_KEY: {
+			struct aws_dynamo_item *item = &(r->items[r->num_items - 1]);
+
+			if (v2_push(v_ctx, &(item->attributes[v_ctx->attribute_index]),
+				VALUE_STATE_TYPE_KEY, 1) == -1) {
+				return 0;
+			}
+			v_ctx->parser_state = PARSER_STATE_VALUE;
+			break;
+		}
+		case PARSER_STATE_LAST_EVALUATED_KEY: {
+			if (v_ctx->last_evaluated_key.type == AWS_DYNAMO_MAP) {
+				Warnx("v2_start_map: duplicate last evaluated key?");
+				return 0;
+			}
+			v_ctx->last_evaluated_key.type = AWS_DYNAMO_MAP;
+			if (v2_push(v_ctx, &(v_ctx->last_evaluated_key), VALUE_STATE_MAP, 0) == -1) {
+				return 0;
+			}
+			v_ctx->stack[0].bare = 1;
+			v_ctx->parser_state = PARSER_STATE_VALUE;
+			break;
+		}
+		case PARSER_STATE_CAPACITY_KEY: {
+			if (r->consumed_capacity != NULL) {
+				Warnx("v2_start_map: duplicate consumed capacity?");
+				return 0;
+			}
+			r->consumed_capacity = aws_arena_calloc(r->arena, 1, sizeof(*(r->consumed_capacity)));
+			if (r->consumed_capacity == NULL) {
+				Warnx("v2_start_map: consumed capacity alloc failed.");
+				return 0;
+			}
+			v_ctx->capacity = &(r->consumed_capacity->total);
+			v_ctx->parser_state = PARSER_STATE_CAPACITY_MAP;
+			break;
+		}
+		case PARSER_STATE_CAPACITY_TABLE_KEY: {
+			v_ctx->capacity = &(r->consumed_capacity->table);
+			v_ctx->parser_state = PARSER_STATE_CAPACITY_MAP;
+			break;
+		}
+		case PARSER_STATE_CAPACITY_INDEXES_KEY: {
+			v_ctx->parser_state = PARSER_STATE_CAPACITY_INDEXES_MAP;
+			break;
+		}
+		case PARSER_STATE_CAPACITY_INDEX_KEY: {
+			struct aws_dynamo_v2_consumed_capacity *cc = r->consumed_capacity;
+
+			v_ctx->capacity = &(cc->indexes[cc->num_indexes - 1].capacity);
+			v_ctx->parser_state = PARSER_STATE_CAPACITY_MAP;
+			break;
+		}
+		case PARSER_STATE_VALUE: {
+			return v2_value_start_map(v_ctx);
+		}
+		default: {
+			Warnx("v2_start_map - unexpected state '%s'",
+				parser_state_string(v_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* A key of a ConsumedCapacity object, or of its Table or of an index.
+   Returns -1 if the key is not known. */
+static int v2_capacity_key(struct v2_ctx *v_ctx, const unsigned char *val, size_t len)
+{
+	struct aws_dynamo_v2_consumed_capacity *cc = v_ctx->r->consumed_capacity;
+	struct aws_dynamo_v2_capacity *c = v_ctx->capacity;
+
+	if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_V2_CAPACITY_UNITS, val, len)) {
+		v_ctx->capacity_number = &(c->capacity_units);
+	} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_V2_READ_CAPACITY_UNITS, val, len)) {
+		v_ctx->capacity_number = &(c->read_capacity_units);
+	} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_V2_WRITE_CAPACITY_UNITS, val, len)) {
+		v_ctx->capacity_number = &(c->write_capacity_units);
+	} else if (c != &(cc->total)) {
+		return -1;
+	} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_TABLE_NAME, val, len)) {
+		v_ctx->parser_state = PARSER_STATE_CAPACITY_TABLE_NAME;
+		return 0;
+	} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_TABLE, val, len)) {
+		v_ctx->parser_state = PARSER_STATE_CAPACITY_TABLE_KEY;
+		return 0;
+	} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_V2_GLOBAL_SECONDARY_INDEXES, val, len)) {
+		v_ctx->parser_state = PARSER_STATE_CAPACITY_INDEXES_KEY;
+		v_ctx->indexes_global = 1;
+		return 0;
+	} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_V2_LOCAL_SECONDARY_INDEXES, val, len)) {
+		v_ctx->parser_state = PARSER_STATE_CAPACITY_INDEXES_KEY;
+		v_ctx->indexes_global = 0;
+		return 0;
+	} else {
+		return -1;
+	}
+
+	v_ctx->parser_state = PARSER_STATE_CAPACITY_NUMBER;
+	return 0;
+}
+
+static int v2_map_key(void *ctx, const unsigned char *val, unsigned int len)
+{
+	struct v2_ctx *v_ctx = (struct v2_ctx *) ctx;
+	struct aws_dynamo_v2_response *r = v_ctx->r;
+
+	if (aws_dynamo_skip_event(&(v_ctx->skip), AWS_DYNAMO_SKIP_KEY)) {
+		return 1;
+	}
+
+	switch (v_ctx->parser_state) {
+		case PARSER_STATE_ROOT_MAP: {
+			if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_COUNT, val, len)) {
+				v_ctx->parser_state = PARSER_STATE_COUNT_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_SCANNED_COUNT, val, len)) {
+				v_ctx->parser_state = PARSER_STATE_SCANNED_COUNT_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_ITEMS, val, len) &&
+				r->item == NULL) {
+				v_ctx->parser_state = PARSER_STATE_ITEMS_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_ITEM, val, len) &&
+				r->num_items == 0) {
+				v_ctx->parser_state = PARSER_STATE_ITEM_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_LAST_EVALUATED_KEY, val, len)) {
+				v_ctx->parser_state = PARSER_STATE_LAST_EVALUATED_KEY;
+			} else if (AWS_DYNAMO_VALCMP(AWS_DYNAMO_JSON_V2_CONSUMED_CAPACITY, val, len)) {
+				v_ctx->parser_state = PARSER_STATE_CAPACITY_KEY;
+			} else if (v_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+				return aws_dynamo_skip_start(&(v_ctx->skip));
+			} else {
+				Warnx("v2_map_key: Unknown key.");
+				return 0;
+			}
+			break;
+		}
+		case PARSER_STATE_ITEM_MAP: {
+			v_ctx->attribute_index = aws_dynamo_template_lookup(&(v_ctx->template),
+				(const char *)val, len);
+			if (v_ctx->attribute_index == -1) {
+				if (v_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+					return aws_dynamo_skip_start(&(v_ctx->skip));
+				}
+				Warnx("v2_map_key: Unknown attribute.");
+				return 0;
+			}
+			v_ctx->parser_state = PARSER_STATE_ATTRIBUTE_KEY;
+			break;
+		}
+		case PARSER_STATE_CAPACITY_MAP: {
+			if (v2_capacity_key(v_ctx, val, len) == -1) {
+				if (v_ctx->flags & AWS_DYNAMO_PARSE_SKIP_UNKNOWN) {
+					return aws_dynamo_skip_start(&(v_ctx->skip));
+				}
+				Warnx("v2_map_key: Unknown capacity key.");
+				return 0;
+			}
+			break;
+		}
+		case PARSER_STATE_CAPACITY_INDEXES_MAP: {
+			struct aws_dynamo_v2_consumed_capacity *cc = r->consumed_capacity;
+			struct aws_dynamo_v2_index_capacity *indexes;
+			struct aws_dynamo_v2_index_capacity *index;
+
+			indexes = v2_grow(r->arena, cc->indexes, sizeof(*indexes),
+				cc->num_indexes, &(v_ctx->indexes_size));
+			if (indexes == NULL) {
+				return 0;
+			}
+			cc->indexes = indexes;
+
+			index = &(indexes[cc->num_indexes]);
+			memset(index, 0, sizeof(*index));
+			index->global = v_ctx->indexes_global;
+			index->name = aws_dynamo_strndup_borrow(r->arena, v_ctx->body, val, len);
+			if (index->name == NULL) {
+				Warnx("v2_map_key: index name alloc failed.");
+				return 0;
+			}
+			cc->num_indexes++;
+			v_ctx->parser_state = PARSER_STATE_CAPACITY_INDEX_KEY;
+			break;
+		}
+		case PARSER_STATE_VALUE: {
+			return v2_value_map_key(v_ctx, val, len);
+		}
+		default: {
+			Warnx("v2_map_key - unexpected state '%s'",
+				parser_state_string(v_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int v2_end_map(void *ctx)
+{
+	struct v2_ctx *v_ctx = (struct v2_ctx *) ctx;
+	struct aws_dynamo_v2_consumed_capacity *cc = v_ctx->r->consumed_capacity;
+
+	if (aws_dynamo_skip_event(&(v_ctx->skip), AWS_DYNAMO_SKIP_END)) {
+		return 1;
+	}
+
+	switch (v_ctx->parser_state) {
+		case PARSER_STATE_ITEM_MAP: {
+			v_ctx->parser_state = v_ctx->single ?
+				PARSER_STATE_ROOT_MAP : PARSER_STATE_ITEMS_ARRAY;
+			break;
+		}
+		case PARSER_STATE_ROOT_MAP: {
+			v_ctx->parser_state = PARSER_STATE_NONE;
+			break;
+		}
+		case PARSER_STATE_CAPACITY_MAP: {
+			if (v_ctx->capacity == &(cc->total)) {
+				v_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			} else if (v_ctx->capacity == &(cc->table)) {
+				v_ctx->capacity = &(cc->total);
+			} else {
+				v_ctx->parser_state = PARSER_STATE_CAPACITY_INDEXES_MAP;
+			}
+			break;
+		}
+		case PARSER_STATE_CAPACITY_INDEXES_MAP: {
+			v_ctx->capacity = &(cc->total);
+			v_ctx->parser_state = PARSER_STATE_CAPACITY_MAP;
+			break;
+		}
+		case PARSER_STATE_VALUE: {
+			return v2_value_end_map(v_ctx);
+		}
+		default: {
+			Warnx("v2_end_map - unexpected state '%s'",
+				parser_state_string(v_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int v2_start_array(void *ctx)
+{
+	struct v2_ctx *v_ctx = (struct v2_ctx *) ctx;
+
+	if (aws_dynamo_skip_event(&(v_ctx->skip), AWS_DYNAMO_SKIP_START)) {
+		return 1;
+	}
+
+	switch (v_ctx->parser_state) {
+		case PARSER_STATE_ITEMS_KEY: {
+			v_ctx->parser_state = PARSER_STATE_ITEMS_ARRAY;
+			break;
+		}
+		case PARSER_STATE_VALUE: {
+			return v2_value_start_array(v_ctx);
+		}
+		default: {
+			Warnx("v2_start_array - unexpected state '%s'",
+				parser_state_string(v_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int v2_end_array(void *ctx)
+{
+	struct v2_ctx *v_ctx = (struct v2_ctx *) ctx;
+
+	if (aws_dynamo_skip_event(&(v_ctx->skip), AWS_DYNAMO_SKIP_END)) {
+		return 1;
+	}
+
+	switch (v_ctx->parser_state) {
+		case PARSER_STATE_ITEMS_ARRAY: {
+			v_ctx->parser_state = PARSER_STATE_ROOT_MAP;
+			break;
+		}
+		case PARSER_STATE_VALUE: {
+			return v2_value_end_array(v_ctx);
+		}
+		default: {
+			Warnx("v2_end_array - unexpected state '%s'",
+				parser_state_string(v_ctx->parser_state));
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static yajl_callbacks v2_callbacks = {
+	.yajl_null = v2_null,
+	.yajl_boolean = v2_boolean,
+	.yajl_number = v2_number_cb,
+	.yajl_string = v2_string,
+	.yajl_start_map = v2_start_map,
+	.yajl_map_key = v2_map_key,
+	.yajl_end_map = v2_end_map,
+	.yajl_start_array = v2_start_array,
+	.yajl_end_array = v2_end_array,
+};
+
+/* Start a new response, dropping any from an earlier parse. */
+static int v2_reset(void *ctx)
+{
+	struct v2_ctx *v_ctx = (struct v2_ctx *) ctx;
+	struct aws_arena *arena;
+
+	aws_dynamo_v2_free_response(v_ctx->r);
+	v_ctx->r = NULL;
+	v_ctx->items_size = 0;
+	v_ctx->single = 0;
+	v_ctx->attribute_index = 0;
+	v_ctx->depth = 0;
+	memset(&(v_ctx->last_evaluated_key), 0, sizeof(v_ctx->last_evaluated_key));
+	v_ctx->capacity = NULL;
+	v_ctx->capacity_number = NULL;
+	v_ctx->indexes_size = 0;
+	v_ctx->parser_state = PARSER_STATE_NONE;
+	memset(&(v_ctx->skip), 0, sizeof(v_ctx->skip));
+
+	/* The response itself comes from its arena. */
+	arena = aws_arena_init(v_ctx->size_hint);
+	if (arena == NULL) {
+		Warnx("v2_reset: arena alloc failed.");
+		return -1;
+	}
+	v_ctx->r = aws_arena_calloc(arena, 1, sizeof(*(v_ctx->r)));
+	if (v_ctx->r == NULL) {
+		Warnx("v2_reset: alloc failed.");
+		aws_arena_deinit(arena);
+		return -1;
+	}
+	v_ctx->r->arena = arena;
+
+	if (v_ctx->body != NULL) {
+		if (aws_arena_defer(arena, http_body_put, v_ctx->body) == -1) {
+			Warnx("v2_reset: body defer failed.");
+			aws_arena_deinit(arena);
+			v_ctx->r = NULL;
+			return -1;
+		}
+		http_body_get(v_ctx->body);
+	}
+
+	return 0;
+}
+
+/**
+ * aws_dynamo_v2_parse - parse a complete v2 response
+ * @response: response body
+ * @response_len: length of @response
+ * @attributes: attribute template of the items
+ * @num_attributes: number of attributes in @attributes
+ * @flags: AWS_DYNAMO_PARSE_* flags
+ * @body: body holding @response to borrow strings from, NULL to copy them
+ * Returns: response, NULL on failure
+ */
+static struct aws_dynamo_v2_response *aws_dynamo_v2_parse(const char *response,
+	int response_len, struct aws_dynamo_attribute *attributes, int num_attributes,
+	int flags, struct http_body *body)
+{
+	struct v2_ctx v_ctx = {
+		.attributes = attributes,
+		.num_attributes = num_attributes,
+		.flags = flags,
+		.size_hint = response_len,
+		.body = body,
+	};
+
+	aws_dynamo_template_init(&(v_ctx.template), attributes, num_attributes);
+
+	if (v2_reset(&v_ctx) == -1) {
+		aws_dynamo_template_deinit(&(v_ctx.template));
+		return NULL;
+	}
+
+	if (aws_dynamo_tokenize(&v2_callbacks, &v_ctx, (const unsigned char *)response,
+		response_len) == -1) {
+		Warnx("aws_dynamo_v2_parse: json parse failed.");
+		aws_dynamo_template_deinit(&(v_ctx.template));
+		aws_dynamo_v2_free_response(v_ctx.r);
+		return NULL;
+	}
+
+	aws_dynamo_template_deinit(&(v_ctx.template));
+	return v_ctx.r;
+}
+
+struct aws_dynamo_v2_response *aws_dynamo_v2_parse_response(const char *response,
+	int response_len, struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	return aws_dynamo_v2_parse(response, response_len, attributes, num_attributes, 0, NULL);
+}
+
+static struct aws_dynamo_v2_response *aws_dynamo_v2_stream(struct aws_handle *aws,
+	const char *target, const char *request,
+	struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	struct v2_ctx v_ctx = {
+		.attributes = attributes,
+		.num_attributes = num_attributes,
+		.flags = aws->dynamo_parse_flags,
+	};
+
+	aws_dynamo_template_init(&(v_ctx.template), attributes, num_attributes);
+
+	if (aws_dynamo_request_stream(aws, target, request,
+		&v2_callbacks, v2_reset, &v_ctx) == -1) {
+		Warnx("aws_dynamo_v2_request: Failed to get or parse response.");
+		aws_dynamo_template_deinit(&(v_ctx.template));
+		aws_dynamo_v2_free_response(v_ctx.r);
+		return NULL;
+	}
+
+	aws_dynamo_template_deinit(&(v_ctx.template));
+	return v_ctx.r;
+}
+
+static struct aws_dynamo_v2_response *aws_dynamo_v2_request(struct aws_handle *aws,
+	const char *target, const char *request,
+	struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	struct aws_dynamo_v2_response *r;
+	const char *response;
+	int response_len;
+
+	if (aws->dynamo_parse_flags & AWS_DYNAMO_PARSE_STREAM) {
+		return aws_dynamo_v2_stream(aws, target, request, attributes, num_attributes);
+	}
+
+	if (aws_dynamo_request(aws, target, request) == -1) {
+		return NULL;
+	}
+
+	if (aws->dynamo_parse_flags & AWS_DYNAMO_PARSE_BORROW) {
+		struct http_body *body;
+
+		/* The response takes a reference to the body. */
+		body = http_take_body(aws_get_http(aws));
+		if (body == NULL) {
+			Warnx("aws_dynamo_v2_request: Failed to get response.");
+			return NULL;
+		}
+		r = aws_dynamo_v2_parse((const char *)body->data, body->len,
+			attributes, num_attributes, aws->dynamo_parse_flags, body);
+		if (r == NULL) {
+			Warnx("aws_dynamo_v2_request: Failed to parse response.");
+		}
+		http_body_put(body);
+		return r;
+	}
+
+	response = http_get_data(aws_get_http(aws), &response_len);
+	if (response == NULL) {
+		Warnx("aws_dynamo_v2_request: Failed to get response.");
+		return NULL;
+	}
+
+	r = aws_dynamo_v2_parse(response, response_len, attributes, num_attributes,
+		aws->dynamo_parse_flags, NULL);
+	if (r == NULL) {
+		Warnx("aws_dynamo_v2_request: Failed to parse response: '%s'", response);
+	}
+
+	http_release_data(aws_get_http(aws));
+	return r;
+}
+
+struct aws_dynamo_v2_response *aws_dynamo_v2_query(struct aws_handle *aws,
+	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	return aws_dynamo_v2_request(aws, AWS_DYNAMO_V2_QUERY, request,
+		attributes, num_attributes);
+}
+
+struct aws_dynamo_v2_response *aws_dynamo_v2_scan(struct aws_handle *aws,
+	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	return aws_dynamo_v2_request(aws, AWS_DYNAMO_V2_SCAN, request,
+		attributes, num_attributes);
+}
+
+struct aws_dynamo_v2_response *aws_dynamo_v2_get_item(struct aws_handle *aws,
+	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes)
+{
+	return aws_dynamo_v2_request(aws, AWS_DYNAMO_V2_GET_ITEM, request,
+		attributes, num_attributes);
+}
+
+struct aws_dynamo_attribute *aws_dynamo_v2_map_get(const struct aws_dynamo_attribute *map,
+	const char *name)
+{
+	size_t len;
+	int i;
+
+	if (map == NULL || map->type != AWS_DYNAMO_MAP) {
+		return NULL;
+	}
+
+	len = strlen(name);
+	for (i = 0; i < map->value.map.num_attributes; i++) {
+		struct aws_dynamo_attribute *a = &(map->value.map.attributes[i]);
+
+		if ((size_t)a->name_len == len && memcmp(a->name, name, len) == 0) {
+			return a;
+		}
+	}
+
+	return NULL;
+}
+
+void aws_dynamo_v2_free_response(struct aws_dynamo_v2_response *r)
+{
+	if (r == NULL) {
+		return;
+	}
+
+	/* Everything, r included, is in the arena. */
+	aws_arena_deinit(r->arena);
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AWS_DYNAMO_V2_H_
+#define _AWS_DYNAMO_V2_H_
+
+#include "aws_dynamo.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Typed parsing of DynamoDB_20120810 (v2) Query, Scan and GetItem
+ * responses.  Items are parsed against an attribute template as with the
+ * v1 parsers; any of the template attributes may have one of the v2 types.
+ * The values of lists and maps take the types they have in the response,
+ * numbers in them are integers when they can be and doubles otherwise.
+ *
+ * Responses are always parsed into an arena, freed as a whole with
+ * aws_dynamo_v2_free_response(), so their items can't be used with
+ * aws_dynamo_copy_item() or aws_dynamo_free_item().  The
+ * AWS_DYNAMO_PARSE_STREAM and AWS_DYNAMO_PARSE_BORROW flags apply as they
+ * do to v1 requests.
+ */
+
+/**
+ * struct aws_dynamo_v2_capacity - capacity consumed by a request
+ * @capacity_units: total capacity units
+ * @read_capacity_units: read capacity units, 0 unless reported separately
+ * @write_capacity_units: write capacity units, 0 unless reported separately
+ */
+struct aws_dynamo_v2_capacity {
+	double capacity_units;
+	double read_capacity_units;
+	double write_capacity_units;
+};
+
+/**
+ * struct aws_dynamo_v2_index_capacity - capacity consumed on an index
+ * @name: index name
+ * @global: 1 for a global secondary index, 0 for a local one
+ * @capacity: capacity consumed on the index
+ */
+struct aws_dynamo_v2_index_capacity {
+	char *name;
+	int global;
+	struct aws_dynamo_v2_capacity capacity;
+};
+
+/**
+ * struct aws_dynamo_v2_consumed_capacity - a ConsumedCapacity object
+ * @table_name: table the request was made on
+ * @total: capacity consumed in all
+ * @table: capacity consumed on the table itself, with
+ *	   ReturnConsumedCapacity INDEXES
+ * @num_indexes: number of indexes in @indexes
+ * @indexes: capacity consumed on each index, with ReturnConsumedCapacity
+ *	     INDEXES
+ */
+struct aws_dynamo_v2_consumed_capacity {
+	char *table_name;
+	struct aws_dynamo_v2_capacity total;
+	struct aws_dynamo_v2_capacity table;
+	int num_indexes;
+	struct aws_dynamo_v2_index_capacity *indexes;
+};
+
+/**
+ * struct aws_dynamo_v2_response - a v2 Query, Scan or GetItem response
+ * @count: Count of a Query or Scan
+ * @scanned_count: ScannedCount of a Query or Scan
+ * @num_items: number of items in @items, 0 for a Select of COUNT
+ * @items: the items of a Query or Scan, or the item of a GetItem
+ * @item: the item of a GetItem, NULL if there was none or for Query and Scan
+ * @last_evaluated_key: the key attributes of LastEvaluatedKey, with the
+ *			types in the response; num_attributes is 0 if there
+ *			was none
+ * @consumed_capacity: the ConsumedCapacity, NULL if it was not returned
+ * @arena: holds all of the above, the response included
+ */
+struct aws_dynamo_v2_response {
+	int count;
+	int scanned_count;
+	int num_items;
+	struct aws_dynamo_item *items;
+	struct aws_dynamo_item *item;
+	struct aws_dynamo_item last_evaluated_key;
+	struct aws_dynamo_v2_consumed_capacity *consumed_capacity;
+	struct aws_arena *arena;
+};
+
+/**
+ * aws_dynamo_v2_parse_response - parse a v2 Query, Scan or GetItem response
+ * @response: response body
+ * @response_len: length of @response
+ * @attributes: attribute template of the items
+ * @num_attributes: number of attributes in @attributes
+ * Returns: response, NULL on failure
+ */
+struct aws_dynamo_v2_response *aws_dynamo_v2_parse_response(const char *response,
+	int response_len, struct aws_dynamo_attribute *attributes, int num_attributes);
+
+/**
+ * aws_dynamo_v2_query - make a v2 Query request
+ * @aws: library handle
+ * @request: Query request
+ * @attributes: attribute template of the items
+ * @num_attributes: number of attributes in @attributes
+ * Returns: response, NULL on failure
+ */
+struct aws_dynamo_v2_response *aws_dynamo_v2_query(struct aws_handle *aws,
+	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes);
+
+/**
+ * aws_dynamo_v2_scan - make a v2 Scan request
+ * @aws: library handle
+ * @request: Scan request
+ * @attributes: attribute template of the items
+ * @num_attributes: number of attributes in @attributes
+ * Returns: response, NULL on failure
+ */
+struct aws_dynamo_v2_response *aws_dynamo_v2_scan(struct aws_handle *aws,
+	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes);
+
+/**
+ * aws_dynamo_v2_get_item - make a v2 GetItem request
+ * @aws: library handle
+ * @request: GetItem request
+ * @attributes: attribute template of the item
+ * @num_attributes: number of attributes in @attributes
+ * Returns: response, NULL on failure
+ */
+struct aws_dynamo_v2_response *aws_dynamo_v2_get_item(struct aws_handle *aws,
+	const char *request, struct aws_dynamo_attribute *attributes, int num_attributes);
+
+/**
+ * aws_dynamo_v2_map_get - find a member of a map
+ * @map: attribute of type AWS_DYNAMO_MAP
+ * @name: name of the member
+ * Returns: the member, NULL if @map has none of that name or is not a map
+ */
+struct aws_dynamo_attribute *aws_dynamo_v2_map_get(const struct aws_dynamo_attribute *map,
+	const char *name);
+
+/**
+ * aws_dynamo_v2_free_response - free a v2 response
+ * @r: response, may be NULL
+ */
+void aws_dynamo_v2_free_response(struct aws_dynamo_v2_response *r);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* _AWS_DYNAMO_V2_H_ */
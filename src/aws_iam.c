@@ -343,46 +343,168 @@ static struct aws_session_token *aws_iam_parse_credentials(const char *response,
 	return token;
 }
 	
-#define DEFAULT_TOKEN_URL "http://169.254.169.254/latest/meta-data/iam/security-credentials/"
+#define AWS_IAM_CREDENTIALS_PATH "/latest/meta-data/iam/security-credentials/"
+
+/**
+ * aws_iam_get_http - get the handle used to talk to the metadata service
+ * @aws: aws handle
+ * Returns: HTTP handle, NULL on failure
+ *
+ * The metadata service has a transport of its own so that a refresh never
+ * touches the connections or response data of DynamoDB requests.  Called
+ * with iam_lock held.
+ */
+static void *aws_iam_get_http(struct aws_handle *aws) {
+	if (aws->iam_http == NULL) {
+		aws->iam_http = http_init();
+		if (aws->iam_http == NULL) {
+			Warnx("aws_iam_get_http: Failed to initialize http handle.");
+		}
+	}
+	return aws->iam_http;
+}
 
 struct aws_session_token *aws_iam_load_default_token(struct aws_handle *aws) {
 	const char *response;
 	int response_len;
-	struct aws_session_token *token;
-	char creds_url[128];
+	struct aws_session_token *token = NULL;
+	const char *endpoint;
+	char role_url[256];
+	char creds_url[512];
+	void *http;
 	int n;
 
-	if (http_get(aws->http, DEFAULT_TOKEN_URL,
-		HTTP_CLOSE, NULL) != HTTP_OK) {
+	pthread_mutex_lock(&aws->iam_lock);
+
+	http = aws_iam_get_http(aws);
+	if (http == NULL) {
+		goto failure;
+	}
+
+	endpoint = aws->iam_endpoint ? aws->iam_endpoint : AWS_IAM_DEFAULT_ENDPOINT;
+	n = snprintf(role_url, sizeof(role_url), "%s" AWS_IAM_CREDENTIALS_PATH, endpoint);
+
+	if (n == -1 || n >= sizeof(role_url)) {
+		Warnx("aws_iam_load_default_token: buffer too small.");
+		goto failure;
+	}
+
+	if (http_get(http, role_url, HTTP_NOCLOSE, NULL) != HTTP_OK ||
+	    http_get_response_code(http) != 200) {
 		Warnx("aws_iam_load_default_token: Failed to get role.");
-		return NULL;
+		goto failure;
 	}
 
-	response = http_get_data(aws->http, &response_len);
+	response = http_get_data(http, &response_len);
 
 	if (response == NULL) {
 		Warnx("aws_iam_load_default_token: Failed to get response.");
-		return NULL; 
+		goto failure;
 	}
 
-	n = snprintf(creds_url, sizeof(creds_url), DEFAULT_TOKEN_URL "%s", response);
+	n = snprintf(creds_url, sizeof(creds_url), "%s%s", role_url, response);
 
 	if (n == -1 || n >= sizeof(creds_url)) {
 		Warnx("aws_iam_load_default_token: buffer too small.");
-		return NULL;
+		goto failure;
 	}
 
-	if (http_get(aws->http, creds_url, HTTP_CLOSE, NULL) != HTTP_OK) {
+	if (http_get(http, creds_url, HTTP_NOCLOSE, NULL) != HTTP_OK ||
+	    http_get_response_code(http) != 200) {
 		Warnx("aws_iam_load_default_token: Failed to get security credentials.");
-		return NULL;
+		goto failure;
 	}
 
-	response = http_get_data(aws->http, &response_len);
+	response = http_get_data(http, &response_len);
+
+	token = aws_iam_parse_credentials(response, response_len);
 
-	if ((token = aws_iam_parse_credentials(response, response_len)) == NULL) {
+	if (token == NULL) {
 		Warnx("aws_iam_load_default_token: Failed to parse response.");
-		return NULL; 
 	}
+
+failure:
+	if (http != NULL) {
+		http_release_data(http);
+	}
+	pthread_mutex_unlock(&aws->iam_lock);
 	return token;
 }
 
+/**
+ * aws_iam_refresher - thread renewing role credentials before they expire
+ * @arg: aws handle
+ *
+ * New credentials are fetched AWS_SESSION_REFRESH_TIME seconds before the
+ * current ones expire and swapped in under the handle lock, so request
+ * threads only ever copy valid credentials.  A failed refresh is retried
+ * every AWS_SESSION_RETRY_TIME seconds.
+ */
+static void *aws_iam_refresher(void *arg) {
+	struct aws_handle *aws = arg;
+	time_t retry_at = 0;
+
+	pthread_mutex_lock(&aws->lock);
+	while (!aws->refresher_stop) {
+		struct aws_session_token *token;
+		struct timespec deadline;
+		time_t refresh_at;
+
+		refresh_at = aws->token->expiration - AWS_SESSION_REFRESH_TIME;
+		if (refresh_at < retry_at) {
+			refresh_at = retry_at;
+		}
+
+		if (time(NULL) < refresh_at) {
+			deadline.tv_sec = refresh_at;
+			deadline.tv_nsec = 0;
+			pthread_cond_timedwait(&aws->refresher_cond, &aws->lock,
+				&deadline);
+			continue;
+		}
+
+		pthread_mutex_unlock(&aws->lock);
+		token = aws_iam_load_default_token(aws);
+		pthread_mutex_lock(&aws->lock);
+
+		/* Also keeps a service that hands out credentials close to
+		   expiry from being polled in a loop. */
+		retry_at = time(NULL) + AWS_SESSION_RETRY_TIME;
+
+		if (token == NULL) {
+			Warnx("aws_iam_refresher: Failed to refresh token.");
+		} else {
+			struct aws_session_token *old_token;
+
+			old_token = aws->token;
+			aws->token = token;
+			aws_free_session_token(old_token);
+		}
+	}
+	pthread_mutex_unlock(&aws->lock);
+
+	return NULL;
+}
+
+int aws_iam_start_refresher(struct aws_handle *aws) {
+	if (pthread_create(&aws->refresher, NULL, aws_iam_refresher, aws) != 0) {
+		Warnx("aws_iam_start_refresher: Failed to create thread.");
+		return -1;
+	}
+	aws->refresher_running = 1;
+	return 0;
+}
+
+void aws_iam_stop_refresher(struct aws_handle *aws) {
+	if (!aws->refresher_running) {
+		return;
+	}
+
+	pthread_mutex_lock(&aws->lock);
+	aws->refresher_stop = 1;
+	pthread_cond_signal(&aws->refresher_cond);
+	pthread_mutex_unlock(&aws->lock);
+
+	pthread_join(aws->refresher, NULL);
+	aws->refresher_running = 0;
+}
@@ -21,6 +21,27 @@
 
 #include "aws.h"
 
+/**
+ * aws_iam_load_default_token - fetch role credentials from the metadata
+ *	service
+ * @aws: aws handle
+ * Returns: allocated token, NULL on failure
+ */
 struct aws_session_token *aws_iam_load_default_token(struct aws_handle *aws);
 
+/**
+ * aws_iam_start_refresher - start renewing role credentials in the
+ *	background
+ * @aws: aws handle holding role credentials in aws->token
+ * Returns: 0 on success, -1 on failure
+ */
+int aws_iam_start_refresher(struct aws_handle *aws);
+
+/**
+ * aws_iam_stop_refresher - stop the thread started by
+ *	aws_iam_start_refresher()
+ * @aws: aws handle
+ */
+void aws_iam_stop_refresher(struct aws_handle *aws);
+
 #endif /* _AWS_IAM_H_ */
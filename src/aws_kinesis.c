@@ -282,7 +282,15 @@ static int aws_kinesis_parse_error_response(const unsigned char *response, int r
 	return rv;
 }
 
-int aws_kinesis_request(struct aws_handle *aws, const char *target, const char *body) {
+/**
+ * aws_kinesis_request_retry - make a request, retrying it while that helps
+ * @aws: library handle
+ * @target: Kinesis target
+ * @body: request body
+ * Returns: 0 on success, -1 on failure
+ */
+static int aws_kinesis_request_retry(struct aws_handle *aws, const char *target, const char *body) {
+	struct aws_thread_state *ts;
 	int http_response_code;
 	int kinesis_response_code = AWS_KINESIS_CODE_UNKNOWN;
 	int rv = -1;
@@ -292,23 +300,25 @@ int aws_kinesis_request(struct aws_handle *aws, const char *target, const char *
 	do {
 
 		if (aws_post(aws, "kinesis", target, body) == -1) {
+			free(message);
 			return -1;
 		}
 	
-		http_response_code = http_get_response_code(aws->http);
+		http_response_code = http_get_response_code(aws_get_http(aws));
 #ifdef DEBUG_AWS_KINESIS
         Debug("%s:%d http_response_code:%d", __FILE__, __LINE__, http_response_code);
 #endif
 		if (http_response_code == 200) {
+			aws_retry_release(aws);
 			rv = 0;
 			break;
 		} else {
 			const char *response;
 			int response_len;
 			int retry;
-			useconds_t backoff;
+			long backoff;
 
-			response = http_get_data(aws->http, &response_len);
+			response = http_get_data(aws_get_http(aws), &response_len);
 
 			if (response == NULL) {
 				Warnx("aws_kinesis_request: Failed to get error response.");
@@ -325,10 +335,24 @@ int aws_kinesis_request(struct aws_handle *aws, const char *target, const char *
 				break;
 			}
 
-			backoff = (1 << attempt) * (rand() % 50000 + 25000);
-			Warnx("aws_kinesis_request: '%s' will retry after %d ms wait, attempt %d: %s %s",
+			if (attempt + 1 >= aws->dynamo_max_retries) {
+				attempt++;
+				break;
+			}
+			if (aws_retry_acquire(aws) == -1) {
+				Warnx("aws_kinesis_request: retry budget exhausted, giving up: %s %s", target, body);
+				break;
+			}
+
+			backoff = aws_backoff(aws, attempt);
+			Warnx("aws_kinesis_request: '%s' will retry after %ld ms wait, attempt %d: %s %s",
 				message ? message : "unknown error", backoff / 1000, attempt, target, body);
-			usleep(backoff);
+			free(message);
+			message = NULL;
+			if (aws_sleep(aws, backoff) == -1) {
+				Warnx("aws_kinesis_request: Giving up before the retry: %s %s", target, body);
+				return -1;
+			}
 			attempt++;
 		}
 
@@ -338,15 +362,33 @@ int aws_kinesis_request(struct aws_handle *aws, const char *target, const char *
 			Warnx("aws_kinesis_request: max retry limit hit, giving up: %s %s", target, body);
 	}
 
+	/* The error state is per thread so that threads sharing the handle
+	   each see the result of their own last request. */
+	ts = aws_get_thread_state(aws);
+	if (ts == NULL) {
+		free(message);
+		return -1;
+	}
+
 	if (message != NULL) {
-		snprintf(aws->dynamo_message, sizeof(aws->dynamo_message), "%s",
+		snprintf(ts->dynamo_message, sizeof(ts->dynamo_message), "%s",
 			message);
 		free(message);
-		aws->dynamo_errno = kinesis_response_code;
+		ts->dynamo_errno = kinesis_response_code;
 	} else {
-		aws->dynamo_message[0] = '\0';
-		aws->dynamo_errno = AWS_KINESIS_CODE_NONE;
+		ts->dynamo_message[0] = '\0';
+		ts->dynamo_errno = AWS_KINESIS_CODE_NONE;
 	}
 
 	return rv;
 }
+
+int aws_kinesis_request(struct aws_handle *aws, const char *target, const char *body) {
+	int rv;
+
+	aws_deadline_begin(aws);
+	rv = aws_kinesis_request_retry(aws, target, body);
+	aws_deadline_end(aws);
+
+	return rv;
+}
@@ -220,7 +220,7 @@ struct aws_kinesis_put_record_response *aws_kinesis_put_record(struct aws_handle
 		return NULL;
 	}
 
-	response = http_get_data(aws->http, &response_len);
+	response = http_get_data(aws_get_http(aws), &response_len);
 
 	if (response == NULL) {
 		Warnx("aws_kinesis_put_record: Failed to get response.");
@@ -229,9 +229,12 @@ struct aws_kinesis_put_record_response *aws_kinesis_put_record(struct aws_handle
 
 	if ((r = aws_kinesis_parse_put_record_response(response, response_len)) == NULL) {
 		Warnx("aws_kinesis_put_record: Failed to parse response.");
+		http_release_data(aws_get_http(aws));
 		return NULL;
 	}
 
+	http_release_data(aws_get_http(aws));
+
 	return r;
 }
 
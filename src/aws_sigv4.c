@@ -28,6 +28,21 @@
 #include <time.h>
 
 #include "aws.h"
+#include "http.h"
+#include "aws_sigv4.h"
+
+static const char aws_sigv4_hex_digits[] = "0123456789abcdef";
+
+void aws_sigv4_hex_encode(const unsigned char *in, size_t len, char *out)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		out[i * 2] = aws_sigv4_hex_digits[in[i] >> 4];
+		out[i * 2 + 1] = aws_sigv4_hex_digits[in[i] & 0xf];
+	}
+	out[len * 2] = '\0';
+}
 
 char *aws_sigv4_create_hashed_canonical_request(const char *http_request_method,
 					 const char *canonical_uri,
@@ -38,7 +53,6 @@ char *aws_sigv4_create_hashed_canonical_request(const char *http_request_method,
 {
 	SHA256_CTX ctx;
 	unsigned char hash[SHA256_DIGEST_LENGTH];
-	int i;
 	unsigned char hex_hash[SHA256_DIGEST_LENGTH * 2 + 1];
 	char *canonical_request;
 
@@ -46,9 +60,7 @@ char *aws_sigv4_create_hashed_canonical_request(const char *http_request_method,
 	SHA256_Update(&ctx, request_payload, strlen(request_payload));
 	SHA256_Final(hash, &ctx);
 
-	for (i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-		sprintf(hex_hash + i * 2, "%.2x", hash[i]);
-	}
+	aws_sigv4_hex_encode(hash, sizeof(hash), (char *)hex_hash);
 
 	if (asprintf(&canonical_request, "%s\n%s\n%s\n%s\n%s\n%s", http_request_method,
 	     canonical_uri, canonical_query_string, canonical_headers,
@@ -63,9 +75,7 @@ char *aws_sigv4_create_hashed_canonical_request(const char *http_request_method,
 
 	free(canonical_request);
 
-	for (i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-		sprintf(hex_hash + i * 2, "%.2x", hash[i]);
-	}
+	aws_sigv4_hex_encode(hash, sizeof(hash), (char *)hex_hash);
 
 	return strdup(hex_hash);
 }
@@ -89,92 +99,228 @@ char *aws_sigv4_create_string_to_sign(char *iso8601_basic_date,
 	return string_to_sign;
 }
 
-int aws_sigv4_derive_signing_key(
-	const char *aws_secret_access_key, const char *yyyy_mm_dd,
-	const char *region, const char *service, unsigned char **key /* OUT */,
-	int *key_len /* OUT */)
+/* The four chained HMACs of the SigV4 key derivation, into key which must
+   hold AWS_SIGV4_KEY_LEN bytes. */
+static int aws_sigv4_derive_key(const char *aws_secret_access_key,
+	const char *yyyy_mm_dd, const char *region, const char *service,
+	unsigned char *key)
 {
 	unsigned char md[EVP_MAX_MD_SIZE];
 	unsigned int md_len;
-	unsigned char date_key[128];
+	char date_key[128];
 	int n;
-	HMAC_CTX hmac_ctx;
-
-	HMAC_CTX_init(&hmac_ctx);
 
 	n = snprintf(date_key, sizeof(date_key), "AWS4%s",
 		aws_secret_access_key);
 
-	if (n < 0 || n > sizeof(date_key)) {
+	if (n < 0 || n >= sizeof(date_key)) {
 		Warnx("aws_sigv4_derive_signing_key: did not create date key.");
 		return -1;
 	}
 
-	HMAC_Init_ex(&hmac_ctx, date_key, strlen(date_key), EVP_sha256(), NULL);
-	HMAC_Update(&hmac_ctx, yyyy_mm_dd, strlen(yyyy_mm_dd));
-	HMAC_Final(&hmac_ctx, md, &md_len);
-	
-	HMAC_Init_ex(&hmac_ctx, md, md_len, EVP_sha256(), NULL);
-	HMAC_Update(&hmac_ctx, region, strlen(region));
-	HMAC_Final(&hmac_ctx, md, &md_len);
-	
-	HMAC_Init_ex(&hmac_ctx, md, md_len, EVP_sha256(), NULL);
-	HMAC_Update(&hmac_ctx, service, strlen(service));
-	HMAC_Final(&hmac_ctx, md, &md_len);
-	
-	HMAC_Init_ex(&hmac_ctx, md, md_len, EVP_sha256(), NULL);
-	HMAC_Update(&hmac_ctx, "aws4_request", strlen("aws4_request"));
-	HMAC_Final(&hmac_ctx, md, &md_len);
-	
-	HMAC_CTX_cleanup(&hmac_ctx);
-
-	*key = malloc(md_len);
+	if (HMAC(EVP_sha256(), date_key, n, (const unsigned char *)yyyy_mm_dd,
+		strlen(yyyy_mm_dd), md, &md_len) == NULL ||
+	    HMAC(EVP_sha256(), md, md_len, (const unsigned char *)region,
+		strlen(region), md, &md_len) == NULL ||
+	    HMAC(EVP_sha256(), md, md_len, (const unsigned char *)service,
+		strlen(service), md, &md_len) == NULL ||
+	    HMAC(EVP_sha256(), md, md_len, (const unsigned char *)"aws4_request",
+		strlen("aws4_request"), md, &md_len) == NULL) {
+		Warnx("aws_sigv4_derive_signing_key: HMAC failed.");
+		return -1;
+	}
+
+	memcpy(key, md, AWS_SIGV4_KEY_LEN);
+	return 0;
+}
+
+int aws_sigv4_derive_signing_key(
+	const char *aws_secret_access_key, const char *yyyy_mm_dd,
+	const char *region, const char *service, unsigned char **key /* OUT */,
+	int *key_len /* OUT */)
+{
+	unsigned char md[AWS_SIGV4_KEY_LEN];
+
+	if (aws_sigv4_derive_key(aws_secret_access_key, yyyy_mm_dd, region,
+		service, md) == -1) {
+		return -1;
+	}
+
+	*key = malloc(sizeof(md));
 	if (*key == NULL) {
 		Warnx("aws_sigv4_derive_signing_key: key alloc failed.");
 		return -1;
 	}
-	memcpy(*key, md, md_len);
-	*key_len = md_len;
+	memcpy(*key, md, sizeof(md));
+	*key_len = sizeof(md);
 	return 0;
 }
 
-char *aws_sigv4_create_signature(
+const unsigned char *aws_sigv4_get_signing_key(struct aws_sigv4_key_cache *cache,
 	const char *aws_secret_access_key, const char *yyyy_mm_dd,
-	const char *region, const char *service,
+	const char *region, const char *service)
+{
+	struct aws_sigv4_signing_key *k;
+	int i;
+
+	for (i = 0; i < AWS_SIGV4_KEY_CACHE_SIZE; i++) {
+		k = &(cache->keys[i]);
+		if (strcmp(k->yyyy_mm_dd, yyyy_mm_dd) == 0 &&
+		    strcmp(k->service, service) == 0 &&
+		    strcmp(k->region, region) == 0 &&
+		    strcmp(k->aws_secret_access_key, aws_secret_access_key) == 0) {
+			return k->key;
+		}
+	}
+
+	k = &(cache->keys[cache->next]);
+	cache->next = (cache->next + 1) % AWS_SIGV4_KEY_CACHE_SIZE;
+
+	/* Leave the entry unused until the key is in place. */
+	k->yyyy_mm_dd[0] = '\0';
+
+	if (strlen(aws_secret_access_key) >= sizeof(k->aws_secret_access_key) ||
+	    strlen(yyyy_mm_dd) >= sizeof(k->yyyy_mm_dd) ||
+	    strlen(region) >= sizeof(k->region) ||
+	    strlen(service) >= sizeof(k->service)) {
+		Warnx("aws_sigv4_get_signing_key: key parameters too long.");
+		return NULL;
+	}
+
+	if (aws_sigv4_derive_key(aws_secret_access_key, yyyy_mm_dd, region,
+		service, k->key) == -1) {
+		return NULL;
+	}
+
+	strcpy(k->aws_secret_access_key, aws_secret_access_key);
+	strcpy(k->region, region);
+	strcpy(k->service, service);
+	strcpy(k->yyyy_mm_dd, yyyy_mm_dd);
+
+	return k->key;
+}
+
+char *aws_sigv4_create_signature_with_key(const unsigned char *key,
 	const unsigned char *message)
 {
-	HMAC_CTX hmac_ctx;
 	unsigned char md[EVP_MAX_MD_SIZE];
 	unsigned int md_len;
 	char *signature;
-	int message_len = strlen(message);
-	unsigned char *key = NULL;
-	int key_len = 0;
-	int i;
 
-	HMAC_CTX_init(&hmac_ctx);
-
-	aws_sigv4_derive_signing_key(aws_secret_access_key,
-		yyyy_mm_dd, region, service, &key, &key_len);
+	if (HMAC(EVP_sha256(), key, AWS_SIGV4_KEY_LEN, message,
+		strlen((const char *)message), md, &md_len) == NULL) {
+		Warnx("aws_sigv4_create_signature: HMAC failed.");
+		return NULL;
+	}
 
-	HMAC_Init_ex(&hmac_ctx, key, key_len, EVP_sha256(), NULL);
-	HMAC_Update(&hmac_ctx, message, message_len);
-	HMAC_Final(&hmac_ctx, md, &md_len);
-	free(key);
 	signature = malloc(md_len * 2 + 1);
 
 	if (signature == NULL) {
 		Warnx("aws_sigv4_create_signature: failed to allocate sig");
-		HMAC_CTX_cleanup(&hmac_ctx);
 		return NULL;
 	}
 
-	for (i = 0; i < md_len; i++) {
-		sprintf(signature + i * 2, "%.2x", md[i]);
+	aws_sigv4_hex_encode(md, md_len, signature);
+
+	return signature;
+}
+
+char *aws_sigv4_create_signature(
+	const char *aws_secret_access_key, const char *yyyy_mm_dd,
+	const char *region, const char *service,
+	const unsigned char *message)
+{
+	unsigned char key[AWS_SIGV4_KEY_LEN];
+
+	if (aws_sigv4_derive_key(aws_secret_access_key, yyyy_mm_dd, region,
+		service, key) == -1) {
+		return NULL;
 	}
 
-	HMAC_CTX_cleanup(&hmac_ctx);
+	return aws_sigv4_create_signature_with_key(key, message);
+}
+
+#define SHA256_UPDATE_STR(ctx, str) SHA256_Update(ctx, str, strlen(str))
 
-	return signature;
+int aws_sigv4_hash_canonical_request(const char *http_request_method,
+	const char *canonical_uri, const char *canonical_query_string,
+	const struct http_headers *headers, const char *signed_headers,
+	const char *request_payload, size_t request_payload_len,
+	char *hashed_canonical_request)
+{
+	unsigned char hash[SHA256_DIGEST_LENGTH];
+	char hex_hash[AWS_SIGV4_HEX_LEN + 1];
+
+	if (SHA256((const unsigned char *)request_payload, request_payload_len,
+		hash) == NULL) {
+		Warnx("aws_sigv4_hash_canonical_request: payload hash failed.");
+		return -1;
+	}
+	aws_sigv4_hex_encode(hash, sizeof(hash), hex_hash);
+
+	return aws_sigv4_hash_canonical_request_hashed(http_request_method,
+		canonical_uri, canonical_query_string, headers, signed_headers,
+		hex_hash, hashed_canonical_request);
 }
 
+int aws_sigv4_hash_canonical_request_hashed(const char *http_request_method,
+	const char *canonical_uri, const char *canonical_query_string,
+	const struct http_headers *headers, const char *signed_headers,
+	const char *payload_hash, char *hashed_canonical_request)
+{
+	SHA256_CTX ctx;
+	unsigned char hash[SHA256_DIGEST_LENGTH];
+	size_t i;
+
+	/* The canonical request is hashed piece by piece as it would be laid
+	   out, it is never assembled in memory. */
+	SHA256_Init(&ctx);
+	SHA256_UPDATE_STR(&ctx, http_request_method);
+	SHA256_Update(&ctx, "\n", 1);
+	SHA256_UPDATE_STR(&ctx, canonical_uri);
+	SHA256_Update(&ctx, "\n", 1);
+	SHA256_UPDATE_STR(&ctx, canonical_query_string);
+	SHA256_Update(&ctx, "\n", 1);
+	for (i = 0; i < headers->count; i++) {
+		SHA256_UPDATE_STR(&ctx, headers->entries[i].name);
+		SHA256_Update(&ctx, ":", 1);
+		SHA256_UPDATE_STR(&ctx, headers->entries[i].value);
+		SHA256_Update(&ctx, "\n", 1);
+	}
+	SHA256_Update(&ctx, "\n", 1);
+	SHA256_UPDATE_STR(&ctx, signed_headers);
+	SHA256_Update(&ctx, "\n", 1);
+	SHA256_Update(&ctx, payload_hash, AWS_SIGV4_HEX_LEN);
+	SHA256_Final(hash, &ctx);
+
+	aws_sigv4_hex_encode(hash, sizeof(hash), hashed_canonical_request);
+	return 0;
+}
+
+int aws_sigv4_sign(const unsigned char *key, const char *iso8601_basic_date,
+	const char *yyyy_mm_dd, const char *region, const char *service,
+	const char *hashed_canonical_request, char *signature)
+{
+	char string_to_sign[256];
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int md_len;
+	int n;
+
+	n = snprintf(string_to_sign, sizeof(string_to_sign),
+		"AWS4-HMAC-SHA256\n%s\n%s/%s/%s/aws4_request\n%s",
+		iso8601_basic_date, yyyy_mm_dd, region, service,
+		hashed_canonical_request);
+	if (n < 0 || n >= sizeof(string_to_sign)) {
+		Warnx("aws_sigv4_sign: string to sign truncated.");
+		return -1;
+	}
+
+	if (HMAC(EVP_sha256(), key, AWS_SIGV4_KEY_LEN,
+		(const unsigned char *)string_to_sign, n, md, &md_len) == NULL) {
+		Warnx("aws_sigv4_sign: HMAC failed.");
+		return -1;
+	}
+
+	aws_sigv4_hex_encode(md, md_len, signature);
+	return 0;
+}
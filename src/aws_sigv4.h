@@ -19,6 +19,7 @@
 #ifndef _AWS_SIGV4_H_
 #define _AWS_SIGV4_H_
 
+#include <stddef.h>
 #include <time.h>
 
 #ifdef __cplusplus
@@ -39,10 +40,139 @@ char *aws_sigv4_create_signature(const char *aws_secret_access_key,
 	const char *region, const char *service,
 	const unsigned char *message);
 
-char *aws_sigv4_derive_signing_key(const char *aws_secret_access_key,
+int aws_sigv4_derive_signing_key(const char *aws_secret_access_key,
 	const char *yyyy_mm_dd, const char *region, const char *service,
 	unsigned char **key, int *key_len);
 
+/* Length of a SigV4 signing key, the size of a SHA256 digest. */
+#define AWS_SIGV4_KEY_LEN		32
+
+/* Number of signing keys kept by a cache, enough for every service the
+   library talks to. */
+#define AWS_SIGV4_KEY_CACHE_SIZE	4
+
+/**
+ * struct aws_sigv4_signing_key - a derived signing key and what it was
+ *	derived from
+ */
+struct aws_sigv4_signing_key {
+	char aws_secret_access_key[128];
+	char yyyy_mm_dd[16];
+	char region[32];
+	char service[32];
+	unsigned char key[AWS_SIGV4_KEY_LEN];
+};
+
+/**
+ * struct aws_sigv4_key_cache - recently used signing keys
+ * @keys: cached keys, unused entries have an empty date
+ * @next: entry to replace on the next miss
+ *
+ * A signing key only changes when the date, region, service or secret
+ * does, so it is derived once and reused for all requests in between.  A
+ * cache must only be used by one thread at a time.
+ */
+struct aws_sigv4_key_cache {
+	struct aws_sigv4_signing_key keys[AWS_SIGV4_KEY_CACHE_SIZE];
+	int next;
+};
+
+/**
+ * aws_sigv4_get_signing_key - look up a signing key, deriving it on a miss
+ * @cache: key cache
+ * @aws_secret_access_key: secret the key is derived from
+ * @yyyy_mm_dd: date of the request
+ * @region: region of the request
+ * @service: service of the request
+ * Returns: pointer to AWS_SIGV4_KEY_LEN bytes of key, valid until the next
+ *	    call on @cache, NULL on failure
+ */
+const unsigned char *aws_sigv4_get_signing_key(struct aws_sigv4_key_cache *cache,
+	const char *aws_secret_access_key, const char *yyyy_mm_dd,
+	const char *region, const char *service);
+
+/**
+ * aws_sigv4_create_signature_with_key - sign a string with a derived key
+ * @key: AWS_SIGV4_KEY_LEN byte signing key
+ * @message: string to sign
+ * Returns: allocated hex encoded signature, NULL on failure
+ */
+char *aws_sigv4_create_signature_with_key(const unsigned char *key,
+	const unsigned char *message);
+
+/* Length of a hex encoded SHA256 digest or signature, without the nul. */
+#define AWS_SIGV4_HEX_LEN	64
+
+struct http_headers;
+
+/**
+ * aws_sigv4_hex_encode - lower case hex encode a binary string
+ * @in: bytes to encode
+ * @len: number of bytes in @in
+ * @out: buffer of at least @len * 2 + 1 bytes for the nul terminated result
+ */
+void aws_sigv4_hex_encode(const unsigned char *in, size_t len, char *out);
+
+/**
+ * aws_sigv4_hash_canonical_request - hash a canonical request without
+ *	building it
+ * @http_request_method: request method
+ * @canonical_uri: canonical URI
+ * @canonical_query_string: canonical query string
+ * @headers: headers to sign, lower case names sorted by name
+ * @signed_headers: ';' separated names of @headers
+ * @request_payload: request body
+ * @request_payload_len: length of @request_payload
+ * @hashed_canonical_request: buffer of AWS_SIGV4_HEX_LEN + 1 bytes for
+ *			      the hex encoded hash
+ * Returns: 0 on success, -1 on failure
+ *
+ * Equivalent to aws_sigv4_create_hashed_canonical_request() with the
+ * canonical headers formatted from @headers, but nothing is allocated and
+ * the body is not copied.
+ */
+int aws_sigv4_hash_canonical_request(const char *http_request_method,
+	const char *canonical_uri, const char *canonical_query_string,
+	const struct http_headers *headers, const char *signed_headers,
+	const char *request_payload, size_t request_payload_len,
+	char *hashed_canonical_request);
+
+/**
+ * aws_sigv4_hash_canonical_request_hashed - hash a canonical request whose
+ *	body has already been hashed
+ * @http_request_method: request method
+ * @canonical_uri: canonical URI
+ * @canonical_query_string: canonical query string
+ * @headers: headers to sign, lower case names sorted by name
+ * @signed_headers: ';' separated names of @headers
+ * @payload_hash: AWS_SIGV4_HEX_LEN hex digits of the SHA-256 of the body
+ * @hashed_canonical_request: buffer of AWS_SIGV4_HEX_LEN + 1 bytes for
+ *			      the hex encoded hash
+ * Returns: 0 on success, -1 on failure
+ *
+ * As aws_sigv4_hash_canonical_request(), for bodies hashed as they were
+ * written, see aws_dynamo_builder_payload_hash().
+ */
+int aws_sigv4_hash_canonical_request_hashed(const char *http_request_method,
+	const char *canonical_uri, const char *canonical_query_string,
+	const struct http_headers *headers, const char *signed_headers,
+	const char *payload_hash, char *hashed_canonical_request);
+
+/**
+ * aws_sigv4_sign - compute the signature of a request
+ * @key: AWS_SIGV4_KEY_LEN byte signing key
+ * @iso8601_basic_date: request time, YYYYMMDD'T'HHMMSS'Z'
+ * @yyyy_mm_dd: request date
+ * @region: region of the request
+ * @service: service of the request
+ * @hashed_canonical_request: hex encoded hash of the canonical request
+ * @signature: buffer of AWS_SIGV4_HEX_LEN + 1 bytes for the signature
+ * Returns: 0 on success, -1 on failure
+ */
+int aws_sigv4_sign(const unsigned char *key, const char *iso8601_basic_date,
+	const char *yyyy_mm_dd, const char *region, const char *service,
+	const char *hashed_canonical_request, char *signature);
+
 #ifdef  __cplusplus
 }
 #endif
@@ -21,18 +21,146 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
 
 #include "http.h"
 #include "aws_dynamo_utils.h"
 
 //#define DEBUG_HTTP 1
 
+/* Data blocks of up to HTTP_BUFFER_POOL_MAX_SIZE bytes come in power of two
+   size classes and are kept in a process wide pool when not in use. */
+#define HTTP_BUFFER_MIN_SHIFT	12
+#define HTTP_BUFFER_MAX_SHIFT	20
+#define HTTP_BUFFER_CLASSES	(HTTP_BUFFER_MAX_SHIFT - HTTP_BUFFER_MIN_SHIFT + 1)
+
+struct http_buffer_block {
+	struct http_buffer_block *next;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	struct http_buffer_block *free[HTTP_BUFFER_CLASSES];
+	int count[HTTP_BUFFER_CLASSES];
+} http_buffer_pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
 /**
- * http_new_buffer - allocate a new buffer of the specified size
- * @size: size of the data buffer
+ * http_buffer_class - find the pool size class of a block size
+ * @size: block size, a power of two of at least HTTP_BUFFER_MIN_SIZE
+ * Returns: index of the size class, -1 if blocks of @size are not pooled
+ */
+static int http_buffer_class(size_t size)
+{
+	int i;
+
+	for (i = 0; i < HTTP_BUFFER_CLASSES; i++) {
+		if (size == (size_t)1 << (i + HTTP_BUFFER_MIN_SHIFT))
+			return i;
+	}
+	return -1;
+}
+
+/**
+ * http_buffer_alloc - get a data block from the pool or the heap
+ * @size: block size
+ * Returns: pointer to the block, NULL on failure
+ */
+static unsigned char *http_buffer_alloc(size_t size)
+{
+	struct http_buffer_block *block = NULL;
+	int i;
+
+	if ((i = http_buffer_class(size)) >= 0) {
+		pthread_mutex_lock(&http_buffer_pool.lock);
+		if ((block = http_buffer_pool.free[i]) != NULL) {
+			http_buffer_pool.free[i] = block->next;
+			http_buffer_pool.count[i]--;
+		}
+		pthread_mutex_unlock(&http_buffer_pool.lock);
+	}
+
+	if (block == NULL)
+		return malloc(size);
+
+	return (unsigned char *)block;
+}
+
+/**
+ * http_buffer_release - give a data block back to the pool or the heap
+ * @data: block obtained from http_buffer_alloc(), may be NULL
+ * @size: block size
+ */
+static void http_buffer_release(unsigned char *data, size_t size)
+{
+	struct http_buffer_block *block = (struct http_buffer_block *)data;
+	int i;
+
+	if (data == NULL)
+		return;
+
+	if ((i = http_buffer_class(size)) >= 0) {
+		pthread_mutex_lock(&http_buffer_pool.lock);
+		if (http_buffer_pool.count[i] < HTTP_BUFFER_POOL_DEPTH) {
+			block->next = http_buffer_pool.free[i];
+			http_buffer_pool.free[i] = block;
+			http_buffer_pool.count[i]++;
+			block = NULL;
+		}
+		pthread_mutex_unlock(&http_buffer_pool.lock);
+	}
+
+	free(block);
+}
+
+/**
+ * http_buffer_reserve - make room in a buffer
+ * @buf: buffer to grow
+ * @size: number of bytes the buffer must be able to hold
+ * Returns: 0 on success, -1 on failure
+ *
+ * The buffer grows geometrically, the content is preserved.
+ */
+static int http_buffer_reserve(struct http_buffer *buf, size_t size)
+{
+	unsigned char *data;
+	size_t max;
+
+	if (size <= buf->max)
+		return 0;
+
+	if (size > HTTP_BUFFER_MAX_SIZE) {
+		Warnx("http_buffer_reserve: response larger than %d bytes\n",
+		      HTTP_BUFFER_MAX_SIZE);
+		return -1;
+	}
+
+	for (max = buf->max ? buf->max : HTTP_BUFFER_MIN_SIZE; max < size; max *= 2)
+		;
+
+	if ((data = http_buffer_alloc(max)) == NULL)
+		return -1;
+
+	if (buf->cur > 0)
+		memcpy(data, buf->data, buf->cur);
+	http_buffer_release(buf->data, buf->max);
+
+	buf->data = data;
+	buf->max = max;
+
+	return 0;
+}
+
+/**
+ * http_new_buffer - allocate a new, empty buffer
  * Returns: Pointer to the newly allocated buffer, NULL on error
+ *
+ * No data block is attached until data arrives.
  */
-static struct http_buffer *http_new_buffer(size_t size)
+static struct http_buffer *http_new_buffer(void)
 {
 	struct http_buffer *buf;
 
@@ -40,14 +168,6 @@ static struct http_buffer *http_new_buffer(size_t size)
 		return NULL;
 	memset(buf, 0, sizeof(*buf));
 
-	if ((buf->data = malloc(size)) == NULL) {
-		free(buf);
-		return NULL;
-	}
-	memset(buf->data, 0, size);
-
-	buf->max = size;
-
 	return buf;
 }
 
@@ -58,7 +178,7 @@ static struct http_buffer *http_new_buffer(size_t size)
  */
 static void http_free_buffer(struct http_buffer *buf)
 {
-	free(buf->data);
+	http_buffer_release(buf->data, buf->max);
 	free(buf);
 }
 
@@ -71,6 +191,18 @@ static void http_reset_buffer(struct http_buffer *buf)
 	buf->cur = 0;
 }
 
+/**
+ * http_drop_buffer - hand the data block of a buffer back to the pool
+ * @buf: buffer to empty
+ */
+static void http_drop_buffer(struct http_buffer *buf)
+{
+	http_buffer_release(buf->data, buf->max);
+	buf->data = NULL;
+	buf->max = 0;
+	buf->cur = 0;
+}
+
 #ifdef AWS_DYNAMO_HTTP_SIM
 
 #include <sys/types.h>
@@ -403,6 +535,74 @@ struct http_curl_handle {
        CURL *curl;
        struct http_buffer *buf;
        char agent[128];
+       /* State of an asynchronous transfer, see http_multi_post(). */
+       struct curl_slist *headers;
+       http_async_callback cb;
+       void *cb_arg;
+       int result;
+       struct http_curl_handle *next;
+       struct http_curl_handle *prev;
+       /* Receiver of successful response bodies, see http_set_stream(). */
+       struct http_stream *stream;
+       int streaming;
+       int aborted;
+       /* Limits set with http_set_timeout(). */
+       long timeout_ms;
+       const volatile int *cancelled;
+};
+
+/**
+ * struct http_timer - a callback scheduled with http_multi_schedule()
+ * @expires: tick at which the timer fires
+ * @cb: function to call
+ * @arg: argument for @cb
+ * @next: next timer in the same wheel slot
+ */
+struct http_timer {
+	long long expires;
+	http_timer_callback cb;
+	void *arg;
+	struct http_timer *next;
+};
+
+/**
+ * struct http_multi_handle - engine for concurrent HTTP transfers
+ * @multi: curl multi handle driving the transfers
+ * @active: easy handles with a transfer in flight
+ * @idle: easy handles that are available for reuse
+ * @pending: number of transfers submitted and not yet completed
+ * @pool: pool whose share object the easy handles use, or NULL
+ * @cafile: CA certificate file applied to new easy handles, or NULL
+ * @wheel: timers, hashed on their expiry tick
+ * @tick: last tick whose timers have been run
+ * @timers: number of timers on @wheel
+ */
+struct http_multi_handle {
+	CURLM *multi;
+	struct http_curl_handle *active;
+	struct http_curl_handle *idle;
+	int pending;
+	struct http_pool *pool;
+	char *cafile;
+	struct http_timer *wheel[HTTP_TIMER_SLOTS];
+	long long tick;
+	int timers;
+};
+
+/**
+ * struct http_pool - easy handles shared by the threads of a process
+ * @share: share object for DNS, TLS sessions and connections
+ * @share_locks: one lock per type of data in @share
+ * @lock: protects @idle and @cafile
+ * @idle: easy handles that are available to be acquired
+ * @cafile: CA certificate file applied to new easy handles, or NULL
+ */
+struct http_pool {
+	CURLSH *share;
+	pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+	pthread_mutex_t lock;
+	struct http_curl_handle *idle;
+	char *cafile;
 };
 
 /**
@@ -416,20 +616,12 @@ const char *http_strerror(int error)
 }
 
 /**
- * _curl_easy_perform - call curl_easy_perform(), retry once
- * @curl: HTTP handle
+ * http_curl_result - map a libcurl result code onto an HTTP_* result code
+ * @ret: libcurl result code
  * Returns: HTTP_* result code (HTTP_OK, etc.)
  */
-static int _curl_easy_perform(CURL *curl)
+static int http_curl_result(int ret)
 {
-	int ret;
-
-	ret = curl_easy_perform(curl);
-
-	if (ret == CURLE_OPERATION_TIMEOUTED) /* (sic) */ {
-		ret = curl_easy_perform(curl);
-	}
-
 	if (ret == CURLE_OK)
 		return HTTP_OK;
 
@@ -437,6 +629,9 @@ static int _curl_easy_perform(CURL *curl)
 	Debug("HTTP ERROR: %s\n", curl_easy_strerror(ret));
 #endif
 
+	if (ret == CURLE_OPERATION_TIMEDOUT)
+		return HTTP_TIMEOUT;
+
 	if (ret == CURLE_SSL_PEER_CERTIFICATE ||
 	    ret == CURLE_SSL_CERTPROBLEM ||
 	    ret == CURLE_SSL_CACERT
@@ -450,23 +645,107 @@ static int _curl_easy_perform(CURL *curl)
 	return HTTP_FAILURE;
 }
 
+/**
+ * http_transfer_result - map the libcurl result code of a transfer onto an
+ *			  HTTP_* result code
+ * @h: HTTP handle of the transfer
+ * @ret: libcurl result code
+ * Returns: HTTP_* result code (HTTP_OK, etc.)
+ */
+static int http_transfer_result(struct http_curl_handle *h, int ret)
+{
+	if (ret == CURLE_ABORTED_BY_CALLBACK && h->cancelled != NULL &&
+	    *h->cancelled)
+		return HTTP_CANCELLED;
+
+	if (ret == CURLE_WRITE_ERROR && h->aborted)
+		return HTTP_ABORTED;
+
+	return http_curl_result(ret);
+}
+
+/**
+ * _curl_easy_perform - call curl_easy_perform(), retry once on a timeout
+ *			unless the caller set its own limit
+ * @h: HTTP handle
+ * Returns: HTTP_* result code (HTTP_OK, etc.)
+ */
+static int _curl_easy_perform(struct http_curl_handle *h)
+{
+	int ret;
+
+	ret = curl_easy_perform(h->curl);
+
+	if (ret == CURLE_OPERATION_TIMEOUTED /* (sic) */ && h->timeout_ms == 0) {
+		/* The body starts over, a streamed one with another begin. */
+		http_reset_buffer(h->buf);
+		h->streaming = 0;
+		ret = curl_easy_perform(h->curl);
+	}
+
+	return http_transfer_result(h, ret);
+}
+
+/**
+ * http_progress - progress callback, aborts cancelled transfers
+ * @arg: HTTP handle of the transfer
+ * Returns: 0 to continue, non-zero to abort the transfer
+ */
+#if LIBCURL_VERSION_NUM >= 0x072000 /* Only if this version supports it */
+static int http_progress(void *arg, curl_off_t dltotal, curl_off_t dlnow,
+			 curl_off_t ultotal, curl_off_t ulnow)
+#else
+static int http_progress(void *arg, double dltotal, double dlnow,
+			 double ultotal, double ulnow)
+#endif
+{
+	struct http_curl_handle *h = arg;
+
+	return h->cancelled != NULL && *h->cancelled;
+}
+
 /**
  * http_receive_data - callback for processing data received over HTTP
  * @ptr: pointer to the current chunk of data
  * @size: size of each element
  * @nmemb: number of elements
- * @arg: buffer to store chunk in
+ * @arg: HTTP handle of the transfer
  * Returns: amount of data processed
  */
 static size_t http_receive_data(void *ptr, size_t size, size_t nmemb, void *arg)
 {
 	size_t len = size * nmemb;
-	struct http_buffer *buf = arg;
+	struct http_curl_handle *h = arg;
+	struct http_buffer *buf = h->buf;
 
-	if (len > (size_t)(buf->max - buf->cur)) {
-		/* Too much data for buffer */
-		len = buf->max - buf->cur;
-		Warnx("Only storing %zd bytes; buffer too small\n", len);
+	if (h->stream != NULL && !h->streaming && buf->cur == 0) {
+		long response = 0;
+
+		/* The status line and headers have been received by the time
+		   the first chunk of the body arrives. */
+		curl_easy_getinfo(h->curl, CURLINFO_RESPONSE_CODE, &response);
+		if (response == 200) {
+			if (h->stream->begin(h->stream->arg) == -1) {
+				h->aborted = 1;
+				return 0;
+			}
+			h->streaming = 1;
+		}
+	}
+
+	if (h->streaming) {
+		/* Returning less than len aborts the transfer. */
+		if (h->stream->data(h->stream->arg, ptr, len) == -1) {
+			h->aborted = 1;
+			return 0;
+		}
+		return len;
+	}
+
+	/* Leave room for the terminating nul. */
+	if (http_buffer_reserve(buf, (size_t)buf->cur + len + 1) == -1) {
+		/* Returning less than len aborts the transfer. */
+		return 0;
 	}
 	memcpy(buf->data + buf->cur, ptr, len);
 	buf->cur += len;
@@ -475,33 +754,78 @@ static size_t http_receive_data(void *ptr, size_t size, size_t nmemb, void *arg)
 }
 
 /**
- * http_transaction - issue an HTTP transaction to the specified URL
- * @handle: HTTP handle
- * @url: URL to post to
- * @data: data string to send with post
+ * http_build_headers - convert a list of headers into a curl header list
+ * @hdrs: headers to convert, may be NULL
+ * @headers: the resulting curl header list (out), NULL if there are none
+ * Returns: 0 on success, -1 on failure
+ */
+static int http_build_headers(struct http_headers *hdrs,
+			      struct curl_slist **headers)
+{
+	int i;
+
+	*headers = NULL;
+
+	if (hdrs == NULL)
+		return 0;
+
+	for (i = 0; i < hdrs->count; i++) {
+		struct curl_slist *list;
+		char *header;
+
+		if (asprintf(&header, "%s: %s",
+			     hdrs->entries[i].name,
+			     hdrs->entries[i].value) == -1) {
+			goto failure;
+		}
+		list = curl_slist_append(*headers, header);
+		free(header);
+		if (list == NULL)
+			goto failure;
+		*headers = list;
+	}
+
+	return 0;
+
+failure:
+	if (*headers)
+		curl_slist_free_all(*headers);
+	*headers = NULL;
+	return -1;
+}
+
+/**
+ * http_setup_transfer - prepare an easy handle for a transfer
+ * @h: HTTP handle
+ * @url: URL of the transfer
+ * @data: data string to post, NULL for an HTTP GET
+ * @copy: have curl take a private copy of @data? (1=yes; 0=no)
  * @con_close: close connection? (1=yes; 0=no)
- * @hdrs: a linked list of headers to be included in the request
- * Returns: HTTP_* result code (HTTP_OK, etc.)
+ * @headers: curl header list to be included in the request, may be NULL
  */
-static int http_transaction(void *handle, const char *url,
-			    const char *data, int con_close,
-		   	    struct http_headers *hdrs)
+static void http_setup_transfer(struct http_curl_handle *h, const char *url,
+				const char *data, int copy, int con_close,
+				struct curl_slist *headers)
 {
-	int ret;
-	struct http_curl_handle *h = handle;
 	CURL *curl = h->curl;
-	struct curl_slist *headers = NULL;
-	struct http_buffer *buf = h->buf;
 
-	http_reset_buffer(buf);
+	http_reset_buffer(h->buf);
+	h->streaming = 0;
+	h->aborted = 0;
 
 	curl_easy_setopt(curl, CURLOPT_URL, url);
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, http_receive_data);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, buf);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, h);
 
 	if (data) {
 		curl_easy_setopt(curl, CURLOPT_POST, 1);
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data);
+		if (copy) {
+			curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)strlen(data));
+			curl_easy_setopt(curl, CURLOPT_COPYPOSTFIELDS, data);
+		} else {
+			curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, -1L);
+			curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data);
+		}
 	} else {
 		/* Use HTTP GET */
 		curl_easy_setopt(curl, CURLOPT_HTTPGET, 1);
@@ -512,40 +836,77 @@ static int http_transaction(void *handle, const char *url,
 	else
 		curl_easy_setopt(curl, CURLOPT_FORBID_REUSE, 0);
 
-	if (hdrs) {
-		int i;
-
-		for (i = 0; i < hdrs->count; i++) {
-			char *header;
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
 
-			if (asprintf(&header, "%s: %s",
-				     hdrs->entries[i].name,
-				     hdrs->entries[i].value) == -1) {
-				if (headers)
-					curl_slist_free_all(headers);
-				return HTTP_FAILURE;
-			}
-			headers = curl_slist_append(headers, header);
-			free(header);
-		}
+	curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS,
+			 h->timeout_ms ? h->timeout_ms : HTTP_DEFAULT_TIMEOUT_MS);
+	if (h->cancelled) {
+#if LIBCURL_VERSION_NUM >= 0x072000 /* Only if this version supports it */
+		curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, http_progress);
+		curl_easy_setopt(curl, CURLOPT_XFERINFODATA, h);
+#else
+		curl_easy_setopt(curl, CURLOPT_PROGRESSFUNCTION, http_progress);
+		curl_easy_setopt(curl, CURLOPT_PROGRESSDATA, h);
+#endif
+		curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+	} else {
+		curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
 	}
+}
 
-	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+/**
+ * http_finish_transfer - collect the results of a completed transfer
+ * @h: HTTP handle
+ * @ret: HTTP_* result code of the transfer
+ */
+static void http_finish_transfer(struct http_curl_handle *h, int ret)
+{
+	struct http_buffer *buf = h->buf;
 
-	/* Perform the transfer */
-	if ((ret = _curl_easy_perform(curl)) == 0) {
+	if (ret == HTTP_OK) {
 		/* Get a copy of the response code */
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &buf->response);
+		curl_easy_getinfo(h->curl, CURLINFO_RESPONSE_CODE, &buf->response);
 	}
 
-	if (hdrs) {	
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, NULL);
-		curl_slist_free_all(headers);
+	if (h->headers) {
+		curl_easy_setopt(h->curl, CURLOPT_HTTPHEADER, NULL);
+		curl_slist_free_all(h->headers);
+		h->headers = NULL;
 	}
 
-	if (buf->cur >= buf->max)
-		buf->cur = buf->max - 1;
+	if (http_buffer_reserve(buf, (size_t)buf->cur + 1) == -1) {
+		/* Only possible for an empty body without a block attached. */
+		buf->cur = 0;
+		return;
+	}
 	buf->data[buf->cur] = '\0';
+}
+
+/**
+ * http_transaction - issue an HTTP transaction to the specified URL
+ * @handle: HTTP handle
+ * @url: URL to post to
+ * @data: data string to send with post
+ * @con_close: close connection? (1=yes; 0=no)
+ * @hdrs: a linked list of headers to be included in the request
+ * Returns: HTTP_* result code (HTTP_OK, etc.)
+ */
+static int http_transaction(void *handle, const char *url,
+			    const char *data, int con_close,
+		   	    struct http_headers *hdrs)
+{
+	int ret;
+	struct http_curl_handle *h = handle;
+
+	if (http_build_headers(hdrs, &h->headers) == -1)
+		return HTTP_FAILURE;
+
+	http_setup_transfer(h, url, data, 0, con_close, h->headers);
+
+	/* Perform the transfer */
+	ret = _curl_easy_perform(h);
+
+	http_finish_transfer(h, ret);
 
 	return ret;
 }
@@ -567,19 +928,21 @@ int http_get(void *handle, const char *url,
 }
 
 /**
- * http_init - initialise an HTTP session
- * Returns: HTTP handle to use in other calls
+ * http_new_handle - allocate and configure an easy handle
+ * @cafile: CA certificate file to use, NULL for the curl default
+ * @share: curl share object to attach the handle to, or NULL
+ * Returns: HTTP handle, NULL on failure
  */
-void *http_init()
+static struct http_curl_handle *http_new_handle(const char *cafile, CURLSH *share)
 {
 	struct http_curl_handle *h;
 	CURL *curl;
 
-	if ((h = malloc(sizeof(*h))) == NULL)
+	if ((h = calloc(1, sizeof(*h))) == NULL)
 		return NULL;
 
    /* Create page buffer */
-   h->buf = http_new_buffer(HTTP_PAGE_BUFFER_SIZE);
+   h->buf = http_new_buffer();
    if (h->buf == NULL) {
       Warnx("Failed to allocate buffer for page\n");
 		free(h);
@@ -596,9 +959,6 @@ void *http_init()
 		return NULL;
 	}
 
-	/* Set the maximum time in seconds that a transfer can take. */
-	curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10);
-		
 	/* Tell curl not to use signals for timeout's etc. */
 	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1);
 	curl_easy_setopt(curl, CURLOPT_USERAGENT, h->agent);
@@ -606,11 +966,28 @@ void *http_init()
 	curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1);
 	curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2);
 
+	if (cafile)
+		curl_easy_setopt(curl, CURLOPT_CAINFO, cafile);
+
+	if (share)
+		curl_easy_setopt(curl, CURLOPT_SHARE, share);
+
+	curl_easy_setopt(curl, CURLOPT_PRIVATE, h);
+
 	h->curl = curl;
 
 	return h;
 }
 
+/**
+ * http_init - initialise an HTTP session
+ * Returns: HTTP handle to use in other calls
+ */
+void *http_init()
+{
+	return http_new_handle(NULL, NULL);
+}
+
 /**
  * http_deinit - terminate an HTTP session
  * @handle: HTTP handle
@@ -619,6 +996,8 @@ void http_deinit(void *handle)
 {
 	struct http_curl_handle *h = handle;
 
+	if (h->headers)
+		curl_slist_free_all(h->headers);
 	curl_easy_cleanup(h->curl);
 	http_free_buffer(h->buf);
 	free(h);
@@ -643,6 +1022,92 @@ const unsigned char *http_get_data(void *handle, int *len)
 	return NULL;
 }
 
+/**
+ * http_set_stream - have successful response bodies passed on as they arrive
+ * @handle: HTTP library handle
+ * @stream: receiver of the bodies, NULL to buffer them again
+ *
+ * Bodies of responses with a status other than 200 are still buffered so
+ * that they can be read with http_get_data().
+ */
+void http_set_stream(void *handle, struct http_stream *stream)
+{
+	struct http_curl_handle *h = handle;
+
+	h->stream = stream;
+}
+
+/**
+ * http_get_streamed - check whether the last body went to the stream
+ * @handle: HTTP library handle
+ * Returns: 1 if the body of the last response was passed to the stream set
+ *	    with http_set_stream(), 0 if it was buffered
+ */
+int http_get_streamed(void *handle)
+{
+	struct http_curl_handle *h = handle;
+
+	return h->streaming;
+}
+
+/**
+ * http_release_data - hand the response data of a handle back to the pool
+ * @handle: HTTP library handle
+ *
+ * Call once the response has been parsed.  The next transaction gets a
+ * fresh buffer, sized from the smallest class.
+ */
+void http_release_data(void *handle)
+{
+	struct http_curl_handle *h = handle;
+
+	http_drop_buffer(h->buf);
+}
+
+struct http_body *http_take_body(void *handle)
+{
+	struct http_curl_handle *h = handle;
+	struct http_buffer *buf = h->buf;
+	struct http_body *body;
+
+	if (buf->data == NULL) {
+		Warnx("http_take_body: no data.");
+		return NULL;
+	}
+
+	if ((body = malloc(sizeof(*body))) == NULL) {
+		Warnx("http_take_body: alloc failed.");
+		return NULL;
+	}
+
+	body->data = buf->data;
+	body->len = buf->cur;
+	body->max = buf->max;
+	body->refs = 1;
+
+	buf->data = NULL;
+	buf->max = 0;
+	buf->cur = 0;
+
+	return body;
+}
+
+void http_body_get(struct http_body *body)
+{
+	__sync_add_and_fetch(&(body->refs), 1);
+}
+
+void http_body_put(void *arg)
+{
+	struct http_body *body = arg;
+
+	if (body == NULL || __sync_sub_and_fetch(&(body->refs), 1) > 0)
+		return;
+
+	http_buffer_release(body->data, body->max);
+	free(body);
+}
+
 int http_get_response_code(void *handle)
 {
 	struct http_curl_handle *h = handle;
@@ -651,6 +1116,21 @@ int http_get_response_code(void *handle)
 	return buf->response;
 }
 
+/**
+ * http_set_timeout - limit the transfers made on a handle
+ * @handle: HTTP library handle
+ * @timeout_ms: maximum time for each following transfer, 0 for
+ *		HTTP_DEFAULT_TIMEOUT_MS
+ * @cancelled: transfers are aborted once this is non-zero, NULL for none
+ */
+void http_set_timeout(void *handle, long timeout_ms, const volatile int *cancelled)
+{
+	struct http_curl_handle *h = handle;
+
+	h->timeout_ms = timeout_ms;
+	h->cancelled = cancelled;
+}
+
 /**
  * http_post - post a form back to the specified URL, internal function
  * @handle: HTTP handle
@@ -719,4 +1199,545 @@ int http_set_https_certificate_file(void *handle, const char *filename)
 	return 0;
 }
 
+static void http_share_lock(CURL *handle, curl_lock_data data,
+			    curl_lock_access access, void *userptr)
+{
+	struct http_pool *pool = userptr;
+
+	pthread_mutex_lock(&pool->share_locks[data]);
+}
+
+static void http_share_unlock(CURL *handle, curl_lock_data data, void *userptr)
+{
+	struct http_pool *pool = userptr;
+
+	pthread_mutex_unlock(&pool->share_locks[data]);
+}
+
+/**
+ * http_pool_init - create a pool of HTTP handles
+ * Returns: pool handle to use in the other http_pool_* calls, NULL on
+ *	    failure
+ *
+ * All handles acquired from the pool share DNS lookups, TLS sessions and
+ * keep-alive connections.  The pool may be used from any thread, each
+ * handle acquired from it by only one thread at a time.
+ */
+void *http_pool_init(void)
+{
+	struct http_pool *pool;
+	int i;
+
+	if ((pool = calloc(1, sizeof(*pool))) == NULL)
+		return NULL;
+
+	if ((pool->share = curl_share_init()) == NULL) {
+		Warnx("Failed to init curl share handle\n");
+		free(pool);
+		return NULL;
+	}
+
+	for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+		pthread_mutex_init(&pool->share_locks[i], NULL);
+	pthread_mutex_init(&pool->lock, NULL);
+
+	curl_share_setopt(pool->share, CURLSHOPT_LOCKFUNC, http_share_lock);
+	curl_share_setopt(pool->share, CURLSHOPT_UNLOCKFUNC, http_share_unlock);
+	curl_share_setopt(pool->share, CURLSHOPT_USERDATA, pool);
+	curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900 /* Only if this version supports it */
+	curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+
+	return pool;
+}
+
+/**
+ * http_pool_deinit - destroy a pool and the idle handles in it
+ * @handle: pool handle
+ *
+ * All handles acquired from the pool must have been released.
+ */
+void http_pool_deinit(void *handle)
+{
+	struct http_pool *pool = handle;
+	struct http_curl_handle *h;
+	int i;
+
+	if (pool == NULL)
+		return;
+
+	while ((h = pool->idle) != NULL) {
+		pool->idle = h->next;
+		http_deinit(h);
+	}
+
+	curl_share_cleanup(pool->share);
+
+	for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+		pthread_mutex_destroy(&pool->share_locks[i]);
+	pthread_mutex_destroy(&pool->lock);
+
+	free(pool->cafile);
+	free(pool);
+}
+
+/**
+ * http_pool_acquire - take a handle out of the pool
+ * @handle: pool handle
+ * Returns: HTTP handle to use with http_get(), http_post(), etc., NULL on
+ *	    failure
+ */
+void *http_pool_acquire(void *handle)
+{
+	struct http_pool *pool = handle;
+	struct http_curl_handle *h;
+
+	pthread_mutex_lock(&pool->lock);
+	if ((h = pool->idle) != NULL) {
+		pool->idle = h->next;
+		h->next = NULL;
+	} else {
+		h = http_new_handle(pool->cafile, pool->share);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return h;
+}
+
+/**
+ * http_pool_release - return a handle to the pool
+ * @handle: pool handle
+ * @http: HTTP handle obtained from http_pool_acquire()
+ */
+void http_pool_release(void *handle, void *http)
+{
+	struct http_pool *pool = handle;
+	struct http_curl_handle *h = http;
+
+	if (h == NULL)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	h->next = pool->idle;
+	pool->idle = h;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * http_pool_set_https_certificate_file - set the CA file for pooled handles
+ * @handle: pool handle
+ * @filename: CA certificate file
+ * Returns: 0 on success, -1 on failure
+ *
+ * Applies to idle handles and handles created from now on, not to handles
+ * that are currently acquired.
+ */
+int http_pool_set_https_certificate_file(void *handle, const char *filename)
+{
+	struct http_pool *pool = handle;
+	struct http_curl_handle *h;
+	char *cafile;
+
+	if ((cafile = strdup(filename)) == NULL)
+		return -1;
+
+	pthread_mutex_lock(&pool->lock);
+	free(pool->cafile);
+	pool->cafile = cafile;
+	for (h = pool->idle; h != NULL; h = h->next)
+		http_set_https_certificate_file(h, filename);
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+/**
+ * http_timer_now - current time in timer wheel ticks
+ * Returns: ticks of HTTP_TIMER_TICK_MS on the monotonic clock
+ */
+static long long http_timer_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000) /
+		HTTP_TIMER_TICK_MS;
+}
+
+/**
+ * http_timer_run - run the timers that are due
+ * @m: multi handle
+ *
+ * Every slot passed over since the last run is visited once; a slot holds
+ * the timers of all turns of the wheel, only those that are due fire.
+ */
+static void http_timer_run(struct http_multi_handle *m)
+{
+	struct http_timer *due = NULL, **tail = &due;
+	struct http_timer *t, **p;
+	long long now = http_timer_now();
+	long long tick;
+
+	if (m->timers == 0) {
+		m->tick = now;
+		return;
+	}
+
+	for (tick = m->tick + 1; tick <= now && tick <= m->tick + HTTP_TIMER_SLOTS; tick++) {
+		p = &m->wheel[tick % HTTP_TIMER_SLOTS];
+		while ((t = *p) != NULL) {
+			if (t->expires <= now) {
+				*p = t->next;
+				t->next = NULL;
+				*tail = t;
+				tail = &t->next;
+				m->timers--;
+			} else {
+				p = &t->next;
+			}
+		}
+	}
+	m->tick = now;
+
+	/* Callbacks may schedule timers and start transfers. */
+	while ((t = due) != NULL) {
+		due = t->next;
+		t->cb(t->arg);
+		free(t);
+	}
+}
+
+/**
+ * http_timer_next - time until the next timer is due
+ * @m: multi handle
+ * @timeout_ms: longest time of interest
+ * Returns: milliseconds until the first timer fires, at most @timeout_ms
+ */
+static int http_timer_next(struct http_multi_handle *m, int timeout_ms)
+{
+	struct http_timer *t;
+	long long now = http_timer_now();
+	long long first = -1;
+	long long tick;
+	long long last;
+
+	if (m->timers == 0)
+		return timeout_ms;
+
+	/* Scan ahead only as far as the timeout reaches. */
+	last = now + (timeout_ms + HTTP_TIMER_TICK_MS - 1) / HTTP_TIMER_TICK_MS;
+	if (last > now + HTTP_TIMER_SLOTS)
+		last = now + HTTP_TIMER_SLOTS;
+
+	for (tick = m->tick + 1; tick <= last && first == -1; tick++) {
+		for (t = m->wheel[tick % HTTP_TIMER_SLOTS]; t != NULL; t = t->next) {
+			if (t->expires <= last && (first == -1 || t->expires < first))
+				first = t->expires;
+		}
+	}
+
+	if (first == -1)
+		return timeout_ms;
+	if (first <= now)
+		return 0;
+	if ((first - now) * HTTP_TIMER_TICK_MS < timeout_ms)
+		return (first - now) * HTTP_TIMER_TICK_MS;
+	return timeout_ms;
+}
+
+/**
+ * http_multi_init - create an engine for concurrent HTTP transfers
+ * @pool: pool whose DNS, TLS session and connection caches the transfers
+ *	  share, NULL for private caches
+ * Returns: multi handle to use in the other http_multi_* calls, NULL on
+ *	    failure
+ */
+void *http_multi_init(void *pool)
+{
+	struct http_multi_handle *m;
+
+	if ((m = calloc(1, sizeof(*m))) == NULL)
+		return NULL;
+
+	if ((m->multi = curl_multi_init()) == NULL) {
+		Warnx("Failed to init curl multi handle\n");
+		free(m);
+		return NULL;
+	}
+
+	m->pool = pool;
+	m->tick = http_timer_now();
+
+	if (m->pool) {
+		pthread_mutex_lock(&m->pool->lock);
+		if (m->pool->cafile)
+			m->cafile = strdup(m->pool->cafile);
+		pthread_mutex_unlock(&m->pool->lock);
+	}
+
+	/* Keep enough connections alive to serve every in flight request. */
+	curl_multi_setopt(m->multi, CURLMOPT_MAXCONNECTS, (long)HTTP_MULTI_MAX_CONNECTS);
+
+	return m;
+}
+
+/**
+ * http_multi_deinit - destroy a multi handle
+ * @handle: multi handle
+ *
+ * Transfers still in flight are aborted and timers dropped without invoking
+ * their callbacks, whatever their arguments own is left to the caller.
+ */
+void http_multi_deinit(void *handle)
+{
+	struct http_multi_handle *m = handle;
+	struct http_curl_handle *h;
+	int i;
+
+	if (m == NULL)
+		return;
+
+	if (m->pending + m->timers > 0)
+		Warnx("http_multi_deinit: dropping %d transfers and %d timers.",
+		      m->pending, m->timers);
+
+	while ((h = m->active) != NULL) {
+		m->active = h->next;
+		curl_multi_remove_handle(m->multi, h->curl);
+		http_deinit(h);
+	}
+
+	while ((h = m->idle) != NULL) {
+		m->idle = h->next;
+		http_deinit(h);
+	}
+
+	for (i = 0; i < HTTP_TIMER_SLOTS; i++) {
+		struct http_timer *t;
+
+		while ((t = m->wheel[i]) != NULL) {
+			m->wheel[i] = t->next;
+			free(t);
+		}
+	}
+
+	curl_multi_cleanup(m->multi);
+	free(m->cafile);
+	free(m);
+}
+
+/**
+ * http_multi_post - start an asynchronous post to the specified URL
+ * @handle: multi handle
+ * @url: URL to post to
+ * @data: data string to send with post, copied before this returns
+ * @hdrs: a list of headers to be included in the request
+ * @cb: function called when the transfer completes
+ * @arg: argument passed to @cb
+ * Returns: HTTP_OK if the transfer was started, HTTP_FAILURE otherwise
+ */
+int http_multi_post(void *handle, const char *url, const char *data,
+		    struct http_headers *hdrs, http_async_callback cb, void *arg)
+{
+	struct http_multi_handle *m = handle;
+	struct http_curl_handle *h;
+
+	if (m->idle != NULL) {
+		h = m->idle;
+		m->idle = h->next;
+	} else {
+		h = http_new_handle(m->cafile, m->pool ? m->pool->share : NULL);
+		if (h == NULL)
+			return HTTP_FAILURE;
+	}
+	h->next = NULL;
+
+	if (http_build_headers(hdrs, &h->headers) == -1)
+		goto failure;
+
+	http_setup_transfer(h, url, data, 1, HTTP_NOCLOSE, h->headers);
+	h->cb = cb;
+	h->cb_arg = arg;
+
+	if (curl_multi_add_handle(m->multi, h->curl) != CURLM_OK) {
+		Warnx("http_multi_post: Failed to add transfer.");
+		goto failure;
+	}
+
+	h->prev = NULL;
+	h->next = m->active;
+	if (m->active)
+		m->active->prev = h;
+	m->active = h;
+	m->pending++;
+
+	return HTTP_OK;
+
+failure:
+	if (h->headers) {
+		curl_easy_setopt(h->curl, CURLOPT_HTTPHEADER, NULL);
+		curl_slist_free_all(h->headers);
+		h->headers = NULL;
+	}
+	h->next = m->idle;
+	m->idle = h;
+	return HTTP_FAILURE;
+}
+
+/**
+ * http_multi_schedule - call a function after a delay
+ * @handle: multi handle
+ * @delay_ms: delay in milliseconds
+ * @cb: function to call from http_multi_perform() once the delay is over
+ * @arg: argument passed to @cb
+ * Returns: HTTP_OK if the timer was set, HTTP_FAILURE otherwise
+ */
+int http_multi_schedule(void *handle, int delay_ms, http_timer_callback cb,
+			void *arg)
+{
+	struct http_multi_handle *m = handle;
+	struct http_timer *t;
+	long long now;
+
+	if ((t = malloc(sizeof(*t))) == NULL) {
+		Warnx("http_multi_schedule: Failed to allocate timer.");
+		return HTTP_FAILURE;
+	}
+
+	/* No callbacks are run from here.  The wheel may lag behind the
+	   clock, but a timer due after m->tick is found by the next
+	   http_timer_run() however far behind that is. */
+	now = http_timer_now();
+	t->expires = now + (delay_ms + HTTP_TIMER_TICK_MS - 1) / HTTP_TIMER_TICK_MS;
+	if (t->expires <= m->tick)
+		t->expires = m->tick + 1;
+	t->cb = cb;
+	t->arg = arg;
+	t->next = m->wheel[t->expires % HTTP_TIMER_SLOTS];
+	m->wheel[t->expires % HTTP_TIMER_SLOTS] = t;
+	m->timers++;
+
+	return HTTP_OK;
+}
+
+/**
+ * http_multi_perform - make progress on the transfers of a multi handle
+ * @handle: multi handle
+ * @timeout_ms: maximum time to wait for network activity or a timer, 0 to
+ *		not wait
+ * Returns: number of transfers and timers still pending, -1 on failure
+ *
+ * The callback of every transfer that completes and every timer that
+ * expires is called before this returns.  Callbacks may start new
+ * transfers and set new timers on the same multi handle.
+ */
+int http_multi_perform(void *handle, int timeout_ms)
+{
+	struct http_multi_handle *m = handle;
+	struct http_curl_handle *done = NULL, **tail = &done;
+	struct http_curl_handle *h;
+	CURLMsg *msg;
+	int running;
+	int msgs;
+
+	http_timer_run(m);
+
+	if (curl_multi_perform(m->multi, &running) != CURLM_OK)
+		return -1;
+
+	timeout_ms = http_timer_next(m, timeout_ms);
+	if (timeout_ms > 0) {
+		if (running > 0) {
+			if (curl_multi_wait(m->multi, NULL, 0, timeout_ms, NULL) != CURLM_OK)
+				return -1;
+			if (curl_multi_perform(m->multi, &running) != CURLM_OK)
+				return -1;
+		} else if (m->timers > 0) {
+			/* Nothing on the network, sleep until the timer. */
+			poll(NULL, 0, timeout_ms);
+		}
+	}
+
+	http_timer_run(m);
+
+	/* Collect the finished transfers before calling any callbacks, the
+	   callbacks may start new transfers on this multi handle. */
+	while ((msg = curl_multi_info_read(m->multi, &msgs)) != NULL) {
+		CURLcode result;
+
+		if (msg->msg != CURLMSG_DONE)
+			continue;
+
+		result = msg->data.result;
+		curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&h);
+		curl_multi_remove_handle(m->multi, h->curl);
+
+		if (h->prev)
+			h->prev->next = h->next;
+		else
+			m->active = h->next;
+		if (h->next)
+			h->next->prev = h->prev;
+
+		h->result = http_transfer_result(h, result);
+		http_finish_transfer(h, h->result);
+		*tail = h;
+		tail = &h->next;
+		h->next = NULL;
+		m->pending--;
+	}
+
+	while ((h = done) != NULL) {
+		done = h->next;
+
+		h->cb(h, h->result, h->cb_arg);
+
+		http_drop_buffer(h->buf);
+		h->cb = NULL;
+		h->cb_arg = NULL;
+		h->next = m->idle;
+		m->idle = h;
+	}
+
+	return m->pending + m->timers;
+}
+
+/**
+ * http_multi_pending - number of transfers in flight on a multi handle
+ * @handle: multi handle
+ * Returns: number of transfers submitted and not yet completed plus the
+ *	    number of timers not yet expired
+ */
+int http_multi_pending(void *handle)
+{
+	struct http_multi_handle *m = handle;
+
+	return m->pending + m->timers;
+}
+
+/**
+ * http_multi_set_https_certificate_file - set the CA file for new transfers
+ * @handle: multi handle
+ * @filename: CA certificate file
+ * Returns: 0 on success, -1 on failure
+ */
+int http_multi_set_https_certificate_file(void *handle, const char *filename)
+{
+	struct http_multi_handle *m = handle;
+	struct http_curl_handle *h;
+	char *cafile;
+
+	if ((cafile = strdup(filename)) == NULL)
+		return -1;
+	free(m->cafile);
+	m->cafile = cafile;
+
+	for (h = m->idle; h != NULL; h = h->next)
+		http_set_https_certificate_file(h, filename);
+
+	return 0;
+}
+
 #endif /* AWS_DYNAMO_HTTP_SIM */
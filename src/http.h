@@ -19,7 +19,28 @@
 #ifndef _HTTP_H_
 #define _HTTP_H_
 
-#define HTTP_PAGE_BUFFER_SIZE	1048576
+#include <stddef.h>
+
+/* Response buffers start at HTTP_BUFFER_MIN_SIZE and double as data
+   arrives, up to HTTP_BUFFER_MAX_SIZE.  Blocks of up to
+   HTTP_BUFFER_POOL_MAX_SIZE bytes are recycled through a pool which keeps
+   at most HTTP_BUFFER_POOL_DEPTH free blocks of each size. */
+#define HTTP_BUFFER_MIN_SIZE		4096
+#define HTTP_BUFFER_POOL_MAX_SIZE	1048576
+#define HTTP_BUFFER_POOL_DEPTH		32
+#define HTTP_BUFFER_MAX_SIZE		(64 * 1048576)
+
+/* Timers of a multi handle are kept on a hashed wheel of HTTP_TIMER_SLOTS
+   slots, HTTP_TIMER_TICK_MS apart.  Timers further out than one turn of
+   the wheel share slots with nearer ones. */
+#define HTTP_TIMER_TICK_MS	10
+#define HTTP_TIMER_SLOTS	256
+
+/* Time limit of a transfer unless http_set_timeout() sets another. */
+#define HTTP_DEFAULT_TIMEOUT_MS	10000
+
+/* Connections kept alive by a multi handle for reuse. */
+#define HTTP_MULTI_MAX_CONNECTS	256
 
 /* Close connection or not */
 #define HTTP_NOCLOSE	0
@@ -29,6 +50,9 @@
 #define HTTP_OK			0 
 #define HTTP_FAILURE		-1 
 #define HTTP_CERT_FAILURE	-2 
+#define HTTP_TIMEOUT		-3
+#define HTTP_CANCELLED		-4
+#define HTTP_ABORTED		-5
 
 /* Default form content-type. */
 #define HTTP_CONTENT_URLENCODED	"application/x-www-form-urlencoded"
@@ -41,8 +65,8 @@ char *http_url_encode(void *handle, const char *string);
 /* Internal structure used for raw page data */
 /**
  * struct http_buffer - buffer to store a page in
- * @buffer: pointer to allocated buffer
- * @max: maximum size of buffer
+ * @buffer: pointer to allocated buffer, NULL until data arrives
+ * @max: current size of buffer
  * @cur: current length of content
  * @response: HTTP response code
  */
@@ -125,8 +149,219 @@ const char *http_strerror(int error);
  */
 const unsigned char *http_get_data(void *handle, int *len);
 
+/**
+ * struct http_stream - receiver of response bodies as they arrive
+ * @begin: called before the first chunk of a 200 response body; returns 0
+ *	   to continue, -1 to abort the transfer
+ * @data: called with each chunk of the body; returns 0 to continue, -1 to
+ *	  abort the transfer
+ * @arg: argument passed to @begin and @data
+ *
+ * @begin is called again if the request is retried, it must discard
+ * anything built from an earlier body.  A transfer aborted by @begin or
+ * @data fails with HTTP_ABORTED; it is the receiver's own doing, so the
+ * request is not retried.
+ */
+struct http_stream {
+	int (*begin)(void *arg);
+	int (*data)(void *arg, const unsigned char *data, size_t len);
+	void *arg;
+};
+
+/**
+ * http_set_stream - have successful response bodies passed on as they arrive
+ * @handle: HTTP library handle
+ * @stream: receiver of the bodies, NULL to buffer them again
+ */
+void http_set_stream(void *handle, struct http_stream *stream);
+
+/**
+ * http_get_streamed - check whether the last body went to the stream
+ * @handle: HTTP library handle
+ * Returns: 1 if the body of the last response was passed to the stream, 0
+ *	    if it was buffered
+ */
+int http_get_streamed(void *handle);
+
+/**
+ * http_release_data - hand the response data of a handle back to the pool
+ * @handle: HTTP library handle
+ *
+ * The data returned by http_get_data() is invalid after this call.
+ */
+void http_release_data(void *handle);
+
+/**
+ * struct http_body - a response body taken over from a handle
+ * @data: body, nul terminated
+ * @len: length of the body
+ * @max: size of the block holding @data
+ * @refs: number of references, see http_body_get() and http_body_put()
+ *
+ * @data may be written to, as long as it is not grown.
+ */
+struct http_body {
+	unsigned char *data;
+	unsigned int len;
+	unsigned int max;
+	int refs;
+};
+
+/**
+ * http_take_body - take the response data of a handle
+ * @handle: HTTP library handle
+ * Returns: body holding one reference, NULL on failure
+ *
+ * Like http_release_data() the handle is left without data, but the block
+ * stays alive until the last reference to the body is dropped.  This lets
+ * a parsed response point into its body instead of copying out of it.
+ */
+struct http_body *http_take_body(void *handle);
+
+/**
+ * http_body_get - take another reference to a body
+ * @body: body
+ */
+void http_body_get(struct http_body *body);
+
+/**
+ * http_body_put - drop a reference to a body
+ * @body: body, may be NULL
+ *
+ * The data block goes back to the pool with the last reference.  A void
+ * pointer is taken so that this can be passed as a cleanup function.
+ */
+void http_body_put(void *body);
+
 int http_get_response_code(void *handle);
 
+/**
+ * http_set_timeout - limit the transfers made on a handle
+ * @handle: HTTP library handle
+ * @timeout_ms: maximum time for each following transfer, connecting
+ *		included, 0 for HTTP_DEFAULT_TIMEOUT_MS
+ * @cancelled: transfers are aborted with HTTP_CANCELLED once this is
+ *	       non-zero, NULL for none
+ *
+ * A transfer that runs out of time fails with HTTP_TIMEOUT.  @cancelled is
+ * polled from curl's progress callback, so an abort may take up to a
+ * second to be noticed on an idle connection.
+ */
+void http_set_timeout(void *handle, long timeout_ms, const volatile int *cancelled);
+
 int http_set_https_certificate_file(void *handle, const char *filename);
 
+/**
+ * http_async_callback - called when an asynchronous transfer completes
+ * @handle: HTTP handle of the transfer; http_get_data() and
+ *	    http_get_response_code() may be used on it until the callback
+ *	    returns
+ * @result: HTTP_* result code (HTTP_OK, etc.)
+ * @arg: argument given to http_multi_post()
+ */
+typedef void (*http_async_callback)(void *handle, int result, void *arg);
+
+/**
+ * http_pool_init - create a pool of HTTP handles
+ * Returns: pool handle to use in the other http_pool_* calls, NULL on
+ *	    failure
+ *
+ * All handles acquired from the pool share DNS lookups, TLS sessions and
+ * keep-alive connections.  The pool may be used from any thread, each
+ * handle acquired from it by only one thread at a time.
+ */
+void *http_pool_init(void);
+
+/**
+ * http_pool_deinit - destroy a pool and the idle handles in it
+ * @handle: pool handle
+ */
+void http_pool_deinit(void *handle);
+
+/**
+ * http_pool_acquire - take a handle out of the pool
+ * @handle: pool handle
+ * Returns: HTTP handle to use with http_get(), http_post(), etc., NULL on
+ *	    failure
+ */
+void *http_pool_acquire(void *handle);
+
+/**
+ * http_pool_release - return a handle to the pool
+ * @handle: pool handle
+ * @http: HTTP handle obtained from http_pool_acquire()
+ */
+void http_pool_release(void *handle, void *http);
+
+int http_pool_set_https_certificate_file(void *handle, const char *filename);
+
+/**
+ * http_multi_init - create an engine for concurrent HTTP transfers
+ * @pool: pool whose DNS, TLS session and connection caches the transfers
+ *	  share, NULL for private caches
+ * Returns: multi handle to use in the other http_multi_* calls, NULL on
+ *	    failure
+ */
+void *http_multi_init(void *pool);
+
+/**
+ * http_multi_deinit - destroy a multi handle
+ * @handle: multi handle
+ *
+ * Transfers and timers still pending are dropped without calling their
+ * callbacks; http_multi_pending() should be 0 first.
+ */
+void http_multi_deinit(void *handle);
+
+/**
+ * http_multi_post - start an asynchronous post to the specified URL
+ * @handle: multi handle
+ * @url: URL to post to
+ * @data: data string to send with post, copied before this returns
+ * @headers: a list of headers to be included in the request
+ * @cb: function called when the transfer completes
+ * @arg: argument passed to @cb
+ * Returns: HTTP_OK if the transfer was started, HTTP_FAILURE otherwise
+ */
+int http_multi_post(void *handle, const char *url, const char *data,
+		    struct http_headers *headers, http_async_callback cb,
+		    void *arg);
+
+/**
+ * http_timer_callback - called when a timer set with http_multi_schedule()
+ *			 expires
+ * @arg: argument given to http_multi_schedule()
+ */
+typedef void (*http_timer_callback)(void *arg);
+
+/**
+ * http_multi_schedule - call a function after a delay
+ * @handle: multi handle
+ * @delay_ms: delay in milliseconds
+ * @cb: function to call from http_multi_perform() once the delay is over
+ * @arg: argument passed to @cb
+ * Returns: HTTP_OK if the timer was set, HTTP_FAILURE otherwise
+ */
+int http_multi_schedule(void *handle, int delay_ms, http_timer_callback cb,
+			void *arg);
+
+/**
+ * http_multi_perform - make progress on the transfers of a multi handle
+ * @handle: multi handle
+ * @timeout_ms: maximum time to wait for network activity or a timer, 0 to
+ *		not wait
+ * Returns: number of transfers and timers still pending, -1 on failure
+ */
+int http_multi_perform(void *handle, int timeout_ms);
+
+/**
+ * http_multi_pending - number of transfers in flight on a multi handle
+ * @handle: multi handle
+ * Returns: number of transfers submitted and not yet completed plus the
+ *	    number of timers not yet expired
+ */
+int http_multi_pending(void *handle);
+
+int http_multi_set_https_certificate_file(void *handle, const char *filename);
+
 #endif /* _HTTP_H_ */
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "aws_arena.h"
+
+static void test_alloc(void)
+{
+	struct aws_arena *arena;
+	char *strings[1000];
+	char *big;
+	int i;
+
+	arena = aws_arena_init(0);
+	assert(arena != NULL);
+
+	/* Enough to fill several blocks. */
+	for (i = 0; i < 1000; i++) {
+		char buf[64];
+		int len;
+
+		len = snprintf(buf, sizeof(buf), "string %d", i);
+		strings[i] = aws_arena_strndup(arena, buf, len);
+		assert(strings[i] != NULL);
+		assert(((uintptr_t)strings[i] % AWS_ARENA_ALIGN) == 0);
+	}
+
+	/* Too big for a block, gets one of its own. */
+	big = aws_arena_calloc(arena, 1, AWS_ARENA_MAX_BLOCK * 2);
+	assert(big != NULL);
+	assert(big[AWS_ARENA_MAX_BLOCK * 2 - 1] == 0);
+
+	for (i = 0; i < 1000; i++) {
+		char buf[64];
+
+		snprintf(buf, sizeof(buf), "string %d", i);
+		assert(strcmp(strings[i], buf) == 0);
+	}
+
+	aws_arena_deinit(arena);
+}
+
+static void test_realloc(void)
+{
+	struct aws_arena *arena;
+	int *a;
+	int *b;
+	int i;
+
+	arena = aws_arena_init(AWS_ARENA_MIN_BLOCK);
+	assert(arena != NULL);
+
+	/* The last allocation grows in place. */
+	a = aws_arena_alloc(arena, sizeof(*a) * 4);
+	assert(a != NULL);
+	for (i = 0; i < 4; i++) {
+		a[i] = i;
+	}
+	b = aws_arena_realloc(arena, a, sizeof(*a) * 4, sizeof(*a) * 8);
+	assert(b == a);
+
+	/* Others are copied. */
+	assert(aws_arena_alloc(arena, 1) != NULL);
+	b = aws_arena_realloc(arena, a, sizeof(*a) * 8, sizeof(*a) * 16);
+	assert(b != NULL && b != a);
+	for (i = 0; i < 4; i++) {
+		assert(b[i] == i);
+	}
+
+	aws_arena_deinit(arena);
+}
+
+static void test_adopt(void)
+{
+	struct aws_arena *arena;
+	struct aws_arena *other;
+	char *s;
+
+	arena = aws_arena_init(0);
+	other = aws_arena_init(0);
+	assert(arena != NULL && other != NULL);
+
+	s = aws_arena_strndup(other, "kept", 4);
+	assert(s != NULL);
+	aws_arena_adopt(arena, other);
+	assert(aws_arena_alloc(arena, 100) != NULL);
+	assert(strcmp(s, "kept") == 0);
+
+	/* Frees the blocks of both. */
+	aws_arena_deinit(arena);
+}
+
+static int cleanup_order[4];
+static int cleanups;
+
+static void cleanup(void *arg)
+{
+	cleanup_order[cleanups++] = *(int *)arg;
+}
+
+static void test_defer(void)
+{
+	struct aws_arena *arena;
+	struct aws_arena *other;
+	int ids[] = { 1, 2, 3 };
+
+	arena = aws_arena_init(0);
+	other = aws_arena_init(0);
+	assert(arena != NULL && other != NULL);
+
+	assert(aws_arena_defer(arena, cleanup, &ids[0]) == 0);
+	assert(aws_arena_defer(arena, cleanup, &ids[1]) == 0);
+	assert(aws_arena_defer(other, cleanup, &ids[2]) == 0);
+	assert(aws_arena_defer(NULL, cleanup, &ids[0]) == -1);
+
+	/* The cleanups of an adopted arena run with those of its new owner. */
+	aws_arena_adopt(arena, other);
+	assert(cleanups == 0);
+	aws_arena_deinit(arena);
+	assert(cleanups == 3);
+	assert(cleanup_order[0] == 2 && cleanup_order[1] == 1 && cleanup_order[2] == 3);
+}
+
+static void test_heap(void)
+{
+	char *s;
+
+	/* Without an arena the C library heap is used. */
+	s = aws_arena_strndup(NULL, "heap string", 4);
+	assert(strcmp(s, "heap") == 0);
+	s = aws_arena_realloc(NULL, s, 5, 100);
+	assert(s != NULL);
+	aws_arena_free(NULL, s);
+}
+
+int main(int argc, char *argv[])
+{
+	test_alloc();
+	test_realloc();
+	test_adopt();
+	test_defer();
+	test_heap();
+	return 0;
+}
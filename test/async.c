@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "aws_dynamo.h"
+#include "test_utils.h"
+
+#define NUM_REQUESTS 200
+
+/* Number of times requests for "flaky_table" are throttled. */
+#define FLAKY_FAILURES 3
+
+static int flaky_count;
+static int cut_count;
+
+static int handler(const struct test_http_request *req, char **response, void *arg)
+{
+	int hash;
+
+	assert(strcmp(req->method, "POST") == 0);
+	assert(strcmp(req->target, AWS_DYNAMO_GET_ITEM) == 0);
+
+	if (strstr(req->body, "missing_table") != NULL) {
+		*response = strdup("{\"__type\":\"com.amazonaws.dynamodb.v20111205#ResourceNotFoundException\",\"message\":\"Requested resource not found\"}");
+		return 400;
+	}
+
+	if (strstr(req->body, "flaky_table") != NULL) {
+		if (__sync_fetch_and_add(&flaky_count, 1) < FLAKY_FAILURES) {
+			*response = strdup("{\"__type\":\"com.amazonaws.dynamodb.v20120810#ProvisionedThroughputExceededException\",\"message\":\"Throughput exceeded\"}");
+			return 400;
+		}
+		*response = strdup("{\"Item\":{\"hash\":{\"N\":\"7\"}},\"ConsumedCapacityUnits\":0.5}");
+		return 200;
+	}
+
+	if (strstr(req->body, "cut_table") != NULL) {
+		__sync_fetch_and_add(&cut_count, 1);
+		*response = strdup("{\"Item\":{\"hash\":{\"N\":\"5\"}},\"ConsumedCapacityUnits\":0.5}");
+		return 200;
+	}
+
+	assert(sscanf(req->body, "{\"TableName\":\"test\",\"Key\":{\"HashKeyElement\":{\"N\":\"%d\"}}}", &hash) == 1);
+	assert(asprintf(response, "{\"Item\":{\"hash\":{\"N\":\"%d\"}},\"ConsumedCapacityUnits\":0.5}", hash) != -1);
+	return 200;
+}
+
+struct result {
+	int done;
+	int hash;
+};
+
+static void get_item_done(struct aws_handle *aws,
+	const struct aws_dynamo_async_response *response, void *arg)
+{
+	struct result *result = arg;
+	struct aws_dynamo_attribute attributes[] = {
+		{
+			.type = AWS_DYNAMO_NUMBER,
+			.name = "hash",
+			.name_len = strlen("hash"),
+			.value.number.type = AWS_DYNAMO_NUMBER_INTEGER,
+		},
+	};
+	struct aws_dynamo_get_item_response *r;
+
+	assert(response->rv == 0);
+	assert(response->http_code == 200);
+	assert(response->dynamo_errno == AWS_DYNAMO_CODE_NONE);
+
+	r = aws_dynamo_parse_get_item_response(response->response,
+		response->response_len, attributes, 1);
+	assert(r != NULL);
+	assert(r->item.attributes[0].value.number.value.integer_val != NULL);
+	result->hash = *r->item.attributes[0].value.number.value.integer_val;
+	result->done++;
+	aws_dynamo_free_get_item_response(r);
+}
+
+static void error_done(struct aws_handle *aws,
+	const struct aws_dynamo_async_response *response, void *arg)
+{
+	int *done = arg;
+
+	assert(response->rv == -1);
+	assert(response->http_code == 400);
+	assert(response->dynamo_errno == AWS_DYNAMO_CODE_RESOURCE_NOT_FOUND_EXCEPTION);
+	assert(strcmp(response->message, "Requested resource not found") == 0);
+	(*done)++;
+}
+
+static void test_async_fan_out(struct aws_handle *aws)
+{
+	struct result results[NUM_REQUESTS];
+	int errors = 0;
+	int i;
+
+	memset(results, 0, sizeof(results));
+
+	for (i = 0; i < NUM_REQUESTS; i++) {
+		char body[128];
+
+		snprintf(body, sizeof(body), "{\"TableName\":\"test\",\"Key\":{\"HashKeyElement\":{\"N\":\"%d\"}}}", i);
+		assert(aws_dynamo_request_async(aws, AWS_DYNAMO_GET_ITEM, body,
+			get_item_done, &results[i]) == 0);
+	}
+	assert(aws_dynamo_request_async(aws, AWS_DYNAMO_GET_ITEM,
+		"{\"TableName\":\"missing_table\",\"Key\":{\"HashKeyElement\":{\"N\":\"1\"}}}",
+		error_done, &errors) == 0);
+
+	assert(aws_async_pending(aws) == NUM_REQUESTS + 1);
+
+	while (aws_async_perform(aws, 100) > 0)
+		;
+
+	for (i = 0; i < NUM_REQUESTS; i++) {
+		assert(results[i].done == 1);
+		assert(results[i].hash == i);
+	}
+	assert(errors == 1);
+}
+
+static void test_async_retry(struct aws_handle *aws)
+{
+	struct result flaky, other;
+
+	memset(&flaky, 0, sizeof(flaky));
+	memset(&other, 0, sizeof(other));
+	flaky_count = 0;
+
+	assert(aws_dynamo_request_async(aws, AWS_DYNAMO_GET_ITEM,
+		"{\"TableName\":\"flaky_table\",\"Key\":{\"HashKeyElement\":{\"N\":\"7\"}}}",
+		get_item_done, &flaky) == 0);
+
+	/* The retries wait on timers, other requests go ahead meanwhile. */
+	while (flaky_count == 0)
+		assert(aws_async_perform(aws, 10) > 0);
+	assert(aws_dynamo_request_async(aws, AWS_DYNAMO_GET_ITEM,
+		"{\"TableName\":\"test\",\"Key\":{\"HashKeyElement\":{\"N\":\"3\"}}}",
+		get_item_done, &other) == 0);
+
+	while (aws_async_perform(aws, 100) > 0)
+		;
+
+	assert(flaky_count == FLAKY_FAILURES + 1);
+	assert(flaky.done == 1);
+	assert(flaky.hash == 7);
+	assert(other.done == 1);
+	assert(other.hash == 3);
+}
+
+static void test_async_transport_retry(struct aws_handle *aws)
+{
+	struct result result;
+
+	memset(&result, 0, sizeof(result));
+	cut_count = 0;
+
+	/* The connection drops halfway through the first response, the
+	   request is sent once more as aws_post() would. */
+	test_http_server_set_chunking(0, 10);
+	assert(aws_dynamo_request_async(aws, AWS_DYNAMO_GET_ITEM,
+		"{\"TableName\":\"cut_table\",\"Key\":{\"HashKeyElement\":{\"N\":\"5\"}}}",
+		get_item_done, &result) == 0);
+
+	while (aws_async_perform(aws, 100) > 0)
+		;
+
+	assert(cut_count == 2);
+	assert(result.done == 1);
+	assert(result.hash == 5);
+}
+
+static void timer_fired(void *arg)
+{
+	(*(int *)arg)++;
+}
+
+static void test_async_schedule(struct aws_handle *aws)
+{
+	int first = 0, second = 0;
+
+	/* Timers only fire from aws_async_perform(), never from setting
+	   another one. */
+	assert(aws_async_schedule(aws, 0, timer_fired, &first) == 0);
+	usleep(30000);
+	assert(aws_async_schedule(aws, 0, timer_fired, &second) == 0);
+	assert(first == 0 && second == 0);
+	assert(aws_async_pending(aws) == 2);
+
+	while (aws_async_perform(aws, 100) > 0)
+		;
+
+	assert(first == 1 && second == 1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct aws_handle *aws;
+	int port;
+
+	port = test_http_server_start(handler, NULL);
+	aws = test_local_handle(port);
+
+	test_async_fan_out(aws);
+	/* Run again to reuse the easy handles and connections. */
+	test_async_fan_out(aws);
+	test_async_retry(aws);
+	test_async_transport_retry(aws);
+	test_async_schedule(aws);
+
+	aws_deinit(aws);
+	return 0;
+}
@@ -0,0 +1,462 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "aws_dynamo.h"
+#include "aws_sigv4.h"
+#include "http.h"
+#include "test_utils.h"
+
+static const char *finish(struct aws_dynamo_builder *b)
+{
+	const char *body;
+	size_t len;
+
+	body = aws_dynamo_builder_finish(b, &len);
+	assert(body != NULL);
+	assert(strlen(body) == len);
+
+	return body;
+}
+
+/* The escapes the builder is expected to write, one byte at a time. */
+static char *reference_escape(const char *s)
+{
+	char *out;
+	char *p;
+
+	out = malloc(strlen(s) * 6 + 3);
+	assert(out != NULL);
+
+	p = out;
+	*p++ = '"';
+	for (; *s != '\0'; s++) {
+		unsigned char c = *s;
+
+		if (c == '"' || c == '\\') {
+			*p++ = '\\';
+			*p++ = c;
+		} else if (c == '\n') {
+			p += sprintf(p, "\\n");
+		} else if (c == '\r') {
+			p += sprintf(p, "\\r");
+		} else if (c == '\t') {
+			p += sprintf(p, "\\t");
+		} else if (c < 0x20) {
+			p += sprintf(p, "\\u%04x", c);
+		} else {
+			*p++ = c;
+		}
+	}
+	*p++ = '"';
+	*p = '\0';
+
+	return out;
+}
+
+static void test_escape(void)
+{
+	const char specials[] = "\"\\\n\r\t\x01\x1f";
+	struct aws_dynamo_builder *b;
+	char s[100];
+	char expected[1024];
+	char *escaped;
+	int len;
+	int pos;
+	int i;
+
+	b = aws_dynamo_builder_new();
+	assert(b != NULL);
+
+	/* Each special byte at every position of strings around the vector
+	   width, and strings with nothing to escape. */
+	for (len = 0; len < 70; len++) {
+		for (pos = -1; pos < len; pos++) {
+			for (i = 0; i < sizeof(specials) - 1; i++) {
+				memset(s, 'a' + len % 26, len);
+				s[len] = '\0';
+				if (pos >= 0) {
+					s[pos] = specials[i];
+					s[len - 1] = specials[(i + 1) % (sizeof(specials) - 1)];
+				}
+
+				aws_dynamo_builder_reset(b);
+				assert(aws_dynamo_builder_string(b, "s", s) == 0);
+				escaped = reference_escape(s);
+				snprintf(expected, sizeof(expected), "{\"s\":%s}", escaped);
+				free(escaped);
+				assert(strcmp(finish(b), expected) == 0);
+			}
+		}
+	}
+
+	/* UTF-8 is passed as it is. */
+	aws_dynamo_builder_reset(b);
+	assert(aws_dynamo_builder_string(b, "k\xc3\xa9", "caf\xc3\xa9 \xe2\x82\xac") == 0);
+	assert(strcmp(finish(b), "{\"k\xc3\xa9\":\"caf\xc3\xa9 \xe2\x82\xac\"}") == 0);
+
+	aws_dynamo_builder_free(b);
+}
+
+static void test_values(void)
+{
+	aws_dynamo_integer_t i = -9223372036854775807LL - 1;
+	aws_dynamo_double_t d = 2.5;
+	char *strings[] = { "a", "b\"" };
+	struct aws_dynamo_number numbers[2];
+	unsigned char data[] = { 0xfb, 0xff, 0x00, 'a' };
+	struct aws_dynamo_binary binaries[] = {
+		{ .len = 1, .data = data },
+		{ .len = 2, .data = data },
+		{ .len = 0, .data = NULL },
+	};
+	struct aws_dynamo_attribute members[] = {
+		{ .type = AWS_DYNAMO_BOOLEAN, .name = "t", .value.boolean = 1 },
+		{ .type = AWS_DYNAMO_NULL, .name = "n" },
+	};
+	struct aws_dynamo_attribute values[] = {
+		{ .type = AWS_DYNAMO_STRING, .value.string = "x" },
+		{ .type = AWS_DYNAMO_MAP, .value.map = { 2, members } },
+	};
+	struct aws_dynamo_attribute attributes[] = {
+		{ .type = AWS_DYNAMO_STRING, .name = "s", .value.string = "\x7f" },
+		{ .type = AWS_DYNAMO_NUMBER, .name = "i",
+		  .value.number = { .type = AWS_DYNAMO_NUMBER_INTEGER, .value.integer_val = &i } },
+		{ .type = AWS_DYNAMO_NUMBER, .name = "d",
+		  .value.number = { .type = AWS_DYNAMO_NUMBER_DOUBLE, .value.double_val = &d } },
+		{ .type = AWS_DYNAMO_STRING_SET, .name = "ss", .value.string_set = { 2, strings } },
+		{ .type = AWS_DYNAMO_NUMBER_SET, .name = "ns",
+		  .value.number_set = { .n = 2, .numbers = numbers } },
+		{ .type = AWS_DYNAMO_BINARY, .name = "b",
+		  .value.binary = { .len = sizeof(data), .data = data } },
+		{ .type = AWS_DYNAMO_BINARY_SET, .name = "bs", .value.binary_set = { 3, binaries } },
+		{ .type = AWS_DYNAMO_BOOLEAN, .name = "f", .value.boolean = 0 },
+		{ .type = AWS_DYNAMO_LIST, .name = "l", .value.list = { 2, values } },
+	};
+	struct aws_dynamo_builder *b;
+
+	assert(aws_dynamo_number_set_integer(NULL, &(numbers[0]), 42) == 0);
+	assert(aws_dynamo_number_set_double(NULL, &(numbers[1]), 0.1) == 0);
+
+	b = aws_dynamo_builder_new();
+	assert(b != NULL);
+
+	assert(aws_dynamo_builder_table(b, "t") == 0);
+	assert(aws_dynamo_builder_attributes(b, AWS_DYNAMO_JSON_ITEM, attributes,
+		sizeof(attributes) / sizeof(attributes[0])) == 0);
+	assert(strcmp(finish(b), "{\"TableName\":\"t\",\"Item\":{"
+		"\"s\":{\"S\":\"\x7f\"},"
+		"\"i\":{\"N\":\"-9223372036854775808\"},"
+		"\"d\":{\"N\":\"2.5\"},"
+		"\"ss\":{\"SS\":[\"a\",\"b\\\"\"]},"
+		"\"ns\":{\"NS\":[\"42\",\"0.100000000000000005551\"]},"
+		"\"b\":{\"B\":\"+/8AYQ==\"},"
+		"\"bs\":{\"BS\":[\"+w==\",\"+/8=\",\"\"]},"
+		"\"f\":{\"BOOL\":false},"
+		"\"l\":{\"L\":[{\"S\":\"x\"},{\"M\":{\"t\":{\"BOOL\":true},\"n\":{\"NULL\":true}}}]}"
+		"}}") == 0);
+
+	aws_dynamo_builder_free(b);
+	free(numbers[0].value.integer_val);
+	free(numbers[1].value.double_val);
+}
+
+static void test_requests(void)
+{
+	aws_dynamo_integer_t id = 7;
+	aws_dynamo_integer_t low = 1;
+	aws_dynamo_integer_t high = 9;
+	struct aws_dynamo_attribute hash_key = {
+		.type = AWS_DYNAMO_STRING,
+		.value.string = "jdoe",
+	};
+	struct aws_dynamo_attribute range_key = {
+		.type = AWS_DYNAMO_NUMBER,
+		.value.number = { .type = AWS_DYNAMO_NUMBER_INTEGER, .value.integer_val = &id },
+	};
+	struct aws_dynamo_attribute range[] = {
+		{
+			.type = AWS_DYNAMO_NUMBER,
+			.value.number = { .type = AWS_DYNAMO_NUMBER_INTEGER, .value.integer_val = &low },
+		},
+		{
+			.type = AWS_DYNAMO_NUMBER,
+			.value.number = { .type = AWS_DYNAMO_NUMBER_INTEGER, .value.integer_val = &high },
+		},
+	};
+	struct aws_dynamo_attribute attributes[] = {
+		{ .type = AWS_DYNAMO_STRING, .name = "name", .value.string = "John" },
+		{ .type = AWS_DYNAMO_STRING, .name = "city", .value.string = "SF" },
+	};
+	struct aws_dynamo_builder *b;
+
+	b = aws_dynamo_builder_new();
+	assert(b != NULL);
+
+	/* GetItem */
+	aws_dynamo_builder_table(b, "users");
+	aws_dynamo_builder_key(b, AWS_DYNAMO_JSON_KEY, &hash_key, &range_key);
+	aws_dynamo_builder_attributes_to_get(b, attributes, 2);
+	aws_dynamo_builder_boolean(b, "ConsistentRead", 1);
+	assert(strcmp(finish(b), "{\"TableName\":\"users\",\"Key\":{"
+		"\"HashKeyElement\":{\"S\":\"jdoe\"},\"RangeKeyElement\":{\"N\":\"7\"}},"
+		"\"AttributesToGet\":[\"name\",\"city\"],\"ConsistentRead\":true}") == 0);
+
+	/* Query, DynamoDB_20111205 */
+	aws_dynamo_builder_reset(b);
+	aws_dynamo_builder_table(b, "users");
+	aws_dynamo_builder_value(b, AWS_DYNAMO_JSON_HASH_KEY_VALUE, &hash_key);
+	aws_dynamo_builder_condition(b, AWS_DYNAMO_JSON_RANGE_KEY_CONDITION, "BETWEEN", range, 2);
+	aws_dynamo_builder_integer(b, "Limit", 10);
+	aws_dynamo_builder_key(b, AWS_DYNAMO_JSON_EXCLUSIVE_START_KEY, &hash_key, NULL);
+	assert(strcmp(finish(b), "{\"TableName\":\"users\",\"HashKeyValue\":{\"S\":\"jdoe\"},"
+		"\"RangeKeyCondition\":{\"AttributeValueList\":[{\"N\":\"1\"},{\"N\":\"9\"}],"
+		"\"ComparisonOperator\":\"BETWEEN\"},\"Limit\":10,"
+		"\"ExclusiveStartKey\":{\"HashKeyElement\":{\"S\":\"jdoe\"}}}") == 0);
+
+	/* Query, DynamoDB_20120810 */
+	aws_dynamo_builder_reset(b);
+	aws_dynamo_builder_table(b, "users");
+	aws_dynamo_builder_object_start(b, AWS_DYNAMO_JSON_KEY_CONDITIONS);
+	aws_dynamo_builder_condition(b, "user", "EQ", &hash_key, 1);
+	aws_dynamo_builder_condition(b, "id", "NOT_NULL", NULL, 0);
+	aws_dynamo_builder_object_end(b);
+	aws_dynamo_builder_array_start(b, "Select");
+	aws_dynamo_builder_string(b, NULL, "a");
+	aws_dynamo_builder_raw(b, NULL, "{}");
+	aws_dynamo_builder_array_end(b);
+	assert(strcmp(finish(b), "{\"TableName\":\"users\",\"KeyConditions\":{"
+		"\"user\":{\"AttributeValueList\":[{\"S\":\"jdoe\"}],\"ComparisonOperator\":\"EQ\"},"
+		"\"id\":{\"ComparisonOperator\":\"NOT_NULL\"}},\"Select\":[\"a\",{}]}") == 0);
+
+	/* UpdateItem */
+	aws_dynamo_builder_reset(b);
+	aws_dynamo_builder_table(b, "users");
+	aws_dynamo_builder_key(b, AWS_DYNAMO_JSON_KEY, &hash_key, NULL);
+	aws_dynamo_builder_attribute_updates(b, attributes, 2, "PUT");
+	assert(strcmp(finish(b), "{\"TableName\":\"users\",\"Key\":{"
+		"\"HashKeyElement\":{\"S\":\"jdoe\"}},\"AttributeUpdates\":{"
+		"\"name\":{\"Value\":{\"S\":\"John\"},\"Action\":\"PUT\"},"
+		"\"city\":{\"Value\":{\"S\":\"SF\"},\"Action\":\"PUT\"}}}") == 0);
+
+	/* Finishing again gives the same request. */
+	assert(strcmp(finish(b), finish(b)) == 0);
+
+	aws_dynamo_builder_free(b);
+}
+
+static void test_errors(void)
+{
+	aws_dynamo_double_t nan = 0.0 / 0.0;
+	struct aws_dynamo_attribute bad[] = {
+		{ .type = AWS_DYNAMO_STRING, .name = "s" },
+		{ .type = AWS_DYNAMO_NUMBER, .name = "n",
+		  .value.number = { .type = AWS_DYNAMO_NUMBER_DOUBLE, .value.double_val = &nan } },
+		{ .type = AWS_DYNAMO_NUMBER, .name = "n",
+		  .value.number = { .type = AWS_DYNAMO_NUMBER_INTEGER } },
+		{ .type = 99, .name = "t" },
+	};
+	struct aws_dynamo_builder *b;
+	int i;
+
+	b = aws_dynamo_builder_new();
+	assert(b != NULL);
+
+	/* Members of objects are named, elements of arrays are not. */
+	assert(aws_dynamo_builder_string(b, NULL, "x") == -1);
+	assert(aws_dynamo_builder_finish(b, NULL) == NULL);
+
+	aws_dynamo_builder_reset(b);
+	aws_dynamo_builder_array_start(b, "a");
+	assert(aws_dynamo_builder_string(b, "x", "x") == -1);
+	/* Later calls fail too. */
+	assert(aws_dynamo_builder_array_end(b) == -1);
+	assert(aws_dynamo_builder_finish(b, NULL) == NULL);
+
+	/* Unbalanced. */
+	aws_dynamo_builder_reset(b);
+	aws_dynamo_builder_object_start(b, "o");
+	assert(aws_dynamo_builder_finish(b, NULL) == NULL);
+
+	aws_dynamo_builder_reset(b);
+	aws_dynamo_builder_object_start(b, "o");
+	assert(aws_dynamo_builder_array_end(b) == -1);
+
+	aws_dynamo_builder_reset(b);
+	assert(aws_dynamo_builder_object_end(b) == -1);
+
+	for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		aws_dynamo_builder_reset(b);
+		assert(aws_dynamo_builder_attributes(b, AWS_DYNAMO_JSON_ITEM, &(bad[i]), 1) == -1);
+		assert(aws_dynamo_builder_finish(b, NULL) == NULL);
+	}
+
+	/* Nothing is added to a finished request. */
+	aws_dynamo_builder_reset(b);
+	assert(strcmp(finish(b), "{}") == 0);
+	assert(aws_dynamo_builder_string(b, "x", "x") == -1);
+
+	/* Too deep. */
+	aws_dynamo_builder_reset(b);
+	for (i = 1; i < AWS_DYNAMO_BUILDER_MAX_DEPTH; i++) {
+		assert(aws_dynamo_builder_array_start(b, i == 1 ? "a" : NULL) == 0);
+	}
+	assert(aws_dynamo_builder_array_start(b, NULL) == -1);
+
+	/* A reset builder works again. */
+	aws_dynamo_builder_reset(b);
+	assert(aws_dynamo_builder_table(b, "t") == 0);
+	assert(strcmp(finish(b), "{\"TableName\":\"t\"}") == 0);
+
+	aws_dynamo_builder_free(b);
+}
+
+static void test_hash(void)
+{
+	struct http_header hdrs[] = {
+		{ .name = "host", .value = "dynamodb.us-east-1.amazonaws.com" },
+		{ .name = "x-amz-date", .value = "20140101T000000Z" },
+	};
+	struct http_headers headers = {
+		.count = 2,
+		.entries = hdrs,
+	};
+	char expected[AWS_SIGV4_HEX_LEN + 1];
+	char hashed[AWS_SIGV4_HEX_LEN + 1];
+	struct aws_dynamo_builder *b;
+	const char *body;
+	char value[64];
+	int len;
+	int i;
+
+	b = aws_dynamo_builder_new();
+	assert(b != NULL);
+
+	/* Bodies ending on and around the hash block boundaries. */
+	for (len = 0; len < 300; len++) {
+		aws_dynamo_builder_reset(b);
+		for (i = 0; i < len; i++) {
+			snprintf(value, sizeof(value), "v\"%d", i);
+			aws_dynamo_builder_string(b, "k", value);
+		}
+		body = finish(b);
+
+		assert(aws_dynamo_builder_payload_hash(b, body) != NULL);
+		assert(aws_dynamo_builder_payload_hash(b, "{}") == NULL);
+		assert(aws_dynamo_builder_payload_hash(NULL, body) == NULL);
+
+		assert(aws_sigv4_hash_canonical_request("POST", "/", "", &headers,
+			"host;x-amz-date", body, strlen(body), expected) == 0);
+		assert(aws_sigv4_hash_canonical_request_hashed("POST", "/", "", &headers,
+			"host;x-amz-date", aws_dynamo_builder_payload_hash(b, body),
+			hashed) == 0);
+		assert(strcmp(expected, hashed) == 0);
+	}
+
+	/* Reset forgets the hash. */
+	aws_dynamo_builder_reset(b);
+	assert(aws_dynamo_builder_payload_hash(b, body) == NULL);
+
+	aws_dynamo_builder_free(b);
+}
+
+static int handler(const struct test_http_request *req, char **body, void *arg)
+{
+	assert(strstr(req->target, "GetItem") != NULL);
+	assert(strcmp(req->body, "{\"TableName\":\"t\",\"Key\":{"
+		"\"HashKeyElement\":{\"S\":\"k\\\"\"}},\"AttributesToGet\":[\"name\"]}") == 0);
+
+	*body = strdup("{\"Item\":{\"name\":{\"S\":\"John\"}},\"ConsumedCapacityUnits\":0.5}");
+	return 200;
+}
+
+static void *thread_builder(void *arg)
+{
+	return aws_dynamo_builder_get(arg);
+}
+
+static void test_thread_builder(void)
+{
+	struct aws_dynamo_attribute hash_key = {
+		.type = AWS_DYNAMO_STRING,
+		.value.string = "k\"",
+	};
+	struct aws_dynamo_attribute attributes[] = {
+		{ .type = AWS_DYNAMO_STRING, .name = "name", .name_len = 4 },
+	};
+	struct aws_dynamo_get_item_response *r;
+	struct aws_dynamo_builder *b;
+	struct aws_handle *aws;
+	const char *request;
+	pthread_t thread;
+	void *other;
+	int port;
+
+	port = test_http_server_start(handler, NULL);
+	aws = test_local_handle(port);
+
+	b = aws_dynamo_builder_get(aws);
+	assert(b != NULL);
+	assert(aws_dynamo_builder_get(aws) == b);
+
+	assert(pthread_create(&thread, NULL, thread_builder, aws) == 0);
+	assert(pthread_join(thread, &other) == 0);
+	assert(other != NULL && other != b);
+
+	aws_dynamo_builder_table(b, "t");
+	aws_dynamo_builder_key(b, AWS_DYNAMO_JSON_KEY, &hash_key, NULL);
+	aws_dynamo_builder_attributes_to_get(b, attributes, 1);
+	request = aws_dynamo_builder_finish(b, NULL);
+	assert(request != NULL);
+
+	r = aws_dynamo_get_item(aws, request, attributes, 1);
+	assert(r != NULL);
+	assert(strcmp(r->item.attributes[0].value.string, "John") == 0);
+	aws_dynamo_free_get_item_response(r);
+
+	/* The same request copied elsewhere is hashed when it is signed. */
+	request = strdup(request);
+	assert(request != NULL);
+	r = aws_dynamo_get_item(aws, request, attributes, 1);
+	assert(r != NULL);
+	aws_dynamo_free_get_item_response(r);
+	free((char *)request);
+
+	aws_deinit(aws);
+}
+
+int main(int argc, char *argv[])
+{
+	signal(SIGPIPE, SIG_IGN);
+
+	test_escape();
+	test_values();
+	test_requests();
+	test_errors();
+	test_hash();
+	test_thread_builder();
+	return 0;
+}
@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "aws_dynamo.h"
+#include "test_utils.h"
+
+#define COLUMN_ITEMS 1000
+
+static struct aws_dynamo_attribute attributes[] = {
+	{
+		.type = AWS_DYNAMO_NUMBER,
+		.name = "id",
+		.name_len = 2,
+		.value.number.type = AWS_DYNAMO_NUMBER_INTEGER,
+	},
+	{
+		.type = AWS_DYNAMO_STRING,
+		.name = "name",
+		.name_len = 4,
+	},
+	{
+		.type = AWS_DYNAMO_NUMBER,
+		.name = "score",
+		.name_len = 5,
+		.value.number.type = AWS_DYNAMO_NUMBER_DOUBLE,
+	},
+};
+
+/* Item i has a score unless i % 7 is 3, and a name unless i % 5 is 0. */
+static char *columns_response(int count)
+{
+	char *response;
+	size_t size = 256 + (size_t)count * 96;
+	size_t n;
+	int i;
+
+	response = malloc(size);
+	assert(response != NULL);
+
+	n = snprintf(response, size, "{\"Count\":%d,\"Items\":[", count);
+	for (i = 0; i < count; i++) {
+		n += snprintf(response + n, size - n, "%s{\"id\":{\"N\":\"%d\"}",
+			i == 0 ? "" : ",", (i * 7919) % 1000 - 500);
+		if (i % 5 != 0) {
+			n += snprintf(response + n, size - n, ",\"name\":{\"S\":\"n%d\"}", i);
+		}
+		if (i % 7 != 3) {
+			n += snprintf(response + n, size - n, ",\"score\":{\"N\":\"%d.25\"}", i % 100 - 50);
+		}
+		n += snprintf(response + n, size - n, "}");
+	}
+	n += snprintf(response + n, size - n, "],\"ScannedCount\":%d,"
+		"\"LastEvaluatedKey\":{\"HashKeyElement\":{\"N\":\"42\"}},"
+		"\"ConsumedCapacityUnits\":2.5}", count);
+	assert(n < size);
+
+	return response;
+}
+
+static void check_columns(struct aws_dynamo_columns *c, int count)
+{
+	struct aws_dynamo_column *id = &(c->columns[0]);
+	struct aws_dynamo_column *name = &(c->columns[1]);
+	struct aws_dynamo_column *score = &(c->columns[2]);
+	int i;
+
+	assert(c->count == count);
+	assert(c->scanned_count == count);
+	assert(c->consumed_capacity_units == 2.5);
+	assert(c->num_columns == 3);
+	assert(c->hash_key != NULL);
+	assert(strcmp(c->hash_key->type, "N") == 0);
+	assert(strcmp(c->hash_key->value, "42") == 0);
+	assert(c->range_key == NULL);
+
+	for (i = 0; i < count; i++) {
+		char buf[32];
+		int len;
+
+		assert(AWS_DYNAMO_COLUMN_VALID(id, i));
+		assert(id->integers[i] == (i * 7919) % 1000 - 500);
+
+		len = name->offsets[i + 1] - name->offsets[i];
+		if (i % 5 != 0) {
+			snprintf(buf, sizeof(buf), "n%d", i);
+			assert(AWS_DYNAMO_COLUMN_VALID(name, i));
+			assert(len == strlen(buf));
+			assert(memcmp(name->blob + name->offsets[i], buf, len) == 0);
+		} else {
+			assert(!AWS_DYNAMO_COLUMN_VALID(name, i));
+			assert(len == 0);
+		}
+
+		if (i % 7 != 3) {
+			assert(AWS_DYNAMO_COLUMN_VALID(score, i));
+			/* "-3.25" is -3 - 0.25. */
+			assert(score->doubles[i] == (i % 100 - 50) + (i % 100 >= 50 ? 0.25 : -0.25));
+		} else {
+			assert(!AWS_DYNAMO_COLUMN_VALID(score, i));
+			assert(score->doubles[i] == 0);
+		}
+	}
+}
+
+static void test_parse_columns(void)
+{
+	struct aws_dynamo_columns *c;
+	char *response;
+	const char *bad = "{\"Count\":2,\"Items\":[{\"id\":{\"N\":\"1\"}},"
+		"{\"id\":{\"N\":\"2\"}},{\"id\":{\"N\":\"3\"}}]}";
+	const char *duplicate = "{\"Count\":1,\"Items\":[{\"id\":{\"N\":\"1\"},"
+		"\"id\":{\"N\":\"2\"}}]}";
+	const char *empty = "{\"Count\":0,\"Items\":[]}";
+	struct aws_dynamo_attribute set = {
+		.type = AWS_DYNAMO_STRING_SET,
+		.name = "tags",
+		.name_len = 4,
+	};
+
+	response = columns_response(COLUMN_ITEMS);
+	c = aws_dynamo_parse_columns(response, strlen(response), attributes, 3);
+	assert(c != NULL);
+	check_columns(c, COLUMN_ITEMS);
+	aws_dynamo_free_columns(c);
+	free(response);
+
+	c = aws_dynamo_parse_columns(empty, strlen(empty), attributes, 3);
+	assert(c != NULL);
+	assert(c->count == 0);
+	assert(c->columns[1].offsets[0] == 0);
+	aws_dynamo_free_columns(c);
+
+	/* More items than Count, and an attribute given twice. */
+	assert(aws_dynamo_parse_columns(bad, strlen(bad), attributes, 3) == NULL);
+	assert(aws_dynamo_parse_columns(duplicate, strlen(duplicate), attributes, 3) == NULL);
+
+	/* Sets have no column layout. */
+	assert(aws_dynamo_parse_columns(empty, strlen(empty), &set, 1) == NULL);
+}
+
+static void check_aggregate(struct aws_dynamo_columns *c)
+{
+	struct aws_dynamo_aggregate a;
+	long long isum = 0, imin = 0, imax = 0;
+	double sum = 0, min = 0, max = 0;
+	int count = 0;
+	int i;
+
+	assert(aws_dynamo_columns_aggregate(c, 0, &a) == 0);
+	for (i = 0; i < c->count; i++) {
+		long long v = c->columns[0].integers[i];
+
+		isum += v;
+		if (i == 0 || v < imin) {
+			imin = v;
+		}
+		if (i == 0 || v > imax) {
+			imax = v;
+		}
+	}
+	assert(a.count == c->count);
+	assert(a.integer_sum == isum);
+	assert(a.integer_min == imin);
+	assert(a.integer_max == imax);
+
+	assert(aws_dynamo_columns_aggregate(c, 2, &a) == 0);
+	for (i = 0; i < c->count; i++) {
+		double v = c->columns[2].doubles[i];
+
+		if (!AWS_DYNAMO_COLUMN_VALID(&(c->columns[2]), i)) {
+			continue;
+		}
+		sum += v;
+		if (count == 0 || v < min) {
+			min = v;
+		}
+		if (count == 0 || v > max) {
+			max = v;
+		}
+		count++;
+	}
+	assert(a.count == count);
+	/* Quarters sum exactly in any order. */
+	assert(a.sum == sum);
+	assert(a.min == min);
+	assert(a.max == max);
+
+	assert(aws_dynamo_columns_aggregate(c, 1, &a) == -1);
+	assert(aws_dynamo_columns_aggregate(c, 3, &a) == -1);
+}
+
+static void test_aggregate(void)
+{
+	enum aws_dynamo_aggregate_impl impls[] = {
+		AWS_DYNAMO_AGGREGATE_SCALAR,
+		AWS_DYNAMO_AGGREGATE_AVX2,
+		AWS_DYNAMO_AGGREGATE_AUTO,
+	};
+	int sizes[] = { 0, 1, 3, 63, 64, 65, 200, COLUMN_ITEMS };
+	int i, j;
+
+	for (i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+		if (aws_dynamo_aggregate_select(impls[i]) == -1) {
+			printf("aggregate implementation %d not supported\n", impls[i]);
+			continue;
+		}
+		for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+			struct aws_dynamo_columns *c;
+			char *response;
+
+			response = columns_response(sizes[j]);
+			c = aws_dynamo_parse_columns(response, strlen(response), attributes, 3);
+			assert(c != NULL);
+			check_aggregate(c);
+			aws_dynamo_free_columns(c);
+			free(response);
+		}
+	}
+	assert(aws_dynamo_aggregate_select(AWS_DYNAMO_AGGREGATE_AUTO) == 0);
+}
+
+static int handler(const struct test_http_request *req, char **response, void *arg)
+{
+	*response = columns_response(COLUMN_ITEMS);
+	return 200;
+}
+
+static void test_scan_columns(void)
+{
+	struct aws_dynamo_columns *c;
+	struct aws_handle *aws;
+	int port;
+
+	port = test_http_server_start(handler, NULL);
+	aws = test_local_handle(port);
+
+	c = aws_dynamo_scan_columns(aws, "{\"TableName\":\"t\"}", attributes, 3);
+	assert(c != NULL);
+	check_columns(c, COLUMN_ITEMS);
+	aws_dynamo_free_columns(c);
+
+	aws_dynamo_set_parse_flags(aws, AWS_DYNAMO_PARSE_STREAM);
+	c = aws_dynamo_query_columns(aws, "{\"TableName\":\"t\"}", attributes, 3);
+	assert(c != NULL);
+	check_columns(c, COLUMN_ITEMS);
+	aws_dynamo_free_columns(c);
+
+	aws_deinit(aws);
+}
+
+int main(int argc, char *argv[])
+{
+	test_parse_columns();
+	test_aggregate();
+	test_scan_columns();
+	return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "aws_dynamo.h"
+#include "test_utils.h"
+
+#define GET_ITEM(table) "{\"TableName\":\"" table "\",\"Key\":{\"HashKeyElement\":{\"N\":\"1\"}}}"
+
+static int handler(const struct test_http_request *req, char **response, void *arg)
+{
+	if (strstr(req->body, "slow_table") != NULL) {
+		sleep(2);
+	} else if (strstr(req->body, "throttled_table") != NULL) {
+		*response = strdup("{\"__type\":\"com.amazonaws.dynamodb.v20111205#ProvisionedThroughputExceededException\",\"message\":\"The level of configured provisioned throughput for the table was exceeded.\"}");
+		return 400;
+	}
+	*response = strdup("{\"Item\":{\"hash\":{\"N\":\"1\"}},\"ConsumedCapacityUnits\":0.5}");
+	return 200;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void test_slow_transfer(struct aws_handle *aws)
+{
+	double start;
+
+	assert(aws_set_timeout(aws, 300, NULL) == 0);
+
+	start = now();
+	assert(aws_dynamo_request(aws, AWS_DYNAMO_GET_ITEM, GET_ITEM("slow_table")) == -1);
+	assert(now() - start < 1.5);
+	assert(aws_dynamo_get_errno(aws) == AWS_DYNAMO_CODE_DEADLINE_EXCEEDED);
+
+	/* Requests that fit in the time limit are unaffected. */
+	assert(aws_dynamo_request(aws, AWS_DYNAMO_GET_ITEM, GET_ITEM("test")) == 0);
+	assert(aws_dynamo_get_errno(aws) == AWS_DYNAMO_CODE_NONE);
+
+	assert(aws_set_timeout(aws, 0, NULL) == 0);
+}
+
+static void test_retries(struct aws_handle *aws)
+{
+	double start;
+
+	/* Without a limit the backoff would add up to tens of seconds. */
+	aws_dynamo_set_max_retries(aws, 12);
+	assert(aws_set_timeout(aws, 500, NULL) == 0);
+
+	start = now();
+	assert(aws_dynamo_request(aws, AWS_DYNAMO_GET_ITEM, GET_ITEM("throttled_table")) == -1);
+	assert(now() - start < 0.6);
+	assert(aws_dynamo_get_errno(aws) == AWS_DYNAMO_CODE_DEADLINE_EXCEEDED);
+
+	assert(aws_set_timeout(aws, 0, NULL) == 0);
+}
+
+static void *cancel_thread(void *arg)
+{
+	struct aws_cancel *cancel = arg;
+
+	usleep(200000);
+	aws_cancel_signal(cancel);
+	return NULL;
+}
+
+static void test_cancel(struct aws_handle *aws)
+{
+	struct aws_cancel *cancel;
+	pthread_t thread;
+	double start;
+
+	cancel = aws_cancel_init();
+	assert(cancel != NULL);
+
+	aws_dynamo_set_max_retries(aws, 20);
+	assert(aws_set_timeout(aws, 0, cancel) == 0);
+	assert(pthread_create(&thread, NULL, cancel_thread, cancel) == 0);
+
+	start = now();
+	assert(aws_dynamo_request(aws, AWS_DYNAMO_GET_ITEM, GET_ITEM("throttled_table")) == -1);
+	assert(now() - start < 1.0);
+	assert(aws_dynamo_get_errno(aws) == AWS_DYNAMO_CODE_CANCELLED);
+	pthread_join(thread, NULL);
+
+	/* The handle stays cancelled until it is reset. */
+	assert(aws_dynamo_request(aws, AWS_DYNAMO_GET_ITEM, GET_ITEM("test")) == -1);
+	assert(aws_dynamo_get_errno(aws) == AWS_DYNAMO_CODE_CANCELLED);
+
+	aws_cancel_reset(cancel);
+	assert(aws_dynamo_request(aws, AWS_DYNAMO_GET_ITEM, GET_ITEM("test")) == 0);
+
+	assert(aws_set_timeout(aws, 0, NULL) == 0);
+	aws_cancel_deinit(cancel);
+}
+
+int main(int argc, char *argv[])
+{
+	struct aws_handle *aws;
+	int port;
+
+	/* The slow handler writes to connections the client gave up on. */
+	signal(SIGPIPE, SIG_IGN);
+
+	port = test_http_server_start(handler, NULL);
+	aws = test_local_handle(port);
+
+	test_slow_transfer(aws);
+	test_retries(aws);
+	test_cancel(aws);
+
+	aws_deinit(aws);
+	return 0;
+}
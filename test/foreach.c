@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <assert.h>
+
+#include "aws_dynamo.h"
+#include "test_utils.h"
+
+#define FOREACH_PAGES		10
+#define FOREACH_PAGE_ITEMS	37
+
+static struct aws_dynamo_attribute attributes[] = {
+	{
+		.type = AWS_DYNAMO_NUMBER,
+		.name = "id",
+		.name_len = 2,
+		.value.number.type = AWS_DYNAMO_NUMBER_INTEGER,
+	},
+	{
+		.type = AWS_DYNAMO_STRING,
+		.name = "name",
+		.name_len = 4,
+	},
+	{
+		.type = AWS_DYNAMO_STRING_SET,
+		.name = "tags",
+		.name_len = 4,
+	},
+};
+
+/* Items are numbered through all the pages, page 4 is empty. */
+static int page_first(int page)
+{
+	return page <= 4 ? page * FOREACH_PAGE_ITEMS : (page - 1) * FOREACH_PAGE_ITEMS;
+}
+
+static int page_count(int page)
+{
+	return page == 4 ? 0 : FOREACH_PAGE_ITEMS;
+}
+
+/* Query pages end with a hash key, Scan pages with an escaped hash key and
+   a range key, both holding the number of the next page. */
+static char *page_response(int page, int scan)
+{
+	char *response;
+	size_t size = 256 + FOREACH_PAGE_ITEMS * 128;
+	size_t n;
+	int i;
+
+	response = malloc(size);
+	assert(response != NULL);
+
+	n = snprintf(response, size, "{\"Count\":%d,\"Items\":[", page_count(page));
+	for (i = 0; i < page_count(page); i++) {
+		int id = page_first(page) + i;
+
+		n += snprintf(response + n, size - n, "%s{\"id\":{\"N\":\"%d\"}",
+			i == 0 ? "" : ",", id);
+		if (id % 3 != 0) {
+			n += snprintf(response + n, size - n, ",\"name\":{\"S\":\"\\\"n\\u00e9\\\"%d\"}", id);
+		}
+		n += snprintf(response + n, size - n,
+			",\"tags\":{\"SS\":[\"a%d\",\"b\"]}}", id);
+	}
+	n += snprintf(response + n, size - n, "],");
+	if (scan) {
+		n += snprintf(response + n, size - n, "\"ScannedCount\":%d,", page_count(page));
+	}
+	if (page < FOREACH_PAGES - 1) {
+		if (scan) {
+			n += snprintf(response + n, size - n,
+				"\"LastEvaluatedKey\":{\"HashKeyElement\":{\"S\":\"k\\\"\\\\\\n\"},"
+				"\"RangeKeyElement\":{\"N\":\"%d\"}},", page + 1);
+		} else {
+			n += snprintf(response + n, size - n,
+				"\"LastEvaluatedKey\":{\"HashKeyElement\":{\"N\":\"%d\"}},", page + 1);
+		}
+	}
+	n += snprintf(response + n, size - n, "\"ConsumedCapacityUnits\":0.5}");
+	assert(n < size);
+
+	return response;
+}
+
+static int handler(const struct test_http_request *req, char **response, void *arg)
+{
+	int *requests = arg;
+	int scan = strstr(req->target, "Scan") != NULL;
+	const char *key;
+	int page = 0;
+
+	key = strstr(req->body, "\"ExclusiveStartKey\":");
+	if (key != NULL) {
+		if (scan) {
+			/* The hash key comes back escaped as it was sent. */
+			assert(strstr(key, "\"HashKeyElement\":{\"S\":\"k\\\"\\\\\\u000a\"}") != NULL);
+			key = strstr(key, "\"RangeKeyElement\":{\"N\":\"");
+		} else {
+			assert(strncmp(req->body, "{\"TableName\":\"foreach\",", 23) == 0);
+			key = strstr(key, "\"HashKeyElement\":{\"N\":\"");
+		}
+		assert(key != NULL);
+		page = atoi(strchr(key, ':') + 7);
+		assert(page > 0 && page < FOREACH_PAGES);
+	}
+
+	(*requests)++;
+	*response = page_response(page, scan);
+	return 200;
+}
+
+struct foreach_state {
+	int num_items;
+	int stop_at;
+};
+
+static int check_item(struct aws_dynamo_item *item, void *arg)
+{
+	struct foreach_state *state = arg;
+	struct aws_dynamo_attribute *a = item->attributes;
+	int id = state->num_items;
+	char buf[64];
+
+	assert(item->num_attributes == 3);
+	assert(*(a[0].value.number.value.integer_val) == id);
+	if (id % 3 == 0) {
+		assert(a[1].value.string == NULL);
+	} else {
+		snprintf(buf, sizeof(buf), "\"n\xc3\xa9\"%d", id);
+		assert(strcmp(a[1].value.string, buf) == 0);
+	}
+	assert(a[2].value.string_set.num_strings == 2);
+	snprintf(buf, sizeof(buf), "a%d", id);
+	assert(strcmp(a[2].value.string_set.strings[0], buf) == 0);
+
+	state->num_items++;
+	return state->num_items == state->stop_at;
+}
+
+static void test_foreach(void)
+{
+	struct foreach_state state = { 0, -1 };
+	struct aws_handle *aws;
+	int requests = 0;
+	int port;
+
+	port = test_http_server_start(handler, &requests);
+	aws = test_local_handle(port);
+
+	/* Every page is requested and every item is seen in order. */
+	assert(aws_dynamo_query_foreach(aws, "{\"TableName\":\"foreach\"}",
+		attributes, 3, check_item, &state) == 0);
+	assert(state.num_items == page_first(FOREACH_PAGES));
+	assert(requests == FOREACH_PAGES);
+
+	state.num_items = 0;
+	requests = 0;
+	assert(aws_dynamo_scan_foreach(aws, " { } ", attributes, 3,
+		check_item, &state) == 0);
+	assert(state.num_items == page_first(FOREACH_PAGES));
+	assert(requests == FOREACH_PAGES);
+
+	/* Stopping part way through a page requests no more pages. */
+	state.num_items = 0;
+	state.stop_at = FOREACH_PAGE_ITEMS + 5;
+	requests = 0;
+	assert(aws_dynamo_query_foreach(aws, "{\"TableName\":\"foreach\"}",
+		attributes, 3, check_item, &state) == 1);
+	assert(state.num_items == FOREACH_PAGE_ITEMS + 5);
+	assert(requests == 2);
+
+	/* A request that already has a start key can't be paginated. */
+	state.num_items = page_first(3);
+	state.stop_at = -1;
+	assert(aws_dynamo_query_foreach(aws, "{\"TableName\":\"foreach\","
+		"\"ExclusiveStartKey\":{\"HashKeyElement\":{\"N\":\"3\"}}}",
+		attributes, 3, check_item, &state) == -1);
+	assert(state.num_items == page_first(4));
+
+	aws_deinit(aws);
+}
+
+/* Bodies that arrive in pieces have their items passed on before the page
+   is complete. */
+static void test_foreach_chunked(void)
+{
+	struct foreach_state state = { 0, -1 };
+	struct aws_handle *aws;
+	int requests = 0;
+	int port;
+
+	port = test_http_server_start(handler, &requests);
+	aws = test_local_handle(port);
+	test_http_server_set_chunking(128, 0);
+
+	assert(aws_dynamo_query_foreach(aws, "{\"TableName\":\"foreach\"}",
+		attributes, 3, check_item, &state) == 0);
+	assert(state.num_items == page_first(FOREACH_PAGES));
+	assert(requests == FOREACH_PAGES);
+
+	/* Stopping aborts the transfer of the page, it is not retried. */
+	state.num_items = 0;
+	state.stop_at = FOREACH_PAGE_ITEMS + 5;
+	requests = 0;
+	assert(aws_dynamo_query_foreach(aws, "{\"TableName\":\"foreach\"}",
+		attributes, 3, check_item, &state) == 1);
+	assert(state.num_items == FOREACH_PAGE_ITEMS + 5);
+	assert(requests == 2);
+
+	/* A page that breaks off after some of its items were passed on is
+	   retried by the transport, but not parsed again. */
+	state.num_items = 0;
+	state.stop_at = -1;
+	requests = 0;
+	test_http_server_set_chunking(128, 1024);
+	assert(aws_dynamo_query_foreach(aws, "{\"TableName\":\"foreach\"}",
+		attributes, 3, check_item, &state) == -1);
+	assert(state.num_items > 0 && state.num_items < FOREACH_PAGE_ITEMS);
+	assert(requests == 2);
+
+	test_http_server_set_chunking(0, 0);
+	aws_deinit(aws);
+}
+
+int main(int argc, char *argv[])
+{
+	/* The server may still be writing a response the client gave up on. */
+	signal(SIGPIPE, SIG_IGN);
+
+	test_foreach();
+	test_foreach_chunked();
+	return 0;
+}
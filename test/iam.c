@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "aws_dynamo.h"
+#include "test_utils.h"
+
+#define CREDENTIALS_PATH "/latest/meta-data/iam/security-credentials/"
+
+/* Seconds until the refresher is due to renew each set of credentials. */
+#define REFRESH_DELAY 2
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int credentials_served;
+
+static int handler(const struct test_http_request *req, char **response, void *arg)
+{
+	if (strcmp(req->method, "GET") == 0) {
+		time_t expiration;
+		struct tm tm;
+		char date[64];
+		int n;
+
+		if (strcmp(req->path, CREDENTIALS_PATH) == 0) {
+			*response = strdup("test-role");
+			return 200;
+		}
+		assert(strcmp(req->path, CREDENTIALS_PATH "test-role") == 0);
+
+		expiration = time(NULL) + AWS_SESSION_REFRESH_TIME + REFRESH_DELAY;
+		gmtime_r(&expiration, &tm);
+		strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", &tm);
+
+		pthread_mutex_lock(&lock);
+		n = ++credentials_served;
+		pthread_mutex_unlock(&lock);
+
+		assert(asprintf(response, "{\"Code\":\"Success\",\"Type\":\"AWS-HMAC\","
+			"\"AccessKeyId\":\"ASIATEST%d\",\"SecretAccessKey\":\"secret%d\","
+			"\"Token\":\"token%d\",\"Expiration\":\"%s\"}", n, n, n, date) != -1);
+		return 200;
+	}
+
+	assert(strcmp(req->target, AWS_DYNAMO_GET_ITEM) == 0);
+	*response = strdup("{\"Item\":{\"hash\":{\"N\":\"1\"}},\"ConsumedCapacityUnits\":0.5}");
+	return 200;
+}
+
+static void get_item(struct aws_handle *aws)
+{
+	struct aws_dynamo_attribute attributes[] = {
+		{
+			.type = AWS_DYNAMO_NUMBER,
+			.name = "hash",
+			.name_len = strlen("hash"),
+			.value.number.type = AWS_DYNAMO_NUMBER_INTEGER,
+		},
+	};
+	struct aws_dynamo_get_item_response *r;
+
+	r = aws_dynamo_get_item(aws,
+		"{\"TableName\":\"test\",\"Key\":{\"HashKeyElement\":{\"N\":\"1\"}}}",
+		attributes, 1);
+	assert(r != NULL);
+	aws_dynamo_free_get_item_response(r);
+}
+
+static void test_background_refresh(struct aws_handle *aws)
+{
+	int refreshed = 0;
+	int i;
+
+	pthread_mutex_lock(&aws->lock);
+	assert(strcmp(aws->token->access_key_id, "ASIATEST1") == 0);
+	pthread_mutex_unlock(&aws->lock);
+
+	/* Requests keep going while the credentials are swapped. */
+	for (i = 0; i < 100 && !refreshed; i++) {
+		get_item(aws);
+		usleep(100000);
+
+		pthread_mutex_lock(&aws->lock);
+		refreshed = strcmp(aws->token->access_key_id, "ASIATEST2") == 0;
+		pthread_mutex_unlock(&aws->lock);
+	}
+	assert(refreshed);
+
+	pthread_mutex_lock(&aws->lock);
+	assert(strcmp(aws->token->secret_access_key, "secret2") == 0);
+	pthread_mutex_unlock(&aws->lock);
+	get_item(aws);
+}
+
+int main(int argc, char *argv[])
+{
+	struct aws_handle *aws;
+	char endpoint[64];
+	int port;
+
+	port = test_http_server_start(handler, NULL);
+
+	/* Role credentials from the stand-in metadata service. */
+	unsetenv("AWS_ACCESS_KEY_ID");
+	unsetenv("AWS_SECRET_ACCESS_KEY");
+	snprintf(endpoint, sizeof(endpoint), "http://127.0.0.1:%d", port);
+	setenv("AWS_EC2_METADATA_SERVICE_ENDPOINT", endpoint, 1);
+
+	aws = aws_init(NULL, NULL);
+	assert(aws != NULL);
+	aws_dynamo_set_https(aws, 0);
+	assert(aws_dynamo_set_endpoint(aws, "127.0.0.1", "us-east-1") == 0);
+	aws_dynamo_set_port(aws, port);
+
+	test_background_refresh(aws);
+
+	aws_deinit(aws);
+	return 0;
+}
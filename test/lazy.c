@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "aws_dynamo.h"
+#include "test_utils.h"
+
+#define LAZY_ITEMS 500
+
+static struct aws_dynamo_attribute attributes[] = {
+	{
+		.type = AWS_DYNAMO_NUMBER,
+		.name = "id",
+		.name_len = 2,
+		.value.number.type = AWS_DYNAMO_NUMBER_INTEGER,
+	},
+	{
+		.type = AWS_DYNAMO_STRING,
+		.name = "name",
+		.name_len = 4,
+	},
+	{
+		.type = AWS_DYNAMO_STRING_SET,
+		.name = "tags",
+		.name_len = 4,
+	},
+};
+
+/* Item i has a name unless i % 3 is 0, names of even items have escapes. */
+static char *lazy_items(int count)
+{
+	char *response;
+	size_t size = 128 + (size_t)count * 128;
+	size_t n = 0;
+	int i;
+
+	response = malloc(size);
+	assert(response != NULL);
+	response[0] = '\0';
+
+	for (i = 0; i < count; i++) {
+		n += snprintf(response + n, size - n, "%s{\"id\":{\"N\":\"%d\"}",
+			i == 0 ? "" : ", ", i);
+		if (i % 3 != 0) {
+			n += snprintf(response + n, size - n, ",\"name\":{\"S\":\"%s%d\"}",
+				i % 2 ? "n" : "\\\"n\\u00e9\\\"", i);
+		}
+		n += snprintf(response + n, size - n,
+			",\"tags\":{\"SS\":[\"a%d\", \"b\\\\\",\"c\"]}}", i);
+	}
+	assert(n < size);
+
+	return response;
+}
+
+static char *lazy_response(int count)
+{
+	char *items = lazy_items(count);
+	char *response;
+	int n;
+
+	n = asprintf(&response, "{\"Count\":%d,\"Items\":[%s],\"ScannedCount\":%d,"
+		"\"LastEvaluatedKey\":{\"HashKeyElement\":{\"S\":\"k\\\\1\"}},"
+		"\"ConsumedCapacityUnits\":1.5}", count, items, count);
+	assert(n != -1);
+	free(items);
+
+	return response;
+}
+
+static void check_items(struct aws_dynamo_lazy_items *items, int count)
+{
+	int i;
+
+	assert(items->num_items == count);
+	for (i = 0; i < count; i++) {
+		struct aws_dynamo_attribute *a;
+		const unsigned char *json;
+		size_t len;
+		char buf[64];
+
+		/* Nothing is decoded until it is asked for. */
+		assert(items->items[i].attributes == NULL);
+
+		json = aws_dynamo_lazy_item_json(items, i, &len);
+		snprintf(buf, sizeof(buf), "{\"id\":{\"N\":\"%d\"}", i);
+		assert(len > strlen(buf) && memcmp(json, buf, strlen(buf)) == 0);
+		assert(json[len - 1] == '}');
+
+		/* Most readers only look at one attribute. */
+		if (i % 10 != 0) {
+			continue;
+		}
+
+		a = aws_dynamo_lazy_attribute(items, i, 0);
+		assert(a != NULL);
+		assert(*(a->value.number.value.integer_val) == i);
+		assert(aws_dynamo_lazy_attribute(items, i, 0) == a);
+
+		a = aws_dynamo_lazy_attribute(items, i, 1);
+		assert(a != NULL && a->type == AWS_DYNAMO_STRING);
+		if (i % 3 == 0) {
+			assert(a->value.string == NULL);
+		} else {
+			snprintf(buf, sizeof(buf), "%s%d", i % 2 ? "n" : "\"n\xc3\xa9\"", i);
+			assert(strcmp(a->value.string, buf) == 0);
+		}
+
+		a = aws_dynamo_lazy_attribute(items, i, 2);
+		assert(a != NULL);
+		assert(a->value.string_set.num_strings == 3);
+		snprintf(buf, sizeof(buf), "a%d", i);
+		assert(strcmp(a->value.string_set.strings[0], buf) == 0);
+		assert(strcmp(a->value.string_set.strings[1], "b\\") == 0);
+		assert(strcmp(a->value.string_set.strings[2], "c") == 0);
+	}
+
+	assert(aws_dynamo_lazy_attribute(items, count, 0) == NULL);
+	assert(aws_dynamo_lazy_attribute(items, 0, 3) == NULL);
+}
+
+static void test_parse_lazy(void)
+{
+	struct aws_dynamo_lazy_response *r;
+	char *response;
+	const char *bad = "{\"Count\":1,\"Items\":[{\"id\":{\"N\":\"x\"}}]}";
+	const char *twice = "{\"Count\":1,\"Items\":[{\"id\":{\"N\":\"1\"},\"id\":{\"N\":\"2\"}}]}";
+
+	response = lazy_response(LAZY_ITEMS);
+	r = aws_dynamo_parse_lazy_response((const unsigned char *)response, strlen(response),
+		attributes, 3);
+	assert(r != NULL);
+	assert(r->count == LAZY_ITEMS);
+	assert(r->scanned_count == LAZY_ITEMS);
+	assert(r->consumed_capacity_units == 1.5);
+	assert(r->hash_key != NULL && strcmp(r->hash_key->value, "k\\1") == 0);
+	assert(r->range_key == NULL);
+	check_items(&(r->items), LAZY_ITEMS);
+	aws_dynamo_free_lazy_response(r);
+	free(response);
+
+	/* Bad values only fail when they are decoded. */
+	r = aws_dynamo_parse_lazy_response((const unsigned char *)bad, strlen(bad),
+		attributes, 3);
+	assert(r != NULL);
+	assert(aws_dynamo_lazy_attribute(&(r->items), 0, 1) != NULL);
+	assert(aws_dynamo_lazy_attribute(&(r->items), 0, 0) == NULL);
+	aws_dynamo_free_lazy_response(r);
+
+	assert(aws_dynamo_parse_lazy_response((const unsigned char *)twice, strlen(twice),
+		attributes, 3) == NULL);
+}
+
+static char *lazy_batch_response(int count)
+{
+	char *items = lazy_items(count);
+	char *response;
+	int n;
+
+	n = asprintf(&response, "{\"Responses\":{\"other\":{\"Items\":[],"
+		"\"ConsumedCapacityUnits\":0.5},\"lazy\":{\"Items\":[%s],"
+		"\"ConsumedCapacityUnits\":2.5}},\"UnprocessedKeys\":{}}", items);
+	assert(n != -1);
+	free(items);
+
+	return response;
+}
+
+static struct aws_dynamo_batch_get_item_response_table tables[] = {
+	{
+		.name = "lazy",
+		.name_len = 4,
+		.attributes = attributes,
+		.num_attributes = 3,
+	},
+	{
+		.name = "other",
+		.name_len = 5,
+		.attributes = attributes,
+		.num_attributes = 3,
+	},
+};
+
+static void check_batch(struct aws_dynamo_lazy_batch_get_item_response *r)
+{
+	assert(r->num_tables == 2);
+	assert(r->tables[0].consumed_capacity_units == 2.5);
+	check_items(&(r->tables[0].items), LAZY_ITEMS);
+	assert(r->tables[1].consumed_capacity_units == 0.5);
+	assert(r->tables[1].items.num_items == 0);
+}
+
+static void test_parse_lazy_batch(void)
+{
+	struct aws_dynamo_lazy_batch_get_item_response *r;
+	char *response;
+
+	response = lazy_batch_response(LAZY_ITEMS);
+	r = aws_dynamo_parse_lazy_batch_get_item_response((const unsigned char *)response,
+		strlen(response), tables, 2);
+	assert(r != NULL);
+	check_batch(r);
+	aws_dynamo_free_lazy_batch_get_item_response(r);
+	free(response);
+}
+
+static int handler(const struct test_http_request *req, char **response, void *arg)
+{
+	if (strstr(req->target, "BatchGetItem") != NULL) {
+		*response = lazy_batch_response(LAZY_ITEMS);
+	} else {
+		*response = lazy_response(LAZY_ITEMS);
+	}
+	return 200;
+}
+
+static void test_lazy_requests(void)
+{
+	struct aws_dynamo_lazy_response *r;
+	struct aws_dynamo_lazy_batch_get_item_response *b;
+	struct aws_handle *aws;
+	int port;
+
+	port = test_http_server_start(handler, NULL);
+	aws = test_local_handle(port);
+
+	r = aws_dynamo_scan_lazy(aws, "{\"TableName\":\"lazy\"}", attributes, 3);
+	assert(r != NULL);
+	check_items(&(r->items), LAZY_ITEMS);
+
+	/* The response keeps the body it points into. */
+	b = aws_dynamo_batch_get_item_lazy(aws, "{\"RequestItems\":{}}", tables, 2);
+	assert(b != NULL);
+	check_batch(b);
+	assert(aws_dynamo_lazy_attribute(&(r->items), 1, 1) != NULL);
+	assert(strcmp(aws_dynamo_lazy_attribute(&(r->items), 1, 1)->value.string, "n1") == 0);
+
+	aws_dynamo_free_lazy_response(r);
+	aws_dynamo_free_lazy_batch_get_item_response(b);
+	aws_deinit(aws);
+}
+
+int main(int argc, char *argv[])
+{
+	test_parse_lazy();
+	test_parse_lazy_batch();
+	test_lazy_requests();
+	return 0;
+}
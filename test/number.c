@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "aws_dynamo_number.h"
+
+static void check_integer(const char *s, int ok, long long expected)
+{
+	long long i = 0;
+
+	if (aws_dynamo_number_parse_integer(s, strlen(s), &i) != (ok ? 0 : -1) ||
+		(ok && i != expected)) {
+		fprintf(stderr, "%s: got %lld, expected %lld\n", s, i, expected);
+		assert(0);
+	}
+}
+
+static void test_integers(void)
+{
+	long long i;
+
+	check_integer("0", 1, 0);
+	check_integer("-0", 1, 0);
+	check_integer("7", 1, 7);
+	check_integer("-42", 1, -42);
+	check_integer("12345678", 1, 12345678);
+	check_integer("1234567890123456789", 1, 1234567890123456789LL);
+	check_integer("9223372036854775807", 1, LLONG_MAX);
+	check_integer("-9223372036854775808", 1, LLONG_MIN);
+	check_integer("9223372036854775808", 0, 0);
+	check_integer("-9223372036854775809", 0, 0);
+	check_integer("99999999999999999999", 0, 0);
+	check_integer("12a", 0, 0);
+	check_integer("1.5", 0, 0);
+	check_integer("-", 0, 0);
+
+	/* What strtoll() accepts is still accepted. */
+	check_integer("010", 1, 8);
+	check_integer("0x10", 1, 16);
+	check_integer("+5", 1, 5);
+	check_integer(" 5", 1, 5);
+
+	/* The number need not be terminated. */
+	assert(aws_dynamo_number_parse_integer("123456789012\"}", 9, &i) == 0);
+	assert(i == 123456789);
+}
+
+/* Both conversions of @s must agree bit for bit with the C library. */
+static void check_decimal(const char *s)
+{
+	char *endptr;
+	double expected = strtod(s, &endptr);
+	long double expected_l = strtold(s, &endptr);
+	double d;
+	long double l;
+
+	if (aws_dynamo_number_parse_double(s, strlen(s), &d) != 0 ||
+		memcmp(&d, &expected, sizeof(d)) != 0) {
+		fprintf(stderr, "%s: got %.17g, expected %.17g\n", s, d, expected);
+		assert(0);
+	}
+
+	if (aws_dynamo_number_parse_long_double(s, strlen(s), &l) != 0 ||
+		l != expected_l || signbit(l) != signbit(expected_l)) {
+		fprintf(stderr, "%s: got %.21Lg, expected %.21Lg\n", s, l, expected_l);
+		assert(0);
+	}
+}
+
+static void test_decimals(void)
+{
+	const char *numbers[] = {
+		"0", "-0", "0.0", "1", "-1", "0.1", "0.5", "1.5", "2.5", "-3.25",
+		"123.456", "0.000001", "1e22", "1e23", "1e-22", "1e-23", "1E5",
+		"1e+5", "9007199254740992", "9007199254740993",
+		"18446744073709551615", "1234567890123456789.5",
+		"12345678901234567890123456789012345678",
+		"0.00000000000000000000000000000000000001",
+		"1.7976931348623157e308", "4.9406564584124654e-300",
+		"0.30000000000000004", "3.14159265358979323846",
+		"0x1p3", "inf",
+	};
+	char buf[64];
+	double d;
+	long double l;
+	int i;
+
+	for (i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+		check_decimal(numbers[i]);
+	}
+
+	/* Random mantissas and exponents on both sides of the fast path. */
+	srand(1);
+	for (i = 0; i < 200000; i++) {
+		unsigned long long m = ((unsigned long long)rand() << 31 ^ rand()) %
+			(i % 2 ? 10000000ULL : 10000000000000000000ULL);
+		int e = rand() % 60 - 30;
+		int frac = rand() % 12;
+
+		if (frac > 0) {
+			snprintf(buf, sizeof(buf), "%s%llu.%0*de%d", i % 3 ? "" : "-",
+				m, frac, rand() % 1000, e);
+		} else {
+			snprintf(buf, sizeof(buf), "%s%llue%d", i % 3 ? "" : "-", m, e);
+		}
+		check_decimal(buf);
+	}
+
+	/* Out of range and not numbers. */
+	assert(aws_dynamo_number_parse_double("1e400", 5, &d) == -1);
+	assert(aws_dynamo_number_parse_double("1e-400", 6, &d) == -1);
+	assert(aws_dynamo_number_parse_double("1.5x", 4, &d) == -1);
+	assert(aws_dynamo_number_parse_double("1.", 2, &d) == 0 && d == 1.0);
+	assert(aws_dynamo_number_parse_long_double("1e99999", 7, &l) == -1);
+	assert(aws_dynamo_number_parse_long_double("--1", 3, &l) == -1);
+
+	/* The number need not be terminated. */
+	assert(aws_dynamo_number_parse_double("2.5e1\"}", 5, &d) == 0 && d == 25.0);
+	assert(aws_dynamo_number_parse_double("2.5e1\"}", 3, &d) == 0 && d == 2.5);
+}
+
+int main(int argc, char *argv[])
+{
+	test_integers();
+	test_decimals();
+	return 0;
+}
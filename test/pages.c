@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "aws_dynamo.h"
+
+static struct aws_dynamo_attribute attributes[] = {
+	{
+		.type = AWS_DYNAMO_NUMBER,
+		.name = "id",
+		.name_len = 2,
+		.value.number.type = AWS_DYNAMO_NUMBER_INTEGER,
+	},
+};
+
+/* A page of @count items numbered from @first, Scan pages have a scanned
+   count. */
+static char *page_response(int first, int count, int last, int scan)
+{
+	char *response;
+	size_t size = 256 + (size_t)count * 32;
+	size_t n;
+	int i;
+
+	response = malloc(size);
+	assert(response != NULL);
+
+	n = snprintf(response, size, "{\"Count\":%d,\"Items\":[", count);
+	for (i = 0; i < count; i++) {
+		n += snprintf(response + n, size - n, "%s{\"id\":{\"N\":\"%d\"}}",
+			i == 0 ? "" : ",", first + i);
+	}
+	n += snprintf(response + n, size - n, "],");
+	if (scan) {
+		n += snprintf(response + n, size - n, "\"ScannedCount\":%d,", count + 1);
+	}
+	if (!last) {
+		n += snprintf(response + n, size - n,
+			"\"LastEvaluatedKey\":{\"HashKeyElement\":{\"N\":\"%d\"}},",
+			first + count - 1);
+	}
+	n += snprintf(response + n, size - n, "\"ConsumedCapacityUnits\":0.5}");
+	assert(n < size);
+
+	return response;
+}
+
+static int item_id(struct aws_dynamo_item *item)
+{
+	return *(item->attributes[0].value.number.value.integer_val);
+}
+
+static void check_pages(struct aws_dynamo_pages *pages, int num_items)
+{
+	struct aws_dynamo_pages_iter iter = AWS_DYNAMO_PAGES_ITER_INIT;
+	struct aws_dynamo_item *item;
+	int i = 0;
+
+	assert(pages->num_items == num_items);
+
+	while ((item = aws_dynamo_pages_next(pages, &iter)) != NULL) {
+		assert(item_id(item) == i);
+		i++;
+	}
+	assert(i == num_items);
+
+	for (i = 0; i < num_items; i++) {
+		assert(item_id(aws_dynamo_pages_item(pages, i)) == i);
+	}
+	assert(aws_dynamo_pages_item(pages, -1) == NULL);
+	assert(aws_dynamo_pages_item(pages, num_items) == NULL);
+}
+
+static void test_query_pages(void)
+{
+	struct aws_dynamo_pages pages = AWS_DYNAMO_PAGES_INIT;
+	int num_items = 0;
+	int page;
+
+	for (page = 0; page < 100; page++) {
+		struct aws_dynamo_query_response *r;
+		char *response;
+		/* Some pages are empty. */
+		int count = page % 7 == 3 ? 0 : page % 13 + 1;
+
+		response = page_response(num_items, count, page == 99, 0);
+		r = aws_dynamo_parse_query_response(response, strlen(response), attributes, 1);
+		assert(r != NULL);
+		free(response);
+
+		assert(aws_dynamo_pages_add_query(&pages, r) == 0);
+		num_items += count;
+
+		if (page < 99) {
+			assert(pages.hash_key != NULL);
+			assert(atoi(pages.hash_key->value) == num_items - 1);
+		}
+	}
+
+	assert(pages.num_pages == 100);
+	assert(pages.consumed_capacity_units == 50);
+	assert(pages.hash_key == NULL);
+	check_pages(&pages, num_items);
+
+	aws_dynamo_pages_free(&pages);
+	assert(pages.num_pages == 0 && pages.pages == NULL);
+	assert(aws_dynamo_pages_item(&pages, 0) == NULL);
+}
+
+static void test_scan_pages(void)
+{
+	struct aws_dynamo_pages pages = AWS_DYNAMO_PAGES_INIT;
+	struct aws_dynamo_pages_iter iter = AWS_DYNAMO_PAGES_ITER_INIT;
+	int num_items = 0;
+	int page;
+
+	for (page = 0; page < 20; page++) {
+		struct aws_dynamo_scan_response *r;
+		char *response;
+
+		response = page_response(num_items, 50, page == 19, 1);
+		r = aws_dynamo_parse_scan_response(response, strlen(response), attributes, 1);
+		assert(r != NULL);
+		free(response);
+
+		assert(aws_dynamo_pages_add_scan(&pages, r) == 0);
+		num_items += 50;
+
+		/* Iteration picks up pages added since it ran out. */
+		assert(aws_dynamo_pages_next(&pages, &iter) != NULL);
+		while (aws_dynamo_pages_next(&pages, &iter) != NULL) {
+		}
+	}
+
+	assert(pages.scanned_count == 20 * 51);
+	check_pages(&pages, num_items);
+	aws_dynamo_pages_free(&pages);
+}
+
+int main(int argc, char *argv[])
+{
+	test_query_pages();
+	test_scan_pages();
+	return 0;
+}
@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "aws_dynamo.h"
+#include "test_utils.h"
+
+#define PREPARED_THREADS	4
+#define PREPARED_REQUESTS	50
+
+static struct aws_dynamo_attribute attributes[] = {
+	{
+		.type = AWS_DYNAMO_STRING,
+		.name = "user",
+		.name_len = 4,
+	},
+	{
+		.type = AWS_DYNAMO_NUMBER,
+		.name = "id",
+		.name_len = 2,
+		.value.number.type = AWS_DYNAMO_NUMBER_INTEGER,
+	},
+};
+
+#define NUM_ATTRIBUTES	(sizeof(attributes) / sizeof(attributes[0]))
+
+/* A table name long enough for the prefix to span hash blocks. */
+#define TABLE "a_table_with_a_name_long_enough_to_take_more_than_one_hash_block"
+
+#define GET_ITEM "{\"TableName\":\"" TABLE "\",\"Key\":{\"HashKeyElement\":?," \
+	"\"RangeKeyElement\":?},\"AttributesToGet\":[\"user\",\"id\"]}"
+
+static void set_values(struct aws_dynamo_attribute *values, char *user,
+	aws_dynamo_integer_t *id)
+{
+	memset(values, 0, 2 * sizeof(*values));
+	values[0].type = AWS_DYNAMO_STRING;
+	values[0].value.string = user;
+	values[1].type = AWS_DYNAMO_NUMBER;
+	values[1].value.number.type = AWS_DYNAMO_NUMBER_INTEGER;
+	values[1].value.number.value.integer_val = id;
+}
+
+static void test_prepare(void)
+{
+	const char *bad[] = {
+		"",
+		"[?]",
+		"{\"a\":?",
+		"{?:{\"S\":\"x\"}}",
+		"{\"a\":? ?}",
+		"{\"a\":?} x",
+	};
+	struct aws_dynamo_prepared *p;
+	int i;
+
+	for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		assert(aws_dynamo_prepare_get_item(bad[i], attributes, NUM_ATTRIBUTES) == NULL);
+	}
+
+	p = aws_dynamo_prepare_get_item(GET_ITEM, attributes, NUM_ATTRIBUTES);
+	assert(p != NULL);
+	assert(aws_dynamo_prepared_num_values(p) == 2);
+	aws_dynamo_prepared_free(p);
+
+	/* A '?' in a string is not a placeholder. */
+	p = aws_dynamo_prepare_query(" {\"TableName\":\"?\\\"?\",\"HashKeyValue\":?} ",
+		attributes, NUM_ATTRIBUTES);
+	assert(p != NULL);
+	assert(aws_dynamo_prepared_num_values(p) == 1);
+	aws_dynamo_prepared_free(p);
+
+	p = aws_dynamo_prepare_update_item("{\"TableName\":\"t\"}", NULL, 0);
+	assert(p != NULL);
+	assert(aws_dynamo_prepared_num_values(p) == 0);
+	aws_dynamo_prepared_free(p);
+
+	aws_dynamo_prepared_free(NULL);
+}
+
+static void test_request(struct aws_handle *aws)
+{
+	struct aws_dynamo_attribute values[2];
+	struct aws_dynamo_prepared *p;
+	struct aws_dynamo_builder *b;
+	aws_dynamo_integer_t id;
+	char user[200];
+	char *expected;
+	char *hash;
+	const char *request;
+	int len;
+
+	p = aws_dynamo_prepare_get_item(GET_ITEM, attributes, NUM_ATTRIBUTES);
+	assert(p != NULL);
+
+	/* The same request as one written with the builder, at every
+	   alignment of the values with the hash blocks. */
+	for (len = 0; len < 150; len++) {
+		memset(user, 'u', len);
+		user[len] = '\0';
+		if (len > 3) {
+			user[len / 2] = '"';
+		}
+		id = len * 1000;
+		set_values(values, user, &id);
+
+		b = aws_dynamo_builder_get(aws);
+		aws_dynamo_builder_table(b, TABLE);
+		aws_dynamo_builder_key(b, AWS_DYNAMO_JSON_KEY, &(values[0]), &(values[1]));
+		aws_dynamo_builder_attributes_to_get(b, attributes, NUM_ATTRIBUTES);
+		request = aws_dynamo_builder_finish(b, NULL);
+		assert(request != NULL);
+		expected = strdup(request);
+		hash = strdup(aws_dynamo_builder_payload_hash(b, request));
+		assert(expected != NULL && hash != NULL);
+
+		request = aws_dynamo_prepared_request(aws, p, values, 2);
+		assert(request != NULL);
+		assert(strcmp(request, expected) == 0);
+		b = aws_dynamo_builder_get(aws);
+		request = aws_dynamo_prepared_request(aws, p, values, 2);
+		assert(strcmp(aws_dynamo_builder_payload_hash(b, request), hash) == 0);
+
+		free(expected);
+		free(hash);
+	}
+
+	/* Values must match the placeholders. */
+	assert(aws_dynamo_prepared_request(aws, p, values, 1) == NULL);
+	assert(aws_dynamo_prepared_request(aws, p, values, 3) == NULL);
+	values[0].value.string = NULL;
+	assert(aws_dynamo_prepared_request(aws, p, values, 2) == NULL);
+
+	aws_dynamo_prepared_free(p);
+}
+
+static int handler(const struct test_http_request *req, char **body, void *arg)
+{
+	char user[64];
+	int id;
+
+	/* Every request has the user and id given in the key, the response
+	   echoes them. */
+	if (sscanf(strstr(req->body, "{\"S\":\""), "{\"S\":\"%63[^\"]\"},", user) != 1 ||
+	    sscanf(strstr(req->body, "{\"N\":\""), "{\"N\":\"%d\"}", &id) != 1) {
+		return 400;
+	}
+
+	if (strstr(req->target, "GetItem") != NULL) {
+		assert(strstr(req->body, "\"AttributesToGet\":[\"user\",\"id\"]}") != NULL);
+		assert(asprintf(body, "{\"Item\":{\"user\":{\"S\":\"%s\"},\"id\":{\"N\":\"%d\"}},"
+			"\"ConsumedCapacityUnits\":0.5}", user, id) != -1);
+	} else if (strstr(req->target, "Query") != NULL) {
+		assert(asprintf(body, "{\"Count\":2,\"Items\":[{\"user\":{\"S\":\"%s\"},\"id\":{\"N\":\"%d\"}},"
+			"{\"user\":{\"S\":\"%s\"},\"id\":{\"N\":\"%d\"}}],\"ConsumedCapacityUnits\":1}",
+			user, id, user, id + 1) != -1);
+	} else if (strstr(req->target, "UpdateItem") != NULL) {
+		assert(strstr(req->body, "\"Action\":\"PUT\"") != NULL);
+		assert(asprintf(body, "{\"Attributes\":{\"user\":{\"S\":\"%s\"},\"id\":{\"N\":\"%d\"}},"
+			"\"ConsumedCapacityUnits\":1}", user, id) != -1);
+	} else {
+		return 400;
+	}
+
+	return 200;
+}
+
+struct prepared_thread {
+	struct aws_handle *aws;
+	struct aws_dynamo_prepared *p;
+	int n;
+};
+
+static void *prepared_thread(void *arg)
+{
+	struct prepared_thread *t = arg;
+	struct aws_dynamo_attribute values[2];
+	struct aws_dynamo_get_item_response *r;
+	aws_dynamo_integer_t id;
+	char user[32];
+	int i;
+
+	for (i = 0; i < PREPARED_REQUESTS; i++) {
+		snprintf(user, sizeof(user), "user%d", t->n);
+		id = t->n * PREPARED_REQUESTS + i;
+		set_values(values, user, &id);
+
+		r = aws_dynamo_prepared_get_item(t->aws, t->p, values, 2);
+		assert(r != NULL);
+		assert(r->item.num_attributes == NUM_ATTRIBUTES);
+		assert(strcmp(r->item.attributes[0].value.string, user) == 0);
+		assert(*(r->item.attributes[1].value.number.value.integer_val) == id);
+		aws_dynamo_free_get_item_response(r);
+	}
+
+	return NULL;
+}
+
+static void test_operations(struct aws_handle *aws)
+{
+	struct prepared_thread threads[PREPARED_THREADS];
+	pthread_t ids[PREPARED_THREADS];
+	struct aws_dynamo_attribute values[2];
+	struct aws_dynamo_prepared *get_item;
+	struct aws_dynamo_prepared *query;
+	struct aws_dynamo_prepared *update_item;
+	struct aws_dynamo_query_response *q;
+	struct aws_dynamo_update_item_response *u;
+	aws_dynamo_integer_t id = 41;
+	int i;
+
+	get_item = aws_dynamo_prepare_get_item(GET_ITEM, attributes, NUM_ATTRIBUTES);
+	query = aws_dynamo_prepare_query("{\"TableName\":\"t\",\"HashKeyValue\":?,"
+		"\"RangeKeyCondition\":{\"AttributeValueList\":[?],\"ComparisonOperator\":\"GT\"}}",
+		attributes, NUM_ATTRIBUTES);
+	update_item = aws_dynamo_prepare_update_item("{\"TableName\":\"t\",\"Key\":"
+		"{\"HashKeyElement\":?},\"AttributeUpdates\":{\"id\":{\"Value\":?,\"Action\":\"PUT\"}},"
+		"\"ReturnValues\":\"ALL_NEW\"}", attributes, NUM_ATTRIBUTES);
+	assert(get_item != NULL && query != NULL && update_item != NULL);
+
+	set_values(values, "jdoe", &id);
+
+	q = aws_dynamo_prepared_query(aws, query, values, 2);
+	assert(q != NULL);
+	assert(q->count == 2);
+	assert(strcmp(q->items[1].attributes[0].value.string, "jdoe") == 0);
+	assert(*(q->items[1].attributes[1].value.number.value.integer_val) == 42);
+	aws_dynamo_free_query_response(q);
+
+	u = aws_dynamo_prepared_update_item(aws, update_item, values, 2);
+	assert(u != NULL);
+	assert(u->num_attributes == NUM_ATTRIBUTES);
+	assert(*(u->attributes[1].value.number.value.integer_val) == 41);
+	aws_dynamo_free_update_item_response(u);
+
+	/* A request is only made as the operation it was prepared for. */
+	assert(aws_dynamo_prepared_get_item(aws, query, values, 2) == NULL);
+	assert(aws_dynamo_prepared_query(aws, update_item, values, 2) == NULL);
+	assert(aws_dynamo_prepared_update_item(aws, get_item, values, 2) == NULL);
+
+	/* Threads share a prepared request. */
+	for (i = 0; i < PREPARED_THREADS; i++) {
+		threads[i].aws = aws;
+		threads[i].p = get_item;
+		threads[i].n = i;
+		assert(pthread_create(&(ids[i]), NULL, prepared_thread, &(threads[i])) == 0);
+	}
+	for (i = 0; i < PREPARED_THREADS; i++) {
+		assert(pthread_join(ids[i], NULL) == 0);
+	}
+
+	aws_dynamo_prepared_free(get_item);
+	aws_dynamo_prepared_free(query);
+	aws_dynamo_prepared_free(update_item);
+}
+
+int main(int argc, char *argv[])
+{
+	struct aws_handle *aws;
+	int port;
+
+	signal(SIGPIPE, SIG_IGN);
+
+	port = test_http_server_start(handler, NULL);
+	aws = test_local_handle(port);
+
+	test_prepare();
+	test_request(aws);
+	test_operations(aws);
+
+	aws_deinit(aws);
+	return 0;
+}
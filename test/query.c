@@ -86,9 +86,57 @@ static void test_parse_query_response_network(void) {
 	test_aws_dynamo_parse_query_response("{\"ConsumedCapacityUnits\":0.5,\"Count\":1,\"Items\":[{\"defaultFlag\":{\"N\":\"0\"},\"portal\":{\"N\":\"0\"},\"serviceState\":{\"N\":\"3\"}}]}", attributes, sizeof(attributes) / sizeof(attributes[0]));
 }
 
+static void test_combine_query_responses(void) {
+	struct aws_dynamo_attribute attributes[] = {
+		{
+			.type = AWS_DYNAMO_NUMBER,
+			.name = "id",
+			.name_len = strlen("id"),
+			.value.number.type = AWS_DYNAMO_NUMBER_INTEGER,
+		},
+		{
+			.type = AWS_DYNAMO_STRING_SET,
+			.name = "tokens",
+			.name_len = strlen("tokens"),
+		},
+	};
+	const char *first = "{\"Count\":2,\"Items\":[{\"id\":{\"N\":\"0\"},\"tokens\":{\"SS\":[\"a\"]}},{\"id\":{\"N\":\"1\"}}],\"LastEvaluatedKey\":{\"HashKeyElement\":{\"N\":\"1\"}}}";
+	const char *second = "{\"Count\":1,\"Items\":[{\"id\":{\"N\":\"2\"},\"tokens\":{\"SS\":[\"b\",\"c\"]}}]}";
+	struct aws_dynamo_query_response *r;
+	struct aws_dynamo_query_response *next;
+	int i;
+
+	r = aws_dynamo_parse_query_response(first, strlen(first), attributes, 2);
+	assert(r != NULL);
+
+	/* Items are rows of one block of attributes. */
+	assert(r->num_attributes == 2);
+	for (i = 0; i < r->count; i++) {
+		assert(r->items[i].attributes == r->attributes + i * 2);
+	}
+
+	next = aws_dynamo_parse_query_response(second, strlen(second), attributes, 2);
+	assert(next != NULL);
+	r = aws_dynamo_query_combine_and_free_responses(r, next);
+	assert(r != NULL);
+	assert(r->count == 3);
+	assert(r->hash_key == NULL);
+	for (i = 0; i < r->count; i++) {
+		struct aws_dynamo_number *number = &(r->items[i].attributes[0].value.number);
+
+		assert(r->items[i].attributes == r->attributes + i * 2);
+		assert(aws_dynamo_number_get_integer(number) == i);
+	}
+	assert(r->items[0].attributes[1].value.string_set.num_strings == 1);
+	assert(r->items[1].attributes[1].value.string_set.num_strings == 0);
+	assert(strcmp(r->items[2].attributes[1].value.string_set.strings[1], "c") == 0);
+	aws_dynamo_free_query_response(r);
+}
+
 static void test_parse_query_response(void) {
 	test_parse_query_response_credential();
 	test_parse_query_response_network();
+	test_combine_query_responses();
 }
 
 int main(int argc, char *argv[]) {
@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "aws_dynamo.h"
+#include "aws_dynamo_limiter.h"
+#include "test_utils.h"
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int throttles = 2;
+
+static int handler(const struct test_http_request *req, char **response, void *arg)
+{
+	int throttle;
+
+	pthread_mutex_lock(&lock);
+	throttle = throttles > 0;
+	if (throttle)
+		throttles--;
+	pthread_mutex_unlock(&lock);
+
+	if (throttle) {
+		*response = strdup("{\"__type\":\"com.amazonaws.dynamodb.v20111205#ProvisionedThroughputExceededException\",\"message\":\"The level of configured provisioned throughput for the table was exceeded.\"}");
+		return 400;
+	}
+	*response = strdup("{\"Item\":{\"hash\":{\"N\":\"1\"}},\"ConsumedCapacityUnits\":0.5}");
+	return 200;
+}
+
+static void test_pacing(void)
+{
+	struct aws_dynamo_limiter *limiter;
+	long wait;
+	int i;
+
+	limiter = aws_dynamo_limiter_init(10, 0);
+	assert(limiter != NULL);
+
+	/* One request goes straight away, the next ten are 1/10 s apart. */
+	assert(aws_dynamo_limiter_acquire(limiter, "{\"TableName\": \"a\"}", &wait) == 0);
+	assert(wait == 0);
+	for (i = 1; i < 11; i++) {
+		assert(aws_dynamo_limiter_acquire(limiter, "{\"TableName\": \"a\"}", &wait) == 0);
+		assert(wait > (i - 1) * 100000 && wait <= i * 100000);
+	}
+
+	/* Other tables have buckets of their own. */
+	assert(aws_dynamo_limiter_acquire(limiter, "{\"TableName\":\"b\"}", &wait) == 0);
+	assert(wait == 0);
+
+	aws_dynamo_limiter_deinit(limiter);
+}
+
+static void test_release(void)
+{
+	struct aws_dynamo_limiter *limiter;
+	const char *body = "{\"TableName\":\"a\"}";
+	long wait;
+	long given_up;
+
+	limiter = aws_dynamo_limiter_init(10, 0);
+	assert(limiter != NULL);
+
+	assert(aws_dynamo_limiter_acquire(limiter, body, &wait) == 0);
+	assert(wait == 0);
+	assert(aws_dynamo_limiter_acquire(limiter, body, &given_up) == 0);
+	assert(given_up > 0);
+
+	/* The next request takes the slot of the one that gave up waiting. */
+	aws_dynamo_limiter_release(limiter, body);
+	assert(aws_dynamo_limiter_acquire(limiter, body, &wait) == 0);
+	assert(wait > 0 && wait <= given_up);
+
+	aws_dynamo_limiter_deinit(limiter);
+}
+
+static void test_tables(void)
+{
+	struct aws_dynamo_limiter *limiter;
+	long wait;
+
+	limiter = aws_dynamo_limiter_init(10, 0);
+	assert(limiter != NULL);
+
+	/* Only the top level TableName counts, not an attribute named so. */
+	assert(aws_dynamo_limiter_acquire(limiter, "{\"Item\":{\"TableName\":{\"S\":\"x\"}},"
+		"\"AttributesToGet\":[\"TableName\"],\"TableName\":\"a\"}", &wait) == 0);
+	assert(wait == 0);
+	assert(aws_dynamo_limiter_get_rate(limiter, "a") == 10);
+	assert(aws_dynamo_limiter_get_rate(limiter, "x") == -1);
+
+	/* A batch takes a slot from each of its tables and waits for "a". */
+	assert(aws_dynamo_limiter_acquire(limiter, "{\"RequestItems\":{"
+		"\"a\":{\"Keys\":[{\"TableName\":{\"S\":\"y\"}}]},\"b\":{\"Keys\":[]}}}", &wait) == 0);
+	assert(wait > 0 && wait <= 100000);
+	assert(aws_dynamo_limiter_get_rate(limiter, "b") == 10);
+	assert(aws_dynamo_limiter_get_rate(limiter, "y") == -1);
+	assert(aws_dynamo_limiter_get_rate(limiter, "") == -1);
+	assert(aws_dynamo_limiter_acquire(limiter, "{\"TableName\":\"b\"}", &wait) == 0);
+	assert(wait > 0 && wait <= 100000);
+
+	/* A throttled batch slows each of its tables down. */
+	aws_dynamo_limiter_update(limiter, "{\"RequestItems\":{\"a\":{},\"b\":{}}}", 1);
+	assert(aws_dynamo_limiter_get_rate(limiter, "a") == 5);
+	assert(aws_dynamo_limiter_get_rate(limiter, "b") == 5);
+
+	/* Requests that name no table share a bucket. */
+	assert(aws_dynamo_limiter_acquire(limiter, "{}", &wait) == 0);
+	assert(aws_dynamo_limiter_get_rate(limiter, "") == 10);
+
+	aws_dynamo_limiter_deinit(limiter);
+}
+
+static void test_aimd(void)
+{
+	struct aws_dynamo_limiter *limiter;
+	const char *body = "{\"TableName\":\"a\"}";
+	long wait;
+	int i;
+
+	limiter = aws_dynamo_limiter_init(8, 9);
+	assert(limiter != NULL);
+	assert(aws_dynamo_limiter_get_rate(limiter, "a") == -1);
+	assert(aws_dynamo_limiter_acquire(limiter, body, &wait) == 0);
+	assert(aws_dynamo_limiter_get_rate(limiter, "a") == 8);
+
+	/* Throttles in quick succession halve the rate once. */
+	aws_dynamo_limiter_update(limiter, body, 1);
+	aws_dynamo_limiter_update(limiter, body, 1);
+	assert(aws_dynamo_limiter_get_rate(limiter, "a") == 4);
+
+	aws_dynamo_limiter_update(limiter, body, 0);
+	assert(aws_dynamo_limiter_get_rate(limiter, "a") == 4.25);
+
+	for (i = 0; i < 1000; i++) {
+		aws_dynamo_limiter_update(limiter, body, 0);
+	}
+	assert(aws_dynamo_limiter_get_rate(limiter, "a") == 9);
+
+	aws_dynamo_limiter_deinit(limiter);
+}
+
+static void test_throttled_requests(struct aws_handle *aws)
+{
+	struct aws_dynamo_attribute attributes[] = {
+		{
+			.type = AWS_DYNAMO_NUMBER,
+			.name = "hash",
+			.name_len = strlen("hash"),
+			.value.number.type = AWS_DYNAMO_NUMBER_INTEGER,
+		},
+	};
+	struct aws_dynamo_get_item_response *r;
+
+	assert(aws_dynamo_set_rate_limit(aws, 8, 0) == 0);
+
+	r = aws_dynamo_get_item(aws,
+		"{\"TableName\":\"hot\",\"Key\":{\"HashKeyElement\":{\"N\":\"1\"}}}",
+		attributes, 1);
+	assert(r != NULL);
+	aws_dynamo_free_get_item_response(r);
+
+	/* Two throttles, at least one of them counted, then a success. */
+	assert(aws_dynamo_limiter_get_rate(aws->dynamo_limiter, "hot") < 8);
+
+	assert(aws_dynamo_set_rate_limit(aws, 0, 0) == 0);
+	assert(aws->dynamo_limiter == NULL);
+}
+
+#define PACED_REQUESTS 6
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void paced_done(struct aws_handle *aws,
+	const struct aws_dynamo_async_response *response, void *arg)
+{
+	int *done = arg;
+
+	assert(response->rv == 0);
+	(*done)++;
+}
+
+static void test_paced_async_requests(struct aws_handle *aws)
+{
+	long long start;
+	int done = 0;
+	int i;
+
+	assert(aws_dynamo_set_rate_limit(aws, 10, 0) == 0);
+
+	/* Submitting does not wait, the requests past the first wait on
+	   timers 1/10 s apart. */
+	start = now_ms();
+	for (i = 0; i < PACED_REQUESTS; i++) {
+		assert(aws_dynamo_request_async(aws, AWS_DYNAMO_GET_ITEM,
+			"{\"TableName\":\"paced\",\"Key\":{\"HashKeyElement\":{\"N\":\"1\"}}}",
+			paced_done, &done) == 0);
+	}
+	assert(now_ms() - start < 100);
+	assert(aws_async_pending(aws) == PACED_REQUESTS);
+
+	while (aws_async_perform(aws, 100) > 0)
+		;
+
+	assert(done == PACED_REQUESTS);
+	assert(now_ms() - start >= (PACED_REQUESTS - 2) * 100);
+
+	assert(aws_dynamo_set_rate_limit(aws, 0, 0) == 0);
+}
+
+int main(int argc, char *argv[])
+{
+	struct aws_handle *aws;
+	int port;
+
+	test_pacing();
+	test_release();
+	test_tables();
+	test_aimd();
+
+	port = test_http_server_start(handler, NULL);
+	aws = test_local_handle(port);
+
+	test_throttled_requests(aws);
+	test_paced_async_requests(aws);
+
+	aws_deinit(aws);
+	return 0;
+}
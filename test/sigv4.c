@@ -21,6 +21,7 @@
 #include <string.h>
 #include <assert.h>
 
+#include "http.h"
 #include "aws_sigv4.h"
 
 void test_aws_sigv4_create_hashed_canonical_request(void) {
@@ -78,11 +79,87 @@ void test_aws_sigv4_create_signature() {
 	free(sig);
 }
 
+void test_aws_sigv4_get_signing_key() {
+	struct aws_sigv4_key_cache cache;
+	const unsigned char *key;
+	const unsigned char *other;
+	unsigned char *derived;
+	int derived_len;
+	char *sig;
+
+	memset(&cache, 0, sizeof(cache));
+
+	key = aws_sigv4_get_signing_key(&cache,
+		"wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY",
+		"20110909", "us-east-1", "iam");
+	assert(key != NULL);
+	assert(aws_sigv4_derive_signing_key(
+		"wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY",
+		"20110909", "us-east-1", "iam", &derived, &derived_len) == 0);
+	assert(derived_len == AWS_SIGV4_KEY_LEN);
+	assert(memcmp(key, derived, AWS_SIGV4_KEY_LEN) == 0);
+	free(derived);
+
+	/* A second lookup is served from the cache. */
+	assert(aws_sigv4_get_signing_key(&cache,
+		"wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY",
+		"20110909", "us-east-1", "iam") == key);
+
+	sig = aws_sigv4_create_signature_with_key(key,
+		"AWS4-HMAC-SHA256\n20110909T233600Z\n20110909/us-east-1/iam/aws4_request\n3511de7e95d28ecd39e9513b642aee07e54f4941150d8df8bf94b328ef7e55e2");
+	assert(strcmp(sig, "ced6826de92d2bdeed8f846f0bf508e8559e98e4b0199114b84c54174deb456c") == 0);
+	free(sig);
+
+	/* A new day or new credentials give a new key. */
+	other = aws_sigv4_get_signing_key(&cache,
+		"wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY",
+		"20110910", "us-east-1", "iam");
+	assert(other != NULL && other != key);
+	assert(memcmp(other, key, AWS_SIGV4_KEY_LEN) != 0);
+	other = aws_sigv4_get_signing_key(&cache,
+		"AnotherSecretKey",
+		"20110909", "us-east-1", "iam");
+	assert(other != NULL && other != key);
+	assert(memcmp(other, key, AWS_SIGV4_KEY_LEN) != 0);
+}
+
+void test_aws_sigv4_sign() {
+	struct http_header hdrs[] = {
+		{ .name = "content-type", .value = "application/x-www-form-urlencoded; charset=utf-8" },
+		{ .name = "host", .value = "iam.amazonaws.com" },
+		{ .name = "x-amz-date", .value = "20110909T233600Z" },
+	};
+	struct http_headers headers = {
+		.count = 3,
+		.entries = hdrs,
+	};
+	const char *payload = "Action=ListUsers&Version=2010-05-08";
+	char hashed_canonical_request[AWS_SIGV4_HEX_LEN + 1];
+	char signature[AWS_SIGV4_HEX_LEN + 1];
+	unsigned char *key;
+	int key_len;
+
+	assert(aws_sigv4_hash_canonical_request("POST", "/", "", &headers,
+		"content-type;host;x-amz-date", payload, strlen(payload),
+		hashed_canonical_request) == 0);
+	assert(strcmp(hashed_canonical_request, "3511de7e95d28ecd39e9513b642aee07e54f4941150d8df8bf94b328ef7e55e2") == 0);
+
+	assert(aws_sigv4_derive_signing_key(
+		"wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY",
+		"20110909", "us-east-1", "iam", &key, &key_len) == 0);
+	assert(aws_sigv4_sign(key, "20110909T233600Z", "20110909", "us-east-1",
+		"iam", hashed_canonical_request, signature) == 0);
+	assert(strcmp(signature, "ced6826de92d2bdeed8f846f0bf508e8559e98e4b0199114b84c54174deb456c") == 0);
+	free(key);
+}
+
 int main(int argc, char *argv[]) {
 	test_aws_sigv4_create_hashed_canonical_request();
 	test_aws_sigv4_create_string_to_sign();
 	test_aws_sigv4_derive_signing_key();
 	test_aws_sigv4_create_signature();
+	test_aws_sigv4_get_signing_key();
+	test_aws_sigv4_sign();
 	return 0;
 }
 
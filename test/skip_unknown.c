@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <assert.h>
+
+#include "aws_dynamo.h"
+#include "test_utils.h"
+
+#define SKIP_ITEMS	40
+
+/* A template with two of the attributes of the items. */
+static struct aws_dynamo_attribute attributes[] = {
+	{
+		.type = AWS_DYNAMO_NUMBER,
+		.name = "id",
+		.name_len = 2,
+		.value.number.type = AWS_DYNAMO_NUMBER_INTEGER,
+	},
+	{
+		.type = AWS_DYNAMO_STRING,
+		.name = "name",
+		.name_len = 4,
+	},
+};
+
+#define NUM_ATTRIBUTES	(sizeof(attributes) / sizeof(attributes[0]))
+
+/* A key new to the parsers, its value holds every kind of JSON value and
+   strings that look like structure. */
+#define EXTRA "\"Extra\":{\"a\":[1,{\"b\":\"}]\\\\\\\"{\"},true,null,-2.5e3,[[]]]," \
+	"\"c\":{},\"d\":\"\"}"
+
+static size_t add_item(char *buf, size_t size, int id)
+{
+	return snprintf(buf, size, "{\"blob\":{\"SS\":[\"{\\\"x\\\"}\",\"]\"]},"
+		"\"id\":{\"N\":\"%d\"},\"extra\":{\"N\":\"1\"},\"name\":{\"S\":\"n%d\"},"
+		"\"more\":{\"M\":{\"a\":{\"L\":[{\"BOOL\":true},{\"NULL\":true},{\"S\":\"}\"}]}}}}",
+		id, id);
+}
+
+static size_t add_items(char *buf, size_t size, int count)
+{
+	size_t n = 0;
+	int i;
+
+	n += snprintf(buf + n, size - n, "[");
+	for (i = 0; i < count; i++) {
+		if (i > 0) {
+			n += snprintf(buf + n, size - n, ",");
+		}
+		n += add_item(buf + n, size - n, i);
+	}
+	n += snprintf(buf + n, size - n, "]");
+
+	return n;
+}
+
+static char *response(const char *target)
+{
+	size_t size = 1024 + SKIP_ITEMS * 256;
+	char *buf;
+	size_t n = 0;
+
+	buf = malloc(size);
+	assert(buf != NULL);
+
+	if (strstr(target, "BatchGetItem") != NULL) {
+		n += snprintf(buf + n, size - n, "{\"Responses\":{\"other\":{\"Items\":");
+		n += add_items(buf + n, size - n, 1);
+		n += snprintf(buf + n, size - n, ",\"ConsumedCapacityUnits\":1},\"t\":{\"Items\":");
+		n += add_items(buf + n, size - n, SKIP_ITEMS);
+		n += snprintf(buf + n, size - n, ",\"ConsumedCapacityUnits\":1,\"New\":{\"x\":1}}},"
+			EXTRA "}");
+	} else if (strstr(target, "GetItem") != NULL) {
+		n += snprintf(buf + n, size - n, "{" EXTRA ",\"Item\":");
+		n += add_item(buf + n, size - n, 1);
+		n += snprintf(buf + n, size - n, ",\"ConsumedCapacityUnits\":1,\"Version\":2}");
+	} else if (strstr(target, "20120810") != NULL) {
+		n += snprintf(buf + n, size - n, "{\"Count\":%d,\"Items\":", SKIP_ITEMS);
+		n += add_items(buf + n, size - n, SKIP_ITEMS);
+		n += snprintf(buf + n, size - n, ",\"ScannedCount\":%d,\"ConsumedCapacity\":"
+			"{\"TableName\":\"t\",\"CapacityUnits\":1,\"New\":{\"x\":[1]}}," EXTRA "}",
+			SKIP_ITEMS);
+	} else {
+		n += snprintf(buf + n, size - n, "{" EXTRA ",\"Count\":%d,\"Items\":", SKIP_ITEMS);
+		n += add_items(buf + n, size - n, SKIP_ITEMS);
+		n += snprintf(buf + n, size - n, ",\"ScannedCount\":%d,\"Note\":\"x\","
+			"\"ConsumedCapacityUnits\":0.5,\"Tail\":[],\"Version\":2}", SKIP_ITEMS);
+	}
+	assert(n < size);
+
+	return buf;
+}
+
+static int handler(const struct test_http_request *req, char **body, void *arg)
+{
+	*body = response(req->target);
+	return 200;
+}
+
+static void check_item(struct aws_dynamo_item *item, int id)
+{
+	char buf[16];
+
+	snprintf(buf, sizeof(buf), "n%d", id);
+	assert(item->num_attributes == NUM_ATTRIBUTES);
+	assert(*(item->attributes[0].value.number.value.integer_val) == id);
+	assert(strcmp(item->attributes[1].value.string, buf) == 0);
+}
+
+static void check_lazy_items(struct aws_dynamo_lazy_items *items)
+{
+	int i;
+
+	assert(items->num_items == SKIP_ITEMS);
+	for (i = 0; i < SKIP_ITEMS; i++) {
+		struct aws_dynamo_item item = {
+			.num_attributes = NUM_ATTRIBUTES,
+		};
+
+		item.attributes = aws_dynamo_lazy_attribute(items, i, 0);
+		assert(item.attributes != NULL);
+		assert(aws_dynamo_lazy_attribute(items, i, 1) != NULL);
+		check_item(&item, i);
+	}
+}
+
+static int foreach_item(struct aws_dynamo_item *item, void *arg)
+{
+	int *num_items = arg;
+
+	check_item(item, (*num_items)++);
+	return 0;
+}
+
+static void test_skip_unknown(struct aws_handle *aws)
+{
+	struct aws_dynamo_batch_get_item_response_table tables[] = {
+		{
+			.name = "t",
+			.name_len = 1,
+			.attributes = attributes,
+			.num_attributes = NUM_ATTRIBUTES,
+		},
+	};
+	struct aws_dynamo_scan_response *scan;
+	struct aws_dynamo_get_item_response *get;
+	struct aws_dynamo_batch_get_item_response *batch;
+	struct aws_dynamo_lazy_response *lazy;
+	struct aws_dynamo_lazy_batch_get_item_response *lazy_batch;
+	struct aws_dynamo_columns *c;
+	struct aws_dynamo_v2_response *v2;
+	int num_items = 0;
+	int i;
+
+	scan = aws_dynamo_scan(aws, "{\"TableName\":\"t\"}", attributes, NUM_ATTRIBUTES);
+	assert(scan != NULL);
+	assert(scan->count == SKIP_ITEMS && scan->scanned_count == SKIP_ITEMS);
+	assert(scan->consumed_capacity_units == 0.5);
+	for (i = 0; i < SKIP_ITEMS; i++) {
+		check_item(&(scan->items[i]), i);
+	}
+	aws_dynamo_free_scan_response(scan);
+
+	get = aws_dynamo_get_item(aws, "{\"TableName\":\"t\"}", attributes, NUM_ATTRIBUTES);
+	assert(get != NULL);
+	assert(get->consumed_capacity_units == 1);
+	check_item(&(get->item), 1);
+	aws_dynamo_free_get_item_response(get);
+
+	batch = aws_dynamo_batch_get_item(aws, "{}", tables, 1);
+	assert(batch != NULL);
+	assert(batch->num_tables == 1 && batch->tables[0].num_items == SKIP_ITEMS);
+	for (i = 0; i < SKIP_ITEMS; i++) {
+		check_item(&(batch->tables[0].items[i]), i);
+	}
+	aws_dynamo_free_batch_get_item_response(batch);
+
+	lazy = aws_dynamo_scan_lazy(aws, "{\"TableName\":\"t\"}", attributes, NUM_ATTRIBUTES);
+	assert(lazy != NULL);
+	check_lazy_items(&(lazy->items));
+	aws_dynamo_free_lazy_response(lazy);
+
+	lazy_batch = aws_dynamo_batch_get_item_lazy(aws, "{}", tables, 1);
+	assert(lazy_batch != NULL && lazy_batch->num_tables == 1);
+	check_lazy_items(&(lazy_batch->tables[0].items));
+	aws_dynamo_free_lazy_batch_get_item_response(lazy_batch);
+
+	c = aws_dynamo_scan_columns(aws, "{\"TableName\":\"t\"}", attributes, NUM_ATTRIBUTES);
+	assert(c != NULL);
+	assert(c->count == SKIP_ITEMS && c->num_columns == NUM_ATTRIBUTES);
+	for (i = 0; i < SKIP_ITEMS; i++) {
+		assert(AWS_DYNAMO_COLUMN_VALID(&(c->columns[0]), i));
+		assert(c->columns[0].integers[i] == i);
+		assert(AWS_DYNAMO_COLUMN_VALID(&(c->columns[1]), i));
+	}
+	aws_dynamo_free_columns(c);
+
+	assert(aws_dynamo_scan_foreach(aws, "{\"TableName\":\"t\"}", attributes,
+		NUM_ATTRIBUTES, foreach_item, &num_items) == 0);
+	assert(num_items == SKIP_ITEMS);
+
+	v2 = aws_dynamo_v2_query(aws, "{\"TableName\":\"t\"}", attributes, NUM_ATTRIBUTES);
+	assert(v2 != NULL);
+	assert(v2->num_items == SKIP_ITEMS);
+	for (i = 0; i < SKIP_ITEMS; i++) {
+		check_item(&(v2->items[i]), i);
+	}
+	assert(v2->consumed_capacity != NULL);
+	assert(strcmp(v2->consumed_capacity->table_name, "t") == 0);
+	assert(v2->consumed_capacity->total.capacity_units == 1);
+	aws_dynamo_v2_free_response(v2);
+}
+
+static void test_requests(void)
+{
+	int flags[] = {
+		AWS_DYNAMO_PARSE_SKIP_UNKNOWN,
+		AWS_DYNAMO_PARSE_SKIP_UNKNOWN | AWS_DYNAMO_PARSE_STREAM,
+		AWS_DYNAMO_PARSE_SKIP_UNKNOWN | AWS_DYNAMO_PARSE_BORROW,
+	};
+	struct aws_handle *aws;
+	int port;
+	int i;
+
+	port = test_http_server_start(handler, NULL);
+	aws = test_local_handle(port);
+
+	/* Without the flag unknown keys fail the response. */
+	assert(aws_dynamo_scan(aws, "{\"TableName\":\"t\"}", attributes, NUM_ATTRIBUTES) == NULL);
+	aws_dynamo_set_parse_flags(aws, AWS_DYNAMO_PARSE_STREAM);
+	assert(aws_dynamo_scan(aws, "{\"TableName\":\"t\"}", attributes, NUM_ATTRIBUTES) == NULL);
+
+	for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+		aws_dynamo_set_parse_flags(aws, flags[i]);
+		test_skip_unknown(aws);
+	}
+
+	aws_deinit(aws);
+}
+
+int main(int argc, char *argv[])
+{
+	signal(SIGPIPE, SIG_IGN);
+
+	test_requests();
+	return 0;
+}
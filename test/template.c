@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "aws_dynamo.h"
+#include "aws_dynamo_scan.h"
+#include "aws_dynamo_template.h"
+
+/* More attributes than fit in the inline hash table. */
+#define MAX_ATTRIBUTES	100
+
+static char names[MAX_ATTRIBUTES][16];
+
+static void make_attributes(struct aws_dynamo_attribute *attributes, int n)
+{
+	int i;
+
+	memset(attributes, 0, sizeof(*attributes) * n);
+	for (i = 0; i < n; i++) {
+		snprintf(names[i], sizeof(names[i]), "attr%d", i);
+		attributes[i].name = names[i];
+		attributes[i].name_len = strlen(names[i]);
+		if (i % 2) {
+			attributes[i].type = AWS_DYNAMO_STRING;
+		} else {
+			attributes[i].type = AWS_DYNAMO_NUMBER;
+			attributes[i].value.number.type = AWS_DYNAMO_NUMBER_INTEGER;
+		}
+	}
+}
+
+static void test_lookup(int n)
+{
+	struct aws_dynamo_attribute attributes[MAX_ATTRIBUTES];
+	struct aws_dynamo_template t;
+	int i;
+
+	make_attributes(attributes, n);
+	aws_dynamo_template_init(&t, attributes, n);
+
+	for (i = 0; i < n; i++) {
+		assert(aws_dynamo_template_lookup(&t, names[i], strlen(names[i])) == i);
+		assert(aws_dynamo_template_check_type(&t, i, i % 2 ? "S" : "N", 1));
+		assert(!aws_dynamo_template_check_type(&t, i, i % 2 ? "N" : "S", 1));
+		assert(!aws_dynamo_template_check_type(&t, i, i % 2 ? "SS" : "NS", 2));
+	}
+
+	/* Prefixes and other near misses. */
+	assert(aws_dynamo_template_lookup(&t, "attr", 4) == -1);
+	assert(aws_dynamo_template_lookup(&t, "attr1", 4) == -1);
+	assert(aws_dynamo_template_lookup(&t, "attr1000", 8) == -1);
+	assert(aws_dynamo_template_lookup(&t, "", 0) == -1);
+
+	aws_dynamo_template_deinit(&t);
+}
+
+static void test_duplicates(void)
+{
+	struct aws_dynamo_attribute attributes[MAX_ATTRIBUTES];
+	struct aws_dynamo_template t;
+
+	/* The first attribute of a name wins, as with a linear search. */
+	make_attributes(attributes, 20);
+	attributes[15].name = attributes[3].name;
+	attributes[15].name_len = attributes[3].name_len;
+	aws_dynamo_template_init(&t, attributes, 20);
+	assert(aws_dynamo_template_lookup(&t, "attr3", 5) == 3);
+	assert(aws_dynamo_template_lookup(&t, "attr15", 6) == -1);
+	aws_dynamo_template_deinit(&t);
+}
+
+static void test_wide_items(void)
+{
+	struct aws_dynamo_attribute attributes[MAX_ATTRIBUTES];
+	struct aws_dynamo_scan_response *r;
+	char response[16384];
+	int len;
+	int i;
+	int j;
+
+	make_attributes(attributes, 40);
+
+	len = snprintf(response, sizeof(response), "{\"Count\":2,\"Items\":[");
+	for (i = 0; i < 2; i++) {
+		len += snprintf(response + len, sizeof(response) - len, "%s{", i ? "," : "");
+		/* Attributes in reverse order of the template. */
+		for (j = 39; j >= 0; j--) {
+			len += snprintf(response + len, sizeof(response) - len,
+				"\"attr%d\":{\"%s\":\"%d\"}%s", j, j % 2 ? "S" : "N",
+				i * 100 + j, j ? "," : "");
+		}
+		len += snprintf(response + len, sizeof(response) - len, "}");
+	}
+	len += snprintf(response + len, sizeof(response) - len,
+		"],\"ScannedCount\":2,\"ConsumedCapacityUnits\":0.5}");
+
+	r = aws_dynamo_parse_scan_response(response, len, attributes, 40);
+	assert(r != NULL);
+	assert(r->count == 2);
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < 40; j++) {
+			struct aws_dynamo_attribute *a = &(r->items[i].attributes[j]);
+
+			if (j % 2) {
+				assert(atoi(a->value.string) == i * 100 + j);
+			} else {
+				assert(*a->value.number.value.integer_val == i * 100 + j);
+			}
+		}
+	}
+	aws_dynamo_free_scan_response(r);
+
+	/* A type that does not match the template fails the parse. */
+	response[strstr(response, "\"attr39\":{\"S\"") - response + 11] = 'N';
+	r = aws_dynamo_parse_scan_response(response, len, attributes, 40);
+	assert(r == NULL);
+}
+
+int main(int argc, char *argv[])
+{
+	test_lookup(1);
+	test_lookup(AWS_DYNAMO_TEMPLATE_LINEAR);
+	test_lookup(AWS_DYNAMO_TEMPLATE_LINEAR + 1);
+	test_lookup(40);
+	test_lookup(MAX_ATTRIBUTES);
+	test_duplicates();
+	test_wide_items();
+	return 0;
+}
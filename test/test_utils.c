@@ -23,8 +23,15 @@
 #include <string.h>
 #include <unistd.h>
 #include <assert.h>
+#include <pthread.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
 
 #include "aws_dynamo.h"
+#include "test_utils.h"
 
 int aws_dynamo_item_snprintf(char *buf, size_t buflen, struct aws_dynamo_attribute *attributes,
 	int num_attributes) {
@@ -275,4 +282,266 @@ void create_test_table(struct aws_handle *aws_dynamo, const char *table_name,
 
 }
 
+struct test_http_server {
+	int fd;
+	test_http_handler handler;
+	void *arg;
+};
 
+struct test_http_conn {
+	struct test_http_server *server;
+	int fd;
+};
+
+/* See test_http_server_set_chunking(). */
+static pthread_mutex_t test_http_chunk_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t test_http_chunk;
+static size_t test_http_cut;
+
+void test_http_server_set_chunking(size_t chunk, size_t cut)
+{
+	pthread_mutex_lock(&test_http_chunk_lock);
+	test_http_chunk = chunk;
+	test_http_cut = cut;
+	pthread_mutex_unlock(&test_http_chunk_lock);
+}
+
+static const char *test_http_header(char *headers, const char *name)
+{
+	size_t name_len = strlen(name);
+	char *line;
+
+	for (line = strstr(headers, "\r\n"); line != NULL; line = strstr(line, "\r\n")) {
+		line += 2;
+		if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':') {
+			line += name_len + 1;
+			while (*line == ' ')
+				line++;
+			return line;
+		}
+	}
+	return NULL;
+}
+
+static int test_http_write_all(int fd, const char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+
+		if (n <= 0)
+			return -1;
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* Write a response body as test_http_server_set_chunking() asks for.
+   Returns -1 if the connection is to be closed. */
+static int test_http_write_body(int fd, const char *buf, size_t len)
+{
+	size_t chunk, cut;
+
+	pthread_mutex_lock(&test_http_chunk_lock);
+	chunk = test_http_chunk;
+	cut = test_http_cut;
+	test_http_cut = 0;
+	pthread_mutex_unlock(&test_http_chunk_lock);
+
+	if (cut > 0 && cut < len)
+		len = cut;
+	else
+		cut = 0;
+
+	while (chunk > 0 && len > chunk) {
+		if (test_http_write_all(fd, buf, chunk) == -1)
+			return -1;
+		buf += chunk;
+		len -= chunk;
+		usleep(1000);
+	}
+
+	if (test_http_write_all(fd, buf, len) == -1 || cut > 0)
+		return -1;
+	return 0;
+}
+
+static void *test_http_conn_thread(void *p)
+{
+	struct test_http_conn *conn = p;
+	size_t size = 65536, used = 0;
+	char *buf = malloc(size);
+
+	assert(buf != NULL);
+
+	for (;;) {
+		struct test_http_request req;
+		char method[16], path[1024], target[256];
+		char *end, *response = NULL, *header;
+		const char *value;
+		size_t head_len, body_len = 0, response_len;
+		int code, close_conn;
+
+		/* Read the request head. */
+		while ((end = memmem(buf, used, "\r\n\r\n", 4)) == NULL) {
+			ssize_t n;
+
+			if (used + 1 >= size) {
+				size *= 2;
+				buf = realloc(buf, size);
+				assert(buf != NULL);
+			}
+			n = read(conn->fd, buf + used, size - used - 1);
+			if (n <= 0)
+				goto done;
+			used += n;
+		}
+		*end = '\0';
+		head_len = end - buf + 4;
+
+		if (sscanf(buf, "%15s %1023s", method, path) != 2)
+			goto done;
+
+		if ((value = test_http_header(buf, "content-length")) != NULL)
+			body_len = strtoul(value, NULL, 10);
+
+		target[0] = '\0';
+		if ((value = test_http_header(buf, "x-amz-target")) != NULL)
+			sscanf(value, "%255[^\r]", target);
+
+		value = test_http_header(buf, "connection");
+		close_conn = value != NULL && strncasecmp(value, "close", 5) == 0;
+
+		/* Read the request body. */
+		while (used < head_len + body_len) {
+			ssize_t n;
+
+			if (head_len + body_len + 1 > size) {
+				size = head_len + body_len + 1;
+				buf = realloc(buf, size);
+				assert(buf != NULL);
+			}
+			n = read(conn->fd, buf + used, size - used - 1);
+			if (n <= 0)
+				goto done;
+			used += n;
+		}
+
+		{
+			char body[body_len + 1];
+
+			memcpy(body, buf + head_len, body_len);
+			body[body_len] = '\0';
+
+			req.method = method;
+			req.path = path;
+			req.target = target;
+			req.body = body;
+
+			code = conn->server->handler(&req, &response, conn->server->arg);
+		}
+
+		response_len = response ? strlen(response) : 0;
+		assert(asprintf(&header, "HTTP/1.1 %d %s\r\n"
+			"Content-Type: application/x-amz-json-1.0\r\n"
+			"Content-Length: %zu\r\n"
+			"%s"
+			"\r\n", code, code == 200 ? "OK" : "Error", response_len,
+			close_conn ? "Connection: close\r\n" : "") != -1);
+
+		if (test_http_write_all(conn->fd, header, strlen(header)) == -1 ||
+		    test_http_write_body(conn->fd, response ? response : "", response_len) == -1) {
+			free(header);
+			free(response);
+			goto done;
+		}
+		free(header);
+		free(response);
+
+		/* Keep anything the client already sent for the next request. */
+		memmove(buf, buf + head_len + body_len, used - head_len - body_len);
+		used -= head_len + body_len;
+
+		if (close_conn)
+			goto done;
+	}
+
+done:
+	close(conn->fd);
+	free(buf);
+	free(conn);
+	return NULL;
+}
+
+static void *test_http_accept_thread(void *p)
+{
+	struct test_http_server *server = p;
+
+	for (;;) {
+		struct test_http_conn *conn;
+		pthread_t thread;
+		int fd;
+
+		fd = accept(server->fd, NULL, NULL);
+		if (fd < 0)
+			continue;
+
+		conn = malloc(sizeof(*conn));
+		assert(conn != NULL);
+		conn->server = server;
+		conn->fd = fd;
+
+		/* Chunks go out as they are written. */
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &(int){ 1 }, sizeof(int));
+
+		assert(pthread_create(&thread, NULL, test_http_conn_thread, conn) == 0);
+		pthread_detach(thread);
+	}
+	return NULL;
+}
+
+int test_http_server_start(test_http_handler handler, void *arg)
+{
+	struct test_http_server *server;
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	pthread_t thread;
+
+	server = calloc(1, sizeof(*server));
+	assert(server != NULL);
+	server->handler = handler;
+	server->arg = arg;
+
+	server->fd = socket(AF_INET, SOCK_STREAM, 0);
+	assert(server->fd >= 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+
+	assert(bind(server->fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	assert(listen(server->fd, 128) == 0);
+	assert(getsockname(server->fd, (struct sockaddr *)&addr, &addr_len) == 0);
+
+	assert(pthread_create(&thread, NULL, test_http_accept_thread, server) == 0);
+	pthread_detach(thread);
+
+	return ntohs(addr.sin_port);
+}
+
+struct aws_handle *test_local_handle(int port)
+{
+	struct aws_handle *aws;
+
+	setenv("AWS_ACCESS_KEY_ID", "AKIDEXAMPLE", 1);
+	setenv("AWS_SECRET_ACCESS_KEY", "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY", 1);
+
+	aws = aws_init(NULL, NULL);
+	assert(aws != NULL);
+	aws_dynamo_set_https(aws, 0);
+	assert(aws_dynamo_set_endpoint(aws, "127.0.0.1", "us-east-1") == 0);
+	aws_dynamo_set_port(aws, port);
+
+	return aws;
+}
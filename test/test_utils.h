@@ -31,6 +31,60 @@ void wait_for_table(struct aws_handle *aws_dynamo, const char *table_name);
 void create_test_table(struct aws_handle *aws_dynamo, const char *table_name,
 		       const char *hash_key_type, const char *range_key_type);
 
+/**
+ * struct test_http_request - a request received by the local test server
+ * @method: request method, "GET" or "POST"
+ * @path: request path
+ * @target: value of the x-amz-target header, "" if not present
+ * @body: request body, "" if there is none
+ */
+struct test_http_request {
+	const char *method;
+	const char *path;
+	const char *target;
+	const char *body;
+};
+
+/**
+ * test_http_handler - produce the response to a request
+ * @req: the request
+ * @response: allocated response body (out), may be left NULL
+ * @arg: argument given to test_http_server_start()
+ * Returns: HTTP status code of the response
+ *
+ * Handlers are called concurrently from one thread per connection.
+ */
+typedef int (*test_http_handler)(const struct test_http_request *req,
+				 char **response, void *arg);
+
+/**
+ * test_http_server_start - start a stand-in HTTP server on the loopback
+ * @handler: function called for every request
+ * @arg: argument passed to @handler
+ * Returns: TCP port the server listens on
+ *
+ * The server runs in background threads until the process exits.
+ */
+int test_http_server_start(test_http_handler handler, void *arg);
+
+/**
+ * test_http_server_set_chunking - have response bodies arrive in pieces
+ * @chunk: bytes of a body written at a time with a short pause between
+ *	   writes, 0 to write bodies in one go
+ * @cut: bytes of the next body to write before closing the connection,
+ *	 0 to write it whole; only one body is cut short
+ *
+ * Applies to every server of the process.
+ */
+void test_http_server_set_chunking(size_t chunk, size_t cut);
+
+/**
+ * test_local_handle - create a handle that talks to the local test server
+ * @port: port returned by test_http_server_start()
+ * Returns: library handle using static test credentials
+ */
+struct aws_handle *test_local_handle(int port);
+
 #ifdef  __cplusplus
 }
 #endif
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "aws_dynamo.h"
+#include "test_utils.h"
+
+#define NUM_THREADS 64
+#define NUM_REQUESTS 20
+
+static int handler(const struct test_http_request *req, char **response, void *arg)
+{
+	int hash;
+
+	if (strstr(req->body, "missing_table") != NULL) {
+		*response = strdup("{\"__type\":\"com.amazonaws.dynamodb.v20111205#ResourceNotFoundException\",\"message\":\"Requested resource not found\"}");
+		return 400;
+	}
+
+	assert(sscanf(req->body, "{\"TableName\":\"test\",\"Key\":{\"HashKeyElement\":{\"N\":\"%d\"}}}", &hash) == 1);
+	assert(asprintf(response, "{\"Item\":{\"hash\":{\"N\":\"%d\"}},\"ConsumedCapacityUnits\":0.5}", hash) != -1);
+	return 200;
+}
+
+struct thread_arg {
+	struct aws_handle *aws;
+	int id;
+};
+
+static void *thread_main(void *p)
+{
+	struct thread_arg *arg = p;
+	struct aws_dynamo_attribute attributes[] = {
+		{
+			.type = AWS_DYNAMO_NUMBER,
+			.name = "hash",
+			.name_len = strlen("hash"),
+			.value.number.type = AWS_DYNAMO_NUMBER_INTEGER,
+		},
+	};
+	int i;
+
+	for (i = 0; i < NUM_REQUESTS; i++) {
+		struct aws_dynamo_get_item_response *r;
+		char body[128];
+		int hash = arg->id * NUM_REQUESTS + i;
+
+		if (arg->id % 2 == 1 && i == NUM_REQUESTS - 1) {
+			/* Odd threads end on a failed request. */
+			r = aws_dynamo_get_item(arg->aws, "{\"TableName\":\"missing_table\",\"Key\":{\"HashKeyElement\":{\"N\":\"1\"}}}", attributes, 1);
+			assert(r == NULL);
+			continue;
+		}
+
+		snprintf(body, sizeof(body), "{\"TableName\":\"test\",\"Key\":{\"HashKeyElement\":{\"N\":\"%d\"}}}", hash);
+		r = aws_dynamo_get_item(arg->aws, body, attributes, 1);
+		assert(r != NULL);
+		assert(*r->item.attributes[0].value.number.value.integer_val == hash);
+		aws_dynamo_free_get_item_response(r);
+	}
+
+	/* Each thread sees the error state of its own last request. */
+	if (arg->id % 2 == 1) {
+		assert(aws_dynamo_get_errno(arg->aws) == AWS_DYNAMO_CODE_RESOURCE_NOT_FOUND_EXCEPTION);
+		assert(strcmp(aws_dynamo_get_message(arg->aws), "Requested resource not found") == 0);
+	} else {
+		assert(aws_dynamo_get_errno(arg->aws) == AWS_DYNAMO_CODE_NONE);
+		assert(strcmp(aws_dynamo_get_message(arg->aws), "") == 0);
+	}
+
+	return NULL;
+}
+
+static void test_shared_handle(struct aws_handle *aws)
+{
+	pthread_t threads[NUM_THREADS];
+	struct thread_arg args[NUM_THREADS];
+	int i;
+
+	for (i = 0; i < NUM_THREADS; i++) {
+		args[i].aws = aws;
+		args[i].id = i;
+		assert(pthread_create(&threads[i], NULL, thread_main, &args[i]) == 0);
+	}
+
+	for (i = 0; i < NUM_THREADS; i++) {
+		assert(pthread_join(threads[i], NULL) == 0);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct aws_handle *aws;
+	int port;
+
+	port = test_http_server_start(handler, NULL);
+	aws = test_local_handle(port);
+
+	test_shared_handle(aws);
+	/* The second round reuses the handles released by the first. */
+	test_shared_handle(aws);
+
+	aws_deinit(aws);
+	return 0;
+}
@@ -0,0 +1,408 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "aws_dynamo_tokenizer.h"
+
+/* The callbacks write the events of a document to a string. */
+struct events {
+	char *buf;
+	size_t len;
+	size_t size;
+	int cancel_at;
+};
+
+static int add(void *ctx, const char *type, const unsigned char *val, size_t len)
+{
+	struct events *e = ctx;
+
+	if (e->cancel_at > 0 && --e->cancel_at == 0) {
+		return 0;
+	}
+
+	if (e->len + len + 8 > e->size) {
+		e->size = (e->len + len + 8) * 2;
+		e->buf = realloc(e->buf, e->size);
+		assert(e->buf != NULL);
+	}
+	e->len += sprintf(e->buf + e->len, "%s", type);
+	if (val != NULL) {
+		e->buf[e->len++] = '(';
+		memcpy(e->buf + e->len, val, len);
+		e->len += len;
+		e->buf[e->len++] = ')';
+	}
+	e->buf[e->len++] = ' ';
+	e->buf[e->len] = '\0';
+	return 1;
+}
+
+static int ev_null(void *ctx)
+{
+	return add(ctx, "null", NULL, 0);
+}
+
+static int ev_boolean(void *ctx, int b)
+{
+	return add(ctx, b ? "true" : "false", NULL, 0);
+}
+
+static int ev_number(void *ctx, const char *val, size_t len)
+{
+	return add(ctx, "n", (const unsigned char *)val, len);
+}
+
+static int ev_string(void *ctx, const unsigned char *val, size_t len)
+{
+	return add(ctx, "s", val, len);
+}
+
+static int ev_map_key(void *ctx, const unsigned char *val, size_t len)
+{
+	return add(ctx, "k", val, len);
+}
+
+static int ev_start_map(void *ctx)
+{
+	return add(ctx, "{", NULL, 0);
+}
+
+static int ev_end_map(void *ctx)
+{
+	return add(ctx, "}", NULL, 0);
+}
+
+static int ev_start_array(void *ctx)
+{
+	return add(ctx, "[", NULL, 0);
+}
+
+static int ev_end_array(void *ctx)
+{
+	return add(ctx, "]", NULL, 0);
+}
+
+static yajl_callbacks callbacks = {
+	.yajl_null = ev_null,
+	.yajl_boolean = ev_boolean,
+	.yajl_number = ev_number,
+	.yajl_string = ev_string,
+	.yajl_start_map = ev_start_map,
+	.yajl_map_key = ev_map_key,
+	.yajl_end_map = ev_end_map,
+	.yajl_start_array = ev_start_array,
+	.yajl_end_array = ev_end_array,
+};
+
+static int integer_seen;
+
+static int ev_integer(void *ctx, long long i)
+{
+	integer_seen = (int)i;
+	return 1;
+}
+
+/* Returns the events of @json, NULL if it does not parse. */
+static char *events(const char *json, size_t len)
+{
+	struct events e = { 0 };
+
+	if (aws_dynamo_tokenize(&callbacks, &e, (const unsigned char *)json, len) == -1) {
+		free(e.buf);
+		return NULL;
+	}
+	return e.buf != NULL ? e.buf : strdup("");
+}
+
+static void check(const char *json, const char *expected)
+{
+	char *got;
+
+	got = events(json, strlen(json));
+	if (expected == NULL) {
+		assert(got == NULL);
+		return;
+	}
+	if (got == NULL || strcmp(got, expected) != 0) {
+		fprintf(stderr, "%s: got '%s', expected '%s'\n", json, got, expected);
+		assert(0);
+	}
+	free(got);
+}
+
+static void test_documents(void)
+{
+	check("{}", "{ } ");
+	check(" [ ] ", "[ ] ");
+	check("{\"Count\":2,\"Items\":[{\"a\":{\"N\":\"1\"}},{\"b\":{\"SS\":[\"x\",\"y\"]}}]}",
+		"{ k(Count) n(2) k(Items) [ { k(a) { k(N) s(1) } } { k(b) { k(SS) [ s(x) s(y) ] } } ] } ");
+	check("[true,false,null,-0,1.5e-3,12E+2,\"\"]",
+		"[ true false null n(-0) n(1.5e-3) n(12E+2) s() ] ");
+	check("\t{ \"a\" :\n[ 1 , 2 ] }\r\n", "{ k(a) [ n(1) n(2) ] } ");
+	check("\"top\"", "s(top) ");
+	check("7", "n(7) ");
+	check("[[[[]]]]", "[ [ [ [ ] ] ] ] ");
+
+	/* Structural characters in strings. */
+	check("[\"{}[]:,\",\"a b\"]", "[ s({}[]:,) s(a b) ] ");
+
+	/* Escapes. */
+	check("[\"a\\\"b\",\"c\\\\\",\"\\/\\b\\f\\n\\r\\t\"]", "[ s(a\"b) s(c\\) s(/\b\f\n\r\t) ] ");
+	check("{\"k\\u0041\":\"\\u00e9\\u20ac\\ud83d\\ude00\"}",
+		"{ k(kA) s(\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80) } ");
+	check("[\"\\ud83d\", \"\\ude00x\"]", "[ s(?) s(?x) ] ");
+	check("[\"\\\\\\\\\",\"\\\\\\\"\"]", "[ s(\\\\) s(\\\") ] ");
+
+	/* Not JSON. */
+	check("", NULL);
+	check("   ", NULL);
+	check("{", NULL);
+	check("{\"a\"}", NULL);
+	check("{\"a\":}", NULL);
+	check("{\"a\":1,}", NULL);
+	check("[1,]", NULL);
+	check("[1 2]", NULL);
+	check("[1}", NULL);
+	check("{]", NULL);
+	check("{} {}", NULL);
+	check("{1:2}", NULL);
+	check("[\"abc]", NULL);
+	check("[\"a\nb\"]", NULL);
+	check("[\"\\x\"]", NULL);
+	check("[\"\\u12\"]", NULL);
+	check("[01]", NULL);
+	check("[1.]", NULL);
+	check("[.5]", NULL);
+	check("[1e]", NULL);
+	check("[-]", NULL);
+	check("[tru]", NULL);
+	check("[truex]", NULL);
+	check("[nul1]", NULL);
+	check("[1\x01]", NULL);
+	check("[\x01]", NULL);
+	check("]", NULL);
+}
+
+/* Strings, escapes and numbers placed across the 64 byte block
+   boundaries. */
+static void test_block_boundaries(void)
+{
+	char json[512];
+	char expected[512];
+	int offset;
+
+	for (offset = 0; offset < 140; offset++) {
+		char pad[256];
+
+		memset(pad, 'p', offset);
+		pad[offset] = '\0';
+
+		snprintf(json, sizeof(json), "[\"%s\",\"a\\\\\",\"b\\\"c\",12345678,\"\\u00e9\"]", pad);
+		snprintf(expected, sizeof(expected), "[ s(%s) s(a\\) s(b\"c) n(12345678) s(\xc3\xa9) ] ", pad);
+		check(json, expected);
+
+		/* A run of backslashes ending at each position. */
+		snprintf(json, sizeof(json), "[\"%s\\\\\\\\\\\"\",1]", pad);
+		snprintf(expected, sizeof(expected), "[ s(%s\\\\\") n(1) ] ", pad);
+		check(json, expected);
+
+		snprintf(json, sizeof(json), "{\"%s\":tru}", pad);
+		check(json, NULL);
+	}
+}
+
+static void test_callbacks(void)
+{
+	yajl_callbacks integer_callbacks = {
+		.yajl_integer = ev_integer,
+		.yajl_start_array = ev_start_array,
+		.yajl_end_array = ev_end_array,
+	};
+	struct events e = { 0 };
+
+	/* A callback returning 0 ends the parse. */
+	e.cancel_at = 3;
+	assert(aws_dynamo_tokenize(&callbacks, &e, (const unsigned char *)"[1,2,3]", 7) == -1);
+	assert(strcmp(e.buf, "[ n(1) ") == 0);
+	free(e.buf);
+
+	/* Integers without a number callback. */
+	memset(&e, 0, sizeof(e));
+	assert(aws_dynamo_tokenize(&integer_callbacks, &e, (const unsigned char *)"[-42, 1.5]", 10) == 0);
+	assert(integer_seen == -42);
+	free(e.buf);
+	memset(&e, 0, sizeof(e));
+	assert(aws_dynamo_tokenize(&integer_callbacks, &e, (const unsigned char *)"[99999999999999999999]", 22) == -1);
+	free(e.buf);
+}
+
+/* Keys starting with x have their values skipped. */
+static int ev_skip_key(void *ctx, const unsigned char *val, size_t len)
+{
+	if (!add(ctx, "k", val, len)) {
+		return 0;
+	}
+	return len > 0 && val[0] == 'x' ? AWS_DYNAMO_TOKENIZE_SKIP : 1;
+}
+
+static char *skip_events(const char *json)
+{
+	yajl_callbacks skip_callbacks = callbacks;
+	struct events e = { 0 };
+
+	skip_callbacks.yajl_map_key = ev_skip_key;
+	if (aws_dynamo_tokenize(&skip_callbacks, &e, (const unsigned char *)json,
+		strlen(json)) == -1) {
+		free(e.buf);
+		return NULL;
+	}
+	return e.buf;
+}
+
+static void check_skip(const char *json, const char *expected)
+{
+	char *got;
+
+	got = skip_events(json);
+	if (expected == NULL) {
+		assert(got == NULL);
+		return;
+	}
+	if (got == NULL || strcmp(got, expected) != 0) {
+		fprintf(stderr, "%s: got '%s', expected '%s'\n", json, got, expected);
+		assert(0);
+	}
+	free(got);
+}
+
+static void test_skip(void)
+{
+	char json[512];
+	char pad[200];
+
+	check_skip("{\"a\":1,\"x\":{\"b\":[1,\"}\",{\"c\":null}]},\"d\":2}",
+		"{ k(a) n(1) k(x) k(d) n(2) } ");
+	check_skip("{\"x\":\"]\\\"\",\"x2\":true}", "{ k(x) k(x2) } ");
+	check_skip("[{\"x\":[[],{}]},{\"x\":-1.5e3}]", "[ { k(x) } { k(x) } ] ");
+	check_skip("{\"x\":{\"x\":{}}}", "{ k(x) } ");
+
+	/* Only the nesting of a skipped value is checked. */
+	check_skip("{\"x\":[1}", NULL);
+	check_skip("{\"x\":{\"a\":1}", NULL);
+	check_skip("{\"x\":,\"a\":1}", NULL);
+	check_skip("{\"x\":}", NULL);
+	check_skip("{\"x\":1 2}", NULL);
+
+	/* Skipped values spanning blocks. */
+	memset(pad, '{', sizeof(pad) - 1);
+	pad[sizeof(pad) - 1] = '\0';
+	snprintf(json, sizeof(json), "{\"x\":[\"%s\",{\"a\":\"%s\"}],\"b\":1}", pad, pad);
+	check_skip(json, "{ k(x) k(b) n(1) } ");
+}
+
+/* Strings are left escaped, pointing into the document, and offsets are
+   those of the tokens. */
+static void test_raw(void)
+{
+	const char *json = "{\"a\\u0062\": [\"x\\n\", {}]}";
+	unsigned char out[16];
+	size_t out_len;
+	size_t offset = 0;
+	struct events e = { 0 };
+
+	assert(aws_dynamo_tokenize_raw(&callbacks, &e, (const unsigned char *)json,
+		strlen(json), &offset) == 0);
+	assert(strcmp(e.buf, "{ k(ab) [ s(x\\n) { } ] } ") == 0);
+	assert(offset == strlen(json) - 1);
+	free(e.buf);
+
+	assert(aws_dynamo_json_unescape((const unsigned char *)"x\\n\\u00e9", 9, out, &out_len) == 0);
+	assert(out_len == 4 && memcmp(out, "x\n\xc3\xa9", 4) == 0);
+	assert(aws_dynamo_json_unescape((const unsigned char *)"x\\", 2, out, &out_len) == -1);
+	assert(aws_dynamo_json_unescape((const unsigned char *)"\\q", 2, out, &out_len) == -1);
+}
+
+/* Every implementation must produce the events of the scalar one. */
+static void test_large_document(void)
+{
+	enum aws_dynamo_tokenizer_impl impls[] = {
+		AWS_DYNAMO_TOKENIZER_SSE2,
+		AWS_DYNAMO_TOKENIZER_AVX2,
+	};
+	char *json;
+	char *expected;
+	size_t len = 0;
+	int i;
+
+	json = malloc(1024 * 1024);
+	assert(json != NULL);
+	len += sprintf(json + len, "{\"Count\":5000,\"Items\":[");
+	for (i = 0; i < 5000; i++) {
+		len += sprintf(json + len, "%s{\"hash\":{\"N\":\"%d\"},\"name\":{\"S\":\"item \\\"%d\\\" \\u00e9\"},"
+			"\"tags\":{\"SS\":[\"a\",\"b\\\\\",\"c\"]}}", i ? ",\n" : "", i, i);
+	}
+	len += sprintf(json + len, "],\"ConsumedCapacityUnits\":2.5}");
+
+	assert(aws_dynamo_tokenizer_select(AWS_DYNAMO_TOKENIZER_SCALAR) == 0);
+	expected = events(json, len);
+	assert(expected != NULL);
+
+	for (i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+		char *got;
+
+		if (aws_dynamo_tokenizer_select(impls[i]) == -1) {
+			continue;
+		}
+		got = events(json, len);
+		assert(got != NULL && strcmp(got, expected) == 0);
+		free(got);
+	}
+
+	assert(aws_dynamo_tokenizer_select(AWS_DYNAMO_TOKENIZER_AUTO) == 0);
+	free(expected);
+	free(json);
+}
+
+int main(int argc, char *argv[])
+{
+	enum aws_dynamo_tokenizer_impl impls[] = {
+		AWS_DYNAMO_TOKENIZER_SCALAR,
+		AWS_DYNAMO_TOKENIZER_SSE2,
+		AWS_DYNAMO_TOKENIZER_AVX2,
+	};
+	int i;
+
+	for (i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+		if (aws_dynamo_tokenizer_select(impls[i]) == -1) {
+			continue;
+		}
+		test_documents();
+		test_block_boundaries();
+		test_callbacks();
+		test_skip();
+	}
+	test_large_document();
+	test_raw();
+
+	assert(aws_dynamo_tokenizer_select(AWS_DYNAMO_TOKENIZER_AUTO) == 0);
+	return 0;
+}
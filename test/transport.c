@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <assert.h>
+
+#include "aws_dynamo.h"
+#include "test_utils.h"
+
+/* Large enough to need several buffer size classes and more than the
+   largest pooled block. */
+#define LARGE_SCAN_ITEMS 40000
+
+/* With @escape set the padding strings start with a JSON escape. */
+static char *scan_response_escaped(int count, int escape)
+{
+	char *response;
+	size_t size = 128 + (size_t)count * 96;
+	size_t n;
+	int i;
+
+	response = malloc(size);
+	assert(response != NULL);
+
+	n = snprintf(response, size, "{\"Count\":%d,\"Items\":[", count);
+	for (i = 0; i < count; i++) {
+		n += snprintf(response + n, size - n,
+			"%s{\"hash\":{\"N\":\"%d\"},\"padding\":{\"S\":\"%s%0*d\"}}",
+			i == 0 ? "" : ",", i, escape ? "\\u0030" : "", escape ? 39 : 40, i);
+	}
+	n += snprintf(response + n, size - n, "],\"ScannedCount\":%d,\"ConsumedCapacityUnits\":1.5}", count);
+	assert(n < size);
+
+	return response;
+}
+
+static char *scan_response(int count)
+{
+	return scan_response_escaped(count, 0);
+}
+
+static int handler(const struct test_http_request *req, char **response, void *arg)
+{
+	int *malformed_requests = arg;
+
+	if (strstr(req->body, "large_table") != NULL) {
+		*response = scan_response(LARGE_SCAN_ITEMS);
+	} else if (strstr(req->body, "escaped_table") != NULL) {
+		*response = scan_response_escaped(100, 1);
+	} else if (strstr(req->body, "truncated_table") != NULL) {
+		*response = scan_response(LARGE_SCAN_ITEMS);
+		(*response)[strlen(*response) / 2] = '\0';
+	} else if (strstr(req->body, "malformed_table") != NULL) {
+		(*malformed_requests)++;
+		*response = scan_response(LARGE_SCAN_ITEMS);
+		(*response)[strlen(*response) / 2] = '#';
+	} else {
+		*response = scan_response(1);
+	}
+	return 200;
+}
+
+static void test_scan(struct aws_handle *aws, const char *table, int count)
+{
+	struct aws_dynamo_attribute attributes[] = {
+		{
+			.type = AWS_DYNAMO_NUMBER,
+			.name = "hash",
+			.name_len = strlen("hash"),
+			.value.number.type = AWS_DYNAMO_NUMBER_INTEGER,
+		},
+		{
+			.type = AWS_DYNAMO_STRING,
+			.name = "padding",
+			.name_len = strlen("padding"),
+		},
+	};
+	struct aws_dynamo_scan_response *r;
+	char body[128];
+	int i;
+
+	snprintf(body, sizeof(body), "{\"TableName\":\"%s\"}", table);
+	r = aws_dynamo_scan(aws, body, attributes, 2);
+	assert(r != NULL);
+	assert(r->count == count);
+	assert(r->scanned_count == count);
+	assert((r->arena != NULL) == ((aws->dynamo_parse_flags &
+		(AWS_DYNAMO_PARSE_ARENA | AWS_DYNAMO_PARSE_BORROW)) != 0));
+	for (i = 0; i < count; i++) {
+		struct aws_dynamo_number *number;
+		char padding[64];
+
+		snprintf(padding, sizeof(padding), "%040d", i);
+		number = &(r->items[i].attributes[0].value.number);
+		assert(aws_dynamo_number_get_integer(number) == i);
+		assert(aws_dynamo_number_get_double(number) == i);
+		assert(strcmp(r->items[i].attributes[1].value.string, padding) == 0);
+	}
+	if (count > 0) {
+		struct aws_dynamo_item *copy;
+		struct aws_dynamo_number *number;
+
+		copy = aws_dynamo_copy_item(&(r->items[count - 1]));
+		assert(copy != NULL);
+		number = &(copy->attributes[0].value.number);
+		assert(number->value.integer_val != r->items[count - 1].attributes[0].value.number.value.integer_val);
+		assert(*number->value.integer_val == count - 1);
+		aws_dynamo_free_item(copy);
+	}
+	aws_dynamo_free_scan_response(r);
+}
+
+static void test_large_response(struct aws_handle *aws)
+{
+	/* Responses over 1 MB used to be truncated. */
+	test_scan(aws, "large_table", LARGE_SCAN_ITEMS);
+	/* The buffer is handed back, a small response follows. */
+	test_scan(aws, "small_table", 1);
+	test_scan(aws, "large_table", LARGE_SCAN_ITEMS);
+}
+
+static void test_streamed_response(struct aws_handle *aws, int *malformed_requests)
+{
+	struct aws_dynamo_scan_response *r;
+
+	aws_dynamo_set_parse_flags(aws, AWS_DYNAMO_PARSE_STREAM);
+	test_scan(aws, "large_table", LARGE_SCAN_ITEMS);
+	test_scan(aws, "small_table", 1);
+
+	/* A body that ends early is a parse failure, not a short result. */
+	r = aws_dynamo_scan(aws, "{\"TableName\":\"truncated_table\"}", NULL, 0);
+	assert(r == NULL);
+
+	/* A parse that fails part way through aborts the transfer, and the
+	   request is not made again. */
+	r = aws_dynamo_scan(aws, "{\"TableName\":\"malformed_table\"}", NULL, 0);
+	assert(r == NULL);
+	assert(*malformed_requests == 1);
+
+	test_scan(aws, "large_table", LARGE_SCAN_ITEMS);
+	aws_dynamo_set_parse_flags(aws, 0);
+}
+
+static void test_arena_response(struct aws_handle *aws)
+{
+	struct aws_dynamo_scan_response *r;
+
+	aws_dynamo_set_parse_flags(aws, AWS_DYNAMO_PARSE_ARENA);
+	test_scan(aws, "large_table", LARGE_SCAN_ITEMS);
+	test_scan(aws, "small_table", 1);
+
+	/* A streamed response does not know its size up front. */
+	aws_dynamo_set_parse_flags(aws, AWS_DYNAMO_PARSE_ARENA | AWS_DYNAMO_PARSE_STREAM);
+	test_scan(aws, "large_table", LARGE_SCAN_ITEMS);
+	r = aws_dynamo_scan(aws, "{\"TableName\":\"truncated_table\"}", NULL, 0);
+	assert(r == NULL);
+	test_scan(aws, "small_table", 1);
+	aws_dynamo_set_parse_flags(aws, 0);
+}
+
+static void test_borrowed_response(struct aws_handle *aws)
+{
+	struct aws_dynamo_attribute attributes[] = {
+		{
+			.type = AWS_DYNAMO_NUMBER,
+			.name = "hash",
+			.name_len = strlen("hash"),
+			.value.number.type = AWS_DYNAMO_NUMBER_INTEGER,
+		},
+		{
+			.type = AWS_DYNAMO_STRING,
+			.name = "padding",
+			.name_len = strlen("padding"),
+		},
+	};
+	struct aws_dynamo_scan_response *r;
+
+	aws_dynamo_set_parse_flags(aws, AWS_DYNAMO_PARSE_BORROW);
+	test_scan(aws, "large_table", LARGE_SCAN_ITEMS);
+	test_scan(aws, "small_table", 1);
+
+	/* Escaped strings are copied. */
+	test_scan(aws, "escaped_table", 100);
+
+	/* A response keeps its body when the handle moves on. */
+	r = aws_dynamo_scan(aws, "{\"TableName\":\"small_table\"}", attributes, 2);
+	assert(r != NULL);
+	test_scan(aws, "large_table", LARGE_SCAN_ITEMS);
+	assert(strcmp(r->items[0].attributes[1].value.string,
+		"0000000000000000000000000000000000000000") == 0);
+	aws_dynamo_free_scan_response(r);
+
+	r = aws_dynamo_scan(aws, "{\"TableName\":\"truncated_table\"}", NULL, 0);
+	assert(r == NULL);
+
+	/* Streamed responses have no body to borrow from. */
+	aws_dynamo_set_parse_flags(aws, AWS_DYNAMO_PARSE_BORROW | AWS_DYNAMO_PARSE_STREAM);
+	test_scan(aws, "small_table", 1);
+	aws_dynamo_set_parse_flags(aws, 0);
+}
+
+int main(int argc, char *argv[])
+{
+	struct aws_handle *aws;
+	int malformed_requests = 0;
+	int port;
+
+	/* The server may still be writing a response the client gave up on. */
+	signal(SIGPIPE, SIG_IGN);
+
+	port = test_http_server_start(handler, &malformed_requests);
+	aws = test_local_handle(port);
+
+	test_large_response(aws);
+	test_streamed_response(aws, &malformed_requests);
+	test_arena_response(aws);
+	test_borrowed_response(aws);
+
+	aws_deinit(aws);
+	return 0;
+}
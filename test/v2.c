@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2014 Devicescape Software, Inc.
+ * This file is part of aws_dynamo, a C library for AWS DynamoDB.
+ *
+ * aws_dynamo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * aws_dynamo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with aws_dynamo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "aws_dynamo.h"
+#include "test_utils.h"
+
+static struct aws_dynamo_attribute attributes[] = {
+	{
+		.type = AWS_DYNAMO_NUMBER,
+		.name = "id",
+		.name_len = 2,
+		.value.number.type = AWS_DYNAMO_NUMBER_INTEGER,
+	},
+	{
+		.type = AWS_DYNAMO_STRING,
+		.name = "name",
+		.name_len = 4,
+	},
+	{
+		.type = AWS_DYNAMO_BINARY,
+		.name = "data",
+		.name_len = 4,
+	},
+	{
+		.type = AWS_DYNAMO_BINARY_SET,
+		.name = "blobs",
+		.name_len = 5,
+	},
+	{
+		.type = AWS_DYNAMO_BOOLEAN,
+		.name = "ok",
+		.name_len = 2,
+	},
+	{
+		.type = AWS_DYNAMO_NULL,
+		.name = "gone",
+		.name_len = 4,
+	},
+	{
+		.type = AWS_DYNAMO_NUMBER_SET,
+		.name = "nums",
+		.name_len = 4,
+		.value.number_set.type = AWS_DYNAMO_NUMBER_INTEGER,
+	},
+	{
+		.type = AWS_DYNAMO_STRING_SET,
+		.name = "tags",
+		.name_len = 4,
+	},
+	{
+		.type = AWS_DYNAMO_MAP,
+		.name = "doc",
+		.name_len = 3,
+	},
+	{
+		.type = AWS_DYNAMO_LIST,
+		.name = "many",
+		.name_len = 4,
+	},
+};
+
+#define NUM_ATTRIBUTES	(sizeof(attributes) / sizeof(attributes[0]))
+
+#define MANY	100
+
+static char *query_response(void)
+{
+	char many[MANY * 16];
+	char *response;
+	size_t n = 0;
+	int i;
+
+	for (i = 0; i < MANY; i++) {
+		n += snprintf(many + n, sizeof(many) - n, "%s{\"N\":\"%d\"}", i == 0 ? "" : ",", i);
+	}
+	assert(n < sizeof(many));
+
+	n = asprintf(&response, "{\"ConsumedCapacity\":{\"TableName\":\"t\",\"CapacityUnits\":3.5,"
+		"\"Table\":{\"CapacityUnits\":1.5},"
+		"\"GlobalSecondaryIndexes\":{\"g\":{\"CapacityUnits\":2}},"
+		"\"LocalSecondaryIndexes\":{\"l\":{\"ReadCapacityUnits\":0.5}}},"
+		"\"Count\":2,\"Items\":["
+		"{\"id\":{\"N\":\"1\"},\"name\":{\"S\":\"a\\\"b\"},\"data\":{\"B\":\"aGVsbG8=\"},"
+		"\"blobs\":{\"BS\":[\"AA==\",\"/w==\",\"\"]},\"ok\":{\"BOOL\":true},"
+		"\"gone\":{\"NULL\":true},\"nums\":{\"NS\":[\"1\",\"-2\"]},\"tags\":{\"SS\":[\"x\"]},"
+		"\"doc\":{\"M\":{\"n\":{\"N\":\"1.5\"},\"big\":{\"N\":\"12345678901\"},"
+		"\"l\":{\"L\":[{\"S\":\"s\"},{\"BOOL\":false},{\"NULL\":true},{\"L\":[]},{\"M\":{}},"
+		"{\"NS\":[\"1\",\"2.5\"]}]}}},"
+		"\"many\":{\"L\":[%s]}},"
+		"{\"id\":{\"N\":\"2\"}}],"
+		"\"LastEvaluatedKey\":{\"id\":{\"N\":\"2\"},\"r\":{\"S\":\"k\"}},"
+		"\"ScannedCount\":5}", many);
+	assert(n != -1);
+
+	return response;
+}
+
+static void check_query(struct aws_dynamo_v2_response *r)
+{
+	struct aws_dynamo_v2_consumed_capacity *cc = r->consumed_capacity;
+	struct aws_dynamo_attribute *a = r->items[0].attributes;
+	struct aws_dynamo_attribute *doc = &(a[8]);
+	struct aws_dynamo_attribute *l;
+	struct aws_dynamo_attribute *v;
+	int i;
+
+	assert(cc != NULL);
+	assert(strcmp(cc->table_name, "t") == 0);
+	assert(cc->total.capacity_units == 3.5);
+	assert(cc->table.capacity_units == 1.5);
+	assert(cc->num_indexes == 2);
+	assert(strcmp(cc->indexes[0].name, "g") == 0 && cc->indexes[0].global);
+	assert(cc->indexes[0].capacity.capacity_units == 2);
+	assert(strcmp(cc->indexes[1].name, "l") == 0 && !cc->indexes[1].global);
+	assert(cc->indexes[1].capacity.read_capacity_units == 0.5);
+
+	assert(r->count == 2);
+	assert(r->scanned_count == 5);
+	assert(r->num_items == 2);
+	assert(r->item == NULL);
+
+	assert(*(a[0].value.number.value.integer_val) == 1);
+	assert(strcmp(a[1].value.string, "a\"b") == 0);
+	assert(a[2].value.binary.len == 5 && memcmp(a[2].value.binary.data, "hello", 5) == 0);
+	assert(a[3].value.binary_set.num_binaries == 3);
+	assert(a[3].value.binary_set.binaries[0].len == 1 &&
+		a[3].value.binary_set.binaries[0].data[0] == 0);
+	assert(a[3].value.binary_set.binaries[1].len == 1 &&
+		a[3].value.binary_set.binaries[1].data[0] == 0xff);
+	assert(a[3].value.binary_set.binaries[2].len == 0);
+	assert(a[4].value.boolean == 1);
+	assert(a[5].type == AWS_DYNAMO_NULL);
+	assert(a[6].value.number_set.n == 2);
+	assert(a[6].value.number_set.type == AWS_DYNAMO_NUMBER_INTEGER);
+	assert(*(a[6].value.number_set.numbers[1].value.integer_val) == -2);
+	assert(a[7].value.string_set.num_strings == 1);
+
+	assert(doc->value.map.num_attributes == 3);
+	v = aws_dynamo_v2_map_get(doc, "n");
+	assert(v != NULL && v->type == AWS_DYNAMO_NUMBER);
+	assert(v->value.number.type == AWS_DYNAMO_NUMBER_DOUBLE);
+	assert(*(v->value.number.value.double_val) == 1.5);
+	v = aws_dynamo_v2_map_get(doc, "big");
+	assert(v != NULL && *(v->value.number.value.integer_val) == 12345678901LL);
+	assert(aws_dynamo_v2_map_get(doc, "missing") == NULL);
+
+	l = aws_dynamo_v2_map_get(doc, "l");
+	assert(l != NULL && l->type == AWS_DYNAMO_LIST);
+	assert(l->value.list.num_values == 6);
+	v = l->value.list.values;
+	assert(v[0].type == AWS_DYNAMO_STRING && strcmp(v[0].value.string, "s") == 0);
+	assert(v[0].name == NULL);
+	assert(v[1].type == AWS_DYNAMO_BOOLEAN && v[1].value.boolean == 0);
+	assert(v[2].type == AWS_DYNAMO_NULL);
+	assert(v[3].type == AWS_DYNAMO_LIST && v[3].value.list.num_values == 0);
+	assert(v[4].type == AWS_DYNAMO_MAP && v[4].value.map.num_attributes == 0);
+	/* A set that turns out to have a fraction in it holds doubles. */
+	assert(v[5].type == AWS_DYNAMO_NUMBER_SET);
+	assert(v[5].value.number_set.type == AWS_DYNAMO_NUMBER_DOUBLE);
+	assert(*(v[5].value.number_set.numbers[0].value.double_val) == 1);
+	assert(*(v[5].value.number_set.numbers[1].value.double_val) == 2.5);
+
+	/* Numbers in a list that grew still point at their own values. */
+	assert(a[9].value.list.num_values == MANY);
+	for (i = 0; i < MANY; i++) {
+		assert(*(a[9].value.list.values[i].value.number.value.integer_val) == i);
+	}
+
+	/* Attributes an item does not have are left as in the template. */
+	a = r->items[1].attributes;
+	assert(*(a[0].value.number.value.integer_val) == 2);
+	assert(a[1].value.string == NULL);
+	assert(a[8].value.map.num_attributes == 0);
+
+	assert(r->last_evaluated_key.num_attributes == 2);
+	a = r->last_evaluated_key.attributes;
+	assert(strcmp(a[0].name, "id") == 0 && *(a[0].value.number.value.integer_val) == 2);
+	assert(strcmp(a[1].name, "r") == 0 && strcmp(a[1].value.string, "k") == 0);
+}
+
+static void test_parse(void)
+{
+	struct aws_dynamo_v2_response *r;
+	char *response = query_response();
+	const char *get = "{\"Item\":{\"id\":{\"N\":\"3\"},\"ok\":{\"BOOL\":false}}}";
+	const char *bad[] = {
+		/* The type is not that of the template. */
+		"{\"Items\":[{\"id\":{\"S\":\"1\"}}]}",
+		"{\"Items\":[{\"doc\":{\"M\":{\"x\":{\"Q\":\"1\"}}}}]}",
+		"{\"Items\":[{\"data\":{\"B\":\"a===\"}}]}",
+		"{\"Items\":[{\"nums\":{\"NS\":[\"1.5\"]}}]}",
+		"{\"Items\":[{\"id\":{\"N\":\"1\",\"S\":\"1\"}}]}",
+		"{\"Items\":[{\"ok\":{\"BOOL\":null}}]}",
+		"{\"Count\":1,\"Bogus\":1}",
+		"{\"Item\":{},\"Items\":[]}",
+	};
+	char deep[1024];
+	size_t n = 0;
+	int i;
+
+	r = aws_dynamo_v2_parse_response(response, strlen(response), attributes, NUM_ATTRIBUTES);
+	assert(r != NULL);
+	check_query(r);
+	aws_dynamo_v2_free_response(r);
+	free(response);
+
+	r = aws_dynamo_v2_parse_response(get, strlen(get), attributes, NUM_ATTRIBUTES);
+	assert(r != NULL);
+	assert(r->num_items == 1 && r->item == &(r->items[0]));
+	assert(*(r->item->attributes[0].value.number.value.integer_val) == 3);
+	assert(r->item->attributes[4].value.boolean == 0);
+	assert(r->consumed_capacity == NULL);
+	assert(r->last_evaluated_key.num_attributes == 0);
+	aws_dynamo_v2_free_response(r);
+
+	r = aws_dynamo_v2_parse_response("{}", 2, attributes, NUM_ATTRIBUTES);
+	assert(r != NULL && r->item == NULL && r->num_items == 0);
+	aws_dynamo_v2_free_response(r);
+
+	for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		assert(aws_dynamo_v2_parse_response(bad[i], strlen(bad[i]),
+			attributes, NUM_ATTRIBUTES) == NULL);
+	}
+
+	/* Lists nest only so deep. */
+	n += snprintf(deep + n, sizeof(deep) - n, "{\"Item\":{\"many\":{\"L\":[");
+	for (i = 0; i < 40; i++) {
+		n += snprintf(deep + n, sizeof(deep) - n, "{\"L\":[");
+	}
+	for (i = 0; i < 40; i++) {
+		n += snprintf(deep + n, sizeof(deep) - n, "]}");
+	}
+	n += snprintf(deep + n, sizeof(deep) - n, "]}}}");
+	assert(n < sizeof(deep));
+	assert(aws_dynamo_v2_parse_response(deep, n, attributes, NUM_ATTRIBUTES) == NULL);
+}
+
+static int handler(const struct test_http_request *req, char **response, void *arg)
+{
+	assert(strncmp(req->target, "DynamoDB_20120810.", 18) == 0);
+	if (strstr(req->target, "GetItem") != NULL) {
+		*response = strdup("{\"Item\":{\"id\":{\"N\":\"3\"}}}");
+	} else {
+		*response = query_response();
+	}
+	return 200;
+}
+
+static void test_requests(void)
+{
+	int flags[] = { 0, AWS_DYNAMO_PARSE_STREAM, AWS_DYNAMO_PARSE_BORROW };
+	struct aws_handle *aws;
+	int port;
+	int i;
+
+	port = test_http_server_start(handler, NULL);
+	aws = test_local_handle(port);
+
+	for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+		struct aws_dynamo_v2_response *r;
+
+		aws_dynamo_set_parse_flags(aws, flags[i]);
+
+		r = aws_dynamo_v2_query(aws, "{\"TableName\":\"t\"}", attributes, NUM_ATTRIBUTES);
+		assert(r != NULL);
+		check_query(r);
+		aws_dynamo_v2_free_response(r);
+
+		r = aws_dynamo_v2_scan(aws, "{\"TableName\":\"t\"}", attributes, NUM_ATTRIBUTES);
+		assert(r != NULL);
+		check_query(r);
+		aws_dynamo_v2_free_response(r);
+
+		r = aws_dynamo_v2_get_item(aws, "{\"TableName\":\"t\"}", attributes, NUM_ATTRIBUTES);
+		assert(r != NULL && r->item != NULL);
+		assert(*(r->item->attributes[0].value.number.value.integer_val) == 3);
+		aws_dynamo_v2_free_response(r);
+	}
+
+	aws_deinit(aws);
+}
+
+int main(int argc, char *argv[])
+{
+	test_parse();
+	test_requests();
+	return 0;
+}